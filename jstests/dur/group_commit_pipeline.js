@@ -0,0 +1,44 @@
+/* test durability with pipelined group commits
+   j:true acknowledged writes must survive a kill -9, and the dur serverStatus section
+   reports per stage latency histograms
+*/
+
+testname = "group_commit_pipeline";
+load("jstests/_tst.js");
+
+var path = MongoRunner.dataDir + "/gcpipeline";
+
+tst.log("start mongod with dur");
+var conn = startMongodEmpty("--port", 30001, "--dbpath", path, "--dur", "--journalCommitInterval", 2);
+var d = conn.getDB("test");
+
+tst.log("j:true writes");
+var N = 500;
+for (var i = 0; i < N; i++) {
+    d.foo.insert({ _id: i, x: "pipelined" });
+    var gle = d.runCommand({ getlasterror: 1, j: true });
+    assert(gle.ok && gle.err == null, "getlasterror j:true failed: " + tojson(gle));
+}
+
+tst.log("latency histograms");
+// serverStatus reports the previous 3 second interval
+sleep(4000);
+var dur = d.serverStatus().dur;
+printjson(dur.latencyMs);
+["prepLogBuffer", "writeToJournal", "writeToDataFiles", "commit"].forEach(function (stage) {
+    var h = dur.latencyMs[stage];
+    assert(h, "no latency histogram for " + stage);
+    assert.eq(12, Object.keySet(h).length, stage + " buckets");
+    assert(h["<1"] != null && h[">=1024"] != null, stage + " bucket names");
+});
+
+tst.log("kill -9 mongod");
+stopMongod(30001, /*signal*/9);
+
+tst.log("restart and recover");
+conn = startMongodNoReset("--port", 30002, "--dbpath", path, "--dur");
+d = conn.getDB("test");
+assert.eq(N, d.foo.count(), "acknowledged j:true writes lost");
+
+tst.log("stop");
+stopMongod(30002);
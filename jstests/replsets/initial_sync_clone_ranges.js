@@ -0,0 +1,87 @@
+// Test initial sync copying collections in _id ranges on several threads.
+// The collection is split by a small replInitialSyncCloneRangeMB, its _id values mix
+// numbers, strings, subdocuments and ObjectIds, the first range copy fails and must be
+// retried, and replSetGetStatus reports the copy progress while the data pass is held.
+
+var rt = new ReplSetTest( { name : "initial_sync_clone_ranges" , nodes : 2 } );
+var nodes = rt.startSet();
+rt.initiate();
+var master = rt.getMaster();
+
+var md = master.getDB( "d" );
+var big = md.big;
+var small = md.small;
+
+// about 8MB of 1KB documents, so a 1MB range size gives several ranges
+var pad = new Array( 1024 ).join( "x" );
+var perType = 2000;
+for ( var i = 0; i < perType; i++ ) {
+    big.insert( { _id : i , pad : pad } );
+    big.insert( { _id : "s" + i , pad : pad } );
+    big.insert( { _id : { a : i } , pad : pad } );
+    big.insert( { _id : new ObjectId() , pad : pad } );
+}
+for ( var i = 0; i < 100; i++ ) {
+    small.insert( { _id : i } );
+}
+assert.eq( null , md.getLastError( 2 ) );
+var bigCount = big.count();
+var smallCount = small.count();
+assert.eq( 4 * perType , bigCount );
+rt.awaitReplication();
+
+// add a member and set it up to split small, fail one range and hold after the data pass
+var slave = rt.add();
+var admin = slave.getDB( "admin" );
+assert.commandWorked( admin.runCommand( { setParameter : 1 , replInitialSyncCloneRangeMB : 1 } ) );
+assert.commandWorked( admin.runCommand( { setParameter : 1 , replInitialSyncCloneThreads : 4 } ) );
+assert.commandWorked( admin.runCommand( { configureFailPoint : "clonerFailRangeCopy" ,
+                                          mode : { times : 1 } } ) );
+assert.commandWorked( admin.runCommand( { configureFailPoint : "initialSyncHangAfterDataCloning" ,
+                                          mode : "alwaysOn" } ) );
+rt.reInitiate();
+
+var selfStatus = function() {
+    var status = admin.runCommand( { replSetGetStatus : 1 } );
+    if ( ! status.members ) {
+        return {};
+    }
+    for ( var i = 0; i < status.members.length; i++ ) {
+        if ( status.members[i].self ) {
+            return status.members[i];
+        }
+    }
+    return {};
+};
+
+// the failed range fails the attempt
+assert.soon( function() {
+    var me = selfStatus();
+    return me.errmsg && me.errmsg.indexOf( "clonerFailRangeCopy" ) >= 0;
+}, "range copy error never reported", 5 * 60 * 1000 );
+
+// the retry copies every range and waits on the fail point
+var progress;
+assert.soon( function() {
+    var me = selfStatus();
+    progress = me.initialSyncProgress;
+    return progress && progress.docsCloned >= bigCount + smallCount;
+}, "initial sync data pass never finished", 5 * 60 * 1000 );
+printjson( progress );
+assert.gt( progress.rangesCloned , progress.collectionsCloned ,
+           "big collection was not split into ranges" );
+
+assert.commandWorked( admin.runCommand( { configureFailPoint : "initialSyncHangAfterDataCloning" ,
+                                          mode : "off" } ) );
+rt.awaitSecondaryNodes();
+rt.awaitReplication();
+
+slave.setSlaveOk();
+var sd = slave.getDB( "d" );
+assert.eq( bigCount , sd.big.count() , "big count on new member" );
+assert.eq( smallCount , sd.small.count() , "small count on new member" );
+assert.eq( perType , sd.big.find( { _id : { $type : 2 } } ).itcount() , "string _ids" );
+assert.eq( perType , sd.big.find( { _id : { $type : 3 } } ).itcount() , "subdocument _ids" );
+assert.eq( perType , sd.big.find( { _id : { $type : 7 } } ).itcount() , "ObjectId _ids" );
+
+rt.stopSet();
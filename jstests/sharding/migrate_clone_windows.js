@@ -0,0 +1,56 @@
+// Test migrating a chunk larger than one window of disk locs on the donor (256K documents)
+// while documents of the chunk are being deleted. Deletes may land in the window being
+// cloned, in the window being read, or in one not read yet, and all must reach the recipient.
+
+var st = new ShardingTest({ shards : 2, mongos : 1 });
+
+// stop balancer since we want manual control for this
+st.stopBalancer();
+
+var dbname = "testDB";
+var coll = "foo";
+var ns = dbname + "." + coll;
+var s = st.s0;
+var db = s.getDB( dbname );   // db variable name is required due to startParallelShell()
+var t = db.getCollection( coll );
+
+// Create fresh collection with more docs than fit in one window. Only 1 chunk.
+var numDocs = 300000;
+t.drop();
+for ( var i = 0; i < numDocs; i++ ) {
+    t.insert( { _id : i , a : i } );
+}
+assert.eq( null , db.getLastError() );
+
+s.adminCommand( { enablesharding : dbname } );
+s.adminCommand( { shardcollection : ns , key : { _id : 1 } } );
+
+var donor = st.getServer( dbname );
+var recipient = st.getOther( donor );
+
+// migrate from a parallel shell
+var join = startParallelShell(
+    "var res = db.adminCommand( { moveChunk : '" + ns + "' , find : { _id : 0 } ," +
+    "                             to : '" + recipient.name + "' , _waitForDelete : true } );" +
+    "assert( res.ok , 'migration failed: ' + tojson( res ) );" );
+
+// delete every tenth document, throughout the chunk, once the clone has started
+assert.soon( function() {
+    var res = recipient.getDB( "admin" ).runCommand( { _recvChunkStatus : 1 } );
+    return res.state != "ready" && res.counts && res.counts.cloned > 0;
+}, "clone never started", 5 * 60 * 1000, 10 );
+
+t.remove( { _id : { $mod : [ 10 , 0 ] } } );
+assert.eq( null , db.getLastError() );
+
+join();
+
+// the recipient has every remaining document and none of the deleted ones
+var expected = numDocs - numDocs / 10;
+assert.eq( expected , t.count() , "count through mongos" );
+assert.eq( 0 , t.find( { _id : { $mod : [ 10 , 0 ] } } ).itcount() , "deleted docs came back" );
+assert.eq( expected , recipient.getDB( dbname ).getCollection( coll ).count() ,
+           "count on recipient" );
+assert.eq( 0 , donor.getDB( dbname ).getCollection( coll ).count() , "count on donor" );
+
+st.stop();
@@ -0,0 +1,83 @@
+// Tests serving connections from a fixed pool of worker threads (--netWorkerThreads).
+// There are more connections than workers, so each connection's requests are served by
+// whichever worker is free, and its per-connection state (last error, cursors) must follow it.
+
+var numWorkers = 2;
+var numConns = 10;
+var docsPerConn = 500;
+
+var mongo = MongoRunner.runMongod({ netWorkerThreads : numWorkers });
+var db = mongo.getDB("test");
+var coll = db.net_worker_threads;
+coll.drop();
+
+jsTestLog("Interleaving writes and getLastError on " + numConns + " connections");
+var conns = [];
+for (var i = 0; i < numConns; i++) {
+    conns.push(new Mongo(mongo.host));
+}
+for (var round = 0; round < 20; round++) {
+    for (var i = 0; i < numConns; i++) {
+        // odd connections insert a duplicate _id every round after the first.  Legacy inserts,
+        // so that the error is only reported by the getLastError below.
+        var id = (i % 2 == 1) ? i : 100 + i * 1000 + round;
+        conns[i].insert(coll.getFullName(), { _id : id , conn : i });
+    }
+    for (var i = 0; i < numConns; i++) {
+        var err = conns[i].getDB("test").getLastError();
+        if (i % 2 == 1 && round > 0) {
+            assert(err, "connection " + i + " lost its duplicate key error in round " + round);
+        }
+        else {
+            assert.eq(null, err, "connection " + i + " got another's error in round " + round);
+        }
+    }
+}
+assert.eq(numConns / 2 * 20 + numConns / 2, coll.count());
+
+jsTestLog("Interleaving getMores of cursors on " + numConns + " connections");
+var cursors = [];
+for (var i = 0; i < numConns; i++) {
+    cursors.push(conns[i].getDB("test").net_worker_threads.find().sort({ _id : 1 }).batchSize(2));
+}
+var seen = [];
+for (var i = 0; i < numConns; i++) {
+    seen.push(0);
+}
+var more = true;
+while (more) {
+    more = false;
+    for (var i = 0; i < numConns; i++) {
+        if (cursors[i].hasNext()) {
+            cursors[i].next();
+            seen[i]++;
+            more = true;
+        }
+    }
+}
+for (var i = 0; i < numConns; i++) {
+    assert.eq(coll.count(), seen[i], "cursor of connection " + i);
+}
+
+jsTestLog("Running " + numConns + " parallel shells against " + numWorkers + " workers");
+coll.drop();
+var shells = [];
+for (var i = 0; i < numConns; i++) {
+    shells.push(startParallelShell(
+        "var t = db.getSiblingDB('test').net_worker_threads;" +
+        "for (var j = 0; j < " + docsPerConn + "; j++) {" +
+        "    t.insert({ conn : " + i + " , j : j });" +
+        "}" +
+        "assert.eq(null, t.getDB().getLastError());" +
+        "assert.eq(" + docsPerConn + ", t.count({ conn : " + i + " }));",
+        mongo.port));
+}
+for (var i = 0; i < shells.length; i++) {
+    shells[i]();
+}
+assert.eq(numConns * docsPerConn, coll.count());
+
+for (var i = 0; i < numConns; i++) {
+    conns[i] = null;
+}
+MongoRunner.stopMongod(mongo.port);
@@ -31,6 +31,7 @@
 #include "mongo/s/stale_exception.h"  // for RecvStaleConfigException
 #include "mongo/util/assert_util.h"
 #include "mongo/util/md5.hpp"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/net/ssl_manager.h"
 #include "mongo/util/net/ssl_options.h"
 
@@ -911,10 +912,38 @@ namespace mongo {
         int sslModeVal = sslGlobalParams.sslMode.load();
         if (sslModeVal == SSLGlobalParams::SSLMode_preferSSL ||
             sslModeVal == SSLGlobalParams::SSLMode_requireSSL) {
-            return p->secure( sslManager(), _server.host() );
+            if ( !p->secure( sslManager(), _server.host() ) ) {
+                return false;
+            }
         }
 #endif
 
+        if ( MessageCompressor::enabled ) {
+            return _negotiateCompression( errmsg );
+        }
+
+        return true;
+    }
+
+    bool DBClientConnection::_negotiateCompression( string& errmsg ) {
+        BSONObjBuilder cmd;
+        cmd.append( "isMaster", 1 );
+        MessageCompressor::appendOffer( &cmd );
+
+        BSONObj info;
+        try {
+            // servers that don't know about compression ignore the offer
+            if ( DBClientWithCommands::runCommand( "admin", cmd.obj(), info ) &&
+                 MessageCompressor::accepted( info ) ) {
+                p->setCompression( true );
+            }
+        }
+        catch ( const DBException& e ) {
+            errmsg = str::stream() << "couldn't connect to server " << _server.toString()
+                                   << ": " << e.what();
+            _failed = true;
+            return false;
+        }
         return true;
     }
 
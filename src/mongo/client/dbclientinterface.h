@@ -1304,6 +1304,9 @@ namespace mongo {
         double _so_timeout;
         bool _connect( string& errmsg );
 
+        // offers compression in isMaster, and turns it on for p if the server agrees
+        bool _negotiateCompression( string& errmsg );
+
         static AtomicUInt _numConnections;
         static bool _lazyKillCursor; // lazy means we piggy back kill cursors on next op
 
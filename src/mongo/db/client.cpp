@@ -106,6 +106,8 @@ namespace mongo {
         static void check(StringData tname) {
             static int max;
             StackChecker *sc = checker.get();
+            if ( !sc ) // a client that moved from the thread it started on
+                return;
             const char *p = sc->buf;
 
             int lastStackByteModifed = 0;
@@ -30,6 +30,8 @@
 
 #include "mongo/pch.h"
 
+#include <boost/thread/thread.hpp>
+
 #include "mongo/base/init.h"
 #include "mongo/base/status.h"
 #include "mongo/bson/util/builder.h"
@@ -52,9 +54,14 @@
 #include "mongo/db/pdfile.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/db/structure/collection.h"
+#include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/fail_point_service.h"
 
 namespace mongo {
 
+    // Fails a range copy of a parallel clone, for testing its error handling.
+    MONGO_FP_DECLARE(clonerFailRangeCopy);
+
     BSONElement getErrField(const BSONObj& o);
 
     /** Selectively release the mutex based on a parameter. */
@@ -111,16 +118,22 @@ namespace mongo {
         return res;
     }
 
-    Cloner::Cloner() { }
+    Cloner::Cloner() : _progress(NULL) { }
 
     struct Cloner::Fun {
         Fun() : lastLog(0) { }
         time_t lastLog;
         void operator()( DBClientCursorBatchIterator &i ) {
             Lock::GlobalWrite lk;
+            // a parallel clone worker has no context of its own to relock
+            scoped_ptr<Client::Context> workerContext;
             if ( context ) {
                 context->relocked();
             }
+            else {
+                workerContext.reset(new Client::Context(to_collection));
+            }
+            const int nBefore = n;
 
             while( i.moreInCurrentBatch() ) {
                 if ( n % 128 == 127 /*yield some*/ ) {
@@ -181,6 +194,10 @@ namespace mongo {
                     saveLast = time( 0 );
                 }
             }
+
+            if ( progress ) {
+                progress->addDocs(to_collection, n - nBefore);
+            }
         }
         int n;
         bool isindex;
@@ -192,6 +209,7 @@ namespace mongo {
         Client::Context *context;
         bool _mayYield;
         bool _mayBeInterrupted;
+        CloneProgress *progress;
     };
 
     /* copy the specified collection
@@ -214,6 +232,7 @@ namespace mongo {
         f.logForRepl = logForRepl;
         f._mayYield = mayYield;
         f._mayBeInterrupted = mayBeInterrupted;
+        f.progress = isindex ? NULL : _progress;
 
         int options = QueryOption_NoCursorTimeout | ( slaveOk ? QueryOption_SlaveOk : 0 );
         {
@@ -311,6 +330,223 @@ namespace mongo {
 
     extern bool inDBRepair;
 
+    /* we defer building the id index of a cloned collection for performance - building it in
+       batch is much faster */
+    static void buildDeferredIdIndex(const string& ns) {
+        /* we need dropDups to be true as we didn't do a true snapshot and this is before applying
+           oplog operations that occur during the initial sync.  inDBRepair makes dropDups be
+           true.
+           */
+        bool old = inDBRepair;
+        try {
+            inDBRepair = true;
+            Collection* c = cc().database()->getCollection( ns );
+            if ( c )
+                c->getIndexCatalog()->ensureHaveIdIndex();
+            inDBRepair = old;
+        }
+        catch(...) {
+            inDBRepair = old;
+            throw;
+        }
+    }
+
+    struct Cloner::CollectionToClone {
+        string from;
+        string to;
+        bool capped;
+        bool wantIdIndex;
+    };
+
+    struct Cloner::CloneRange {
+        string from;
+        string to;
+        Query query;
+    };
+
+    struct Cloner::ParallelClone {
+        ParallelClone() : mutex("ParallelClone") {}
+        string host;
+        const CloneOptions* opts;
+        CloneProgress* progress;
+
+        // protects ranges and errmsg
+        mongo::mutex mutex;
+        std::deque<CloneRange> ranges;
+        // the first failure; the workers stop once it is set
+        string errmsg;
+    };
+
+    void Cloner::splitCollection(const string& ns, long long rangeBytes, bool slaveOk,
+                                 std::vector<BSONObj>* splitKeys) {
+        // splitVector can't run on a secondary, the usual sync source, so walk the _id index
+        // from here instead.  Each query starts at the last split key and skips a range's worth
+        // of keys, covered by the index, so the source reads each key once.
+        const int queryOptions = slaveOk ? QueryOption_SlaveOk : 0;
+        BSONObj stats;
+        if (!_conn->runCommand(nsToDatabase(ns),
+                               BSON("collStats" << nsToCollectionSubstring(ns)),
+                               stats,
+                               queryOptions)) {
+            log() << "not splitting " << ns << " for cloning, collStats failed: " << stats
+                  << endl;
+            return;
+        }
+
+        const long long count = stats["count"].numberLong();
+        const long long avgObjSize = stats["avgObjSize"].numberLong();
+        if (count == 0 || avgObjSize <= 0) {
+            return;
+        }
+        const long long keysPerRange =
+            std::min(std::max(1LL, rangeBytes / avgObjSize),
+                     (long long)std::numeric_limits<int>::max());
+        if (keysPerRange >= count) {
+            return;
+        }
+
+        const BSONObj idPattern = BSON("_id" << 1);
+        BSONObj last;
+        try {
+            while (true) {
+                Query q;
+                q.hint(idPattern);
+                if (!last.isEmpty()) {
+                    q.minKey(last);
+                }
+                auto_ptr<DBClientCursor> c = _conn->query(ns, q, 1, (int)keysPerRange,
+                                                          &idPattern, queryOptions);
+                uassert(17302, "no cursor from sync source", c.get());
+                if (!c->more()) {
+                    break;
+                }
+                BSONElement id = c->nextSafe()["_id"];
+                uassert(17303, "document without an _id", !id.eoo());
+                last = id.wrap().getOwned();
+                splitKeys->push_back(last);
+            }
+        }
+        catch (const DBException& e) {
+            // e.g. no _id index.  copy it whole.
+            log() << "not splitting " << ns << " for cloning: " << e.toString() << endl;
+            splitKeys->clear();
+        }
+    }
+
+    void Cloner::cloneWorker(ParallelClone* clone) {
+        Client::initThread("cloner");
+        try {
+            string errmsg;
+            ConnectionString cs = ConnectionString::parse(clone->host, errmsg);
+            auto_ptr<DBClientBase> conn(cs.connect(errmsg));
+            uassert(17299, str::stream() << "cloner couldn't connect to " << clone->host
+                                         << causedBy(errmsg),
+                    conn.get());
+            uassert(17300, str::stream() << "cloner couldn't authenticate to " << clone->host,
+                    replAuthenticate(conn.get()));
+
+            Cloner cloner;
+            cloner.setConnection(conn.release());
+            cloner._progress = clone->progress;
+
+            const CloneOptions& opts = *clone->opts;
+            while (true) {
+                CloneRange range;
+                {
+                    scoped_lock lk(clone->mutex);
+                    if (clone->ranges.empty() || !clone->errmsg.empty()) {
+                        break;
+                    }
+                    range = clone->ranges.front();
+                    clone->ranges.pop_front();
+                }
+
+                if (MONGO_FAIL_POINT(clonerFailRangeCopy)) {
+                    uasserted(17304, str::stream() << "clonerFailRangeCopy fail point on "
+                                                   << range.to);
+                }
+
+                if (clone->progress) {
+                    clone->progress->startRange(range.to);
+                }
+                // no lock to yield here; each batch is inserted under its own lock.
+                cloner.copy(range.from.c_str(), range.to.c_str(), false, opts.logForRepl, false,
+                            opts.slaveOk, false, opts.mayBeInterrupted, range.query);
+                if (clone->progress) {
+                    clone->progress->finishRange(range.to);
+                }
+            }
+        }
+        catch (const std::exception& e) {
+            scoped_lock lk(clone->mutex);
+            if (clone->errmsg.empty()) {
+                clone->errmsg = e.what();
+            }
+            clone->ranges.clear();
+        }
+        cc().shutdown();
+    }
+
+    void Cloner::copyParallel(const char *masterHost, const CloneOptions& opts,
+                              const std::vector<CollectionToClone>& colls) {
+        ParallelClone clone;
+        clone.host = masterHost;
+        clone.opts = &opts;
+        clone.progress = _progress;
+
+        {
+            dbtemprelease r;
+
+            for (std::vector<CollectionToClone>::const_iterator i = colls.begin();
+                 i != colls.end();
+                 ++i) {
+                // capped collections are copied whole to keep their insertion order
+                std::vector<BSONObj> splitKeys;
+                if (opts.cloneRangeBytes > 0 && !i->capped) {
+                    splitCollection(i->from, opts.cloneRangeBytes, opts.slaveOk, &splitKeys);
+                }
+
+                for (size_t k = 0; k <= splitKeys.size(); ++k) {
+                    CloneRange range;
+                    range.from = i->from;
+                    range.to = i->to;
+                    if (splitKeys.empty()) {
+                        if (opts.snapshot)
+                            range.query.snapshot();
+                    }
+                    else {
+                        // $min/$max bound the _id index scan without bracketing by type
+                        if (k > 0)
+                            range.query.minKey(splitKeys[k - 1]);
+                        if (k < splitKeys.size())
+                            range.query.maxKey(splitKeys[k]);
+                        range.query.hint(BSON("_id" << 1));
+                    }
+                    clone.ranges.push_back(range);
+                }
+
+                if (_progress) {
+                    _progress->addCollection(i->to, splitKeys.size() + 1);
+                }
+            }
+
+            const int nThreads = std::min(opts.cloneThreads, static_cast<int>(clone.ranges.size()));
+            log() << "cloning " << colls.size() << " collections in " << clone.ranges.size()
+                  << " parts on " << nThreads << " threads" << endl;
+
+            boost::thread_group workers;
+            for (int i = 0; i < nThreads; ++i) {
+                workers.create_thread(boost::bind(&Cloner::cloneWorker, &clone));
+            }
+            workers.join_all();
+        }
+
+        if (!clone.errmsg.empty()) {
+            uasserted(17301, str::stream() << "error cloning " << opts.fromDB << ": "
+                                           << clone.errmsg);
+        }
+    }
+
     bool Cloner::go(const char *masterHost, string& errmsg, const string& fromdb, bool logForRepl, bool slaveOk, bool useReplAuth, bool snapshot, bool mayYield, bool mayBeInterrupted, int *errCode) {
 
         CloneOptions opts;
@@ -435,6 +671,12 @@ namespace mongo {
             }
         }
 
+        _progress = opts.progress;
+
+        // the parallel clone workers need a lock of their own and a connection of their own
+        const bool parallel = opts.cloneThreads > 1 && opts.mayYield && !masterSameProcess;
+        std::vector<CollectionToClone> parallelColls;
+
         for ( list<BSONObj>::iterator i=toClone.begin(); i != toClone.end(); i++ ) {
             {
                 mayInterrupt( opts.mayBeInterrupted );
@@ -454,30 +696,45 @@ namespace mongo {
             {
                 string err;
                 const char *toname = to_name.c_str();
-                /* we defer building id index for performance - building it in batch is much faster */
                 userCreateNS(toname, options, err, opts.logForRepl, &wantIdIndex);
             }
+
+            if ( parallel ) {
+                CollectionToClone c;
+                c.from = from_name;
+                c.to = to_name;
+                c.capped = options["capped"].trueValue();
+                c.wantIdIndex = wantIdIndex;
+                parallelColls.push_back(c);
+                continue;
+            }
+
             LOG(1) << "\t\t cloning " << from_name << " -> " << to_name << endl;
             Query q;
             if( opts.snapshot )
                 q.snapshot();
+            if ( _progress ) {
+                _progress->addCollection(to_name, 1);
+                _progress->startRange(to_name);
+            }
             copy(from_name, to_name.c_str(), false, opts.logForRepl, masterSameProcess, opts.slaveOk, opts.mayYield, opts.mayBeInterrupted, q);
+            if ( _progress ) {
+                _progress->finishRange(to_name);
+            }
 
             if( wantIdIndex ) {
-                /* we need dropDups to be true as we didn't do a true snapshot and this is before applying oplog operations
-                   that occur during the initial sync.  inDBRepair makes dropDups be true.
-                   */
-                bool old = inDBRepair;
-                try {
-                    inDBRepair = true;
-                    Collection* c = cc().database()->getCollection( to_name );
-                    if ( c )
-                        c->getIndexCatalog()->ensureHaveIdIndex();
-                    inDBRepair = old;
-                }
-                catch(...) {
-                    inDBRepair = old;
-                    throw;
+                buildDeferredIdIndex(to_name);
+            }
+        }
+
+        if ( !parallelColls.empty() ) {
+            copyParallel(masterHost, opts, parallelColls);
+
+            for (std::vector<CollectionToClone>::const_iterator i = parallelColls.begin();
+                 i != parallelColls.end();
+                 ++i) {
+                if ( i->wantIdIndex ) {
+                    buildDeferredIdIndex(i->to);
                 }
             }
         }
@@ -534,6 +791,64 @@ namespace mongo {
         return cloner.go(masterHost.c_str(), options, *clonedCollections, errmsg, errCode);
     }
 
+    void CloneProgress::reset() {
+        scoped_lock lk(_mutex);
+        _collections.clear();
+    }
+
+    void CloneProgress::addCollection(const string& ns, int ranges) {
+        scoped_lock lk(_mutex);
+        _collections[ns].ranges += ranges;
+    }
+
+    void CloneProgress::startRange(const string& ns) {
+        scoped_lock lk(_mutex);
+        _collections[ns].rangesStarted++;
+    }
+
+    void CloneProgress::addDocs(const string& ns, long long n) {
+        scoped_lock lk(_mutex);
+        _collections[ns].docs += n;
+    }
+
+    void CloneProgress::finishRange(const string& ns) {
+        scoped_lock lk(_mutex);
+        _collections[ns].rangesCloned++;
+    }
+
+    bool CloneProgress::empty() const {
+        scoped_lock lk(_mutex);
+        return _collections.empty();
+    }
+
+    BSONObj CloneProgress::toBSON() const {
+        scoped_lock lk(_mutex);
+        int collectionsCloned = 0;
+        int rangesCloned = 0;
+        long long docsCloned = 0;
+        BSONArrayBuilder cloning;
+        for (std::map<string, Collection>::const_iterator i = _collections.begin();
+             i != _collections.end();
+             ++i) {
+            const Collection& c = i->second;
+            docsCloned += c.docs;
+            rangesCloned += c.rangesCloned;
+            if (c.rangesCloned == c.ranges) {
+                collectionsCloned++;
+            }
+            else if (c.rangesStarted > 0) {
+                cloning.append(BSON("ns" << i->first <<
+                                    "docsCloned" << c.docs <<
+                                    "rangesCloned" << c.rangesCloned <<
+                                    "ranges" << c.ranges));
+            }
+        }
+        return BSON("collectionsCloned" << collectionsCloned <<
+                    "rangesCloned" << rangesCloned <<
+                    "docsCloned" << docsCloned <<
+                    "cloning" << cloning.arr());
+    }
+
     /* Usage:
        mydb.$cmd.findOne( { clone: "fromhost" } );
        Note: doesn't work with authentication enabled, except as internal operation or for
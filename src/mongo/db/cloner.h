@@ -31,10 +31,12 @@
 #pragma once
 
 #include "mongo/db/jsobj.h"
+#include "mongo/util/concurrency/mutex.h"
 
 namespace mongo {
 
     struct CloneOptions;
+    class CloneProgress;
     class DBClientBase;
     class DBClientCursor;
     class Query;
@@ -104,8 +106,27 @@ namespace mongo {
                   bool masterSameProcess, bool slaveOk, bool mayYield, bool mayBeInterrupted,
                   Query q);
 
+        struct CollectionToClone;
+        struct CloneRange;
+        struct ParallelClone;
+
+        /**
+         * Copies the data of 'colls' on opts.cloneThreads threads, each with its own connection
+         * to 'masterHost'.  Large collections are split into _id ranges of about
+         * opts.cloneRangeBytes.  The caller's lock is released meanwhile.
+         */
+        void copyParallel(const char *masterHost, const CloneOptions& opts,
+                          const std::vector<CollectionToClone>& colls);
+
+        /** Asks the source for the _id keys that split 'ns' into ranges of about 'rangeBytes'. */
+        void splitCollection(const string& ns, long long rangeBytes, bool slaveOk,
+                             std::vector<BSONObj>* splitKeys);
+
+        static void cloneWorker(ParallelClone* clone);
+
         struct Fun;
         auto_ptr<DBClientBase> _conn;
+        CloneProgress* _progress;
     };
 
     struct CloneOptions {
@@ -120,6 +141,10 @@ namespace mongo {
 
             syncData = true;
             syncIndexes = true;
+
+            cloneThreads = 1;
+            cloneRangeBytes = 0;
+            progress = NULL;
         }
             
         string fromDB;
@@ -134,6 +159,52 @@ namespace mongo {
 
         bool syncData;
         bool syncIndexes;
+
+        // number of collections, or ranges of one, to copy at once.  more than one requires
+        // mayYield and a remote source.
+        int cloneThreads;
+        // with cloneThreads > 1, split collections larger than this into _id ranges.  0 = never.
+        long long cloneRangeBytes;
+        // if set, tracks the documents copied
+        CloneProgress* progress;
+    };
+
+    /**
+     * Per collection progress of a clone, for reporting while it runs.  Thread safe.
+     */
+    class CloneProgress : boost::noncopyable {
+    public:
+        CloneProgress() : _mutex("CloneProgress") {}
+
+        void reset();
+
+        /** 'ns' will be copied in 'ranges' parts */
+        void addCollection(const string& ns, int ranges);
+        void startRange(const string& ns);
+        void addDocs(const string& ns, long long n);
+        void finishRange(const string& ns);
+
+        /**
+         * { collectionsCloned: <n>, rangesCloned: <n>, docsCloned: <n>,
+         *   cloning: [ { ns: <ns>, docsCloned: <n>, rangesCloned: <n>, ranges: <n> }, ... ] }
+         * where 'cloning' lists the collections that are being copied.
+         */
+        BSONObj toBSON() const;
+
+        bool empty() const;
+
+    private:
+        struct Collection {
+            Collection() : ranges(0), rangesStarted(0), rangesCloned(0), docs(0) {}
+            int ranges;
+            int rangesStarted;
+            int rangesCloned;
+            long long docs;
+        };
+
+        // all members are protected by _mutex
+        mutable mongo::mutex _mutex;
+        std::map<string, Collection> _collections;
     };
 
 } // namespace mongo
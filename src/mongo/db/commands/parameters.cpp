@@ -36,6 +36,7 @@
 #include "mongo/db/server_parameters.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/util/mongoutils/str.h"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/net/ssl_options.h"
 
 namespace mongo {
@@ -362,6 +363,20 @@ namespace mongo {
                                                     &serverGlobalParams.quiet,
                                                     true,
                                                     true );
+
+        // Compression of messages to and from peers that agree to it in isMaster.
+        ExportedServerParameter<bool> NetworkCompressionSetting( ServerParameterSet::getGlobal(),
+                                                                 "networkCompression",
+                                                                 &MessageCompressor::enabled,
+                                                                 true,
+                                                                 true );
+
+        ExportedServerParameter<int> NetworkCompressionMinSizeSetting(
+                                                                ServerParameterSet::getGlobal(),
+                                                                "networkCompressionMinSize",
+                                                                &MessageCompressor::minSize,
+                                                                true,
+                                                                true );
     }
 
 }
@@ -78,6 +78,7 @@ namespace mongo {
         _maxTimeTracker.reset();
         _message = "";
         _progressMeter.finished();
+        _phaseTimings.reset();
         _killPending.store(0);
         killCurrentOp.notifyAllWaiters();
         _numYields = 0;
@@ -258,6 +259,10 @@ namespace mongo {
             }
         }
 
+        if ( _phaseTimings.have() ) {
+            _phaseTimings.append( b , "phaseTimingsMillis" );
+        }
+
         if( killPending() )
             b.append("killPending", true);
 
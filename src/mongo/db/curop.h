@@ -283,6 +283,8 @@ namespace mongo {
                                   int secondsBetween = 3);
         string getMessage() const { return _message.toString(); }
         ProgressMeter& getProgressMeter() { return _progressMeter; }
+        /** elapsed time of each phase of a multi-phase operation, reported by currentOp */
+        void setPhaseTimings(const BSONObj& timings) { _phaseTimings.set(timings); }
         CurOp *parent() const { return _wrapped; }
         void kill(bool* pNotifyFlag = NULL); 
         bool killPendingStrict() const { return _killPending.load(); }
@@ -337,6 +339,7 @@ namespace mongo {
         OpDebug _debug;
         ThreadSafeString _message;
         ProgressMeter _progressMeter;
+        CachedBSONObj _phaseTimings;
         AtomicInt32 _killPending;
         int _numYields;
         LockStat _lockStat;
@@ -68,6 +68,7 @@
 #include "mongo/db/startup_warnings.h"
 #include "mongo/db/stats/counters.h"
 #include "mongo/db/stats/snapshots.h"
+#include "mongo/db/storage/hmem_storage.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/db/ttl.h"
 #include "mongo/platform/process_id.h"
@@ -179,6 +180,22 @@ namespace mongo {
         sleepmicros( Client::recommendedYieldMicros() );
     }
 
+    /** a connection's Client while no thread serves the connection */
+    class DetachedClient : public DetachedConnection {
+    public:
+        explicit DetachedClient( Client* c ) : _c( c ) {}
+        virtual ~DetachedClient() { delete _c; }
+
+        virtual void attach() {
+            verify( currentClient.get() == 0 );
+            currentClient.reset( _c );
+            _c = 0;
+        }
+
+    private:
+        Client* _c;
+    };
+
     class MyMessageHandler : public MessageHandler {
     public:
         virtual void connected( AbstractMessagingPort* p ) {
@@ -239,6 +256,12 @@ namespace mongo {
             if( c ) c->shutdown();
         }
 
+        virtual bool canMoveConnections() const { return true; }
+
+        virtual DetachedConnection* detachConnection( AbstractMessagingPort* p ) {
+            return new DetachedClient( currentClient.release() );
+        }
+
     };
 
     void logStartup() {
@@ -273,6 +296,7 @@ namespace mongo {
         MessageServer::Options options;
         options.port = port;
         options.ipList = serverGlobalParams.bind_ip;
+        options.workerThreads = serverGlobalParams.netWorkerThreads;
 
         MessageServer * server = createServer( options , new MyMessageHandler() );
         server->setAsTimeTracker();
@@ -684,6 +708,9 @@ namespace mongo {
 
         MONGO_ASSERT_ON_EXCEPTION_WITH_MSG( clearTmpFiles(), "clear tmp files" );
 
+        // before any data file is mapped
+        initHmemStorage();
+
         dur::startup();
 
         if (storageGlobalParams.durOptions & StorageGlobalParams::DurRecoverOnly)
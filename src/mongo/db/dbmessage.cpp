@@ -109,4 +109,38 @@ namespace mongo {
         response.setData( queryResult, true ); // transport will free
     }
 
+    QueryReplyBuilder::QueryReplyBuilder(int initialSize)
+        : _buf(new BufBuilder(initialSize)), _len(sizeof(QueryResult)) {
+        _buf->skip(sizeof(QueryResult));
+    }
+
+    void QueryReplyBuilder::append(const BSONObj& obj) {
+        const int size = obj.objsize();
+        _len += size;
+        if (!obj.isOwned() || size < kMinReferencedSize) {
+            _buf->appendBuf(obj.objdata(), size);
+            return;
+        }
+        flush();
+        _msg.appendObj(obj);
+    }
+
+    void QueryReplyBuilder::flush() {
+        if (0 == _buf->len()) {
+            return;
+        }
+        _msg.appendData(_buf->buf(), _buf->len());
+        _buf->decouple();
+        _buf.reset(new BufBuilder(32768));
+    }
+
+    QueryResult* QueryReplyBuilder::done(Message& result) {
+        flush();
+        result = _msg;
+        QueryResult* qr = reinterpret_cast<QueryResult*>(result.header());
+        verify(qr->len == _len);
+        qr->setOperation(opReply);
+        return qr;
+    }
+
 }
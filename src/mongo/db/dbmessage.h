@@ -315,4 +315,37 @@ namespace mongo {
      * @param resultObj The bson object that contains the reply data.
      */
     void replyToQuery( int queryResultFlags, Message& response, const BSONObj& resultObj );
+
+    /**
+     * Builds the documents of an OP_REPLY.  Documents are copied into the reply, except owned
+     * documents of at least kMinReferencedSize bytes: the reply keeps a reference to those and
+     * sends them from their own buffer.  Unowned documents may point into a data file, which can
+     * change once the read lock is released and before the reply is sent, so they are always
+     * copied.
+     */
+    class QueryReplyBuilder : boost::noncopyable {
+    public:
+        static const int kMinReferencedSize = 4 * 1024;
+
+        explicit QueryReplyBuilder(int initialSize = 32768);
+
+        void append(const BSONObj& obj);
+
+        /** length of the reply so far, including the QueryResult header */
+        int len() const { return _len; }
+
+        /**
+         * Moves the reply into the empty 'result' and returns its header, with len and the
+         * operation set.  The builder can't be used afterwards.
+         */
+        QueryResult* done(Message& result);
+
+    private:
+        void flush();
+
+        // the documents copied since the last referenced one
+        scoped_ptr<BufBuilder> _buf;
+        Message _msg;
+        int _len;
+    };
 } // namespace mongo
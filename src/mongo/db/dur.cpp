@@ -53,13 +53,17 @@
      READLOCK dbMutex
      LOCK groupCommitMutex
        PREPLOGBUFFER()
-     READLOCK mmmutex
        commitJob.reset()
+       push to CommitPipeline
      UNLOCK dbMutex                                     // now other threads can write
+     UNLOCK groupCommitMutex
+
+     journal thread:                                    // commits in order
        WRITETOJOURNAL()
+     datafiles thread:
+     READLOCK mmmutex
        WRITETODATAFILES()
      UNLOCK mmmutex
-     UNLOCK groupCommitMutex
 
      on the next write lock acquisition for dbMutex:    // see MongoMutex::_acquiredWriteLock()
        REMAPPRIVATEVIEW()
@@ -161,12 +165,34 @@ namespace mongo {
                              "writeToJournal" << (unsigned) (_writeToJournalMicros/1000) <<
                              "writeToDataFiles" << (unsigned) (_writeToDataFilesMicros/1000) <<
                              "remapPrivateView" << (unsigned) (_remapPrivateViewMicros/1000)
+                           ) <<
+                       "latencyMs" <<
+                       BSON( "prepLogBuffer" << _prepLogBufferLatency.asObj() <<
+                             "writeToJournal" << _writeToJournalLatency.asObj() <<
+                             "writeToDataFiles" << _writeToDataFilesLatency.asObj() <<
+                             "commit" << _commitLatency.asObj()
                            );
             if (storageGlobalParams.journalCommitInterval != 0)
                 b << "journalCommitIntervalMs" << storageGlobalParams.journalCommitInterval;
             return b.obj();
         }
 
+        void Stats::LatencyHistogram::insert(unsigned long long micros) {
+            unsigned b = 0;
+            for( unsigned long long ms = micros / 1000; ms && b < Buckets - 1; ms >>= 1 )
+                b++;
+            _counts[b]++;
+        }
+
+        /** e.g. { "<1" : 10, "<2" : 3, ..., "<1024" : 0, ">=1024" : 0 } */
+        BSONObj Stats::LatencyHistogram::asObj() const {
+            BSONObjBuilder b;
+            for( unsigned i = 0; i < Buckets - 1; i++ )
+                b.append(string(str::stream() << '<' << (1 << i)), _counts[i]);
+            b.append(string(str::stream() << ">=" << (1 << (Buckets - 2))), _counts[Buckets - 1]);
+            return b.obj();
+        }
+
         BSONObj Stats::asObj() {
             return other()->_asObj();
         }
@@ -555,12 +581,245 @@ namespace mongo {
         // reallocate, and more importantly regrow it, on every single commit.
         static AlignedBuilder __theBuilder(4 * 1024 * 1024);
 
+        /** group commits past PREPLOGBUFFER, oldest first.  the journal thread writes each to the
+            journal, then the datafiles thread applies it to the data files, so that the commit
+            thread can prepare commit N+1 while commit N is written to the journal and N-1 is
+            applied.  getlasterror j:true waiters are notified as each commit reaches the journal.
+
+            anything that needs all commits applied (remapping the private views, closing files,
+            fsync lock) calls drain() under groupCommitMutex, so no new commit is pushed meanwhile.
+
+            locking: the datafiles stage needs LockMongoFilesShared and takes it before _m.  drain()
+            may be called in LockMongoFilesExclusive (closing files), so it doesn't wait for a stage
+            the pipeline threads haven't started, it runs the stage itself.
+        */
+        class CommitPipeline : boost::noncopyable {
+        public:
+            // commits in flight, each holding an AlignedBuilder: one being prepared, one being
+            // written to the journal, one being applied to the data files
+            enum { Depth = 3 };
+
+            CommitPipeline() : _m("commitPipeline"), _nBuilders(0) { }
+
+            /** @return a builder for the next commit, waiting while Depth commits are in flight.
+                call before locking for the commit.
+            */
+            AlignedBuilder* getBuilder() {
+                scoped_lock lk(_m);
+                while( _free.empty() && _nBuilders == Depth )
+                    _changed.wait(lk.boost());
+                if( _free.empty() ) {
+                    _nBuilders++;
+                    return new AlignedBuilder(4 * 1024 * 1024);
+                }
+                AlignedBuilder* ab = _free.back();
+                _free.pop_back();
+                return ab;
+            }
+
+            /** gives back a builder from getBuilder() that had nothing to commit */
+            void returnBuilder(AlignedBuilder* ab) {
+                scoped_lock lk(_m);
+                _free.push_back(ab);
+                _changed.notify_all();
+            }
+
+            /** queues a prepared commit for the journal
+                @param ab from getBuilder(), returned once the commit is applied
+            */
+            void push(const JSectHeader& h, AlignedBuilder* ab, NotifyAll::When commitNumber, 
+                      unsigned long long startedMicros) {
+                groupCommitMutex().dassertLocked();
+                Commit c;
+                c.h = h;
+                c.ab = ab;
+                c.commitNumber = commitNumber;
+                c.startedMicros = startedMicros;
+                c.state = Prepared;
+                scoped_lock lk(_m);
+                _commits.push_back(c);
+                _changed.notify_all();
+            }
+
+            /** for a commit with nothing written: its waiters may only be notified once the commits
+                in flight are in the journal.  
+                @return false if none is in flight, in which case the caller notifies them now
+            */
+            bool notifyWithLast(NotifyAll::When commitNumber) {
+                scoped_lock lk(_m);
+                if( _commits.empty() )
+                    return false;
+                Commit& last = _commits.back();
+                if( last.state != Prepared && last.state != Journaling )
+                    return false; // commits are journaled in order, so all are
+                last.commitNumber = commitNumber;
+                return true;
+            }
+
+            /** journals and applies every queued commit, running stages on this thread when the
+                pipeline threads haven't started them
+            */
+            void drain() {
+                groupCommitMutex().dassertLocked();
+                while( 1 ) {
+                    Commit* toJournal = 0;
+                    Commit* toDataFiles = 0;
+                    {
+                        scoped_lock lk(_m);
+                        if( _commits.empty() )
+                            return;
+                        if( !(toJournal = _claimJournal()) && !(toDataFiles = _claimDataFiles()) ) {
+                            // a pipeline thread is at the oldest stage
+                            _changed.wait(lk.boost());
+                            continue;
+                        }
+                    }
+                    if( toJournal ) {
+                        _journal(toJournal);
+                    }
+                    else {
+                        LockMongoFilesShared lkFiles; // recursive if we are exclusive
+                        _writeToDataFiles(toDataFiles);
+                    }
+                }
+            }
+
+            void journalThread() {
+                Client::initThread("journalWriter");
+                while( !inShutdown() ) {
+                    Commit* c;
+                    {
+                        scoped_lock lk(_m);
+                        if( !(c = _claimJournal()) ) {
+                            _changed.timed_wait(lk.boost(), boost::posix_time::milliseconds(100));
+                            continue;
+                        }
+                    }
+                    _journal(c);
+                }
+                cc().shutdown();
+            }
+
+            void dataFilesThread() {
+                Client::initThread("journalDataFiles");
+                while( !inShutdown() ) {
+                    _waitForJournaled();
+                    LockMongoFilesShared lkFiles;
+                    Commit* c;
+                    {
+                        scoped_lock lk(_m);
+                        if( !(c = _claimDataFiles()) )
+                            continue; // drain() took it
+                    }
+                    _writeToDataFiles(c);
+                }
+                cc().shutdown();
+            }
+
+        private:
+            enum State { Prepared, Journaling, Journaled, WritingToDataFiles };
+
+            struct Commit {
+                JSectHeader h;
+                AlignedBuilder* ab;
+                NotifyAll::When commitNumber;
+                unsigned long long startedMicros;
+                State state;
+            };
+
+            static SimpleMutex& groupCommitMutex() { return commitJob.groupCommitMutex; }
+
+            /** the oldest commit not yet journaled, if the one before it is */
+            Commit* _claimJournal() {
+                for( std::deque<Commit>::iterator i = _commits.begin(); i != _commits.end(); i++ ) {
+                    if( i->state == Journaling )
+                        return 0;
+                    if( i->state == Prepared ) {
+                        i->state = Journaling;
+                        return &*i;
+                    }
+                }
+                return 0;
+            }
+
+            /** the oldest commit, if journaled */
+            Commit* _claimDataFiles() {
+                if( _commits.empty() || _commits.front().state != Journaled )
+                    return 0;
+                _commits.front().state = WritingToDataFiles;
+                return &_commits.front();
+            }
+
+            /** waits a little for the oldest commit to be journaled, without keeping files from closing */
+            void _waitForJournaled() {
+                scoped_lock lk(_m);
+                if( _commits.empty() || _commits.front().state != Journaled )
+                    _changed.timed_wait(lk.boost(), boost::posix_time::milliseconds(100));
+            }
+
+            // deque references stay valid as commits are pushed and popped at the ends
+            void _journal(Commit* c) {
+                try {
+                    WRITETOJOURNAL(c->h, *c->ab);
+                }
+                catch(std::exception& e) {
+                    log() << "exception writing to the journal causing immediate shutdown: " << e.what() << endl;
+                    mongoAbort("dur journal");
+                }
+                NotifyAll::When commitNumber;
+                {
+                    scoped_lock lk(_m);
+                    c->state = Journaled;
+                    commitNumber = c->commitNumber;
+                    stats.curr->_commitLatency.insert(curTimeMicros64() - c->startedMicros);
+                    _changed.notify_all();
+                }
+                // data is now in the journal, which is sufficient for acknowledging getLastError.
+                // (ok to crash after that)
+                commitJob._notify.notifyAll(commitNumber);
+            }
+
+            void _writeToDataFiles(Commit* c) {
+                try {
+                    WRITETODATAFILES(c->h, *c->ab);
+                }
+                catch(std::exception& e) {
+                    log() << "exception writing to the data files causing immediate shutdown: " << e.what() << endl;
+                    mongoAbort("dur datafiles");
+                }
+                scoped_lock lk(_m);
+                dassert( &_commits.front() == c );
+                c->ab->reset();
+                _free.push_back(c->ab);
+                _commits.pop_front();
+                _changed.notify_all();
+            }
+
+            mongo::mutex _m;
+            boost::condition _changed;
+            std::deque<Commit> _commits;
+            std::vector<AlignedBuilder*> _free;
+            int _nBuilders; // allocated so far, up to Depth
+        };
+
+        static CommitPipeline& commitPipeline = *(new CommitPipeline()); // don't destroy
+
+        static void journalThread() {
+            commitPipeline.journalThread();
+        }
+
+        static void dataFilesThread() {
+            commitPipeline.dataFilesThread();
+        }
+
         static bool _groupCommitWithLimitedLocks() {
             unspoolWriteIntents(); // in case we were doing some writing ourself (likely impossible with limitedlocks version)
-            AlignedBuilder &ab = __theBuilder;
 
             verify( ! Lock::isLocked() );
 
+            // waits while the pipeline is full, which throttles writers as if we were journaling
+            AlignedBuilder *ab = commitPipeline.getBuilder();
+
             // do we need this to be greedy, so that it can start working fairly soon?
             // probably: as this is a read lock, it wouldn't change anything if only reads anyway.
             // also needs to stop greed. our time to work before clearing lk1 is not too bad, so 
@@ -572,44 +831,35 @@ namespace mongo {
             commitJob.commitingBegin(); // increments the commit epoch for getlasterror j:true
 
             if( !commitJob.hasWritten() ) {
-                // getlasterror request could have came after the data was already committed
-                commitJob.committingNotifyCommitted();
+                // getlasterror request could have came after the data was already committed, 
+                // but maybe only to a commit still on its way to the journal
+                commitPipeline.returnBuilder(ab);
+                if( !commitPipeline.notifyWithLast(commitJob.commitNumber()) )
+                    commitJob.committingNotifyCommitted();
                 return true;
             }
 
+            unsigned long long startedMicros = curTimeMicros64();
             JSectHeader h;
             // need to be in readlock (writes excluded) for this as write intent stuctures point into 
             // the private mmap for their actual data.  i suppose we could lock individual databases 
             // and do them one at a time or in parallel (surely the latter would make sense if one went 
             // that route...)
-            PREPLOGBUFFER(h,ab); 
-
-            LockMongoFilesShared lk3;
+            PREPLOGBUFFER(h,*ab); 
 
-            unsigned abLen = ab.len();
             commitJob.committingReset(); // must be reset before allowing anyone to write
             DEV verify( !commitJob.hasWritten() );
 
+            // the journal and datafiles threads take it from here.  the data files are written
+            // from the journal buffer, not the private views, so it's fine that writes resume.
+            // files can't close under them as closing drains the pipeline first.
+            commitPipeline.push(h, ab, commitJob.commitNumber(), startedMicros);
+
             // release the readlock -- allowing others to now write while we are writing to the journal (etc.)
             lk1.reset();
 
             // ****** now other threads can do writes ******
 
-            WRITETOJOURNAL(h, ab);
-            verify( abLen == ab.len() ); // a check that no one touched the builder while we were doing work. if so, our locking is wrong.
-
-            // data is now in the journal, which is sufficient for acknowledging getLastError.
-            // (ok to crash after that)
-            commitJob.committingNotifyCommitted();
-
-            // note the higher-up-the-chain locking of filesLockedFsync is important here, 
-            // as we are not in Lock::GlobalRead anymore. private view readers won't see 
-            // anything as we do this, but external viewers of the datafiles will see them 
-            // mutating.
-            WRITETODATAFILES(h, ab);
-            verify( abLen == ab.len() ); // check again wasn't modded
-            ab.reset();
-
             // can't : d.dbMutex._remapPrivateViewRequested = true;
             // (writes have happened we released)
 
@@ -656,6 +906,9 @@ namespace mongo {
                 // there is only one dur thread, "early commits" can be done by other threads)
                 SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
 
+                // commits in flight go to the data files before this one, and before we remap
+                commitPipeline.drain();
+
                 commitJob.commitingBegin();
 
                 if( !commitJob.hasWritten() ) {
@@ -771,7 +1024,7 @@ namespace mongo {
         }
 
         /** called when a DurableMappedFile is closing -- we need to go ahead and group commit in that case before its
-            views disappear
+            views disappear, and apply the commits still in the pipeline to the data files
         */
         void closingFileNotification() {
             if (!storageGlobalParams.dur)
@@ -779,12 +1032,18 @@ namespace mongo {
 
             if( Lock::isLocked() ) {
                 getDur().commitIfNeeded(true);
+                // commitIfNeeded may not have committed (in 'r', or if it couldn't upgrade in 'w'),
+                // and one that did leaves its commit in the pipeline
+                SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
+                commitPipeline.drain();
             }
             else {
                 verify( inShutdown() );
                 if( commitJob.hasWritten() ) {
                     log() << "journal warning files are closing outside locks with writes pending" << endl;
                 }
+                SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
+                commitPipeline.drain();
             }
         }
 
@@ -887,6 +1146,8 @@ namespace mongo {
             preallocateFiles();
 
             boost::thread t(durThread);
+            boost::thread jt(journalThread);
+            boost::thread dt(dataFilesThread);
         }
 
         void DurableImpl::syncDataAndTruncateJournal() {
@@ -897,6 +1158,7 @@ namespace mongo {
             // (dbMutex) locks. This line waits for that to complete if already underway.
             {
                 SimpleMutex::scoped_lock lk(commitJob.groupCommitMutex);
+                commitPipeline.drain();
             }
 
             commitNow();
@@ -172,6 +172,8 @@ namespace mongo {
                 groupCommitMutex.dassertLocked();
                 _notify.notifyAll(_commitNumber); 
             }
+            /** the epoch of the commit begun last, which getlasterror j:true waiters get notified of */
+            NotifyAll::When commitNumber() const { return _commitNumber; }
             /** we use the commitjob object over and over, calling reset() rather than reconstructing */
             void committingReset() {
                 groupCommitMutex.dassertLocked();
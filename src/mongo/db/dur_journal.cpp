@@ -724,8 +724,13 @@ namespace mongo {
         */
         void WRITETOJOURNAL(JSectHeader h, AlignedBuilder& uncompressed) {
             Timer t;
+            // the section was prepared while the previous one was being written, which may have
+            // rotated to a new journal file since.  only this stage rotates, so this is current.
+            h.fileId = j.curFileId();
             j.journal(h, uncompressed);
-            stats.curr->_writeToJournalMicros += t.micros();
+            unsigned long long m = t.micros();
+            stats.curr->_writeToJournalMicros += m;
+            stats.curr->_writeToJournalLatency.insert(m);
         }
         void Journal::journal(const JSectHeader& h, const AlignedBuilder& uncompressed) {
             RACECHECK
@@ -194,7 +194,9 @@ namespace mongo {
             Timer t;
             j.assureLogFileOpen(); // so fileId is set
             _PREPLOGBUFFER(h, ab);
-            stats.curr->_prepLogBufferMicros += t.micros();
+            unsigned long long m = t.micros();
+            stats.curr->_prepLogBufferMicros += m;
+            stats.curr->_prepLogBufferLatency.insert(m);
         }
 
     }
@@ -36,6 +36,7 @@
 #include <fcntl.h>
 #include <sys/stat.h>
 
+#include "mongo/base/owned_pointer_vector.h"
 #include "mongo/db/curop.h"
 #include "mongo/db/database.h"
 #include "mongo/db/db.h"
@@ -54,6 +55,7 @@
 #include "mongo/util/compress.h"
 #include "mongo/util/concurrency/race.h"
 #include "mongo/util/mongoutils/str.h"
+#include "mongo/util/processinfo.h"
 #include "mongo/util/startup_test.h"
 
 using namespace mongoutils;
@@ -196,6 +198,65 @@ namespace mongo {
 
         };
 
+        /** a section checked and parsed by a recovery worker thread */
+        struct ParsedSection : boost::noncopyable {
+            ParsedSection(const JSectHeader *hdr) : h(hdr), errCode(0), truncated(false) { }
+            bool ok() const { return errCode == 0 && !truncated; }
+
+            const JSectHeader *h; // points into the mmaped journal file
+            auto_ptr<JournalSectionIterator> i; // owns the uncompressed data the entries point into
+            vector<ParsedJournalEntry> entries;
+
+            // set if the section is bad; rethrown on the applying thread once the sections before
+            // it are applied
+            int errCode;
+            string errMsg;
+            bool truncated;
+        };
+
+        /** a basic write already resolved to its destination in a data file */
+        struct PendingWrite {
+            PendingWrite(char *d, const char *s, unsigned l) : dest(d), src(s), len(l) { }
+            char *dest;
+            const char *src;
+            unsigned len;
+        };
+
+        /** checksum, uncompress and parse a section. never throws, errors are recorded in s */
+        static void parseSection(ParsedSection *s) {
+            try {
+                const char *data = ((const char *) s->h) + sizeof(JSectHeader);
+                unsigned dataLen = s->h->sectionLen() - sizeof(JSectHeader) - sizeof(JSectFooter);
+                const JSectFooter *f = (const JSectFooter *) (data + dataLen);
+                if( !f->checkHash(s->h, dataLen + sizeof(JSectHeader)) ) {
+                    msgasserted(13594, "journal checksum doesn't match");
+                }
+                s->i.reset(new JournalSectionIterator(*s->h, data, dataLen, true));
+                while( !s->i->atEof() ) {
+                    ParsedJournalEntry e;
+                    s->i->next(e);
+                    s->entries.push_back(e);
+                }
+            }
+            catch( BufReader::eof& ) {
+                s->truncated = true;
+            }
+            catch( DBException& e ) {
+                s->errCode = e.getCode();
+                s->errMsg = e.what();
+            }
+            catch( std::exception& e ) {
+                s->errCode = 13594;
+                s->errMsg = e.what();
+            }
+        }
+
+        static void applyPartition(vector<PendingWrite> *writes) {
+            for( vector<PendingWrite>::const_iterator i = writes->begin(); i != writes->end(); ++i ) {
+                memcpy(i->dest, i->src, i->len);
+            }
+        }
+
         static string fileName(const char* dbName, int fileNo) {
             stringstream ss;
             ss << dbName << '.';
@@ -365,11 +426,8 @@ namespace mongo {
                 log() << "END section" << endl;
         }
 
-        void RecoveryJob::processSection(const JSectHeader *h, const void *p, unsigned len, const JSectFooter *f) {
-            LockMongoFilesShared lkFiles; // for RecoveryJob::Last
-            scoped_lock lk(_mx);
-            RACECHECK
-
+        /** @return true if the section is older than what the data files already have */
+        bool RecoveryJob::skipSection(const JSectHeader *h) {
             /** todo: we should really verify the checksum to see that seqNumber is ok?
                       that is expensive maybe there is some sort of checksum of just the header 
                       within the header itself
@@ -385,16 +443,20 @@ namespace mongo {
                     }
                     _lastSeqMentionedInConsoleLog = h->seqNumber;
                 }
-                return;
+                return true;
             }
+            return false;
+        }
 
-            auto_ptr<JournalSectionIterator> i;
-            if( _recovering ) {
-                i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, p, len, _recovering));
-            }
-            else { 
-                i = auto_ptr<JournalSectionIterator>(new JournalSectionIterator(*h, /*after header*/p, /*w/out header*/len));
-            }
+        void RecoveryJob::processSection(const JSectHeader *h, const void *p, unsigned len) {
+            LockMongoFilesShared lkFiles; // for RecoveryJob::Last
+            scoped_lock lk(_mx);
+            RACECHECK
+
+            if( skipSection(h) )
+                return;
+
+            auto_ptr<JournalSectionIterator> i(new JournalSectionIterator(*h, /*after header*/p, /*w/out header*/len));
 
             // we use a static so that we don't have to reallocate every time through.  occasionally we 
             // go back to a small allocation so that if there were a spiky growth it won't stick forever.
@@ -416,16 +478,137 @@ namespace mongo {
                 entries.push_back(e);
             }
 
-            // after the entries check the footer checksum
-            if( _recovering ) {
-                verify( ((const char *)h) + sizeof(JSectHeader) == p );
-                if( !f->checkHash(h, len + sizeof(JSectHeader)) ) { 
-                    msgasserted(13594, "journal checksum doesn't match");
+            // got all the entries for one group commit.  apply them:
+            applyEntries(entries);
+        }
+
+        /** run the pending writes, one worker per partition, and wait for them */
+        void RecoveryJob::applyWrites(vector<vector<PendingWrite> >& partitions) {
+            for( unsigned k = 0; k < partitions.size(); k++ ) {
+                if( !partitions[k].empty() )
+                    _pool->schedule(applyPartition, &partitions[k]);
+            }
+            _pool->join();
+            for( unsigned k = 0; k < partitions.size(); k++ ) {
+                partitions[k].clear();
+            }
+        }
+
+        /** apply parsed sections in journal order.  basic writes are partitioned by data file so
+            writes to one file stay in order on one worker while different files are written
+            concurrently.  a DurOp is a barrier: everything before it is written first.
+        */
+        void RecoveryJob::applySectionsParallel(const vector<ParsedSection*>& sections, unsigned n) {
+            vector<vector<PendingWrite> > partitions(n);
+            map<DurableMappedFile*, unsigned> partitionOf;
+            DurableMappedFile *lastMmf = 0;
+            unsigned partition = 0;
+            Last last;
+            for( vector<ParsedSection*>::const_iterator s = sections.begin(); s != sections.end(); ++s ) {
+                const vector<ParsedJournalEntry>& entries = (*s)->entries;
+                for( vector<ParsedJournalEntry>::const_iterator i = entries.begin(); i != entries.end(); ++i ) {
+                    const ParsedJournalEntry& entry = *i;
+                    if( entry.e ) {
+                        verify(entry.dbName);
+                        verify((size_t)strnlen(entry.dbName, MaxDatabaseNameLen) < MaxDatabaseNameLen);
+
+                        DurableMappedFile *mmf = last.newEntry(entry, *this);
+                        if( mmf != lastMmf ) {
+                            map<DurableMappedFile*, unsigned>::iterator it = partitionOf.find(mmf);
+                            if( it == partitionOf.end() ) {
+                                it = partitionOf.insert(make_pair(mmf, (unsigned) partitionOf.size() % n)).first;
+                            }
+                            partition = it->second;
+                            lastMmf = mmf;
+                        }
+
+                        if ((entry.e->ofs + entry.e->len) <= mmf->length()) {
+                            verify(mmf->view_write());
+                            verify(entry.e->srcData());
+                            char *dest = (char*)mmf->view_write() + entry.e->ofs;
+                            partitions[partition].push_back(PendingWrite(dest, entry.e->srcData(), entry.e->len));
+                            stats.curr->_writeToDataFilesBytes += entry.e->len;
+                        }
+                    }
+                    else if( entry.op ) {
+                        applyWrites(partitions);
+                        if( entry.op->needFilesClosed() ) {
+                            _close(); // locked in processSections
+                        }
+                        entry.op->replay();
+
+                        // files may have been closed or created
+                        last = Last();
+                        partitionOf.clear();
+                        lastMmf = 0;
+                    }
                 }
             }
+            applyWrites(partitions);
+        }
 
-            // got all the entries for one group commit.  apply them:
-            applyEntries(entries);
+        /** checksum, uncompress and parse a batch of sections in parallel, then apply them.
+            if a section is bad the sections before it are still applied before we throw.
+        */
+        void RecoveryJob::processSections(const vector<const JSectHeader*>& sections) {
+            if( sections.empty() )
+                return;
+
+            OwnedPointerVector<ParsedSection> parsed;
+            for( unsigned k = 0; k < sections.size(); k++ ) {
+                parsed.mutableVector().push_back(new ParsedSection(sections[k]));
+            }
+            const vector<ParsedSection*>& ps = parsed.vector();
+            if( _pool && ps.size() > 1 ) {
+                for( unsigned k = 0; k < ps.size(); k++ ) {
+                    _pool->schedule(parseSection, ps[k]);
+                }
+                _pool->join();
+            }
+            else {
+                for( unsigned k = 0; k < ps.size(); k++ ) {
+                    parseSection(ps[k]);
+                }
+            }
+
+            unsigned good = 0;
+            while( good < ps.size() && ps[good]->ok() )
+                good++;
+
+            {
+                LockMongoFilesShared lkFiles; // for RecoveryJob::Last
+                scoped_lock lk(_mx);
+                RACECHECK
+
+                bool apply = (storageGlobalParams.durOptions &
+                              StorageGlobalParams::DurScanOnly) == 0;
+                bool dump = storageGlobalParams.durOptions &
+                            StorageGlobalParams::DurDumpJournal;
+                if( _pool && apply && !dump ) {
+                    vector<ParsedSection*> toApply(ps.begin(), ps.begin() + good);
+                    applySectionsParallel(toApply, _poolThreads);
+                }
+                else {
+                    for( unsigned k = 0; k < good; k++ ) {
+                        applyEntries(ps[k]->entries);
+                    }
+                }
+            }
+
+            if( good < ps.size() ) {
+                ParsedSection *bad = ps[good];
+                if( bad->truncated )
+                    throw BufReader::eof();
+                log() << "recover error in section seq:" << bad->h->seqNumber << endl;
+                msgasserted(bad->errCode, bad->errMsg);
+            }
+        }
+
+        /** process and empty the batch */
+        void RecoveryJob::flushSections(vector<const JSectHeader*>& batch) {
+            vector<const JSectHeader*> sections;
+            sections.swap(batch);
+            processSections(sections);
         }
 
         /** apply a specific journal file, that is already mmap'd
@@ -433,6 +616,12 @@ namespace mongo {
             @return true if this is detected to be the last file (ends abruptly)
         */
         bool RecoveryJob::processFileBuffer(const void *p, unsigned len) {
+            // sections are handed to processSections() in batches so they can be uncompressed in
+            // parallel.  bounded so that we don't hold too much uncompressed data at once.
+            const unsigned maxBatchSections = _pool ? _poolThreads * 4 : 1;
+            const unsigned maxBatchBytes = 64 * 1024 * 1024;
+            vector<const JSectHeader*> batch;
+            unsigned batchBytes = 0;
             try {
                 unsigned long long fileId;
                 BufReader br(p,len);
@@ -475,22 +664,34 @@ namespace mongo {
                             log() << "Ending processFileBuffer at differing fileId want:" << fileId << " got:" << h.fileId << endl;
                             log() << "  sect len:" << h.sectionLen() << " seqnum:" << h.seqNumber << endl;
                         }
+                        flushSections(batch);
                         return true;
                     }
-                    unsigned slen = h.sectionLen();
-                    unsigned dataLen = slen - sizeof(JSectHeader) - sizeof(JSectFooter);
-                    const char *hdr = (const char *) br.skip(h.sectionLenWithPadding());
-                    const char *data = hdr + sizeof(JSectHeader);
-                    const char *footer = data + dataLen;
-                    processSection((const JSectHeader*) hdr, data, dataLen, (const JSectFooter*) footer);
-
-                    // ctrl c check
-                    killCurrentOp.checkForInterrupt(false);
+                    const JSectHeader *hdr = (const JSectHeader *) br.skip(h.sectionLenWithPadding());
+                    if( skipSection(hdr) )
+                        continue;
+                    batch.push_back(hdr);
+                    batchBytes += h.sectionLen();
+                    if( batch.size() >= maxBatchSections || batchBytes >= maxBatchBytes ) {
+                        flushSections(batch);
+                        batchBytes = 0;
+
+                        // ctrl c check
+                        killCurrentOp.checkForInterrupt(false);
+                    }
                 }
+                flushSections(batch);
             }
             catch( BufReader::eof& ) {
                 if (storageGlobalParams.durOptions & StorageGlobalParams::DurDumpJournal)
                     log() << "ABRUPT END" << endl;
+                // the sections read completely before the end are still good.  batch is empty
+                // if the eof was for a truncated section within it, those before it are applied.
+                try {
+                    flushSections(batch);
+                }
+                catch( BufReader::eof& ) {
+                }
                 return true; // abrupt end
             }
 
@@ -517,26 +718,46 @@ namespace mongo {
             return processFileBuffer(p, (unsigned) f.length());
         }
 
-        /** @param files all the j._0 style files we need to apply for recovery */
-        void RecoveryJob::go(vector<boost::filesystem::path>& files) {
-            log() << "recover begin" << endl;
-            LockMongoFilesExclusive lkFiles; // for RecoveryJob::Last
-            _recovering = true;
-
-            // load the last sequence number synced to the datafiles on disk before the last crash
-            _lastDataSyncedFromLastRun = journalReadLSN();
-            log() << "recover lsn: " << _lastDataSyncedFromLastRun << endl;
+        void RecoveryJob::applyFiles(vector<boost::filesystem::path>& files) {
+            _poolThreads = _threads ? _threads : ProcessInfo().getNumCores();
+            if( _poolThreads > 1 ) {
+                _pool.reset(new ThreadPool(_poolThreads));
+            }
+            log() << "recover using " << (_pool ? _poolThreads : 1) << " thread(s)" << endl;
 
             for( unsigned i = 0; i != files.size(); ++i ) {
                 bool abruptEnd = processFile(files[i]);
                 if( abruptEnd && i+1 < files.size() ) {
                     log() << "recover error: abrupt end to file " << files[i].string() << ", yet it isn't the last journal file" << endl;
                     close();
+                    _pool.reset();
                     uasserted(13535, "recover abrupt journal file end");
                 }
             }
 
             close();
+            _pool.reset();
+        }
+
+        void RecoveryJob::replay(vector<boost::filesystem::path>& files) {
+            LockMongoFilesExclusive lkFiles; // for RecoveryJob::Last
+            _recovering = true;
+            _lastDataSyncedFromLastRun = 0;
+            applyFiles(files);
+            _recovering = false;
+        }
+
+        /** @param files all the j._0 style files we need to apply for recovery */
+        void RecoveryJob::go(vector<boost::filesystem::path>& files) {
+            log() << "recover begin" << endl;
+            LockMongoFilesExclusive lkFiles; // for RecoveryJob::Last
+            _recovering = true;
+
+            // load the last sequence number synced to the datafiles on disk before the last crash
+            _lastDataSyncedFromLastRun = journalReadLSN();
+            log() << "recover lsn: " << _lastDataSyncedFromLastRun << endl;
+
+            applyFiles(files);
 
             if (storageGlobalParams.durOptions & StorageGlobalParams::DurScanOnly) {
                 uasserted(13545, str::stream() << "--durOptions "
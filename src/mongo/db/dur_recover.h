@@ -31,10 +31,12 @@
 #pragma once
 
 #include <boost/filesystem/operations.hpp>
+#include <boost/scoped_ptr.hpp>
 #include <list>
 
 #include "mongo/db/dur_journalformat.h"
 #include "mongo/util/concurrency/mutex.h"
+#include "mongo/util/concurrency/thread_pool.h"
 #include "mongo/util/file.h"
 
 namespace mongo {
@@ -42,6 +44,8 @@ namespace mongo {
 
     namespace dur {
         struct ParsedJournalEntry;
+        struct ParsedSection;
+        struct PendingWrite;
 
         /** call go() to execute a recovery from existing journal files.
          */
@@ -57,12 +61,25 @@ namespace mongo {
             } last;        
         public:
             RecoveryJob() : _lastDataSyncedFromLastRun(0), 
-                _mx("recovery"), _recovering(false) { _lastSeqMentionedInConsoleLog = 1; }
+                _mx("recovery"), _recovering(false), _threads(0), _poolThreads(0) { _lastSeqMentionedInConsoleLog = 1; }
             void go(vector<boost::filesystem::path>& files);
             ~RecoveryJob();
 
-            /** @param data data between header and footer. compressed if recovering. */
-            void processSection(const JSectHeader *h, const void *data, unsigned len, const JSectFooter *f);
+            /** apply the given journal files to the data files without consulting the lsn file
+                and without removing the journal files afterwards.  for testing.
+            */
+            void replay(vector<boost::filesystem::path>& files);
+
+            /** number of threads used to decompress sections and apply writes while recovering.
+                0 (the default) means one per core.
+            */
+            void setThreads(unsigned n) { _threads = n; }
+
+            /** applies a section just written to the journal, for WRITETODATAFILES.  recovery goes
+                through processSections(), which checks the footer checksum.
+                @param data uncompressed data between header and footer.
+            */
+            void processSection(const JSectHeader *h, const void *data, unsigned len);
 
             void close(); // locks and calls _close()
 
@@ -71,6 +88,12 @@ namespace mongo {
             void write(Last& last, const ParsedJournalEntry& entry); // actually writes to the file
             void applyEntry(Last& last, const ParsedJournalEntry& entry, bool apply, bool dump);
             void applyEntries(const vector<ParsedJournalEntry> &entries);
+            void applyFiles(vector<boost::filesystem::path>& files);
+            bool skipSection(const JSectHeader *h);
+            void processSections(const vector<const JSectHeader*>& sections);
+            void flushSections(vector<const JSectHeader*>& batch);
+            void applySectionsParallel(const vector<ParsedSection*>& sections, unsigned n);
+            void applyWrites(vector<vector<PendingWrite> >& partitions);
             bool processFileBuffer(const void *, unsigned len);
             bool processFile(boost::filesystem::path journalfile);
             void _close(); // doesn't lock
@@ -84,6 +107,9 @@ namespace mongo {
             mongo::mutex _mx; // protects _mmfs
         private:
             bool _recovering; // are we in recovery or WRITETODATAFILES
+            unsigned _threads;
+            unsigned _poolThreads;
+            boost::scoped_ptr<ThreadPool> _pool; // only while recovering
 
             static RecoveryJob &_instance;
         };
@@ -31,10 +31,23 @@
 namespace mongo {
     namespace dur {
 
-        /** journaling stats.  the model here is that the commit thread is the only writer, and that reads are
-            uncommon (from a serverStatus command and such).  Thus, there should not be multicore chatter overhead.
+        /** journaling stats.  the model here is that each commit stage (the commit thread, the journal writer,
+            the data files writer) is the only writer of its own fields, and that reads are uncommon (from a
+            serverStatus command and such).  Thus, there should not be multicore chatter overhead.
         */
         struct Stats {
+            /** counts of a commit stage's latencies in power of 2 millisecond buckets: the first
+                counts < 1ms, the next < 2ms, and so on; the last counts everything slower.
+                plain old data, so that S::reset() can zero it.
+            */
+            struct LatencyHistogram {
+                enum { Buckets = 12 };
+                unsigned _counts[Buckets];
+
+                void insert(unsigned long long micros);
+                BSONObj asObj() const;
+            };
+
             Stats();
             void rotate();
             BSONObj asObj();
@@ -56,6 +69,13 @@ namespace mongo {
                 unsigned long long _writeToDataFilesMicros;
                 unsigned long long _remapPrivateViewMicros;
 
+                LatencyHistogram _prepLogBufferLatency;
+                LatencyHistogram _writeToJournalLatency;
+                LatencyHistogram _writeToDataFilesLatency;
+                // from the start of PREPLOGBUFFER until the commit is in the journal, which is
+                // how long getlasterror j:true waits at most (beyond the commit interval)
+                LatencyHistogram _commitLatency;
+
                 // undesirable to be in write lock for the group commit (it can be done in a read lock), so good if we
                 // have visibility when this happens.  can happen for a couple reasons
                 // - read lock starvation
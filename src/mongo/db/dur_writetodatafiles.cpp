@@ -46,7 +46,7 @@ namespace mongo {
 
         static void WRITETODATAFILES_Impl1(const JSectHeader& h, AlignedBuilder& uncompressed) {
             LOG(3) << "journal WRITETODATAFILES 1" << endl;
-            RecoveryJob::get().processSection(&h, uncompressed.buf(), uncompressed.len(), 0);
+            RecoveryJob::get().processSection(&h, uncompressed.buf(), uncompressed.len());
             LOG(3) << "journal WRITETODATAFILES 2" << endl;
         }
 
@@ -106,6 +106,7 @@ namespace mongo {
             WRITETODATAFILES_Impl1(h, uncompressed);
             unsigned long long m = t.micros();
             stats.curr->_writeToDataFilesMicros += m;
+            stats.curr->_writeToDataFilesLatency.insert(m);
             LOG(2) << "journal WRITETODATAFILES " << m / 1000.0 << "ms" << endl;
         }
 
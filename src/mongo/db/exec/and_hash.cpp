@@ -31,12 +31,103 @@
 #include "mongo/db/exec/and_common-inl.h"
 #include "mongo/db/exec/filter.h"
 #include "mongo/db/exec/working_set_common.h"
+#include "mongo/db/storage_options.h"
+
+namespace {
+
+    using namespace mongo;
+
+    class DiskLocComparator {
+    public:
+        int operator()(const AndHashStage::SpillSorter::Data& lhs,
+                       const AndHashStage::SpillSorter::Data& rhs) const {
+            return lhs.first.compare(rhs.first);
+        }
+    };
+
+    SortOptions spillOptions(size_t maxMemUsage) {
+        return SortOptions().TempDir(storageGlobalParams.dbpath + "/_tmp")
+                            .ExtSortAllowed()
+                            .MaxMemoryUsageBytes(maxMemUsage);
+    }
+
+    // Only index key data survives a trip through a sorted run.
+    bool canSpill(const WorkingSetMember& member) {
+        return WorkingSetMember::LOC_AND_IDX == member.state
+               && !member.hasComputed(WSM_COMPUTED_TEXT_SCORE)
+               && !member.hasComputed(WSM_COMPUTED_GEO_DISTANCE);
+    }
+
+    size_t memberBytes(const WorkingSetMember& member) {
+        size_t bytes = sizeof(WorkingSetMember);
+        for (size_t i = 0; i < member.keyData.size(); ++i) {
+            bytes += sizeof(IndexKeyDatum) + member.keyData[i].keyData.objsize();
+        }
+        if (member.hasObj()) {
+            bytes += member.obj.objsize();
+        }
+        return bytes;
+    }
+
+    /**
+     * The key data of a member as stored in a sorted run: [{p: keyPattern, d: key}, ...]
+     */
+    BSONObj keyDataToBSON(const WorkingSetMember& member) {
+        BSONArrayBuilder bab;
+        for (size_t i = 0; i < member.keyData.size(); ++i) {
+            bab.append(BSON("p" << member.keyData[i].indexKeyPattern
+                            << "d" << member.keyData[i].keyData));
+        }
+        return bab.arr();
+    }
+
+    /**
+     * Adds the key data in 'src' for key patterns 'dest' doesn't have, like AndCommon::mergeFrom.
+     */
+    BSONObj mergeKeyData(const BSONObj& dest, const BSONObj& src) {
+        BSONArrayBuilder bab;
+        BSONObjIterator destIt(dest);
+        while (destIt.more()) {
+            bab.append(destIt.next());
+        }
+
+        BSONObjIterator srcIt(src);
+        while (srcIt.more()) {
+            BSONElement datum = srcIt.next();
+            BSONObj keyPattern = datum.Obj()["p"].Obj();
+
+            bool found = false;
+            BSONObjIterator it(dest);
+            while (it.more()) {
+                if (keyPattern == it.next().Obj()["p"].Obj()) {
+                    found = true;
+                    break;
+                }
+            }
+            if (!found) { bab.append(datum); }
+        }
+        return bab.arr();
+    }
+
+}  // namespace
 
 namespace mongo {
 
+    const size_t AndHashStage::kDefaultMaxMemUsage = 32 * 1024 * 1024;
+
     AndHashStage::AndHashStage(WorkingSet* ws, const MatchExpression* filter)
-        : _ws(ws), _filter(filter), _resultIterator(_dataMap.end()),
-          _shouldScanChildren(true), _currentChild(0) {}
+        : _ws(ws), _filter(filter), _wsmBytes(0), _maxMemUsage(kDefaultMaxMemUsage),
+          _resultSlot(0), _shouldScanChildren(true), _currentChild(0), _spilled(false),
+          _spilledCount(0), _haveLeft(false), _haveRight(false), _mergedCount(0) {
+        _specificStats.memLimit = _maxMemUsage;
+    }
+
+    AndHashStage::AndHashStage(WorkingSet* ws, const MatchExpression* filter, size_t maxMemUsage)
+        : _ws(ws), _filter(filter), _wsmBytes(0), _maxMemUsage(maxMemUsage),
+          _resultSlot(0), _shouldScanChildren(true), _currentChild(0), _spilled(false),
+          _spilledCount(0), _haveLeft(false), _haveRight(false), _mergedCount(0) {
+        _specificStats.memLimit = _maxMemUsage;
+    }
 
     AndHashStage::~AndHashStage() {
         for (size_t i = 0; i < _children.size(); ++i) { delete _children[i]; }
@@ -44,9 +135,24 @@ namespace mongo {
 
     void AndHashStage::addChild(PlanStage* child) { _children.push_back(child); }
 
+    size_t AndHashStage::memUsage() const {
+        return _table.memUsage() + _bloom.memUsage() + _wsmBytes;
+    }
+
     bool AndHashStage::isEOF() {
         if (_shouldScanChildren) { return false; }
-        return _dataMap.end() == _resultIterator;
+
+        if (_spilled) {
+            return NULL == _intersection.get() || !_intersection->more();
+        }
+
+        // Skip over slots with nothing to return so this is exact.
+        while (_resultSlot < _table.capacity()) {
+            AndHashTable::Entry& e = _table.slot(_resultSlot);
+            if (!e.loc.isNull() && WorkingSet::INVALID_ID != e.id) { return false; }
+            ++_resultSlot;
+        }
+        return true;
     }
 
     PlanStage::StageState AndHashStage::work(WorkingSetID* out) {
@@ -55,7 +161,18 @@ namespace mongo {
         if (isEOF()) { return PlanStage::IS_EOF; }
 
         // An AND is either reading the first child into the hash table, probing against the hash
-        // table with subsequent children, or returning results.
+        // table with subsequent children, or returning results.  Once spilled, it reads each child
+        // into a Sorter and merges it with the intersection so far instead.
+
+        if (_spilled) {
+            if (NULL != _mergeOut.get()) {
+                return mergeStep();
+            }
+            if (_shouldScanChildren) {
+                return readChildToSorter(out);
+            }
+            return returnFromRun(out);
+        }
 
         // We read the first child into our hash table.
         if (_shouldScanChildren && (0 == _currentChild)) {
@@ -68,14 +185,17 @@ namespace mongo {
         }
 
         // Returning results.
-        verify(!_shouldScanChildren);
+        return returnFromTable(out);
+    }
 
-        // Keep the thing we're returning so we can remove it from our internal map later.
-        DataMap::iterator returnedIt = _resultIterator;
-        ++_resultIterator;
+    PlanStage::StageState AndHashStage::returnFromTable(WorkingSetID* out) {
+        verify(!_shouldScanChildren);
 
-        WorkingSetID idToReturn = returnedIt->second;
-        _dataMap.erase(returnedIt);
+        // isEOF() left _resultSlot at the next entry to return.  We don't erase it as that would
+        // move entries around under _resultSlot.
+        AndHashTable::Entry& e = _table.slot(_resultSlot++);
+        WorkingSetID idToReturn = e.id;
+        e.id = WorkingSet::INVALID_ID;
         WorkingSetMember* member = _ws->get(idToReturn);
 
         // We should check for matching at the end so the matcher can use information in the
@@ -103,9 +223,21 @@ namespace mongo {
             WorkingSetMember* member = _ws->get(id);
 
             verify(member->hasLoc());
-            verify(_dataMap.end() == _dataMap.find(member->loc));
+            verify(NULL == _table.find(member->loc));
+
+            _table.insert(member->loc, id, 0);
+            _wsmBytes += memberBytes(*member);
+
+            size_t bytes = memUsage();
+            if (bytes > _specificStats.memUsage) {
+                _specificStats.memUsage = bytes;
+            }
+            if (bytes > _maxMemUsage && !spill()) {
+                warning() << "AND hash stage exceeded " << _maxMemUsage << " bytes with data that"
+                          << " can't be spilled" << endl;
+                return PlanStage::FAILURE;
+            }
 
-            _dataMap[member->loc] = id;
             ++_commonStats.needTime;
             return PlanStage::NEED_TIME;
         }
@@ -114,13 +246,19 @@ namespace mongo {
             _currentChild = 1;
 
             // If our first child was empty, don't scan any others, no possible results.
-            if (_dataMap.empty()) {
+            if (0 == _table.size()) {
                 _shouldScanChildren = false;
                 return PlanStage::IS_EOF;
             }
 
+            // Later children check the Bloom filter before probing the table.
+            _bloom.init(_table.size());
+            for (size_t i = 0; i < _table.capacity(); ++i) {
+                if (!_table.slot(i).loc.isNull()) { _bloom.add(_table.slot(i).loc); }
+            }
+
             ++_commonStats.needTime;
-            _specificStats.mapAfterChild.push_back(_dataMap.size());
+            _specificStats.mapAfterChild.push_back(_table.size());
 
             return PlanStage::NEED_TIME;
         }
@@ -146,13 +284,16 @@ namespace mongo {
         if (PlanStage::ADVANCED == childStatus) {
             WorkingSetMember* member = _ws->get(id);
             verify(member->hasLoc());
-            if (_dataMap.end() == _dataMap.find(member->loc)) {
-                // Ignore.  It's not in any previous child.
+
+            AndHashTable::Entry* e = NULL;
+            if (!_bloom.mayContain(member->loc)) {
+                // Not in the first child, so not in any previous child.
+                ++_specificStats.bloomRejected;
             }
-            else {
+            else if (NULL != (e = _table.find(member->loc))) {
                 // We have a hit.  Copy data into the WSM we already have.
-                _seenMap.insert(member->loc);
-                WorkingSetMember* olderMember = _ws->get(_dataMap[member->loc]);
+                e->lastChild = _currentChild;
+                WorkingSetMember* olderMember = _ws->get(e->id);
                 AndCommon::mergeFrom(olderMember, member);
             }
             _ws->free(id);
@@ -160,29 +301,23 @@ namespace mongo {
             return PlanStage::NEED_TIME;
         }
         else if (PlanStage::IS_EOF == childStatus) {
-            // Finished with a child.
-            ++_currentChild;
-
-            // Keep elements of _dataMap that are in _seenMap.
-            DataMap::iterator it = _dataMap.begin();
-            while (it != _dataMap.end()) {
-                if (_seenMap.end() == _seenMap.find(it->first)) {
-                    DataMap::iterator toErase = it;
-                    ++it;
-                    _ws->free(toErase->second);
-                    _dataMap.erase(toErase);
-                }
-                else { ++it; }
+            // Keep the entries this child produced.
+            vector<WorkingSetID> dropped;
+            _table.retainChild(_currentChild, &dropped);
+            for (size_t i = 0; i < dropped.size(); ++i) {
+                _wsmBytes -= std::min(_wsmBytes, memberBytes(*_ws->get(dropped[i])));
+                _ws->free(dropped[i]);
             }
 
-            _specificStats.mapAfterChild.push_back(_dataMap.size());
+            // Finished with a child.
+            ++_currentChild;
 
-            _seenMap.clear();
+            _specificStats.mapAfterChild.push_back(_table.size());
 
-            // _dataMap is now the intersection of the first _currentChild nodes.
+            // _table is now the intersection of the first _currentChild nodes.
 
             // If we have nothing to AND with after finishing any child, stop.
-            if (_dataMap.empty()) {
+            if (0 == _table.size()) {
                 _shouldScanChildren = false;
                 return PlanStage::IS_EOF;
             }
@@ -190,9 +325,114 @@ namespace mongo {
             // We've finished scanning all children.  Return results with the next call to work().
             if (_currentChild == _children.size()) {
                 _shouldScanChildren = false;
-                _resultIterator = _dataMap.begin();
+                _resultSlot = 0;
+            }
+
+            ++_commonStats.needTime;
+            return PlanStage::NEED_TIME;
+        }
+        else {
+            if (PlanStage::NEED_FETCH == childStatus) {
+                *out = id;
+                ++_commonStats.needFetch;
+            }
+            else if (PlanStage::NEED_TIME == childStatus) {
+                ++_commonStats.needTime;
+            }
+
+            return childStatus;
+        }
+    }
+
+    void AndHashStage::startChildSorter() {
+        // The Bloom filter stays in memory next to the sorter.
+        size_t sorterBytes = _maxMemUsage > _bloom.memUsage() ? _maxMemUsage - _bloom.memUsage()
+                                                              : _maxMemUsage / 2;
+        _childSorter.reset(SpillSorter::make(spillOptions(sorterBytes), DiskLocComparator()));
+    }
+
+    bool AndHashStage::spill() {
+        verify(0 == _currentChild);
+
+        for (size_t i = 0; i < _table.capacity(); ++i) {
+            AndHashTable::Entry& e = _table.slot(i);
+            if (!e.loc.isNull() && !canSpill(*_ws->get(e.id))) { return false; }
+        }
+
+        LOG(1) << "AND hash stage using more than " << _maxMemUsage << " bytes, spilling" << endl;
+        _spilled = true;
+        _specificStats.spilled = true;
+
+        // Size the Bloom filter for more than the first child has produced so far, as it goes on.
+        _bloom.init(std::max(_table.size() * 4, _maxMemUsage / 64));
+        startChildSorter();
+
+        for (size_t i = 0; i < _table.capacity(); ++i) {
+            AndHashTable::Entry& e = _table.slot(i);
+            if (e.loc.isNull()) { continue; }
+            _bloom.add(e.loc);
+            spillResult(e.id);
+        }
+        _table.clear();
+        _wsmBytes = 0;
+        return true;
+    }
+
+    bool AndHashStage::spillResult(WorkingSetID id) {
+        WorkingSetMember* member = _ws->get(id);
+        if (!canSpill(*member)) { return false; }
+
+        _childSorter->add(member->loc, keyDataToBSON(*member));
+        _ws->free(id);
+        ++_spilledCount;
+        return true;
+    }
+
+    PlanStage::StageState AndHashStage::readChildToSorter(WorkingSetID* out) {
+        WorkingSetID id;
+        StageState childStatus = _children[_currentChild]->work(&id);
+
+        if (PlanStage::ADVANCED == childStatus) {
+            WorkingSetMember* member = _ws->get(id);
+            verify(member->hasLoc());
+
+            if (0 == _currentChild) {
+                _bloom.add(member->loc);
+            }
+            else if (!_bloom.mayContain(member->loc)) {
+                ++_specificStats.bloomRejected;
+                _ws->free(id);
+                ++_commonStats.needTime;
+                return PlanStage::NEED_TIME;
             }
 
+            if (!spillResult(id)) {
+                warning() << "AND hash stage spilled and got data that can't be spilled" << endl;
+                return PlanStage::FAILURE;
+            }
+            ++_commonStats.needTime;
+            return PlanStage::NEED_TIME;
+        }
+        else if (PlanStage::IS_EOF == childStatus) {
+            if (0 == _currentChild) {
+                // The first child's run is the intersection so far.
+                _intersection.reset(_childSorter->done());
+                _childSorter.reset();
+                _specificStats.mapAfterChild.push_back(_spilledCount);
+                _currentChild = 1;
+                startChildSorter();
+            }
+            else {
+                // Merge this child's run with the intersection so far, a step per work().
+                _childRun.reset(_childSorter->done());
+                _childSorter.reset();
+                _mergeOut.reset(new SortedFileWriter<DiskLoc, BSONObj>(spillOptions(_maxMemUsage)));
+                _mergedCount = 0;
+                _haveLeft = _intersection->more();
+                if (_haveLeft) { _left = _intersection->next(); }
+                _haveRight = _childRun->more();
+                if (_haveRight) { _right = _childRun->next(); }
+            }
             ++_commonStats.needTime;
             return PlanStage::NEED_TIME;
         }
@@ -209,6 +449,91 @@ namespace mongo {
         }
     }
 
+    PlanStage::StageState AndHashStage::mergeStep() {
+        if (_haveLeft && _haveRight) {
+            int cmp = _left.first.compare(_right.first);
+            if (0 == cmp) {
+                // In both.  Children may produce a DiskLoc more than once; keep one.
+                if (0 == _mergedCount || _lastMerged != _left.first) {
+                    _mergeOut->addAlreadySorted(_left.first,
+                                                mergeKeyData(_left.second, _right.second));
+                    _lastMerged = _left.first;
+                    ++_mergedCount;
+                }
+                _haveLeft = _intersection->more();
+                if (_haveLeft) { _left = _intersection->next(); }
+                _haveRight = _childRun->more();
+                if (_haveRight) { _right = _childRun->next(); }
+            }
+            else if (cmp < 0) {
+                _haveLeft = _intersection->more();
+                if (_haveLeft) { _left = _intersection->next(); }
+            }
+            else {
+                _haveRight = _childRun->more();
+                if (_haveRight) { _right = _childRun->next(); }
+            }
+            ++_commonStats.needTime;
+            return PlanStage::NEED_TIME;
+        }
+
+        // One side ran out, so nothing else is in the intersection.
+        _intersection.reset(_mergeOut->done());
+        _mergeOut.reset();
+        _childRun.reset();
+        _specificStats.mapAfterChild.push_back(_mergedCount);
+        ++_currentChild;
+
+        if (0 == _mergedCount) {
+            _shouldScanChildren = false;
+            _intersection.reset();
+            return PlanStage::IS_EOF;
+        }
+
+        if (_currentChild == _children.size()) {
+            _shouldScanChildren = false;
+        }
+        else {
+            _spilledCount = 0;
+            startChildSorter();
+        }
+        ++_commonStats.needTime;
+        return PlanStage::NEED_TIME;
+    }
+
+    PlanStage::StageState AndHashStage::returnFromRun(WorkingSetID* out) {
+        SpillIterator::Data next = _intersection->next();
+
+        // We can't flag what's only in a sorted run, so an invalidated DiskLoc is just dropped.
+        if (_spilledInvalidated.end() != _spilledInvalidated.find(next.first)) {
+            ++_specificStats.flaggedButPassed;
+            ++_commonStats.needTime;
+            return PlanStage::NEED_TIME;
+        }
+
+        WorkingSetID id = _ws->allocate();
+        WorkingSetMember* member = _ws->get(id);
+        member->loc = next.first;
+        BSONObjIterator it(next.second);
+        while (it.more()) {
+            BSONObj datum = it.next().Obj();
+            member->keyData.push_back(IndexKeyDatum(datum["p"].Obj().getOwned(),
+                                                    datum["d"].Obj().getOwned()));
+        }
+        member->state = WorkingSetMember::LOC_AND_IDX;
+
+        if (Filter::passes(member, _filter)) {
+            *out = id;
+            ++_commonStats.advanced;
+            return PlanStage::ADVANCED;
+        }
+        else {
+            _ws->free(id);
+            ++_commonStats.needTime;
+            return PlanStage::NEED_TIME;
+        }
+    }
+
     void AndHashStage::prepareToYield() {
         ++_commonStats.yields;
 
@@ -234,34 +559,38 @@ namespace mongo {
             _children[i]->invalidate(dl);
         }
 
-        _seenMap.erase(dl);
-
-        // If we're pointing at the DiskLoc, move past it.  It will be deleted.
-        if (_dataMap.end() != _resultIterator && (_resultIterator->first == dl)) {
-            ++_resultIterator;
+        if (_spilled) {
+            _spilledInvalidated.insert(dl);
+            return;
         }
 
-        DataMap::iterator it = _dataMap.find(dl);
-        if (_dataMap.end() != it) {
-            WorkingSetID id = it->second;
-            WorkingSetMember* member = _ws->get(id);
-            verify(member->loc == dl);
+        AndHashTable::Entry* e = _table.find(dl);
+        if (NULL == e || WorkingSet::INVALID_ID == e->id) { return; }
 
-            if (_shouldScanChildren) {
-                ++_specificStats.flaggedInProgress;
-            }
-            else {
-                ++_specificStats.flaggedButPassed;
-            }
+        WorkingSetID id = e->id;
+        WorkingSetMember* member = _ws->get(id);
+        verify(member->loc == dl);
 
-            // The loc is about to be invalidated.  Fetch it and clear the loc.
-            WorkingSetCommon::fetchAndInvalidateLoc(member);
+        if (_shouldScanChildren) {
+            ++_specificStats.flaggedInProgress;
+        }
+        else {
+            ++_specificStats.flaggedButPassed;
+        }
+
+        // The loc is about to be invalidated.  Fetch it and clear the loc.
+        WorkingSetCommon::fetchAndInvalidateLoc(member);
 
-            // Add the WSID to the to-be-reviewed list in the WS.
-            _ws->flagForReview(id);
+        // Add the WSID to the to-be-reviewed list in the WS.
+        _ws->flagForReview(id);
 
-            // And don't return it.
-            _dataMap.erase(it);
+        // And don't return it.  While returning results we leave the slot in place so that
+        // _resultSlot stays valid.
+        if (_shouldScanChildren) {
+            _table.erase(e);
+        }
+        else {
+            e->id = WorkingSet::INVALID_ID;
         }
     }
 
@@ -278,3 +607,6 @@ namespace mongo {
     }
 
 }  // namespace mongo
+
+#include "mongo/db/sorter/sorter.cpp"
+MONGO_CREATE_SORTER(mongo::DiskLoc, mongo::BSONObj, DiskLocComparator);
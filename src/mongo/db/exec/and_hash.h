@@ -29,12 +29,15 @@
 #pragma once
 
 #include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
 #include <vector>
 
 #include "mongo/db/diskloc.h"
 #include "mongo/db/jsobj.h"
+#include "mongo/db/exec/and_hash_table.h"
 #include "mongo/db/exec/plan_stage.h"
 #include "mongo/db/matcher/expression.h"
+#include "mongo/db/sorter/sorter.h"
 #include "mongo/platform/unordered_set.h"
 
 namespace mongo {
@@ -49,10 +52,16 @@ namespace mongo {
      * is fetched and added to the WorkingSet as "flagged for further review."  Because this stage
      * operates with DiskLocs, we are unable to evaluate the AND for the invalidated DiskLoc, and it
      * must be fully matched later.
+     *
+     * The hash table and the WSMs it holds are limited to a number of bytes.  If the first child
+     * produces more than that, everything is spilled to a Sorter and the AND becomes a merge of
+     * sorted runs of DiskLocs, one per child.  Only DiskLocs with index key data can be spilled;
+     * if there is anything else the stage fails, like SortStage does.
      */
     class AndHashStage : public PlanStage {
     public:
         AndHashStage(WorkingSet* ws, const MatchExpression* filter);
+        AndHashStage(WorkingSet* ws, const MatchExpression* filter, size_t maxMemUsage);
         virtual ~AndHashStage();
 
         void addChild(PlanStage* child);
@@ -66,9 +75,41 @@ namespace mongo {
 
         virtual PlanStageStats* getStats();
 
+        // Default limit on the memory used by the hash table and the WSMs in it.
+        static const size_t kDefaultMaxMemUsage;
+
+        typedef Sorter<DiskLoc, BSONObj> SpillSorter;
+        typedef SortIteratorInterface<DiskLoc, BSONObj> SpillIterator;
+
     private:
         StageState readFirstChild(WorkingSetID* out);
         StageState hashOtherChildren(WorkingSetID* out);
+        StageState returnFromTable(WorkingSetID* out);
+
+        //
+        // Spilling.
+        //
+
+        /**
+         * Moves everything in the hash table to a Sorter.  Returns false if something in the table
+         * can't be spilled.
+         */
+        bool spill();
+
+        /**
+         * Adds the result 'id' of the current child to _childSorter and frees it.  Returns false
+         * if it can't be spilled.
+         */
+        bool spillResult(WorkingSetID id);
+
+        StageState readChildToSorter(WorkingSetID* out);
+        StageState mergeStep();
+        StageState returnFromRun(WorkingSetID* out);
+
+        void startChildSorter();
+
+        // Memory used by the hash table, the Bloom filter and the WSMs in the table.
+        size_t memUsage() const;
 
         // Not owned by us.
         WorkingSet* _ws;
@@ -79,16 +120,21 @@ namespace mongo {
         // The stages we read from.  Owned by us.
         vector<PlanStage*> _children;
 
-        // _dataMap is filled out by the first child and probed by subsequent children.
-        typedef unordered_map<DiskLoc, WorkingSetID, DiskLoc::Hasher> DataMap;
-        DataMap _dataMap;
+        // Filled out by the first child and probed by subsequent children.  Entries that are not
+        // produced by a child are dropped when the child is done.
+        AndHashTable _table;
 
-        // Keeps track of what elements from _dataMap subsequent children have seen.
-        typedef unordered_set<DiskLoc, DiskLoc::Hasher> SeenMap;
-        SeenMap _seenMap;
+        // The DiskLocs of the first child.  Probed before _table, or before spilling the result
+        // of a later child.
+        DiskLocBloomFilter _bloom;
 
-        // Iterator over the members of _dataMap that survive.
-        DataMap::iterator _resultIterator;
+        // Bytes of the WSMs in _table, as of when they were added.
+        size_t _wsmBytes;
+
+        size_t _maxMemUsage;
+
+        // Next slot of _table to return.
+        size_t _resultSlot;
 
         // True if we're still scanning _children for results.
         bool _shouldScanChildren;
@@ -96,6 +142,33 @@ namespace mongo {
         // Which child are we currently working on?
         size_t _currentChild;
 
+        //
+        // Spilled state.  Everything from the first child onward is in sorted runs keyed by
+        // DiskLoc, with the index key data of the WSM as the value.
+        //
+
+        bool _spilled;
+
+        // How many results of the child we're reading went to _childSorter.
+        size_t _spilledCount;
+
+        // The output of the child we're reading.
+        boost::scoped_ptr<SpillSorter> _childSorter;
+
+        // The intersection of the children read so far.
+        boost::scoped_ptr<SpillIterator> _intersection;
+
+        // Merging _intersection with the sorted output of the last child into _mergeOut.
+        boost::scoped_ptr<SpillIterator> _childRun;
+        boost::scoped_ptr<SortedFileWriter<DiskLoc, BSONObj> > _mergeOut;
+        bool _haveLeft, _haveRight;
+        std::pair<DiskLoc, BSONObj> _left, _right;
+        size_t _mergedCount;
+        DiskLoc _lastMerged;
+
+        // DiskLocs invalidated since we spilled.  They may be in a run and are never returned.
+        unordered_set<DiskLoc, DiskLoc::Hasher> _spilledInvalidated;
+
         // Stats
         CommonStats _commonStats;
         AndHashStats _specificStats;
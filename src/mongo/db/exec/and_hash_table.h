@@ -0,0 +1,259 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <vector>
+
+#include "mongo/db/diskloc.h"
+#include "mongo/db/exec/working_set.h"
+#include "mongo/platform/cstdint.h"
+
+namespace mongo {
+
+    /**
+     * Mixes the bits of a DiskLoc into a 64 bit hash.  Every bit of the result depends on every
+     * bit of the DiskLoc, so the table and the Bloom filter can each use different bits of it.
+     */
+    inline uint64_t hashDiskLoc(const DiskLoc& loc) {
+        uint64_t h = (static_cast<uint64_t>(static_cast<uint32_t>(loc.a())) << 32)
+                     | static_cast<uint32_t>(loc.getOfs());
+        h ^= h >> 33;
+        h *= 0xff51afd7ed558ccdULL;
+        h ^= h >> 33;
+        h *= 0xc4ceb9fe1a85ec53ULL;
+        h ^= h >> 33;
+        return h;
+    }
+
+    /**
+     * An open addressing hash table from DiskLoc to the WSID of the WorkingSetMember for it.  Used
+     * by AndHashStage in place of an unordered_map: the entries are in one array, so a probe is
+     * usually one cache miss, and there's no allocation per entry.
+     *
+     * Each entry remembers the last child of the AND that produced it, which replaces a separate
+     * set of the DiskLocs seen by the child being intersected.
+     *
+     * Linear probing.  Deletion shifts later entries of the probe sequence back, so there are no
+     * tombstones.
+     */
+    class AndHashTable {
+    public:
+        struct Entry {
+            // Null if the slot is empty.
+            DiskLoc loc;
+
+            // The last child of the AND that produced loc.
+            uint32_t lastChild;
+
+            WorkingSetID id;
+        };
+
+        AndHashTable() : _size(0) {
+            reset(kMinCapacity);
+        }
+
+        size_t size() const { return _size; }
+
+        /**
+         * Slots, for iterating over the entries.  Empty slots have a null loc.
+         */
+        size_t capacity() const { return _entries.size(); }
+        Entry& slot(size_t i) { return _entries[i]; }
+
+        size_t memUsage() const { return _entries.capacity() * sizeof(Entry); }
+
+        /**
+         * Returns the entry for 'loc', or NULL if there isn't one.
+         */
+        Entry* find(const DiskLoc& loc) {
+            for (size_t i = home(loc); ; i = (i + 1) & _mask) {
+                Entry& e = _entries[i];
+                if (e.loc == loc) { return &e; }
+                if (e.loc.isNull()) { return NULL; }
+            }
+        }
+
+        /**
+         * 'loc' must not be in the table.
+         */
+        void insert(const DiskLoc& loc, WorkingSetID id, uint32_t child) {
+            // Keep the load factor under 1/2 so that probe sequences stay short.
+            if ((_size + 1) * 2 > _entries.size()) {
+                rehash(_entries.size() * 2);
+            }
+
+            size_t i = home(loc);
+            while (!_entries[i].loc.isNull()) { i = (i + 1) & _mask; }
+            _entries[i].loc = loc;
+            _entries[i].lastChild = child;
+            _entries[i].id = id;
+            ++_size;
+        }
+
+        /**
+         * Removes 'e', which must have come from find(...).  Invalidates other Entry pointers.
+         */
+        void erase(Entry* e) {
+            size_t hole = e - &_entries[0];
+            size_t i = hole;
+            for (;;) {
+                i = (i + 1) & _mask;
+                if (_entries[i].loc.isNull()) { break; }
+
+                // An entry can move back into the hole if the hole is between its home slot and
+                // where it is now.
+                size_t h = home(_entries[i].loc);
+                bool canMove = (hole <= i) ? (h <= hole || h > i) : (h <= hole && h > i);
+                if (canMove) {
+                    _entries[hole] = _entries[i];
+                    hole = i;
+                }
+            }
+            _entries[hole].loc = DiskLoc();
+            --_size;
+        }
+
+        /**
+         * Keeps only the entries last produced by 'child', returning the WSIDs of the others in
+         * 'dropped'.  Shrinks the table to fit what's left.
+         */
+        void retainChild(uint32_t child, std::vector<WorkingSetID>* dropped) {
+            std::vector<Entry> old;
+            old.swap(_entries);
+
+            size_t kept = 0;
+            for (size_t i = 0; i < old.size(); ++i) {
+                if (old[i].loc.isNull()) { continue; }
+                if (old[i].lastChild == child) { ++kept; }
+                else { dropped->push_back(old[i].id); }
+            }
+
+            size_t capacity = kMinCapacity;
+            while (capacity < kept * 2) { capacity *= 2; }
+            reset(capacity);
+
+            for (size_t i = 0; i < old.size(); ++i) {
+                if (!old[i].loc.isNull() && old[i].lastChild == child) {
+                    insert(old[i].loc, old[i].id, old[i].lastChild);
+                }
+            }
+        }
+
+        /**
+         * Empties the table and releases its memory.
+         */
+        void clear() {
+            std::vector<Entry> empty;
+            _entries.swap(empty);
+            reset(kMinCapacity);
+        }
+
+    private:
+        static const size_t kMinCapacity = 16;
+
+        size_t home(const DiskLoc& loc) const {
+            return static_cast<size_t>(hashDiskLoc(loc) >> 32) & _mask;
+        }
+
+        void reset(size_t capacity) {
+            Entry empty;
+            empty.lastChild = 0;
+            empty.id = WorkingSet::INVALID_ID;
+            _entries.assign(capacity, empty);
+            _mask = capacity - 1;
+            _size = 0;
+        }
+
+        void rehash(size_t capacity) {
+            std::vector<Entry> old;
+            old.swap(_entries);
+            reset(capacity);
+            for (size_t i = 0; i < old.size(); ++i) {
+                if (!old[i].loc.isNull()) {
+                    insert(old[i].loc, old[i].id, old[i].lastChild);
+                }
+            }
+        }
+
+        std::vector<Entry> _entries;
+        size_t _mask;
+        size_t _size;
+    };
+
+    /**
+     * A blocked Bloom filter of DiskLocs: the bits for a DiskLoc all live in one 64 bit word, so a
+     * lookup touches one cache line.  With about 10 bits per DiskLoc it rejects all but a few
+     * percent of the DiskLocs that were never added.
+     */
+    class DiskLocBloomFilter {
+    public:
+        DiskLocBloomFilter() : _mask(0) { }
+
+        /**
+         * Sizes the filter for 'n' DiskLocs and empties it.
+         */
+        void init(size_t n) {
+            size_t words = 1;
+            while (words * 64 < n * 10) { words *= 2; }
+            _words.assign(words, 0);
+            _mask = words - 1;
+        }
+
+        bool isInitialized() const { return !_words.empty(); }
+
+        size_t memUsage() const { return _words.capacity() * sizeof(uint64_t); }
+
+        void add(const DiskLoc& loc) {
+            uint64_t h = hashDiskLoc(loc);
+            _words[h & _mask] |= bits(h);
+        }
+
+        /**
+         * False if 'loc' was definitely never added.  True if the filter isn't initialized.
+         */
+        bool mayContain(const DiskLoc& loc) const {
+            if (_words.empty()) { return true; }
+            uint64_t h = hashDiskLoc(loc);
+            uint64_t b = bits(h);
+            return (_words[h & _mask] & b) == b;
+        }
+
+    private:
+        // Four bits of the word, picked with the high bits of the hash.  The low bits pick the
+        // word.
+        static uint64_t bits(uint64_t h) {
+            return (1ULL << ((h >> 40) & 63)) | (1ULL << ((h >> 46) & 63))
+                   | (1ULL << ((h >> 52) & 63)) | (1ULL << ((h >> 58) & 63));
+        }
+
+        std::vector<uint64_t> _words;
+        size_t _mask;
+    };
+
+}  // namespace mongo
@@ -0,0 +1,143 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+/**
+ * This file contains tests for mongo/db/exec/and_hash_table.h
+ */
+
+#include <map>
+
+#include "mongo/db/exec/and_hash_table.h"
+#include "mongo/unittest/unittest.h"
+
+using namespace mongo;
+
+namespace {
+
+    DiskLoc nthLoc(int i) {
+        return DiskLoc(i % 7, (i / 7) * 16);
+    }
+
+    /**
+     * Checks every DiskLoc in 'expected' is in 'table' with the right WSID, and nothing else is.
+     */
+    void assertSame(const std::map<int, WorkingSetID>& expected, AndHashTable* table, int maxLoc) {
+        ASSERT_EQUALS(expected.size(), table->size());
+        for (int i = 0; i < maxLoc; ++i) {
+            AndHashTable::Entry* e = table->find(nthLoc(i));
+            std::map<int, WorkingSetID>::const_iterator it = expected.find(i);
+            if (expected.end() == it) {
+                ASSERT(NULL == e);
+            }
+            else {
+                ASSERT(NULL != e);
+                ASSERT_EQUALS(it->second, e->id);
+            }
+        }
+    }
+
+    TEST(AndHashTableTest, InsertFindErase) {
+        AndHashTable table;
+        std::map<int, WorkingSetID> expected;
+        const int n = 5000;
+
+        for (int i = 0; i < n; ++i) {
+            table.insert(nthLoc(i), i + 1, 0);
+            expected[i] = i + 1;
+        }
+        assertSame(expected, &table, n * 2);
+
+        // Erasing shifts entries back along their probe sequences; everything else must still be
+        // found.
+        unsigned rand = 1;
+        for (int i = 0; i < n / 2; ++i) {
+            rand = rand * 1103515245 + 12345;
+            int victim = (rand >> 8) % n;
+            AndHashTable::Entry* e = table.find(nthLoc(victim));
+            if (expected.count(victim)) {
+                ASSERT(NULL != e);
+                table.erase(e);
+                expected.erase(victim);
+            }
+            else {
+                ASSERT(NULL == e);
+            }
+        }
+        assertSame(expected, &table, n * 2);
+    }
+
+    TEST(AndHashTableTest, RetainChild) {
+        AndHashTable table;
+        std::map<int, WorkingSetID> expected;
+        const int n = 1000;
+
+        for (int i = 0; i < n; ++i) {
+            table.insert(nthLoc(i), i, 0);
+        }
+
+        // Child 1 produces every third DiskLoc.
+        for (int i = 0; i < n; i += 3) {
+            table.find(nthLoc(i))->lastChild = 1;
+            expected[i] = i;
+        }
+
+        size_t before = table.memUsage();
+        std::vector<WorkingSetID> dropped;
+        table.retainChild(1, &dropped);
+        ASSERT_EQUALS(n - expected.size(), dropped.size());
+        ASSERT_LESS_THAN(table.memUsage(), before);
+        assertSame(expected, &table, n);
+
+        table.clear();
+        ASSERT_EQUALS(0U, table.size());
+        ASSERT(NULL == table.find(nthLoc(0)));
+    }
+
+    TEST(DiskLocBloomFilterTest, NoFalseNegatives) {
+        DiskLocBloomFilter bloom;
+
+        // Not initialized: anything may be in it.
+        ASSERT(bloom.mayContain(nthLoc(0)));
+
+        const int n = 100000;
+        bloom.init(n);
+        for (int i = 0; i < n; ++i) {
+            bloom.add(nthLoc(i));
+        }
+        for (int i = 0; i < n; ++i) {
+            ASSERT(bloom.mayContain(nthLoc(i)));
+        }
+
+        int falsePositives = 0;
+        for (int i = n; i < 2 * n; ++i) {
+            if (bloom.mayContain(nthLoc(i))) { ++falsePositives; }
+        }
+        ASSERT_LESS_THAN(falsePositives, n / 20);
+    }
+
+}  // namespace
@@ -42,8 +42,13 @@ namespace mongo {
 
     CollectionScan::CollectionScan(const CollectionScanParams& params,
                                    WorkingSet* workingSet,
-                                   const MatchExpression* filter)
-        : _workingSet(workingSet), _filter(filter), _params(params), _nsDropped(false) { }
+                                   const MatchExpression* filter,
+                                   CompiledMatchExpression* compiledFilter)
+        : _workingSet(workingSet),
+          _filter(filter),
+          _compiledFilter(compiledFilter),
+          _params(params),
+          _nsDropped(false) { }
 
     PlanStage::StageState CollectionScan::work(WorkingSetID* out) {
         ++_commonStats.works;
@@ -84,15 +89,46 @@ namespace mongo {
             nextLoc = _iter->getNext();
         }
 
+        return returnIfMatches(nextLoc, out);
+    }
+
+    PlanStage::StageState CollectionScan::workBatch(size_t maxWorks, WorkBatch* batch,
+                                                    WorkingSetID* out) {
+        while (batch->works < maxWorks) {
+            WorkingSetID id;
+            StageState status;
+
+            if (NULL == _iter || isEOF()) {
+                // Opening the collection, tailing and the end of the collection are left to
+                // work(...).
+                status = work(&id);
+            }
+            else {
+                ++_commonStats.works;
+                status = returnIfMatches(_iter->getNext(), &id);
+            }
+            ++batch->works;
+
+            if (PlanStage::ADVANCED == status) {
+                batch->results.push_back(id);
+            }
+            else if (PlanStage::NEED_TIME != status) {
+                return status;
+            }
+        }
+        return PlanStage::NEED_TIME;
+    }
+
+    PlanStage::StageState CollectionScan::returnIfMatches(const DiskLoc& loc, WorkingSetID* out) {
         WorkingSetID id = _workingSet->allocate();
         WorkingSetMember* member = _workingSet->get(id);
-        member->loc = nextLoc;
+        member->loc = loc;
         member->obj = member->loc.obj();
         member->state = WorkingSetMember::LOC_AND_UNOWNED_OBJ;
 
         ++_specificStats.docsTested;
 
-        if (Filter::passes(member, _filter)) {
+        if (Filter::passes(member, _filter, _compiledFilter.get())) {
             *out = id;
             ++_commonStats.advanced;
             return PlanStage::ADVANCED;
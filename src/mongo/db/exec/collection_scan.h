@@ -36,6 +36,7 @@
 
 namespace mongo {
 
+    class CompiledMatchExpression;
     class WorkingSet;
 
     /**
@@ -46,10 +47,15 @@ namespace mongo {
      */
     class CollectionScan : public PlanStage {
     public:
+        /**
+         * 'compiledFilter', if not NULL, is the compiled form of 'filter' and is owned by us.
+         */
         CollectionScan(const CollectionScanParams& params, WorkingSet* workingSet,
-                       const MatchExpression* filter);
+                       const MatchExpression* filter,
+                       CompiledMatchExpression* compiledFilter = NULL);
 
         virtual StageState work(WorkingSetID* out);
+        virtual StageState workBatch(size_t maxWorks, WorkBatch* batch, WorkingSetID* out);
         virtual bool isEOF();
 
         virtual void invalidate(const DiskLoc& dl);
@@ -59,11 +65,18 @@ namespace mongo {
         virtual PlanStageStats* getStats();
 
     private:
+        /**
+         * Put the record at 'loc' in the working set.  If it passes our filter, set *out to its
+         * WSID and return ADVANCED.  Otherwise free it and return NEED_TIME.
+         */
+        StageState returnIfMatches(const DiskLoc& loc, WorkingSetID* out);
+
         // WorkingSet is not owned by us.
         WorkingSet* _workingSet;
 
         // The filter is not owned by us.
         const MatchExpression* _filter;
+        scoped_ptr<CompiledMatchExpression> _compiledFilter;
 
         scoped_ptr<CollectionIterator> _iter;
 
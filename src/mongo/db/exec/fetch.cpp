@@ -39,8 +39,13 @@ namespace mongo {
     MONGO_FP_DECLARE(fetchInMemoryFail);
     MONGO_FP_DECLARE(fetchInMemorySucceed);
 
-    FetchStage::FetchStage(WorkingSet* ws, PlanStage* child, const MatchExpression* filter)
-        : _ws(ws), _child(child), _filter(filter), _idBeingPagedIn(WorkingSet::INVALID_ID) { }
+    FetchStage::FetchStage(WorkingSet* ws, PlanStage* child, const MatchExpression* filter,
+                           CompiledMatchExpression* compiledFilter)
+        : _ws(ws),
+          _child(child),
+          _filter(filter),
+          _compiledFilter(compiledFilter),
+          _idBeingPagedIn(WorkingSet::INVALID_ID) { }
 
     FetchStage::~FetchStage() { }
 
@@ -51,6 +56,10 @@ namespace mongo {
             return false;
         }
 
+        if (!_queued.empty()) {
+            return false;
+        }
+
         return _child->isEOF();
     }
 
@@ -76,42 +85,20 @@ namespace mongo {
             return fetchCompleted(out);
         }
 
+        // Results held back while the last page-in was requested come before new results.
+        if (!_queued.empty()) {
+            WorkingSetID id = _queued.front();
+            _queued.pop_front();
+            return fetchChildResult(id, out);
+        }
+
         // If we're here, we're not waiting for a DiskLoc to be fetched.  Get another to-be-fetched
         // result from our child.
         WorkingSetID id;
         StageState status = _child->work(&id);
 
         if (PlanStage::ADVANCED == status) {
-            WorkingSetMember* member = _ws->get(id);
-
-            // If there's an obj there, there is no fetching to perform.
-            if (member->hasObj()) {
-                ++_specificStats.alreadyHasObj;
-                return returnIfMatches(member, id, out);
-            }
-
-            // We need a valid loc to fetch from and this is the only state that has one.
-            verify(WorkingSetMember::LOC_AND_IDX == member->state);
-            verify(member->hasLoc());
-
-            Record* record = member->loc.rec();
-            const char* data = record->dataNoThrowing();
-
-            if (!recordInMemory(data)) {
-                // member->loc points to a record that's NOT in memory.  Pass a fetch request up.
-                verify(WorkingSet::INVALID_ID == _idBeingPagedIn);
-                _idBeingPagedIn = id;
-                *out = id;
-                ++_commonStats.needFetch;
-                return PlanStage::NEED_FETCH;
-            }
-            else {
-                // Don't need index data anymore as we have an obj.
-                member->keyData.clear();
-                member->obj = BSONObj(data);
-                member->state = WorkingSetMember::LOC_AND_UNOWNED_OBJ;
-                return returnIfMatches(member, id, out);
-            }
+            return fetchChildResult(id, out);
         }
         else {
             if (PlanStage::NEED_FETCH == status) {
@@ -125,6 +112,105 @@ namespace mongo {
         }
     }
 
+    PlanStage::StageState FetchStage::workBatch(size_t maxWorks, WorkBatch* batch,
+                                                WorkingSetID* out) {
+        // Finish any page-in and return what we held back one unit of work at a time.
+        while (WorkingSet::INVALID_ID != _idBeingPagedIn || !_queued.empty()) {
+            if (batch->works >= maxWorks) { return PlanStage::NEED_TIME; }
+
+            WorkingSetID id;
+            StageState status = work(&id);
+            ++batch->works;
+
+            if (PlanStage::ADVANCED == status) {
+                batch->results.push_back(id);
+            }
+            else if (PlanStage::NEED_TIME != status) {
+                if (PlanStage::NEED_FETCH == status) {
+                    *out = id;
+                }
+                return status;
+            }
+        }
+
+        if (isEOF()) {
+            ++_commonStats.works;
+            ++batch->works;
+            return PlanStage::IS_EOF;
+        }
+
+        size_t firstResult = batch->results.size();
+        size_t firstWork = batch->works;
+        StageState status = _child->workBatch(maxWorks, batch, out);
+        _commonStats.works += batch->works - firstWork;
+
+        // Fetch what our child produced, keeping the results that match in place.  Once a result
+        // needs a page-in, everything after it waits in _queued.
+        vector<WorkingSetID>& results = batch->results;
+        size_t numKept = firstResult;
+        for (size_t i = firstResult; i < results.size(); ++i) {
+            if (WorkingSet::INVALID_ID != _idBeingPagedIn) {
+                _queued.push_back(results[i]);
+                continue;
+            }
+
+            WorkingSetID fetchOut;
+            if (PlanStage::ADVANCED == fetchChildResult(results[i], &fetchOut)) {
+                results[numKept++] = results[i];
+            }
+        }
+        results.resize(numKept);
+
+        if (PlanStage::DEAD == status || PlanStage::FAILURE == status) {
+            return status;
+        }
+
+        // Our own page-in request wins over one from our child.  The child goes on as if its
+        // fetch was performed and touches the record in the lock.
+        if (WorkingSet::INVALID_ID != _idBeingPagedIn) {
+            *out = _idBeingPagedIn;
+            return PlanStage::NEED_FETCH;
+        }
+
+        if (PlanStage::NEED_FETCH == status) {
+            ++_commonStats.needFetch;
+        }
+        return status;
+    }
+
+    PlanStage::StageState FetchStage::fetchChildResult(WorkingSetID id, WorkingSetID* out) {
+        WorkingSetMember* member = _ws->get(id);
+
+        // If there's an obj there, there is no fetching to perform.
+        if (member->hasObj()) {
+            ++_specificStats.alreadyHasObj;
+            return returnIfMatches(member, id, out);
+        }
+
+        // We need a valid loc to fetch from and this is the only state that has one.
+        verify(WorkingSetMember::LOC_AND_IDX == member->state);
+        verify(member->hasLoc());
+
+        Record* record = member->loc.rec();
+        const char* data = record->dataNoThrowing();
+
+        if (!recordInMemory(data)) {
+            // member->loc points to a record that's NOT in memory.  Pass a fetch request up.
+            verify(WorkingSet::INVALID_ID == _idBeingPagedIn);
+            _idBeingPagedIn = id;
+            *out = id;
+            ++_commonStats.needFetch;
+            return PlanStage::NEED_FETCH;
+        }
+        else {
+            // Don't need index data anymore as we have an obj.
+            member->keyData.clear();
+            member->obj = BSONObj(data);
+            member->state = WorkingSetMember::LOC_AND_UNOWNED_OBJ;
+            return returnIfMatches(member, id, out);
+        }
+    }
+
     void FetchStage::prepareToYield() {
         ++_commonStats.yields;
         _child->prepareToYield();
@@ -153,6 +239,14 @@ namespace mongo {
                 _idBeingPagedIn = WorkingSet::INVALID_ID;
             }
         }
+
+        // Results we held back keep what the DiskLoc points to by fetching it now.
+        for (size_t i = 0; i < _queued.size(); ++i) {
+            WorkingSetMember* member = _ws->get(_queued[i]);
+            if (member->hasLoc() && member->loc == dl) {
+                WorkingSetCommon::fetchAndInvalidateLoc(member);
+            }
+        }
     }
 
     PlanStage::StageState FetchStage::fetchCompleted(WorkingSetID* out) {
@@ -191,7 +285,7 @@ namespace mongo {
     PlanStage::StageState FetchStage::returnIfMatches(WorkingSetMember* member,
                                                       WorkingSetID memberID,
                                                       WorkingSetID* out) {
-        if (Filter::passes(member, _filter)) {
+        if (Filter::passes(member, _filter, _compiledFilter.get())) {
             if (NULL != _filter) {
                 ++_specificStats.matchTested;
             }
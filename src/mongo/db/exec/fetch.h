@@ -28,6 +28,8 @@
 
 #pragma once
 
+#include <deque>
+
 #include "mongo/db/diskloc.h"
 #include "mongo/db/exec/plan_stage.h"
 #include "mongo/db/jsobj.h"
@@ -35,6 +37,8 @@
 
 namespace mongo {
 
+    class CompiledMatchExpression;
+
     /**
      * This stage turns a DiskLoc into a BSONObj.
      *
@@ -45,11 +49,16 @@ namespace mongo {
      */
     class FetchStage : public PlanStage {
     public:
-        FetchStage(WorkingSet* ws, PlanStage* child, const MatchExpression* filter);
+        /**
+         * 'compiledFilter', if not NULL, is the compiled form of 'filter' and is owned by us.
+         */
+        FetchStage(WorkingSet* ws, PlanStage* child, const MatchExpression* filter,
+                   CompiledMatchExpression* compiledFilter = NULL);
         virtual ~FetchStage();
 
         virtual bool isEOF();
         virtual StageState work(WorkingSetID* out);
+        virtual StageState workBatch(size_t maxWorks, WorkBatch* batch, WorkingSetID* out);
 
         virtual void prepareToYield();
         virtual void recoverFromYield();
@@ -70,17 +79,28 @@ namespace mongo {
          */
         StageState fetchCompleted(WorkingSetID* out);
 
+        /**
+         * Fetch the result 'id' our child produced and return it if it matches.  If it's not in
+         * memory, hold on to it in _idBeingPagedIn, set *out and return NEED_FETCH.
+         */
+        StageState fetchChildResult(WorkingSetID id, WorkingSetID* out);
+
         // _ws is not owned by us.
         WorkingSet* _ws;
         scoped_ptr<PlanStage> _child;
 
         // The filter is not owned by us.
         const MatchExpression* _filter;
+        scoped_ptr<CompiledMatchExpression> _compiledFilter;
 
         // If we're fetching a DiskLoc and it points at something that's not in memory, we return a
         // a "please page this in" result and hold on to the WSID until the next call to work(...).
         WorkingSetID _idBeingPagedIn;
 
+        // Results workBatch(...) received from our child after _idBeingPagedIn.  They're returned,
+        // in order, once the page-in is done.
+        std::deque<WorkingSetID> _queued;
+
         // Stats
         CommonStats _commonStats;
         FetchStats _specificStats;
@@ -29,6 +29,7 @@
 #pragma once
 
 #include "mongo/db/exec/working_set.h"
+#include "mongo/db/matcher/expression_compiled.h"
 #include "mongo/db/matcher/matchable.h"
 
 namespace mongo {
@@ -110,6 +111,18 @@ namespace mongo {
             WorkingSetMatchableDocument doc(wsm);
             return filter->matches(&doc, NULL);
         }
+
+        /**
+         * As above, but uses 'compiled', the compiled form of 'filter', if it isn't NULL and
+         * 'wsm' has its object.
+         */
+        static bool passes(WorkingSetMember* wsm, const MatchExpression* filter,
+                           const CompiledMatchExpression* compiled) {
+            if (NULL != compiled && wsm->hasObj()) {
+                return compiled->matchesBSON(wsm->obj);
+            }
+            return passes(wsm, filter);
+        }
     };
 
 }  // namespace mongo
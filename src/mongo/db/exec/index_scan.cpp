@@ -163,6 +163,39 @@ namespace mongo {
 
         if (isEOF()) { return PlanStage::IS_EOF; }
 
+        return returnIfMatches(out);
+    }
+
+    PlanStage::StageState IndexScan::workBatch(size_t maxWorks, WorkBatch* batch,
+                                               WorkingSetID* out) {
+        while (batch->works < maxWorks) {
+            WorkingSetID id;
+            StageState status;
+
+            if (NULL == _indexCursor.get() || _yieldMovedCursor || isEOF()) {
+                // Cursor setup, resuming after a yield and the end of the scan are left to
+                // work(...).
+                status = work(&id);
+            }
+            else {
+                ++_commonStats.works;
+                _indexCursor->next();
+                checkEnd();
+                status = isEOF() ? PlanStage::IS_EOF : returnIfMatches(&id);
+            }
+            ++batch->works;
+
+            if (PlanStage::ADVANCED == status) {
+                batch->results.push_back(id);
+            }
+            else if (PlanStage::NEED_TIME != status) {
+                return status;
+            }
+        }
+        return PlanStage::NEED_TIME;
+    }
+
+    PlanStage::StageState IndexScan::returnIfMatches(WorkingSetID* out) {
         DiskLoc loc = _indexCursor->getValue();
 
         if (_shouldDedup) {
@@ -77,6 +77,7 @@ namespace mongo {
         virtual ~IndexScan() { }
 
         virtual StageState work(WorkingSetID* out);
+        virtual StageState workBatch(size_t maxWorks, WorkBatch* batch, WorkingSetID* out);
         virtual bool isEOF();
         virtual void prepareToYield();
         virtual void recoverFromYield();
@@ -88,6 +89,12 @@ namespace mongo {
         /** See if the cursor is pointing at or past _endKey, if _endKey is non-empty. */
         void checkEnd();
 
+        /**
+         * Put the entry the cursor points at in the working set.  If it's not a dup and passes our
+         * filter, set *out to its WSID and return ADVANCED.  Otherwise return NEED_TIME.
+         */
+        StageState returnIfMatches(WorkingSetID* out);
+
         // The WorkingSet we annotate with results.  Not owned by us.
         WorkingSet* _workingSet;
 
@@ -64,6 +64,32 @@ namespace mongo {
         }
     }
 
+    PlanStage::StageState LimitStage::workBatch(size_t maxWorks, WorkBatch* batch,
+                                                WorkingSetID* out) {
+        if (isEOF()) {
+            ++_commonStats.works;
+            ++batch->works;
+            return PlanStage::IS_EOF;
+        }
+
+        // A unit of work produces at most one result, so never ask for more units than we have
+        // results left to return.
+        size_t firstResult = batch->results.size();
+        size_t firstWork = batch->works;
+        StageState status = _child->workBatch(std::min(maxWorks,
+                                                       firstWork + static_cast<size_t>(_numToReturn)),
+                                              batch, out);
+
+        size_t numResults = batch->results.size() - firstResult;
+        _numToReturn -= numResults;
+        _commonStats.works += batch->works - firstWork;
+        _commonStats.advanced += numResults;
+        if (PlanStage::NEED_FETCH == status) {
+            ++_commonStats.needFetch;
+        }
+        return status;
+    }
+
     void LimitStage::prepareToYield() {
         ++_commonStats.yields;
         _child->prepareToYield();
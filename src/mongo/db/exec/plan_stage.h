@@ -35,6 +35,26 @@ namespace mongo {
 
     class DiskLoc;
 
+    /**
+     * The output of PlanStage::workBatch(...): the results of a run of units of work and how many
+     * units of work the run stood for.
+     */
+    struct WorkBatch {
+        WorkBatch() : works(0) { }
+
+        void clear() {
+            results.clear();
+            works = 0;
+        }
+
+        // Results in the order work(...) would have returned them.  The caller must free them
+        // from the working set when done with them.
+        vector<WorkingSetID> results;
+
+        // Units of work performed so far.
+        size_t works;
+    };
+
     /**
      * A PlanStage ("stage") is the basic building block of a "Query Execution Plan."  A stage is
      * the smallest piece of machinery used in executing a compiled query.  Stages either access
@@ -167,6 +187,37 @@ namespace mongo {
          */
         virtual StageState work(WorkingSetID* out) = 0;
 
+        /**
+         * Perform units of work until batch->works reaches maxWorks, appending each result to
+         * batch->results.  Equivalent to calling work(...) that many times, but lets a stage and
+         * its children produce a run of results without a virtual call per result per stage.
+         *
+         * Returns NEED_TIME if the budget of work ran out.  Otherwise stops early and returns the
+         * IS_EOF, DEAD, FAILURE or NEED_FETCH that a unit of work produced, with *out set as
+         * work(...) would set it.  Results already in the batch come before that state.
+         *
+         * A stage may only look at the results it appended itself.  The default implementation
+         * calls work(...) in a loop.
+         */
+        virtual StageState workBatch(size_t maxWorks, WorkBatch* batch, WorkingSetID* out) {
+            while (batch->works < maxWorks) {
+                WorkingSetID id;
+                StageState state = work(&id);
+                ++batch->works;
+
+                if (ADVANCED == state) {
+                    batch->results.push_back(id);
+                }
+                else if (NEED_TIME != state) {
+                    if (NEED_FETCH == state) {
+                        *out = id;
+                    }
+                    return state;
+                }
+            }
+            return NEED_TIME;
+        }
+
         /**
          * Returns true if no more work can be done on the query / out of results.
          */
@@ -117,7 +117,11 @@ namespace mongo {
 
     struct AndHashStats : public SpecificStats {
         AndHashStats() : flaggedButPassed(0),
-                         flaggedInProgress(0) { }
+                         flaggedInProgress(0),
+                         memUsage(0),
+                         memLimit(0),
+                         bloomRejected(0),
+                         spilled(false) { }
 
         virtual ~AndHashStats() { }
 
@@ -135,6 +139,18 @@ namespace mongo {
 
         // mapAfterChild[mapAfterChild.size() - 1] WSMswere match tested.
         // commonstats.advanced is how many passed.
+
+        // Peak bytes used by the hash table, the Bloom filter and the WSMs in the table, and
+        // the limit on it.
+        size_t memUsage;
+        size_t memLimit;
+
+        // How many DiskLocs from children after the first were rejected by the Bloom filter
+        // without probing the table.
+        uint64_t bloomRejected;
+
+        // Did we hit memLimit and intersect sorted runs on disk instead?
+        bool spilled;
     };
 
     struct AndSortedStats : public SpecificStats {
@@ -237,12 +253,23 @@ namespace mongo {
     };
 
     struct SortStats : public SpecificStats {
-        SortStats() : forcedFetches(0) { }
+        SortStats() : forcedFetches(0), memUsage(0), memLimit(0), limit(0), spills(0) { }
 
         virtual ~SortStats() { }
 
         // How many records were we forced to fetch as the result of an invalidation?
         uint64_t forcedFetches;
+
+        // The most bytes of data buffered in memory at once, and how many we could buffer
+        // before spilling to disk.
+        size_t memUsage;
+        size_t memLimit;
+
+        // Only the first 'limit' results are kept.  0 for no limit.
+        size_t limit;
+
+        // How many sorted runs were written to disk.
+        uint64_t spills;
     };
 
     struct MergeSortStats : public SpecificStats {
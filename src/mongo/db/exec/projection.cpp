@@ -76,6 +76,42 @@ namespace mongo {
         return status;
     }
 
+    PlanStage::StageState ProjectionStage::workBatch(size_t maxWorks, WorkBatch* batch,
+                                                     WorkingSetID* out) {
+        if (isEOF()) {
+            ++_commonStats.works;
+            ++batch->works;
+            return PlanStage::IS_EOF;
+        }
+
+        size_t firstResult = batch->results.size();
+        size_t firstWork = batch->works;
+        StageState status = _child->workBatch(maxWorks, batch, out);
+        _commonStats.works += batch->works - firstWork;
+
+        vector<WorkingSetID>& results = batch->results;
+        for (size_t i = firstResult; i < results.size(); ++i) {
+            WorkingSetMember* member = _ws->get(results[i]);
+            Status projStatus = _exec->transform(member);
+            if (!projStatus.isOK()) {
+                warning() << "Couldn't execute projection, status = "
+                          << projStatus.toString() << endl;
+                // Results up to the one that failed are returned as work(...) would have.
+                for (size_t j = i; j < results.size(); ++j) {
+                    _ws->free(results[j]);
+                }
+                results.resize(i);
+                return PlanStage::FAILURE;
+            }
+            ++_commonStats.advanced;
+        }
+
+        if (PlanStage::NEED_FETCH == status) {
+            ++_commonStats.needFetch;
+        }
+        return status;
+    }
+
     void ProjectionStage::prepareToYield() {
         ++_commonStats.yields;
         _child->prepareToYield();
@@ -72,6 +72,37 @@ namespace mongo {
         }
     }
 
+    PlanStage::StageState SkipStage::workBatch(size_t maxWorks, WorkBatch* batch,
+                                               WorkingSetID* out) {
+        if (isEOF()) {
+            ++_commonStats.works;
+            ++batch->works;
+            return PlanStage::IS_EOF;
+        }
+
+        size_t firstResult = batch->results.size();
+        size_t firstWork = batch->works;
+        StageState status = _child->workBatch(maxWorks, batch, out);
+        _commonStats.works += batch->works - firstWork;
+
+        // Drop results from the front of what our child appended while we're still skipping.
+        vector<WorkingSetID>& results = batch->results;
+        size_t numResults = results.size() - firstResult;
+        size_t numSkipped = std::min(numResults, static_cast<size_t>(_toSkip));
+        for (size_t i = firstResult; i < firstResult + numSkipped; ++i) {
+            _ws->free(results[i]);
+        }
+        results.erase(results.begin() + firstResult, results.begin() + firstResult + numSkipped);
+        _toSkip -= numSkipped;
+
+        _commonStats.needTime += numSkipped;
+        _commonStats.advanced += numResults - numSkipped;
+        if (PlanStage::NEED_FETCH == status) {
+            ++_commonStats.needFetch;
+        }
+        return status;
+    }
+
     void SkipStage::prepareToYield() {
         ++_commonStats.yields;
         _child->prepareToYield();
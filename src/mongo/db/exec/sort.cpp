@@ -33,10 +33,52 @@
 #include "mongo/db/exec/working_set_common.h"
 #include "mongo/db/index/btree_key_generator.h"
 #include "mongo/db/query/query_planner.h"
+#include "mongo/db/storage_options.h"
+
+namespace {
+
+    using namespace mongo;
+
+    // A spilled result is {a: <file>, o: <offset>, n: <when it was spilled>, d: <document>}.
+    BSONObj makeSpilledValue(const DiskLoc& loc, long long spilledCount, const BSONObj& obj) {
+        return BSON("a" << loc.a() << "o" << loc.getOfs() << "n" << spilledCount << "d" << obj);
+    }
+
+    DiskLoc spilledLoc(const BSONObj& value) {
+        return DiskLoc(value["a"].numberInt(), value["o"].numberInt());
+    }
+
+    /**
+     * Orders spilled results like SortStage::WorkingSetComparator orders buffered ones.
+     */
+    class SpillComparator {
+    public:
+        explicit SpillComparator(const BSONObj& pattern) : _pattern(pattern) { }
+
+        int operator()(const SortStage::SpillSorter::Data& lhs,
+                       const SortStage::SpillSorter::Data& rhs) const {
+            int result = lhs.first.woCompare(rhs.first, _pattern, false /* ignore field names */);
+            if (0 != result) {
+                return result;
+            }
+            return spilledLoc(lhs.second).compare(spilledLoc(rhs.second));
+        }
+
+    private:
+        BSONObj _pattern;
+    };
+
+    // Computed data doesn't survive a trip through a sorted run.
+    bool canSpill(const WorkingSetMember& member) {
+        return !member.hasComputed(WSM_COMPUTED_TEXT_SCORE)
+               && !member.hasComputed(WSM_COMPUTED_GEO_DISTANCE);
+    }
+
+}  // namespace
 
 namespace mongo {
 
-    const size_t kMaxBytes = 32 * 1024 * 1024;
+    const size_t SortStageParams::kDefaultMaxMemUsage = 32 * 1024 * 1024;
 
     struct SortStage::WorkingSetComparator {
         explicit WorkingSetComparator(BSONObj p) : pattern(p) { }
@@ -56,11 +98,17 @@ namespace mongo {
         : _ws(ws),
           _child(child),
           _pattern(params.pattern),
+          _limit(params.limit),
+          _maxMemUsage(params.maxMemUsage),
           _sorted(false),
           _resultIterator(_data.end()),
+          _spilledCount(0),
           _hasBounds(false),
           _memUsage(0) {
 
+        _specificStats.memLimit = _maxMemUsage;
+        _specificStats.limit = _limit;
+
         // Fill out _bounds and _hasBounds.
         getBoundsForSort(params.query, params.pattern);
 
@@ -138,13 +186,19 @@ namespace mongo {
     bool SortStage::isEOF() {
         // We're done when our child has no more results, we've sorted the child's results, and
         // we've returned all sorted results.
-        return _child->isEOF() && _sorted && (_data.end() == _resultIterator);
+        if (!_child->isEOF() || !_sorted) { return false; }
+
+        if (NULL != _spilledIterator.get()) {
+            return !_spilledIterator->more();
+        }
+        return _data.end() == _resultIterator;
     }
 
     PlanStage::StageState SortStage::work(WorkingSetID* out) {
         ++_commonStats.works;
 
-        if (_memUsage > kMaxBytes) {
+        // We only stay over the limit if we couldn't spill.
+        if (NULL == _sorter.get() && _memUsage > _maxMemUsage) {
             return PlanStage::FAILURE;
         }
 
@@ -160,20 +214,14 @@ namespace mongo {
                 // A DiskLoc may be invalidated at any time (during a yield).  We need to get into
                 // the WorkingSet as quickly as possible to handle it.
                 WorkingSetMember* member = _ws->get(id);
-                if (member->hasLoc()) {
+                if (member->hasLoc() && NULL == _sorter.get()) {
                     _wsidByDiskLoc[member->loc] = id;
                 }
 
-                // Do some accounting to make sure we're not using too much memory.
-                if (member->hasLoc()) {
-                    _memUsage += sizeof(DiskLoc);
-                }
-
                 // We are not supposed (yet) to sort over anything other than objects.  In other
                 // words, the query planner wouldn't put a sort atop anything that wouldn't have a
                 // collection scan as a leaf.
                 verify(member->hasObj());
-                _memUsage += member->obj.objsize();
 
                 // We will sort '_data' in the same order an index over '_pattern' would
                 // have. This has very nuanced implications. Consider the sort pattern {a:1}
@@ -214,6 +262,24 @@ namespace mongo {
                     verify(0);
                 }
 
+                // Past the memory limit, everything goes straight to the Sorter.
+                if (NULL != _sorter.get()) {
+                    if (!canSpill(*member)) {
+                        warning() << "sort stage can't spill a result with computed data" << endl;
+                        _ws->free(id);
+                        return PlanStage::FAILURE;
+                    }
+                    addToSorter(id, sortKey);
+                    ++_commonStats.needTime;
+                    return PlanStage::NEED_TIME;
+                }
+
+                // Do some accounting to make sure we're not using too much memory.
+                if (member->hasLoc()) {
+                    _memUsage += sizeof(DiskLoc);
+                }
+                _memUsage += member->obj.objsize();
+
                 // We let the data stay in the WorkingSet and sort using the selected portion
                 // of the object in that working set member.
                 SortableDataItem item;
@@ -224,14 +290,41 @@ namespace mongo {
                 }
                 _data.push_back(item);
 
+                if (_memUsage > _specificStats.memUsage) {
+                    _specificStats.memUsage = _memUsage;
+                }
+
+                // With a limit, only the best '_limit' results can be returned.  Cutting back
+                // to them every '_limit' results keeps the cost of the cut constant per result.
+                if (0 != _limit && _data.size() >= 2 * _limit) {
+                    trimToLimit();
+                }
+
+                if (_memUsage > _maxMemUsage && !spill()) {
+                    warning() << "sort stage buffered more than " << _maxMemUsage << " bytes"
+                              << " and can't spill results with computed data" << endl;
+                    return PlanStage::FAILURE;
+                }
+
                 ++_commonStats.needTime;
                 return PlanStage::NEED_TIME;
             }
             else if (PlanStage::IS_EOF == code) {
-                // TODO: We don't need the lock for this.  We could ask for a yield and do this work
-                // unlocked.  Also, this is performing a lot of work for one call to work(...)
-                std::sort(_data.begin(), _data.end(), *_cmp);
-                _resultIterator = _data.begin();
+                if (NULL != _sorter.get()) {
+                    // The Sorter merges its runs as we iterate.
+                    _spilledIterator.reset(_sorter->done());
+                    _specificStats.spills = _sorter->numFiles();
+                }
+                else {
+                    // TODO: We don't need the lock for this.  We could ask for a yield and do this
+                    // work unlocked.  Also, this is performing a lot of work for one call to
+                    // work(...)
+                    if (0 != _limit) {
+                        trimToLimit();
+                    }
+                    std::sort(_data.begin(), _data.end(), *_cmp);
+                    _resultIterator = _data.begin();
+                }
                 _sorted = true;
                 ++_commonStats.needTime;
                 return PlanStage::NEED_TIME;
@@ -249,6 +342,10 @@ namespace mongo {
         }
 
         // Returning results.
+        if (NULL != _spilledIterator.get()) {
+            return returnSpilled(out);
+        }
+
         verify(_resultIterator != _data.end());
         verify(_sorted);
         *out = _resultIterator->wsid;
@@ -272,6 +369,91 @@ namespace mongo {
         return PlanStage::ADVANCED;
     }
 
+    void SortStage::trimToLimit() {
+        if (_data.size() <= _limit) { return; }
+
+        std::nth_element(_data.begin(), _data.begin() + _limit, _data.end(), *_cmp);
+        for (size_t i = _limit; i < _data.size(); ++i) {
+            WorkingSetMember* member = _ws->get(_data[i].wsid);
+            if (member->hasLoc()) {
+                _wsidByDiskLoc.erase(member->loc);
+                _memUsage -= sizeof(DiskLoc);
+            }
+            _memUsage -= member->obj.objsize();
+            _ws->free(_data[i].wsid);
+        }
+        _data.resize(_limit);
+    }
+
+    bool SortStage::spill() {
+        for (size_t i = 0; i < _data.size(); ++i) {
+            if (!canSpill(*_ws->get(_data[i].wsid))) { return false; }
+        }
+
+        SortOptions opts = SortOptions().TempDir(storageGlobalParams.dbpath + "/_tmp")
+                                        .ExtSortAllowed()
+                                        .MaxMemoryUsageBytes(_maxMemUsage)
+                                        .Limit(_limit);
+        _sorter.reset(SpillSorter::make(opts, SpillComparator(_pattern)));
+
+        for (size_t i = 0; i < _data.size(); ++i) {
+            // Flagged results would be dropped when returned.
+            if (_ws->isFlagged(_data[i].wsid)) {
+                _ws->free(_data[i].wsid);
+                continue;
+            }
+            addToSorter(_data[i].wsid, _data[i].sortKey);
+        }
+
+        _data.clear();
+        _resultIterator = _data.end();
+        _wsidByDiskLoc.clear();
+        _memUsage = 0;
+        return true;
+    }
+
+    void SortStage::addToSorter(WorkingSetID id, const BSONObj& sortKey) {
+        WorkingSetMember* member = _ws->get(id);
+        DiskLoc loc = member->hasLoc() ? member->loc : DiskLoc();
+        _sorter->add(sortKey.getOwned(), makeSpilledValue(loc, _spilledCount, member->obj));
+        ++_spilledCount;
+        _ws->free(id);
+
+        if (_sorter->memUsed() > _specificStats.memUsage) {
+            _specificStats.memUsage = _sorter->memUsed();
+        }
+        _specificStats.spills = _sorter->numFiles();
+    }
+
+    PlanStage::StageState SortStage::returnSpilled(WorkingSetID* out) {
+        SpillSorter::Data data = _spilledIterator->next();
+        DiskLoc loc = spilledLoc(data.second);
+
+        // Drop it if it was invalidated after it was spilled, as we do with flagged results.
+        if (!loc.isNull()) {
+            InvalidatedMap::const_iterator it = _spilledInvalidated.find(loc);
+            if (_spilledInvalidated.end() != it
+                && data.second["n"].numberLong() < it->second) {
+                ++_commonStats.needTime;
+                return PlanStage::NEED_TIME;
+            }
+        }
+
+        *out = _ws->allocate();
+        WorkingSetMember* member = _ws->get(*out);
+        member->obj = data.second["d"].Obj().getOwned();
+        if (loc.isNull()) {
+            member->state = WorkingSetMember::OWNED_OBJ;
+        }
+        else {
+            member->loc = loc;
+            member->state = WorkingSetMember::LOC_AND_UNOWNED_OBJ;
+        }
+
+        ++_commonStats.advanced;
+        return PlanStage::ADVANCED;
+    }
+
     void SortStage::prepareToYield() {
         ++_commonStats.yields;
         _child->prepareToYield();
@@ -305,6 +487,11 @@ namespace mongo {
             _wsidByDiskLoc.erase(it);
             ++_specificStats.forcedFetches;
         }
+
+        // Spilled copies of it that we haven't returned yet must not be returned.
+        if (NULL != _sorter.get()) {
+            _spilledInvalidated[dl] = _spilledCount;
+        }
     }
 
     PlanStageStats* SortStage::getStats() {
@@ -317,3 +504,6 @@ namespace mongo {
     }
 
 }  // namespace mongo
+
+#include "mongo/db/sorter/sorter.cpp"
+MONGO_CREATE_SORTER(mongo::BSONObj, mongo::BSONObj, SpillComparator);
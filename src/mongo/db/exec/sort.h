@@ -37,6 +37,7 @@
 #include "mongo/db/exec/plan_stage.h"
 #include "mongo/db/exec/working_set.h"
 #include "mongo/db/query/index_bounds.h"
+#include "mongo/db/sorter/sorter.h"
 #include "mongo/platform/unordered_map.h"
 
 namespace mongo {
@@ -46,7 +47,9 @@ namespace mongo {
     // Parameters that must be provided to a SortStage
     class SortStageParams {
     public:
-        SortStageParams() { }
+        SortStageParams() : limit(0), maxMemUsage(kDefaultMaxMemUsage) { }
+
+        static const size_t kDefaultMaxMemUsage;
 
         // How we're sorting.
         BSONObj pattern;
@@ -54,14 +57,22 @@ namespace mongo {
         // The query.  Used to create the IndexBounds for the sorting.
         BSONObj query;
 
-        // TODO: Implement this.
-        // Must be >= 0.  Equal to 0 for no limit.
-        // int limit;
+        // Equal to 0 for no limit.  Otherwise only the first 'limit' results are returned.
+        size_t limit;
+
+        // How many bytes of results we buffer before spilling sorted runs to disk.
+        size_t maxMemUsage;
     };
 
     /**
      * Sorts the input received from the child according to the sort pattern provided.
      *
+     * Results are buffered in the WorkingSet and sorted in memory.  With a limit, the buffer is
+     * cut back to the best 'limit' results whenever it holds twice that many.  Once the buffer
+     * grows past maxMemUsage, it and the rest of the child's results go to a Sorter, which
+     * writes sorted runs to disk (keeping only the top 'limit' if there is one) and merges them
+     * lazily as results are returned.
+     *
      * Preconditions: For each field in 'pattern', all inputs in the child must handle a
      * getFieldDotted for that field.
      */
@@ -80,9 +91,32 @@ namespace mongo {
 
         PlanStageStats* getStats();
 
+        // The sort key, and the spilled document with its DiskLoc.
+        typedef Sorter<BSONObj, BSONObj> SpillSorter;
+
     private:
         void getBoundsForSort(const BSONObj& queryObj, const BSONObj& sortObj);
 
+        /**
+         * Cuts _data back to the best _limit results, freeing the rest.
+         */
+        void trimToLimit();
+
+        /**
+         * Moves _data to a new _sorter.  Returns false if something in _data can't be spilled.
+         */
+        bool spill();
+
+        /**
+         * Adds the result 'id' with sort key 'sortKey' to _sorter and frees it.
+         */
+        void addToSorter(WorkingSetID id, const BSONObj& sortKey);
+
+        /**
+         * Returns the next result of _spilledIterator in a new WorkingSetMember.
+         */
+        StageState returnSpilled(WorkingSetID* out);
+
         // Not owned by us.
         WorkingSet* _ws;
 
@@ -92,6 +126,10 @@ namespace mongo {
         // Our sort pattern.
         BSONObj _pattern;
 
+        // See SortStageParams.
+        size_t _limit;
+        size_t _maxMemUsage;
+
         // Have we sorted our data? If so, we can access _resultIterator. If not,
         // we're still populating _data.
         bool _sorted;
@@ -116,6 +154,21 @@ namespace mongo {
         typedef unordered_map<DiskLoc, WorkingSetID, DiskLoc::Hasher> DataMap;
         DataMap _wsidByDiskLoc;
 
+        // Once _data outgrows memory, everything goes here instead and is returned through
+        // _spilledIterator.
+        boost::scoped_ptr<SpillSorter> _sorter;
+        boost::scoped_ptr<SpillSorter::Iterator> _spilledIterator;
+
+        // How many results have been added to _sorter.  Each spilled result records the count
+        // before it was added.
+        long long _spilledCount;
+
+        // Spilled documents can't be invalidated in place.  Instead we remember the value of
+        // _spilledCount when each DiskLoc was invalidated, and drop the spilled results with that
+        // DiskLoc which were added before then.
+        typedef unordered_map<DiskLoc, long long, DiskLoc::Hasher> InvalidatedMap;
+        InvalidatedMap _spilledInvalidated;
+
         //
         // Sort Apparatus
         //
@@ -38,13 +38,108 @@
 #include "mongo/db/repl/is_master.h"
 #include "mongo/db/repl/oplog.h"
 #include "mongo/db/repl/rs.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/db/sort_phase_one.h"
+#include "mongo/db/storage/extent.h"
+#include "mongo/db/storage/extent_manager.h"
+#include "mongo/db/structure/collection.h"
+#include "mongo/util/concurrency/thread_pool.h"
 #include "mongo/util/processinfo.h"
 
 namespace mongo {
 
     int oldCompare(const BSONObj& l,const BSONObj& r, const Ordering &o); // key.cpp
 
+    int BtreeBasedBuilder::buildThreads = 0;
+
+    namespace {
+        ExportedServerParameter<int> indexBuildThreadsParameter(ServerParameterSet::getGlobal(),
+                                                                "indexBuildThreads",
+                                                                &BtreeBasedBuilder::buildThreads,
+                                                                true,
+                                                                true);
+
+        // memory for the in memory runs of all the sorters of one build, beyond which they
+        // spill compressed runs to dbpath/_tmp
+        int maxIndexBuildMemoryUsageMegabytes = 100;
+        ExportedServerParameter<int> maxIndexBuildMemoryUsageParameter(
+                ServerParameterSet::getGlobal(),
+                "maxIndexBuildMemoryUsageMegabytes",
+                &maxIndexBuildMemoryUsageMegabytes,
+                true,
+                true);
+
+        long sortMemoryBytes() {
+            return std::max(maxIndexBuildMemoryUsageMegabytes, 1) * 1024L * 1024;
+        }
+
+        // smaller collections aren't worth starting threads for
+        const uint64_t minRecordsForParallelBuild = 100000;
+    }
+
+    /** state shared by the threads of a parallel phase one */
+    struct ParallelKeyScan {
+        const ExtentManager* em;
+        BtreeBasedAccessMethod* iam;
+        const ExternalSortComparison* cmp;
+        long sorterMemory;
+        vector<DiskLoc> extents;
+        AtomicUInt32 nextExtent;
+        AtomicUInt64 docsScanned;
+        AtomicUInt32 abort;
+    };
+
+    /** result of one thread of a parallel phase one */
+    struct ParallelKeyScanResult {
+        ParallelKeyScanResult() : errCode(0) { }
+        shared_ptr<SortPhaseOne> phaseOne;
+        int errCode;
+        string errMsg;
+    };
+
+    /**
+     * Takes extents off the shared list until it is empty, adding the keys of their records to
+     * this thread's sorter.  Runs without a Client; the thread that started the scan holds the
+     * write lock and checks for interrupts.  Never throws, errors are recorded in result.
+     */
+    void BtreeBasedBuilder::scanExtents(ParallelKeyScan* scan,
+                                        ParallelKeyScanResult* result) {
+        try {
+            SortPhaseOne* phaseOne = result->phaseOne.get();
+            phaseOne->sorter.reset(new BSONObjExternalSorter(scan->cmp, scan->sorterMemory));
+            while (!scan->abort.load()) {
+                unsigned i = scan->nextExtent.fetchAndAdd(1);
+                if (i >= scan->extents.size())
+                    break;
+                Extent* e = scan->em->getExtent(scan->extents[i]);
+                unsigned n = 0;
+                for (DiskLoc loc = e->firstRecord;
+                     !loc.isNull();
+                     loc = scan->em->getNextRecordInExtent(loc)) {
+                    if (++n % 1024 == 0 && scan->abort.load())
+                        return;
+                    BSONObj o(scan->em->recordFor(loc)->data());
+                    BSONObjSet keys;
+                    scan->iam->getKeys(o, &keys);
+                    phaseOne->addKeys(keys, loc, false);
+                    scan->docsScanned.fetchAndAdd(1);
+                }
+            }
+            // sorts this thread's last run
+            phaseOne->sorted.reset(phaseOne->sorter->iterator().release());
+        }
+        catch (DBException& e) {
+            result->errCode = e.getCode();
+            result->errMsg = e.what();
+            scan->abort.store(1);
+        }
+        catch (std::exception& e) {
+            result->errCode = 17292;
+            result->errMsg = str::stream() << "index build scan thread failed: " << e.what();
+            scan->abort.store(1);
+        }
+    }
+
     class ExternalSortComparisonV0 : public ExternalSortComparison {
     public:
         ExternalSortComparisonV0(const BSONObj& ordering) : _ordering(Ordering::make(ordering)) { }
@@ -73,20 +168,26 @@ namespace mongo {
         const Ordering _ordering;
     };
 
+    /**
+     * Builds the btree bottom up from keys in sorted order.
+     * @param bottomUpMillis if not NULL, set to the time spent before the final commit
+     */
     template< class V >
     void buildBottomUpPhases2And3( bool dupsAllowed,
                                    IndexDescriptor* idx,
-                                   BSONObjExternalSorter& sorter,
+                                   BSONObjExternalSorter::Iterator& sorted,
                                    bool dropDups,
                                    set<DiskLoc>& dupsToDrop,
                                    CurOp* op,
                                    SortPhaseOne* phase1,
                                    ProgressMeterHolder& pm,
                                    Timer& t,
-                                   bool mayInterrupt ) {
+                                   bool mayInterrupt,
+                                   int* bottomUpMillis ) {
+        Timer bottomUp;
         BtreeBuilder<V> btBuilder(dupsAllowed, idx->getOnDisk());
         BSONObj keyLast;
-        auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+        BSONObjExternalSorter::Iterator* i = &sorted;
         // verifies that pm and op refer to the same ProgressMeter
         verify(pm == op->setMessage("index: (2/3) btree bottom up",
                                     "Index: (2/3) BTree Bottom Up Progress",
@@ -127,6 +228,8 @@ namespace mongo {
             pm.hit();
         }
         pm.finished();
+        if ( bottomUpMillis )
+            *bottomUpMillis = bottomUp.millis();
         op->setMessage("index: (3/3) btree-middle", "Index: (3/3) BTree Middle Progress");
         LOG(t.seconds() > 10 ? 0 : 1 ) << "\t done building bottom layer, going to commit" << endl;
         btBuilder.commit( mayInterrupt );
@@ -136,6 +239,30 @@ namespace mongo {
         }
     }
 
+    template< class V >
+    void buildBottomUpPhases2And3( bool dupsAllowed,
+                                   IndexDescriptor* idx,
+                                   BSONObjExternalSorter& sorter,
+                                   bool dropDups,
+                                   set<DiskLoc>& dupsToDrop,
+                                   CurOp* op,
+                                   SortPhaseOne* phase1,
+                                   ProgressMeterHolder& pm,
+                                   Timer& t,
+                                   bool mayInterrupt ) {
+        auto_ptr<BSONObjExternalSorter::Iterator> i = sorter.iterator();
+        buildBottomUpPhases2And3<V>(dupsAllowed, idx, *i, dropDups, dupsToDrop, op, phase1, pm,
+                                    t, mayInterrupt, NULL);
+    }
+
+    // fastBuildIndex() no longer instantiates these, the tests use them
+    template void buildBottomUpPhases2And3<V0>( bool, IndexDescriptor*, BSONObjExternalSorter&,
+                                                bool, set<DiskLoc>&, CurOp*, SortPhaseOne*,
+                                                ProgressMeterHolder&, Timer&, bool );
+    template void buildBottomUpPhases2And3<V1>( bool, IndexDescriptor*, BSONObjExternalSorter&,
+                                                bool, set<DiskLoc>&, CurOp*, SortPhaseOne*,
+                                                ProgressMeterHolder&, Timer&, bool );
+
     DiskLoc BtreeBasedBuilder::makeEmptyIndex(const IndexDetails& idx) {
         if (0 == idx.version()) {
             return BtreeBucket<V0>::addBucket(idx);
@@ -163,7 +290,8 @@ namespace mongo {
 
 
         phaseOne->sortCmp.reset(getComparison(idx->version(), idx->keyPattern()));
-        phaseOne->sorter.reset(new BSONObjExternalSorter(phaseOne->sortCmp.get()));
+        phaseOne->sorter.reset(new BSONObjExternalSorter(phaseOne->sortCmp.get(),
+                                                         sortMemoryBytes()));
         phaseOne->sorter->hintNumObjects( collection->numRecords() );
 
         BtreeBasedAccessMethod* iam =collection->getIndexCatalog()->getBtreeBasedIndex( idx );
@@ -188,6 +316,72 @@ namespace mongo {
 
     }
 
+    void BtreeBasedBuilder::addKeysInParallel(Collection* collection,
+                                              IndexDescriptor* idx,
+                                              SortPhaseOne* phaseOne,
+                                              ProgressMeter* progressMeter,
+                                              unsigned nThreads,
+                                              bool mayInterrupt) {
+        phaseOne->sortCmp.reset(getComparison(idx->version(), idx->keyPattern()));
+
+        const Collection* scanned = collection;
+        ParallelKeyScan scan;
+        scan.em = scanned->getExtentManager();
+        scan.iam = collection->getIndexCatalog()->getBtreeBasedIndex( idx );
+        scan.cmp = phaseOne->sortCmp.get();
+        scan.sorterMemory = sortMemoryBytes() / nThreads;
+        for (DiskLoc e = collection->details()->firstExtent();
+             !e.isNull();
+             e = scan.em->getExtent(e)->xnext) {
+            scan.extents.push_back(e);
+        }
+
+        vector<ParallelKeyScanResult> results(nThreads);
+        {
+            ThreadPool pool(nThreads);
+            for (unsigned k = 0; k < nThreads; k++) {
+                results[k].phaseOne.reset(new SortPhaseOne());
+                pool.schedule(&BtreeBasedBuilder::scanExtents, &scan, &results[k]);
+            }
+
+            // the scan threads have no Client, so progress and interrupts are handled here
+            unsigned long long reported = 0;
+            try {
+                while (pool.tasks_remaining() > 0) {
+                    sleepmillis(10);
+                    unsigned long long scanned = scan.docsScanned.load();
+                    progressMeter->hit(static_cast<int>(scanned - reported));
+                    reported = scanned;
+                    killCurrentOp.checkForInterrupt( !mayInterrupt );
+                }
+            }
+            catch (...) {
+                scan.abort.store(1);
+                pool.join();
+                throw;
+            }
+            pool.join();
+        }
+
+        for (unsigned k = 0; k < nThreads; k++) {
+            if (results[k].errCode)
+                msgasserted(results[k].errCode, results[k].errMsg);
+        }
+
+        vector<boost::shared_ptr<BSONObjExternalSorter::Iterator> > sorted;
+        for (unsigned k = 0; k < nThreads; k++) {
+            SortPhaseOne* part = results[k].phaseOne.get();
+            phaseOne->n += part->n;
+            phaseOne->nkeys += part->nkeys;
+            phaseOne->multi = phaseOne->multi || part->multi;
+            phaseOne->parts.push_back(results[k].phaseOne);
+            sorted.push_back(part->sorted);
+        }
+        phaseOne->sorted.reset(BSONObjExternalSorter::merge(sorted,
+                                                            phaseOne->sortCmp.get(),
+                                                            mayInterrupt));
+    }
+
     uint64_t BtreeBasedBuilder::fastBuildIndex( Collection* collection,
                                                 IndexDescriptor* idx,
                                                 bool mayInterrupt ) {
@@ -212,57 +406,89 @@ namespace mongo {
                                               collection->numRecords(),
                                               10));
         SortPhaseOne phase1;
-        addKeysToPhaseOne(collection, idx, order, &phase1, pm.get(), mayInterrupt );
-        pm.finished();
+        BSONObjBuilder timings;
+        Timer phaseTimer;
+
+        unsigned nThreads = buildThreads > 0 ? buildThreads : ProcessInfo().getNumCores();
+        if ( nThreads > 1 &&
+             collection->numRecords() >= minRecordsForParallelBuild &&
+             !collection->details()->isCapped() ) {
+            LOG(1) << "\t scanning and sorting keys with " << nThreads << " threads" << endl;
+            addKeysInParallel(collection, idx, &phase1, pm.get(), nThreads, mayInterrupt);
+            pm.finished();
+        }
+        else {
+            addKeysToPhaseOne(collection, idx, order, &phase1, pm.get(), mayInterrupt );
+            pm.finished();
+
+            BSONObjExternalSorter& sorter = *(phase1.sorter);
 
-        BSONObjExternalSorter& sorter = *(phase1.sorter);
+            if ( logger::globalLogDomain()->shouldLog(logger::LogSeverity::Debug(2) ) )
+                printMemInfo( "before final sort" );
+            sorter.sort( mayInterrupt );
+            if ( logger::globalLogDomain()->shouldLog(logger::LogSeverity::Debug(2) ) )
+                printMemInfo( "after final sort" );
+
+            LOG(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles()
+                                         << " files " << " in " << t.seconds() << " secs" << endl;
+            phase1.sorted.reset(sorter.iterator().release());
+        }
 
         if( phase1.multi ) {
             collection->getIndexCatalog()->markMultikey( idx );
         }
 
-        if ( logger::globalLogDomain()->shouldLog(logger::LogSeverity::Debug(2) ) )
-            printMemInfo( "before final sort" );
-        phase1.sorter->sort( mayInterrupt );
-        if ( logger::globalLogDomain()->shouldLog(logger::LogSeverity::Debug(2) ) )
-            printMemInfo( "after final sort" );
-
-        LOG(t.seconds() > 5 ? 0 : 1) << "\t external sort used : " << sorter.numFiles()
-                                     << " files " << " in " << t.seconds() << " secs" << endl;
+        timings.append("scanAndSort", phaseTimer.millis());
+        op->setPhaseTimings(timings.asTempObj());
+        phaseTimer.reset();
 
         set<DiskLoc> dupsToDrop;
+        int bottomUpMillis = 0;
 
         /* build index --- */
         if( idx->version() == 0 )
             buildBottomUpPhases2And3<V0>(dupsAllowed,
                                          idx,
-                                         sorter,
+                                         *phase1.sorted,
                                          dropDups,
                                          dupsToDrop,
                                          op,
                                          &phase1,
                                          pm,
                                          t,
-                                         mayInterrupt);
+                                         mayInterrupt,
+                                         &bottomUpMillis);
         else if( idx->version() == 1 )
             buildBottomUpPhases2And3<V1>(dupsAllowed,
                                          idx,
-                                         sorter,
+                                         *phase1.sorted,
                                          dropDups,
                                          dupsToDrop,
                                          op,
                                          &phase1,
                                          pm,
                                          t,
-                                         mayInterrupt);
+                                         mayInterrupt,
+                                         &bottomUpMillis);
         else
             verify(false);
 
+        timings.append("bottomUp", bottomUpMillis);
+        timings.append("btreeMiddle", phaseTimer.millis() - bottomUpMillis);
+        op->setPhaseTimings(timings.asTempObj());
+        phaseTimer.reset();
+
         if( dropDups )
             log() << "\t fastBuildIndex dupsToDrop:" << dupsToDrop.size() << endl;
 
         doDropDups(collection, dupsToDrop, mayInterrupt);
 
+        timings.append("dropDups", phaseTimer.millis());
+        BSONObj phaseTimings = timings.obj();
+        op->setPhaseTimings(phaseTimings);
+        LOG(t.seconds() > 5 ? 0 : 1) << "\t index build phase timings (ms): " << phaseTimings
+                                     << endl;
+
         return phase1.n;
     }
 
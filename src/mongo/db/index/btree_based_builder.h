@@ -50,6 +50,8 @@ namespace mongo {
     class NamespaceDetails;
     class ProgressMeter;
     class ProgressMeterHolder;
+    struct ParallelKeyScan;
+    struct ParallelKeyScanResult;
     struct SortPhaseOne;
 
     class BtreeBasedBuilder {
@@ -62,6 +64,12 @@ namespace mongo {
         static DiskLoc makeEmptyIndex(const IndexDetails& idx);
         static ExternalSortComparison* getComparison(int version, const BSONObj& keyPattern);
 
+        /**
+         * Number of threads that scan the collection and sort keys in a foreground build, set
+         * with the indexBuildThreads server parameter.  0 means one per core.
+         */
+        static int buildThreads;
+
     private:
         friend class IndexUpdateTests::AddKeysToPhaseOne;
         friend class IndexUpdateTests::InterruptAddKeysToPhaseOne;
@@ -73,6 +81,16 @@ namespace mongo {
                                       const BSONObj& order, SortPhaseOne* phaseOne,
                                       ProgressMeter* progressMeter, bool mayInterrupt );
 
+        /**
+         * Like addKeysToPhaseOne(), but the collection's extents are divided among nThreads
+         * threads that each generate and sort keys on their own.  Sets phaseOne->sorted to the
+         * merge of their output.
+         */
+        static void addKeysInParallel(Collection* collection, IndexDescriptor* idx,
+                                      SortPhaseOne* phaseOne, ProgressMeter* progressMeter,
+                                      unsigned nThreads, bool mayInterrupt);
+        static void scanExtents(ParallelKeyScan* scan, ParallelKeyScanResult* result);
+
         static void doDropDups(Collection* collection, const set<DiskLoc>& dupsToDrop,
                                bool mayInterrupt );
     };
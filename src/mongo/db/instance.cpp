@@ -71,6 +71,7 @@
 #include "mongo/db/repl/is_master.h"
 #include "mongo/db/repl/oplog.h"
 #include "mongo/db/stats/counters.h"
+#include "mongo/db/storage/hmem_storage.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/platform/process_id.h"
 #include "mongo/s/d_logic.h"
@@ -732,7 +733,8 @@ namespace mongo {
         scoped_ptr<Timer> timer;
         int pass = 0;
         bool exhaust = false;
-        QueryResult* msgdata = 0;
+        auto_ptr<Message> resp(new Message());
+        bool ready = false;
         OpTime last;
         while( 1 ) {
             bool isCursorAuthorized = false;
@@ -759,13 +761,14 @@ namespace mongo {
                     }
                 }
 
-                msgdata = processGetMore(ns,
-                                         ntoreturn,
-                                         cursorid,
-                                         curop,
-                                         pass,
-                                         exhaust,
-                                         &isCursorAuthorized);
+                ready = processGetMore(ns,
+                                       ntoreturn,
+                                       cursorid,
+                                       curop,
+                                       pass,
+                                       exhaust,
+                                       &isCursorAuthorized,
+                                       *resp);
             }
             catch ( AssertionException& e ) {
                 if ( isCursorAuthorized ) {
@@ -781,7 +784,7 @@ namespace mongo {
                 break;
             }
             
-            if (msgdata == 0) {
+            if (!ready) {
                 // this should only happen with QueryOption_AwaitData
                 exhaust = false;
                 massert(13073, "shutting down", !inShutdown() );
@@ -823,12 +826,11 @@ namespace mongo {
             return ok;
         }
 
-        Message *resp = new Message();
-        resp->setData(msgdata, true);
-        curop.debug().responseLength = resp->header()->dataLen();
+        QueryResult* msgdata = reinterpret_cast<QueryResult*>(resp->header());
+        curop.debug().responseLength = msgdata->dataLen();
         curop.debug().nreturned = msgdata->nReturned;
 
-        dbresponse.response = resp;
+        dbresponse.response = resp.release();
         dbresponse.responseTo = m.header()->id;
         
         if( exhaust ) {
@@ -1135,6 +1137,8 @@ namespace {
         MemoryMappedFile::closeAllFiles( ss3 );
         log() << ss3.str() << endl;
 
+        shutdownHmemStorage();
+
         if (storageGlobalParams.dur) {
             dur::journalCleanup(true);
         }
@@ -0,0 +1,313 @@
+// expression_compiled.cpp
+
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/matcher/expression_compiled.h"
+
+#include "mongo/bson/bsonobjiterator.h"
+#include "mongo/db/matcher/expression_leaf.h"
+
+namespace mongo {
+
+    namespace {
+
+        // The leaves whose matches() is LeafMatchExpression::matches(), which for a document
+        // without arrays on the path is matchesSingleElement() of the element at the path.
+        bool isSupportedLeaf(const MatchExpression* expr) {
+            switch (expr->matchType()) {
+            case MatchExpression::LTE:
+            case MatchExpression::LT:
+            case MatchExpression::EQ:
+            case MatchExpression::GT:
+            case MatchExpression::GTE:
+            case MatchExpression::REGEX:
+            case MatchExpression::MOD:
+            case MatchExpression::EXISTS:
+            case MatchExpression::MATCH_IN:
+                return !expr->path().empty();
+            default:
+                return false;
+            }
+        }
+
+        // Puts the predicates of 'expr' in 'out'.  Returns false if it isn't a supported leaf or
+        // an AND of them.
+        bool getPredicates(const MatchExpression* expr, std::vector<const MatchExpression*>* out) {
+            if (MatchExpression::AND != expr->matchType()) {
+                out->push_back(expr);
+                return isSupportedLeaf(expr);
+            }
+            for (size_t i = 0; i < expr->numChildren(); ++i) {
+                if (!isSupportedLeaf(expr->getChild(i))) {
+                    return false;
+                }
+                out->push_back(expr->getChild(i));
+            }
+            return true;
+        }
+
+        // The same order as compareElementValues(), which puts NaN below every other number.
+        inline int compareDoubles(double left, double right) {
+            if (left < right)
+                return -1;
+            if (left == right)
+                return 0;
+            if (isNaN(left))
+                return isNaN(right) ? 0 : -1;
+            return 1;
+        }
+
+        // Top level fields found in one pass are tracked in a 64 bit mask.
+        const size_t kMaxTopFields = 64;
+
+    }  // namespace
+
+    //
+    // CompiledMatchShape
+    //
+
+    int CompiledMatchShape::addPath(const StringData& path) {
+        int slot = slotFor(path);
+        if (slot >= 0) {
+            return slot;
+        }
+
+        Path p;
+        p.dotted = path.toString();
+        size_t start = 0;
+        while (true) {
+            size_t dot = p.dotted.find('.', start);
+            std::string part = p.dotted.substr(start, dot == std::string::npos ? std::string::npos
+                                                                               : dot - start);
+            if (part.empty()) {
+                return -1;
+            }
+            p.parts.push_back(part);
+            if (dot == std::string::npos) {
+                break;
+            }
+            start = dot + 1;
+        }
+
+        slot = _paths.size();
+        _paths.push_back(p);
+
+        for (size_t i = 0; i < _topFields.size(); ++i) {
+            if (_topFields[i].name == p.parts[0]) {
+                _topFields[i].slots.push_back(slot);
+                return slot;
+            }
+        }
+        if (_topFields.size() == kMaxTopFields) {
+            return -1;
+        }
+        TopField top;
+        top.name = p.parts[0];
+        top.slots.push_back(slot);
+        _topFields.push_back(top);
+        return slot;
+    }
+
+    // static
+    CompiledMatchShape* CompiledMatchShape::make(const MatchExpression* expr) {
+        std::vector<const MatchExpression*> predicates;
+        if (!getPredicates(expr, &predicates)) {
+            return NULL;
+        }
+
+        std::auto_ptr<CompiledMatchShape> shape(new CompiledMatchShape());
+        for (size_t i = 0; i < predicates.size(); ++i) {
+            if (shape->addPath(predicates[i]->path()) < 0) {
+                return NULL;
+            }
+        }
+        return shape.release();
+    }
+
+    int CompiledMatchShape::slotFor(const StringData& path) const {
+        for (size_t i = 0; i < _paths.size(); ++i) {
+            if (path == _paths[i].dotted) {
+                return i;
+            }
+        }
+        return -1;
+    }
+
+    bool CompiledMatchShape::resolve(const BSONObj& obj, BSONElement* elements) const {
+        for (size_t i = 0; i < _paths.size(); ++i) {
+            elements[i] = BSONElement();
+        }
+
+        // Like BSONObj::getField(), use the first field with a name.
+        unsigned long long seen = 0;
+        size_t found = 0;
+        BSONObjIterator it(obj);
+        while (found < _topFields.size() && it.more()) {
+            BSONElement e = it.next();
+            for (size_t t = 0; t < _topFields.size(); ++t) {
+                const unsigned long long bit = 1ULL << t;
+                if ((seen & bit) || _topFields[t].name != e.fieldName()) {
+                    continue;
+                }
+                seen |= bit;
+                ++found;
+
+                // Follow each path down from here as getFieldDottedOrArray() would.
+                const std::vector<size_t>& slots = _topFields[t].slots;
+                for (size_t i = 0; i < slots.size(); ++i) {
+                    const std::vector<std::string>& parts = _paths[slots[i]].parts;
+                    BSONElement res = e;
+                    for (size_t part = 1; ; ++part) {
+                        if (Array == res.type()) {
+                            return false;
+                        }
+                        if (part == parts.size()) {
+                            break;
+                        }
+                        if (Object != res.type()) {
+                            res = BSONElement();
+                            break;
+                        }
+                        res = res.embeddedObject().getField(parts[part]);
+                        if (res.eoo()) {
+                            break;
+                        }
+                    }
+                    elements[slots[i]] = res;
+                }
+                break;
+            }
+        }
+
+        return true;
+    }
+
+    //
+    // CompiledMatchExpression
+    //
+
+    CompiledMatchExpression::CompiledMatchExpression(
+            const boost::shared_ptr<const CompiledMatchShape>& shape,
+            const MatchExpression* expr)
+        : _shape(shape), _expr(expr), _elements(shape->numPaths()) { }
+
+    // static
+    CompiledMatchExpression* CompiledMatchExpression::bind(
+            const boost::shared_ptr<const CompiledMatchShape>& shape,
+            const MatchExpression* expr) {
+        std::vector<const MatchExpression*> predicates;
+        if (!getPredicates(expr, &predicates)) {
+            return NULL;
+        }
+
+        std::auto_ptr<CompiledMatchExpression> compiled(new CompiledMatchExpression(shape, expr));
+        for (size_t i = 0; i < predicates.size(); ++i) {
+            const MatchExpression* leaf = predicates[i];
+            const int slot = shape->slotFor(leaf->path());
+            if (slot < 0) {
+                return NULL;
+            }
+
+            Predicate p;
+            p.leaf = static_cast<const LeafMatchExpression*>(leaf);
+            p.slot = slot;
+            p.type = leaf->matchType();
+            p.numeric = false;
+            p.rhsType = EOO;
+            p.rhsLong = 0;
+            p.rhsDouble = 0;
+
+            switch (p.type) {
+            case MatchExpression::LTE:
+            case MatchExpression::LT:
+            case MatchExpression::EQ:
+            case MatchExpression::GT:
+            case MatchExpression::GTE: {
+                const BSONElement& rhs =
+                    static_cast<const ComparisonMatchExpression*>(leaf)->getData();
+                if (rhs.isNumber()) {
+                    p.numeric = true;
+                    p.rhsType = rhs.type();
+                    p.rhsDouble = rhs.numberDouble();
+                    if (NumberDouble != p.rhsType) {
+                        p.rhsLong = rhs.numberLong();
+                    }
+                }
+                break;
+            }
+            default:
+                break;
+            }
+
+            compiled->_predicates.push_back(p);
+        }
+
+        return compiled.release();
+    }
+
+    bool CompiledMatchExpression::Predicate::matches(const BSONElement& e) const {
+        if (!numeric || !e.isNumber()) {
+            return leaf->matchesSingleElement(e);
+        }
+
+        // Compare two numbers as compareElementValues() does: exactly if both are NumberInt or
+        // both are NumberLong, and as doubles otherwise.
+        int cmp;
+        if (e.type() == rhsType && NumberDouble != rhsType) {
+            const long long left = e.numberLong();
+            cmp = left < rhsLong ? -1 : (left == rhsLong ? 0 : 1);
+        }
+        else {
+            cmp = compareDoubles(e.numberDouble(), rhsDouble);
+        }
+
+        switch (type) {
+        case MatchExpression::LT: return cmp < 0;
+        case MatchExpression::LTE: return cmp <= 0;
+        case MatchExpression::EQ: return cmp == 0;
+        case MatchExpression::GT: return cmp > 0;
+        case MatchExpression::GTE: return cmp >= 0;
+        default: verify(false); return false;
+        }
+    }
+
+    bool CompiledMatchExpression::matchesBSON(const BSONObj& obj) const {
+        if (!_shape->resolve(obj, _elements.empty() ? NULL : &_elements[0])) {
+            return _expr->matchesBSON(obj, NULL);
+        }
+
+        for (size_t i = 0; i < _predicates.size(); ++i) {
+            if (!_predicates[i].matches(_elements[_predicates[i].slot])) {
+                return false;
+            }
+        }
+        return true;
+    }
+
+}  // namespace mongo
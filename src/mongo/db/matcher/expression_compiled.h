@@ -0,0 +1,137 @@
+// expression_compiled.h
+
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include <boost/shared_ptr.hpp>
+#include <string>
+#include <vector>
+
+#include "mongo/base/disallow_copying.h"
+#include "mongo/bson/bsonobj.h"
+#include "mongo/db/matcher/expression.h"
+
+namespace mongo {
+
+    class LeafMatchExpression;
+
+    /**
+     * The part of a compiled match expression that only depends on its shape: the paths its
+     * predicates read, laid out so that one pass over the top level fields of a document finds
+     * all of them.  Filters of the same shape share one of these.
+     */
+    class CompiledMatchShape {
+        MONGO_DISALLOW_COPYING(CompiledMatchShape);
+    public:
+        /**
+         * Returns NULL unless 'expr' is a leaf predicate, or an AND of them, that the compiled
+         * form supports.  The caller owns the result.
+         */
+        static CompiledMatchShape* make(const MatchExpression* expr);
+
+        size_t numPaths() const { return _paths.size(); }
+
+        /** Returns the slot of 'path', or -1 if the shape doesn't read it. */
+        int slotFor(const StringData& path) const;
+
+        /**
+         * Sets elements[slot] to the element at the path of each slot, or EOO where the document
+         * doesn't have it.  Returns false if a path goes through or ends at an array, which the
+         * compiled form leaves to the MatchExpression.
+         */
+        bool resolve(const BSONObj& obj, BSONElement* elements) const;
+
+    private:
+        CompiledMatchShape() { }
+
+        int addPath(const StringData& path);
+
+        struct Path {
+            std::string dotted;
+            std::vector<std::string> parts;
+        };
+        std::vector<Path> _paths;
+
+        // The slots of the paths that start at each top level field.
+        struct TopField {
+            std::string name;
+            std::vector<size_t> slots;
+        };
+        std::vector<TopField> _topFields;
+    };
+
+    /**
+     * Evaluates a conjunction of leaf predicates on a BSONObj by finding all of the fields they
+     * read in one pass and then testing each field, with code specialized for numbers.  Documents
+     * with arrays on those paths are matched by the MatchExpression it was bound to.
+     *
+     * Refers to the MatchExpression it was bound to, which must outlive it.  Not thread safe.
+     */
+    class CompiledMatchExpression {
+        MONGO_DISALLOW_COPYING(CompiledMatchExpression);
+    public:
+        /**
+         * Binds the predicates of 'expr', whose shape 'shape' was made from, to their slots.
+         * Returns NULL if they don't fit.  The caller owns the result.
+         */
+        static CompiledMatchExpression* bind(
+                const boost::shared_ptr<const CompiledMatchShape>& shape,
+                const MatchExpression* expr);
+
+        /** Returns the same as expr->matchesBSON(obj, NULL). */
+        bool matchesBSON(const BSONObj& obj) const;
+
+    private:
+        CompiledMatchExpression(const boost::shared_ptr<const CompiledMatchShape>& shape,
+                                const MatchExpression* expr);
+
+        struct Predicate {
+            bool matches(const BSONElement& e) const;
+
+            const LeafMatchExpression* leaf;
+            size_t slot;
+            MatchExpression::MatchType type;
+
+            // For comparisons with a number, which are done here rather than by 'leaf'.
+            bool numeric;
+            BSONType rhsType;
+            long long rhsLong;
+            double rhsDouble;
+        };
+
+        boost::shared_ptr<const CompiledMatchShape> _shape;
+        const MatchExpression* _expr;
+        std::vector<Predicate> _predicates;
+
+        // Scratch space for resolve().
+        mutable std::vector<BSONElement> _elements;
+    };
+
+}  // namespace mongo
@@ -0,0 +1,177 @@
+// expression_compiled_test.cpp
+
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+/** Unit tests for CompiledMatchExpression, which must agree with MatchExpression::matchesBSON. */
+
+#include "mongo/unittest/unittest.h"
+
+#include <limits>
+
+#include "mongo/db/jsobj.h"
+#include "mongo/db/json.h"
+#include "mongo/db/matcher/expression_compiled.h"
+#include "mongo/db/matcher/expression_parser.h"
+
+namespace mongo {
+
+    namespace {
+
+        MatchExpression* parse(const BSONObj& query) {
+            StatusWithMatchExpression swme = MatchExpressionParser::parse(query);
+            ASSERT_OK(swme.getStatus());
+            return swme.getValue();
+        }
+
+        CompiledMatchExpression* compile(const MatchExpression* expr) {
+            boost::shared_ptr<const CompiledMatchShape> shape(CompiledMatchShape::make(expr));
+            if (NULL == shape) {
+                return NULL;
+            }
+            return CompiledMatchExpression::bind(shape, expr);
+        }
+
+        vector<BSONObj> documents() {
+            const double nan = std::numeric_limits<double>::quiet_NaN();
+            vector<BSONObj> docs;
+            docs.push_back(BSONObj());
+            docs.push_back(BSON("a" << 5));
+            docs.push_back(BSON("a" << 5.0));
+            docs.push_back(BSON("a" << 5LL));
+            docs.push_back(BSON("a" << 6 << "b" << 1));
+            docs.push_back(BSON("a" << ((1LL << 53) + 1)));
+            docs.push_back(BSON("a" << static_cast<double>(1LL << 53)));
+            docs.push_back(BSON("a" << nan));
+            docs.push_back(BSON("a" << "x"));
+            docs.push_back(BSON("a" << "xyz"));
+            docs.push_back(BSON("a" << BSONNULL));
+            docs.push_back(BSON("a" << BSON_ARRAY(5 << 6)));
+            docs.push_back(BSON("a" << BSON("c" << 1)));
+            docs.push_back(BSON("a" << 1 << "a" << 5));
+            docs.push_back(BSON("b" << BSON("c" << "x")));
+            docs.push_back(BSON("b" << BSON("c" << 2 << "d" << BSON("e" << 3))));
+            docs.push_back(BSON("b" << BSON_ARRAY(BSON("c" << "x"))));
+            docs.push_back(BSON("b" << BSON("c" << BSON_ARRAY(2))));
+            docs.push_back(BSON("b" << 5));
+            docs.push_back(BSON("a" << 4 << "b" << BSON("c" << 2)));
+            return docs;
+        }
+
+        void assertAgrees(const char* query) {
+            scoped_ptr<MatchExpression> expr(parse(fromjson(query)));
+            scoped_ptr<CompiledMatchExpression> compiled(compile(expr.get()));
+            ASSERT(NULL != compiled);
+
+            const vector<BSONObj> docs = documents();
+            for (size_t i = 0; i < docs.size(); ++i) {
+                ASSERT_EQUALS(expr->matchesBSON(docs[i], NULL), compiled->matchesBSON(docs[i]));
+            }
+        }
+
+    }  // namespace
+
+    TEST(CompiledMatchExpression, Comparisons) {
+        assertAgrees("{a: 5}");
+        assertAgrees("{a: 5.0}");
+        assertAgrees("{a: NumberLong(5)}");
+        assertAgrees("{a: {$gt: 4, $lte: 5}}");
+        assertAgrees("{a: {$lt: 6}}");
+        assertAgrees("{a: {$gte: 9007199254740992}}");
+        assertAgrees("{a: NumberLong(\"9007199254740993\")}");
+        assertAgrees("{a: 'x'}");
+        assertAgrees("{a: {$gt: 'x'}}");
+        assertAgrees("{a: null}");
+        assertAgrees("{a: {$gt: {$minKey: 1}}}");
+        assertAgrees("{a: [5, 6]}");
+        assertAgrees("{a: {c: 1}}");
+    }
+
+    TEST(CompiledMatchExpression, NaN) {
+        const double nan = std::numeric_limits<double>::quiet_NaN();
+        const char* ops[] = { "$lt", "$lte", "$gt", "$gte" };
+        const vector<BSONObj> docs = documents();
+        for (size_t op = 0; op < sizeof(ops) / sizeof(ops[0]); ++op) {
+            scoped_ptr<MatchExpression> expr(parse(BSON("a" << BSON(ops[op] << nan))));
+            scoped_ptr<CompiledMatchExpression> compiled(compile(expr.get()));
+            ASSERT(NULL != compiled);
+            for (size_t i = 0; i < docs.size(); ++i) {
+                ASSERT_EQUALS(expr->matchesBSON(docs[i], NULL), compiled->matchesBSON(docs[i]));
+            }
+        }
+    }
+
+    TEST(CompiledMatchExpression, OtherLeaves) {
+        assertAgrees("{a: {$exists: true}}");
+        assertAgrees("{a: {$in: [5, 'x', null]}}");
+        assertAgrees("{a: /^x/}");
+        assertAgrees("{a: {$mod: [2, 1]}}");
+    }
+
+    TEST(CompiledMatchExpression, DottedPaths) {
+        assertAgrees("{'b.c': 'x'}");
+        assertAgrees("{'b.c': 2, 'b.d.e': {$gte: 3}}");
+        assertAgrees("{'b.c': null}");
+        assertAgrees("{a: {$lt: 5}, 'b.c': {$exists: true}}");
+    }
+
+    TEST(CompiledMatchExpression, NotCompiled) {
+        const char* queries[] = {
+            "{$or: [{a: 1}, {b: 1}]}",
+            "{a: {$ne: 1}}",
+            "{a: {$size: 1}}",
+            "{a: {$elemMatch: {c: 1}}}",
+            "{a: {$type: 1}}",
+        };
+        for (size_t i = 0; i < sizeof(queries) / sizeof(queries[0]); ++i) {
+            scoped_ptr<MatchExpression> expr(parse(fromjson(queries[i])));
+            ASSERT(NULL == CompiledMatchShape::make(expr.get()));
+        }
+    }
+
+    TEST(CompiledMatchExpression, SharedShape) {
+        scoped_ptr<MatchExpression> first(parse(fromjson("{a: {$gt: 1}, 'b.c': 'x'}")));
+        boost::shared_ptr<const CompiledMatchShape> shape(CompiledMatchShape::make(first.get()));
+        ASSERT(NULL != shape);
+        ASSERT_EQUALS(2U, shape->numPaths());
+
+        // Same shape, other values and order.
+        scoped_ptr<MatchExpression> second(parse(fromjson("{'b.c': 'y', a: {$gt: 5}}")));
+        scoped_ptr<CompiledMatchExpression> compiled(
+            CompiledMatchExpression::bind(shape, second.get()));
+        ASSERT(NULL != compiled);
+        ASSERT(compiled->matchesBSON(BSON("a" << 6 << "b" << BSON("c" << "y"))));
+        ASSERT(!compiled->matchesBSON(BSON("a" << 2 << "b" << BSON("c" << "y"))));
+        ASSERT(!compiled->matchesBSON(BSON("a" << 6 << "b" << BSON("c" << "x"))));
+
+        // Another path doesn't fit.
+        scoped_ptr<MatchExpression> other(parse(fromjson("{d: 1}")));
+        ASSERT(NULL == CompiledMatchExpression::bind(shape, other.get()));
+    }
+
+}  // namespace mongo
@@ -82,6 +82,9 @@ namespace mongo {
         moe::OptionSection rs_options("Replica set options");
         moe::OptionSection replication_options("Replication options");
         moe::OptionSection sharding_options("Sharding options");
+#if defined(__linux__)
+        moe::OptionSection hmem_options("Hybrid memory options");
+#endif
 
         general_options.addOptionChaining("auth", "auth", moe::Switch, "run with security");
 
@@ -225,6 +228,36 @@ namespace mongo {
                 "(used for internal system diagnostics)")
                                           .hidden();
 
+#if defined(__linux__)
+        hmem_options.addOptionChaining("hmem", "hmem", moe::Switch,
+                "map data files through the hybrid memory cache (RAM and flash); "
+                "requires --nojournal");
+
+        hmem_options.addOptionChaining("hmemFlashPath", "hmemFlashPath", moe::String,
+                "directory for the hybrid memory flash cache files - defaults to dbpath");
+
+        hmem_options.addOptionChaining("hmemPageCacheMB", "hmemPageCacheMB", moe::Int,
+                "size (in MB) of materialized data file pages")
+                                      .setDefault(moe::Value(64));
+
+        hmem_options.addOptionChaining("hmemRAMCacheMB", "hmemRAMCacheMB", moe::Int,
+                "size (in MB) of the hybrid memory RAM cache")
+                                      .setDefault(moe::Value(1024));
+
+        hmem_options.addOptionChaining("hmemFlashCacheMB", "hmemFlashCacheMB", moe::Int,
+                "size (in MB) of the hybrid memory flash cache")
+                                      .setDefault(moe::Value(16 * 1024));
+
+        hmem_options.addOptionChaining("hmemInstances", "hmemInstances", moe::Int,
+                "number of independently locked hybrid memory caches")
+                                      .setDefault(moe::Value(8));
+
+        hmem_options.addOptionChaining("hmemReplacementPolicy", "hmemReplacementPolicy",
+                moe::String,
+                "eviction policy of the hybrid memory page and RAM caches: lru, 2q or arc")
+                                      .setDefault(moe::Value(std::string("lru")));
+
+#endif
         options->addSection(general_options);
 #if defined(_WIN32)
         options->addSection(windows_scm_options);
@@ -233,6 +266,9 @@ namespace mongo {
         options->addSection(ms_options);
         options->addSection(rs_options);
         options->addSection(sharding_options);
+#if defined(__linux__)
+        options->addSection(hmem_options);
+#endif
 #ifdef MONGO_SSL
         options->addSection(ssl_options);
 #endif
@@ -463,6 +499,39 @@ namespace mongo {
         if (params.count("smallfiles")) {
             storageGlobalParams.smallfiles = true;
         }
+        if (params.count("hmem")) {
+            if (storageGlobalParams.dur) {
+                return Status(ErrorCodes::BadValue,
+                              "--hmem requires --nojournal, the journal's private views can't "
+                              "be mapped through hybrid memory");
+            }
+            storageGlobalParams.hmem = true;
+            storageGlobalParams.hmemFlashPath = params.count("hmemFlashPath") ?
+                params["hmemFlashPath"].as<string>() : storageGlobalParams.dbpath;
+
+            const char* sizeOptions[] = { "hmemPageCacheMB", "hmemRAMCacheMB",
+                                          "hmemFlashCacheMB", "hmemInstances" };
+            for (size_t i = 0; i < sizeof(sizeOptions) / sizeof(sizeOptions[0]); ++i) {
+                if (params[sizeOptions[i]].as<int>() <= 0) {
+                    return Status(ErrorCodes::BadValue,
+                                  str::stream() << "bad --" << sizeOptions[i] << " arg");
+                }
+            }
+            const unsigned long long oneMB = 1024 * 1024;
+            storageGlobalParams.hmemPageCacheSize = params["hmemPageCacheMB"].as<int>() * oneMB;
+            storageGlobalParams.hmemRAMCacheSize = params["hmemRAMCacheMB"].as<int>() * oneMB;
+            storageGlobalParams.hmemFlashCacheSize = params["hmemFlashCacheMB"].as<int>() * oneMB;
+            storageGlobalParams.hmemInstances = params["hmemInstances"].as<int>();
+            if (storageGlobalParams.hmemInstances > 128) {
+                return Status(ErrorCodes::BadValue, "--hmemInstances can be at most 128");
+            }
+            string policy = params["hmemReplacementPolicy"].as<string>();
+            if (policy != "lru" && policy != "2q" && policy != "arc") {
+                return Status(ErrorCodes::BadValue,
+                              "--hmemReplacementPolicy must be one of lru, 2q or arc");
+            }
+            storageGlobalParams.hmemReplacementPolicy = policy;
+        }
         if (params.count("diaglog")) {
             int x = params["diaglog"].as<int>();
             if ( x < 0 || x > 7 ) {
@@ -115,13 +115,14 @@ namespace mongo {
         return usingKeyPattern.extractSingleKey( c->current() );
     }
 
-    QueryResult* processGetMore(const char* ns,
-                                int ntoreturn,
-                                long long cursorid,
-                                CurOp& curop,
-                                int pass,
-                                bool& exhaust,
-                                bool* isCursorAuthorized ) {
+    bool processGetMore(const char* ns,
+                        int ntoreturn,
+                        long long cursorid,
+                        CurOp& curop,
+                        int pass,
+                        bool& exhaust,
+                        bool* isCursorAuthorized,
+                        Message& result) {
 
         if (isNewQueryFrameworkEnabled()) {
             bool useNewSystem = false;
@@ -140,7 +141,7 @@ namespace mongo {
 
             if (useNewSystem) {
                 return newGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust,
-                                  isCursorAuthorized);
+                                  isCursorAuthorized, result);
             }
         }
 
@@ -171,7 +172,8 @@ namespace mongo {
             // happens.  Instead, hand them off to the new framework.
             if (NULL != cc->getRunner()) {
                 p.release();
-                return newGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust, isCursorAuthorized);
+                return newGetMore(ns, ntoreturn, cursorid, curop, pass, exhaust, isCursorAuthorized,
+                                  result);
             }
 
             // check for spoofing of the ns such that it does not match the one originally there for the cursor
@@ -225,7 +227,7 @@ namespace mongo {
                             continue;
 
                         if( n == 0 && (queryOptions & QueryOption_AwaitData) && pass < 1000 ) {
-                            return 0;
+                            return false;
                         }
 
                         break;
@@ -315,7 +317,8 @@ namespace mongo {
         qr->nReturned = n;
         b.decouple();
 
-        return qr;
+        result.setData( qr, true );
+        return true;
     }
 
     ResultDetails::ResultDetails() :
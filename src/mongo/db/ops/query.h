@@ -54,14 +54,17 @@ namespace mongo {
      * Return a batch of results from a client OP_GET_MORE request.
      * 'cursorid' - The id of the cursor producing results.
      * 'isCursorAuthorized' - Set to true after a cursor with id 'cursorid' is authorized for use.
+     * 'result' - Receives the reply.  Left empty when false is returned, which a tailable cursor
+     *     with QueryOption_AwaitData does while it waits for more data.
      */
-    QueryResult* processGetMore(const char* ns,
-                                int ntoreturn,
-                                long long cursorid,
-                                CurOp& op,
-                                int pass,
-                                bool& exhaust,
-                                bool* isCursorAuthorized);
+    bool processGetMore(const char* ns,
+                        int ntoreturn,
+                        long long cursorid,
+                        CurOp& op,
+                        int pass,
+                        bool& exhaust,
+                        bool* isCursorAuthorized,
+                        Message& result);
 
     string runQuery(Message& m, QueryMessage& q, CurOp& curop, Message &result);
 
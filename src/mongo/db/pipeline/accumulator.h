@@ -33,6 +33,7 @@
 #include <boost/unordered_set.hpp>
 
 #include "mongo/bson/bsontypes.h"
+#include "mongo/db/pipeline/column_batch.h"
 #include "mongo/db/pipeline/value.h"
 
 namespace mongo {
@@ -45,6 +46,15 @@ namespace mongo {
             processInternal(input, merging);
         }
 
+        /** Process every row of a column in order, as process() would with merging false.
+         *  Subclasses override this to run over the typed arrays of a column of numbers.
+         */
+        virtual void processColumn(const ColumnBatch::Column& column) {
+            for (size_t i = 0; i < column.size(); i++) {
+                processInternal(column.getValue(i), false);
+            }
+        }
+
         /** Marks the end of the evaluate() phase and return accumulated result.
          *  toBeMerged should be true when the outputs will be merged by process().
          */
@@ -123,6 +133,7 @@ namespace mongo {
     class AccumulatorSum : public Accumulator {
     public:
         virtual void processInternal(const Value& input, bool merging);
+        virtual void processColumn(const ColumnBatch::Column& column);
         virtual Value getValue(bool toBeMerged) const;
         virtual const char* getOpName() const;
         virtual void reset();
@@ -141,6 +152,7 @@ namespace mongo {
     class AccumulatorMinMax : public Accumulator {
     public:
         virtual void processInternal(const Value& input, bool merging);
+        virtual void processColumn(const ColumnBatch::Column& column);
         virtual Value getValue(bool toBeMerged) const;
         virtual const char* getOpName() const;
         virtual void reset();
@@ -175,6 +187,7 @@ namespace mongo {
     class AccumulatorAvg : public Accumulator {
     public:
         virtual void processInternal(const Value& input, bool merging);
+        virtual void processColumn(const ColumnBatch::Column& column);
         virtual Value getValue(bool toBeMerged) const;
         virtual const char* getOpName() const;
         virtual void reset();
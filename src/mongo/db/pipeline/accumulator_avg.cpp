@@ -58,6 +58,22 @@ namespace {
         }
     }
 
+    void AccumulatorAvg::processColumn(const ColumnBatch::Column& column) {
+        if (column.numericType() == EOO) {
+            // not all numbers, so skip the non numeric rows one at a time
+            Accumulator::processColumn(column);
+            return;
+        }
+
+        const vector<double>& doubles = column.doubles();
+        double total = _total;
+        for (size_t i = 0; i < doubles.size(); i++) {
+            total += doubles[i];
+        }
+        _total = total;
+        _count += doubles.size();
+    }
+
     intrusive_ptr<Accumulator> AccumulatorAvg::create() {
         return new AccumulatorAvg();
     }
@@ -33,6 +33,19 @@
 
 namespace mongo {
 
+namespace {
+    // Compares as Value::compare() does, which puts NaN below every other number.
+    inline int compareDoubles(double left, double right) {
+        if (left < right)
+            return -1;
+        if (left == right)
+            return 0;
+        if (isNaN(left))
+            return isNaN(right) ? 0 : -1;
+        return 1;
+    }
+}
+
     void AccumulatorMinMax::processInternal(const Value& input, bool merging) {
         // nullish values should have no impact on result
         if (!input.nullish()) {
@@ -45,6 +58,53 @@ namespace mongo {
         }
     }
 
+    void AccumulatorMinMax::processColumn(const ColumnBatch::Column& column) {
+        const BSONType columnType = column.numericType();
+        if (columnType == EOO || column.size() == 0) {
+            Accumulator::processColumn(column);
+            return;
+        }
+
+        if (columnType == NumberDouble) {
+            // Value::compare() compares an int or long with a double as doubles but two longs
+            // exactly, so a column mixing them is compared a row at a time.
+            for (size_t i = 0; i < column.size(); i++) {
+                if (column.type(i) != NumberDouble) {
+                    Accumulator::processColumn(column);
+                    return;
+                }
+            }
+        }
+
+        // Find the first row with the extreme value, comparing as Value::compare() would, and
+        // only process that one.
+        size_t best = 0;
+        if (columnType == NumberDouble) {
+            const vector<double>& doubles = column.doubles();
+            for (size_t i = 1; i < doubles.size(); i++) {
+                if (compareDoubles(doubles[i], doubles[best]) * _sense < 0)
+                    best = i;
+            }
+        }
+        else {
+            const vector<long long>& longs = column.longs();
+            if (_sense == 1) {
+                for (size_t i = 1; i < longs.size(); i++) {
+                    if (longs[i] < longs[best])
+                        best = i;
+                }
+            }
+            else {
+                for (size_t i = 1; i < longs.size(); i++) {
+                    if (longs[i] > longs[best])
+                        best = i;
+                }
+            }
+        }
+
+        processInternal(column.getValue(best), false);
+    }
+
     Value AccumulatorMinMax::getValue(bool toBeMerged) const {
         return _val;
     }
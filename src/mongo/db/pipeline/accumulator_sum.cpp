@@ -56,6 +56,39 @@ namespace mongo {
         }
     }
 
+    void AccumulatorSum::processColumn(const ColumnBatch::Column& column) {
+        const BSONType columnType = column.numericType();
+        if (columnType == EOO) {
+            // not all numbers, so skip the non numeric rows one at a time
+            Accumulator::processColumn(column);
+            return;
+        }
+
+        // Widening once for the whole column gives the same total as widening at the first
+        // wider row: once the total is a double only doubleTotal is used.
+        totalType = Value::getWidestNumeric(totalType, columnType);
+
+        if (totalType == NumberDouble) {
+            const vector<double>& doubles = column.doubles();
+            double total = doubleTotal;
+            for (size_t i = 0; i < doubles.size(); i++) {
+                total += doubles[i];
+            }
+            doubleTotal = total;
+        }
+        else {
+            const vector<long long>& longs = column.longs();
+            long long longSum = longTotal;
+            double doubleSum = doubleTotal;
+            for (size_t i = 0; i < longs.size(); i++) {
+                longSum += longs[i];
+                doubleSum += longs[i];
+            }
+            longTotal = longSum;
+            doubleTotal = doubleSum;
+        }
+    }
+
     intrusive_ptr<Accumulator> AccumulatorSum::create() {
         return new AccumulatorSum();
     }
@@ -0,0 +1,117 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pipeline/column_batch.h"
+
+namespace mongo {
+
+    ColumnBatch::ColumnBatch(const vector<string>& fieldNames)
+        : _fieldNames(fieldNames)
+        , _columns(fieldNames.size())
+        , _rows(0)
+    {}
+
+    void ColumnBatch::clear() {
+        _rows = 0;
+        _buf.reset();
+        _offsets.clear();
+        for (size_t i = 0; i < _columns.size(); i++) {
+            _columns[i]._elements.clear();
+            _columns[i]._doubles.clear();
+            _columns[i]._longs.clear();
+        }
+    }
+
+    void ColumnBatch::append(const BSONObj& obj) {
+        const size_t nColumns = _fieldNames.size();
+
+        // One pass over the document finds all of the fields.
+        _rowScratch.assign(nColumns, BSONElement());
+        size_t found = 0;
+        BSONObjIterator it(obj);
+        while (found < nColumns && it.more()) {
+            BSONElement elem = it.next();
+            for (size_t i = 0; i < nColumns; i++) {
+                if (_rowScratch[i].eoo() && _fieldNames[i] == elem.fieldName()) {
+                    _rowScratch[i] = elem;
+                    found++;
+                    break;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < nColumns; i++) {
+            if (_rowScratch[i].eoo()) {
+                _offsets.push_back(-1);
+            }
+            else {
+                _offsets.push_back(_buf.len());
+                _buf.appendBuf(_rowScratch[i].rawdata(), _rowScratch[i].size());
+            }
+        }
+        _rows++;
+    }
+
+    void ColumnBatch::finish() {
+        const size_t nColumns = _fieldNames.size();
+        for (size_t i = 0; i < nColumns; i++) {
+            Column& column = _columns[i];
+            column._elements.resize(_rows);
+            column._numericType = NumberInt; // widened below
+            for (size_t row = 0; row < _rows; row++) {
+                const int offset = _offsets[row * nColumns + i];
+                BSONElement elem = offset < 0 ? BSONElement() : BSONElement(_buf.buf() + offset);
+                column._elements[row] = elem;
+
+                if (!elem.isNumber())
+                    column._numericType = EOO;
+                else if (column._numericType != EOO)
+                    column._numericType = Value::getWidestNumeric(column._numericType,
+                                                                  elem.type());
+            }
+
+            if (column._numericType == EOO)
+                continue;
+
+            column._doubles.resize(_rows);
+            for (size_t row = 0; row < _rows; row++) {
+                column._doubles[row] = column._elements[row].numberDouble();
+            }
+
+            if (column._numericType != NumberDouble) {
+                column._longs.resize(_rows);
+                for (size_t row = 0; row < _rows; row++) {
+                    column._longs[row] = column._elements[row].numberLong();
+                }
+            }
+        }
+    }
+
+}
@@ -0,0 +1,114 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#pragma once
+
+#include "mongo/pch.h"
+
+#include "mongo/bson/util/builder.h"
+#include "mongo/db/jsobj.h"
+#include "mongo/db/pipeline/value.h"
+
+namespace mongo {
+
+    /**
+     * A batch of input documents held as one column for each of a few top level fields, for
+     * stages that only read those fields and so don't need a Document built for each input.
+     *
+     * The fields are copied out of the documents into a single buffer, so a batch doesn't refer
+     * to the records it was loaded from and costs the same however wide the documents are.  A
+     * column of numbers also keeps them in typed arrays, so they can be summed or compared in
+     * tight loops.
+     */
+    class ColumnBatch : boost::noncopyable {
+    public:
+        class Column {
+        public:
+            Column() : _numericType(EOO) {}
+
+            size_t size() const { return _elements.size(); }
+
+            /** Returns the value in 'row', missing if the document didn't have the field. */
+            Value getValue(size_t row) const { return Value(_elements[row]); }
+
+            /** Returns the BSON type of 'row', EOO if the document didn't have the field. */
+            BSONType type(size_t row) const { return _elements[row].type(); }
+
+            /**
+             * Returns the widest numeric type in the column, or EOO if any row is missing or not
+             * a number.  If it is NumberInt or NumberLong, longs() holds every row.
+             */
+            BSONType numericType() const { return _numericType; }
+
+            /** Every row as a double.  Only valid if numericType() isn't EOO. */
+            const vector<double>& doubles() const { return _doubles; }
+
+            /** Every row as a long long. Only valid if numericType() is NumberInt or NumberLong. */
+            const vector<long long>& longs() const { return _longs; }
+
+        private:
+            friend class ColumnBatch;
+
+            vector<BSONElement> _elements; // pointing into ColumnBatch::_buf
+            BSONType _numericType;
+            vector<double> _doubles;
+            vector<long long> _longs;
+        };
+
+        /** The columns will be the named top level fields, in this order. */
+        explicit ColumnBatch(const vector<string>& fieldNames);
+
+        /** Removes all rows. */
+        void clear();
+
+        /** Copies the columns' fields of 'obj' into a new row. */
+        void append(const BSONObj& obj);
+
+        /** Must be called after the last append() and before reading the columns. */
+        void finish();
+
+        size_t size() const { return _rows; }
+        size_t numColumns() const { return _fieldNames.size(); }
+        const Column& column(size_t i) const { return _columns[i]; }
+
+        /** Approximate bytes held by the rows appended so far. */
+        int memUsage() const { return _buf.len() + _offsets.size() * sizeof(int); }
+
+    private:
+        const vector<string> _fieldNames;
+        vector<Column> _columns;
+        size_t _rows;
+
+        // The fields of every row, and for each row and column the offset of its field in _buf
+        // or -1 if the document didn't have it.  Offsets, as _buf moves when it grows.
+        BufBuilder _buf;
+        vector<int> _offsets;
+        vector<BSONElement> _rowScratch;
+    };
+
+}
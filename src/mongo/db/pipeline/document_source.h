@@ -49,6 +49,7 @@
 
 namespace mongo {
     class Accumulator;
+    class ColumnBatch;
     class Cursor;
     class Document;
     class Expression;
@@ -65,6 +66,16 @@ namespace mongo {
          */
         virtual boost::optional<Document> getNext() = 0;
 
+        /**
+         * Loads the next input documents into 'batch', as columns of the top level fields it
+         * was made for, without building a Document for each of them.
+         *
+         * Returns false once the source is exhausted, and always for sources that can't do this,
+         * which is the default.  After false the caller can still use getNext(), but can't mix
+         * the two otherwise.
+         */
+        virtual bool getNextBatch(ColumnBatch* batch) { return false; }
+
         /**
          * Inform the source that it is no longer needed and may release its resources.  After
          * dispose() is called the source must still be able to handle iteration requests, but may
@@ -351,6 +362,7 @@ namespace mongo {
         // virtuals from DocumentSource
         virtual ~DocumentSourceCursor();
         virtual boost::optional<Document> getNext();
+        virtual bool getNextBatch(ColumnBatch* batch);
         virtual const char *getSourceName() const;
         virtual Value serialize(bool explain = false) const;
         virtual void setSource(DocumentSource *pSource);
@@ -414,7 +426,8 @@ namespace mongo {
             CursorId cursorId,
             const intrusive_ptr<ExpressionContext> &pExpCtx);
 
-        void loadBatch();
+        /// Loads into 'columns' instead of _currentBatch if it isn't NULL.
+        void loadBatch(ColumnBatch* columns = NULL);
 
         std::deque<Document> _currentBatch;
 
@@ -431,6 +444,94 @@ namespace mongo {
     };
 
 
+    /**
+     * Runs the $match, $project and $group stages that start a pipeline on several threads and
+     * returns their partial groups, to be merged by the $group that follows this source in the
+     * same way mongos merges the groups of the shards.
+     *
+     * Each thread scans a contiguous range of the collection's extents with its own copy of the
+     * stages.  The partials of each thread are returned in the order of their ranges, so $first,
+     * $last and $push see documents in the same order a serial collection scan would.
+     *
+     * The scan threads take no locks.  The thread calling getNext() holds the read lock while
+     * they run, checks for interrupts, and yields the lock to waiting operations once all the
+     * scan threads have stopped at a checkpoint, which they reach every 128 records.  A
+     * stopped thread holds only the DiskLoc of its next record, which is moved on if that record
+     * is deleted during the yield.  If the collection is dropped, renamed or compacted during a
+     * yield the scan fails.  An object of this type may only be used by one thread.
+     */
+    class DocumentSourceParallelGroup :
+        public DocumentSource {
+    public:
+        // virtuals from DocumentSource
+        virtual ~DocumentSourceParallelGroup();
+        virtual boost::optional<Document> getNext();
+        virtual const char *getSourceName() const;
+        virtual Value serialize(bool explain = false) const;
+        virtual void setSource(DocumentSource *pSource);
+        virtual bool isValidInitialSource() const { return true; }
+        virtual void dispose();
+
+        /**
+         * @param ns the collection to scan
+         * @param query the initial $match, applied as records are scanned
+         * @param deps the fields the stages depend on
+         * @param stages the serialized stages each thread runs, ending with the $group
+         * @param nThreads the number of threads to run them on
+         * @param pExpCtx the expression context for the pipeline
+         */
+        static intrusive_ptr<DocumentSourceParallelGroup> create(
+            const string& ns,
+            const BSONObj& query,
+            const set<string>& deps,
+            const vector<Value>& stages,
+            unsigned nThreads,
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        static const char parallelGroupName[];
+
+        /**
+         * Number of threads a pipeline starting with $match, $project and $group stages is run
+         * on, set by the aggregationGroupThreads server parameter.  1 runs it on the calling
+         * thread only.  0 means one per core.
+         */
+        static int groupThreads;
+
+        /** Collections with fewer records aren't worth starting threads for. */
+        static long long minRecords;
+
+    private:
+        DocumentSourceParallelGroup(
+            const string& ns,
+            const BSONObj& query,
+            const set<string>& deps,
+            const vector<Value>& stages,
+            unsigned nThreads,
+            const intrusive_ptr<ExpressionContext> &pExpCtx);
+
+        /// Runs the stages on the scan threads and waits for them.
+        void populate();
+
+        struct Worker;
+        static void runWorker(Worker* worker);
+
+        class AbortStatus;
+
+        string _ns;
+        BSONObj _query;
+        set<string> _deps;
+        vector<Value> _stages;
+        unsigned _nThreads;
+
+        // Must outlive the workers, whose expression contexts refer to it.
+        boost::scoped_ptr<AbortStatus> _abortStatus;
+
+        bool _populated;
+        vector<boost::shared_ptr<Worker> > _workers;
+        size_t _currentWorker; // the worker whose partials getNext() is returning
+    };
+
+
     class DocumentSourceGroup : public DocumentSource
                               , public SplittableDocumentSource {
     public:
@@ -526,6 +627,39 @@ namespace mongo {
         typedef boost::unordered_map<Value, Accumulators, Value::Hash> GroupsMap;
         GroupsMap groups;
 
+        typedef vector<shared_ptr<Sorter<Value, Value>::Iterator> > SortedFiles;
+
+        /**
+         * Spills the groups to sortedFiles once memoryUsageBytes is over the limit, or fails if
+         * external sort isn't allowed.
+         */
+        void spillIfOverLimit(int* memoryUsageBytes, SortedFiles* sortedFiles);
+
+        /**
+         * Returns the accumulators of the group for 'id', adding the group if it is new.  Takes
+         * the memory used by the accumulators out of memoryUsageBytes, for the caller to add
+         * back after processing.
+         */
+        Accumulators& getGroup(Value id, int* memoryUsageBytes, bool* inserted);
+
+        /*
+          If the _id and the argument of each accumulator are constants or top level fields of
+          the input, the input can be read as columns of those fields rather than as Documents.
+          planColumns() checks this and fills in _columnFields, _idColumn and _argColumns.
+          processBatch() then does what populate() does for each Document.
+         */
+        bool planColumns();
+        bool addColumn(const intrusive_ptr<Expression>& expression, int* column, Value* constant);
+        void processBatch(const ColumnBatch& batch,
+                          int* memoryUsageBytes,
+                          SortedFiles* sortedFiles);
+
+        vector<string> _columnFields;
+        int _idColumn; // -1 when the _id is the constant _idConstant
+        Value _idConstant;
+        vector<int> _argColumns; // parallels vpExpression, -1 for the constants in _argConstants
+        vector<Value> _argConstants;
+
         /*
           The field names for the result documents and the accumulator
           factories for the result documents.  The Expressions are the
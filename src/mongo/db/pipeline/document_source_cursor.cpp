@@ -33,6 +33,7 @@
 #include "mongo/db/clientcursor.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/ops/query.h"
+#include "mongo/db/pipeline/column_batch.h"
 #include "mongo/db/pipeline/document.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/s/d_logic.h"
@@ -63,6 +64,18 @@ namespace mongo {
         return out;
     }
 
+    bool DocumentSourceCursor::getNextBatch(ColumnBatch* batch) {
+        pExpCtx->checkForInterrupt();
+
+        // Documents already loaded for getNext() can't be returned as columns.
+        verify(_currentBatch.empty());
+
+        batch->clear();
+        loadBatch(batch);
+        batch->finish();
+        return batch->size() > 0;
+    }
+
     void DocumentSourceCursor::dispose() {
         if (_cursorId) {
             ClientCursor::erase(_cursorId);
@@ -72,7 +85,7 @@ namespace mongo {
         _currentBatch.clear();
     }
 
-    void DocumentSourceCursor::loadBatch() {
+    void DocumentSourceCursor::loadBatch(ColumnBatch* columns) {
         if (!_cursorId) {
             dispose();
             return;
@@ -96,9 +109,15 @@ namespace mongo {
         BSONObj obj;
         Runner::RunnerState state;
         while ((state = runner->getNext(&obj, NULL)) == Runner::RUNNER_ADVANCED) {
-            // TODO SERVER-11831: consider using documentFromBsonWithDeps(obj, _dependencies)
-
-            _currentBatch.push_back(Document(obj));
+            if (columns) {
+                columns->append(obj);
+                memUsageBytes = columns->memUsage();
+            }
+            else {
+                // TODO SERVER-11831: consider using documentFromBsonWithDeps(obj, _dependencies)
+                _currentBatch.push_back(Document(obj));
+                memUsageBytes += _currentBatch.back().getApproximateSize();
+            }
 
             if (_limit) {
                 if (++_docsAddedToBatches == _limit->getLimit()) {
@@ -107,8 +126,6 @@ namespace mongo {
                 verify(_docsAddedToBatches < _limit->getLimit());
             }
 
-            memUsageBytes += _currentBatch.back().getApproximateSize();
-
             if (memUsageBytes > MaxBytesToReturnToClientAtOnce) {
                 // End this batch and prepare cursor for yielding.
                 runner->saveState();
@@ -31,6 +31,7 @@
 
 #include "mongo/db/jsobj.h"
 #include "mongo/db/pipeline/accumulator.h"
+#include "mongo/db/pipeline/column_batch.h"
 #include "mongo/db/pipeline/document.h"
 #include "mongo/db/pipeline/document_source.h"
 #include "mongo/db/pipeline/expression.h"
@@ -176,6 +177,7 @@ namespace mongo {
     DocumentSourceGroup::DocumentSourceGroup(const intrusive_ptr<ExpressionContext>& pExpCtx)
         : DocumentSource(pExpCtx)
         , populated(false)
+        , _idColumn(-1)
         , _doingMerge(false)
         , _spilled(false)
         , _extSortAllowed(pExpCtx->extSortAllowed && !pExpCtx->inRouter)
@@ -351,54 +353,67 @@ namespace mongo {
         };
     }
 
+    DocumentSourceGroup::Accumulators& DocumentSourceGroup::getGroup(Value id,
+                                                                     int* memoryUsageBytes,
+                                                                     bool* inserted) {
+        /* treat missing values the same as NULL SERVER-4674 */
+        if (id.missing())
+            id = Value(BSONNULL);
+
+        /*
+          Look for the _id value in the map; if it's not there, add a
+          new entry with a blank accumulator.
+        */
+        const size_t numAccumulators = vpAccumulatorFactory.size();
+        const size_t oldSize = groups.size();
+        Accumulators& group = groups[id];
+        *inserted = groups.size() != oldSize;
+
+        if (*inserted) {
+            *memoryUsageBytes += id.getApproximateSize();
+
+            // Add the accumulators
+            group.reserve(numAccumulators);
+            for (size_t i = 0; i < numAccumulators; i++) {
+                group.push_back(vpAccumulatorFactory[i]());
+            }
+        } else {
+            for (size_t i = 0; i < numAccumulators; i++) {
+                // subtract old mem usage. New usage added back after processing.
+                *memoryUsageBytes -= group[i]->memUsageForSorter();
+            }
+        }
+
+        return group;
+    }
+
     void DocumentSourceGroup::populate() {
         const size_t numAccumulators = vpAccumulatorFactory.size();
         dassert(numAccumulators == vpExpression.size());
 
         // pushed to on spill()
-        vector<shared_ptr<Sorter<Value, Value>::Iterator> > sortedFiles;
+        SortedFiles sortedFiles;
         int memoryUsageBytes = 0;
 
+        // Consume as much input as pSource returns in columns, if we can use them.
+        if (planColumns()) {
+            ColumnBatch batch(_columnFields);
+            while (pSource->getNextBatch(&batch)) {
+                processBatch(batch, &memoryUsageBytes, &sortedFiles);
+            }
+        }
+
         // This loop consumes all input from pSource and buckets it based on pIdExpression.
         while (boost::optional<Document> input = pSource->getNext()) {
-            if (memoryUsageBytes > _maxMemoryUsageBytes) {
-                uassert(16945, "Exceeded memory limit for $group, but didn't allow external sort",
-                        _extSortAllowed);
-                sortedFiles.push_back(spill());
-                memoryUsageBytes = 0;
-            }
+            spillIfOverLimit(&memoryUsageBytes, &sortedFiles);
 
             _variables->setRoot(*input);
 
             /* get the _id value */
-            Value id = pIdExpression->evaluate(_variables.get());
-
-            /* treat missing values the same as NULL SERVER-4674 */
-            if (id.missing())
-                id = Value(BSONNULL);
-
-            /*
-              Look for the _id value in the map; if it's not there, add a
-              new entry with a blank accumulator.
-            */
-            const size_t oldSize = groups.size();
-            vector<intrusive_ptr<Accumulator> >& group = groups[id];
-            const bool inserted = groups.size() != oldSize;
-
-            if (inserted) {
-                memoryUsageBytes += id.getApproximateSize();
-
-                // Add the accumulators
-                group.reserve(numAccumulators);
-                for (size_t i = 0; i < numAccumulators; i++) {
-                    group.push_back(vpAccumulatorFactory[i]());
-                }
-            } else {
-                for (size_t i = 0; i < numAccumulators; i++) {
-                    // subtract old mem usage. New usage added back after processing.
-                    memoryUsageBytes -= group[i]->memUsageForSorter();
-                }
-            }
+            bool inserted;
+            Accumulators& group = getGroup(pIdExpression->evaluate(_variables.get()),
+                                           &memoryUsageBytes,
+                                           &inserted);
 
             /* tickle all the accumulators for the group we found */
             dassert(numAccumulators == group.size());
@@ -452,6 +467,126 @@ namespace mongo {
         populated = true;
     }
 
+namespace {
+    /** Returns the field if 'expression' is a top level field of the input, else "". */
+    string topLevelField(const intrusive_ptr<Expression>& expression) {
+        const ExpressionFieldPath* fieldPath =
+            dynamic_cast<const ExpressionFieldPath*>(expression.get());
+        if (!fieldPath)
+            return "";
+
+        const FieldPath& path = fieldPath->getFieldPath();
+        if (path.getPathLength() != 2)
+            return "";
+        if (path.getFieldName(0) != "CURRENT" && path.getFieldName(0) != "ROOT")
+            return "";
+        return path.getFieldName(1);
+    }
+}
+
+    bool DocumentSourceGroup::addColumn(const intrusive_ptr<Expression>& expression,
+                                        int* column,
+                                        Value* constant) {
+        if (const ExpressionConstant* expConst =
+                dynamic_cast<const ExpressionConstant*>(expression.get())) {
+            *column = -1;
+            *constant = expConst->getValue();
+            return true;
+        }
+
+        const string field = topLevelField(expression);
+        if (field.empty())
+            return false;
+
+        const vector<string>::iterator it =
+            std::find(_columnFields.begin(), _columnFields.end(), field);
+        *column = it - _columnFields.begin();
+        if (it == _columnFields.end())
+            _columnFields.push_back(field);
+        return true;
+    }
+
+    bool DocumentSourceGroup::planColumns() {
+        // Merging needs process() to be called with merging true, which columns don't do.
+        if (_doingMerge)
+            return false;
+
+        _columnFields.clear();
+        _argColumns.assign(vpExpression.size(), -1);
+        _argConstants.assign(vpExpression.size(), Value());
+
+        if (!addColumn(pIdExpression, &_idColumn, &_idConstant))
+            return false;
+
+        for (size_t i = 0; i < vpExpression.size(); i++) {
+            if (!addColumn(vpExpression[i], &_argColumns[i], &_argConstants[i]))
+                return false;
+        }
+
+        return true;
+    }
+
+    void DocumentSourceGroup::spillIfOverLimit(int* memoryUsageBytes, SortedFiles* sortedFiles) {
+        if (*memoryUsageBytes > _maxMemoryUsageBytes) {
+            uassert(16945, "Exceeded memory limit for $group, but didn't allow external sort",
+                    _extSortAllowed);
+            sortedFiles->push_back(spill());
+            *memoryUsageBytes = 0;
+        }
+    }
+
+    void DocumentSourceGroup::processBatch(const ColumnBatch& batch,
+                                           int* memoryUsageBytes,
+                                           SortedFiles* sortedFiles) {
+        const size_t numAccumulators = vpAccumulatorFactory.size();
+
+        if (_idColumn < 0) {
+            // The whole batch is in one group, so each accumulator can take a whole column.
+            spillIfOverLimit(memoryUsageBytes, sortedFiles);
+
+            bool inserted;
+            Accumulators& group = getGroup(_idConstant, memoryUsageBytes, &inserted);
+            for (size_t i = 0; i < numAccumulators; i++) {
+                if (_argColumns[i] >= 0) {
+                    group[i]->processColumn(batch.column(_argColumns[i]));
+                }
+                else {
+                    for (size_t row = 0; row < batch.size(); row++) {
+                        group[i]->process(_argConstants[i], false);
+                    }
+                }
+                *memoryUsageBytes += group[i]->memUsageForSorter();
+            }
+            return;
+        }
+
+        // mirrors the loop over Documents in populate()
+        const ColumnBatch::Column& idColumn = batch.column(_idColumn);
+        for (size_t row = 0; row < batch.size(); row++) {
+            spillIfOverLimit(memoryUsageBytes, sortedFiles);
+
+            bool inserted;
+            Accumulators& group = getGroup(idColumn.getValue(row), memoryUsageBytes, &inserted);
+            for (size_t i = 0; i < numAccumulators; i++) {
+                group[i]->process(_argColumns[i] >= 0
+                                      ? batch.column(_argColumns[i]).getValue(row)
+                                      : _argConstants[i],
+                                  false);
+                *memoryUsageBytes += group[i]->memUsageForSorter();
+            }
+
+            DEV {
+                // In debug mode, spill every time we have a duplicate id to stress merge logic.
+                if (!inserted
+                        && !pExpCtx->inRouter
+                        && !_extSortAllowed
+                        && sortedFiles->size() < 20) {
+                    sortedFiles->push_back(spill());
+                }
+            }
+        }
+    }
+
     class DocumentSourceGroup::SpillSTLComparator {
     public:
         bool operator() (const GroupsMap::value_type* lhs, const GroupsMap::value_type* rhs) const {
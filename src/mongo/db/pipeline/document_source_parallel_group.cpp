@@ -0,0 +1,573 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/db/pipeline/document_source.h"
+
+#include "mongo/db/instance.h"
+#include "mongo/db/interrupt_status.h"
+#include "mongo/db/ops/query.h"
+#include "mongo/db/pipeline/column_batch.h"
+#include "mongo/db/pipeline/pipeline.h"
+#include "mongo/db/query/runner.h"
+#include "mongo/db/query/runner_yield_policy.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/db/storage/extent.h"
+#include "mongo/db/storage/extent_manager.h"
+#include "mongo/db/storage_options.h"
+#include "mongo/db/structure/collection.h"
+#include "mongo/util/concurrency/thread_pool.h"
+#include "mongo/util/fail_point_service.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    // For tests: keeps yielding the read lock, once it has been yielded, until turned off
+    MONGO_FP_DECLARE(parallelGroupHangWhileYielded);
+
+    const char DocumentSourceParallelGroup::parallelGroupName[] = "$parallelGroup";
+
+    int DocumentSourceParallelGroup::groupThreads = 1;
+
+    long long DocumentSourceParallelGroup::minRecords = 100000;
+
+namespace {
+    ExportedServerParameter<int> aggregationGroupThreadsParameter(
+            ServerParameterSet::getGlobal(),
+            "aggregationGroupThreads",
+            &DocumentSourceParallelGroup::groupThreads,
+            true,
+            true);
+
+    const int stoppedCode = 17294;
+
+    // how often the thread holding the read lock offers to yield it to waiting operations
+    const int yieldIntervalMillis = 10;
+
+    // records a scan thread reads between offers to stop for a yield
+    const int recordsPerCheckpoint = 128;
+
+    /**
+     * Lets the thread that holds the read lock yield it while the scan threads are stopped
+     * between records, where each holds only the DiskLoc of the next record it will read.
+     */
+    class YieldGate : boost::noncopyable {
+    public:
+        explicit YieldGate(size_t nRunning)
+            : _mutex("YieldGate"), _nRunning(nRunning), _nParked(0), _parking(false) { }
+
+        /**
+         * Called by a scan thread between records.  'next' is the record it reads next, or NULL
+         * if it is between extents.  If the record is deleted while the thread is stopped here,
+         * 'next' is moved on to the following record of the extent.
+         */
+        void checkpoint(DiskLoc* next) {
+            scoped_lock lk(_mutex);
+            if (!_parking)
+                return;
+            if (next)
+                _parkedPositions.insert(next);
+            _nParked++;
+            _changed.notify_all();
+            while (_parking)
+                _changed.wait(lk.boost());
+            _nParked--;
+            if (next)
+                _parkedPositions.erase(next);
+        }
+
+        /** 'dl' is about to be deleted.  Moves on the stopped scan threads about to read it. */
+        void invalidate(const DiskLoc& dl, const ExtentManager* em) {
+            scoped_lock lk(_mutex);
+            for (set<DiskLoc*>::const_iterator it = _parkedPositions.begin();
+                 it != _parkedPositions.end();
+                 ++it) {
+                if (**it == dl)
+                    **it = em->getNextRecordInExtent(dl);
+            }
+        }
+
+        /** Called by a scan thread when it stops, whether or not it succeeded. */
+        void done() {
+            scoped_lock lk(_mutex);
+            _nRunning--;
+            _changed.notify_all();
+        }
+
+        /** Asks the scan threads to stop at their next checkpoint. */
+        void park() {
+            scoped_lock lk(_mutex);
+            _parking = true;
+        }
+
+        /** Waits up to 'millis' for the running scan threads to stop.  True if they all have. */
+        bool waitParked(int millis) {
+            scoped_lock lk(_mutex);
+            if (_nParked < _nRunning)
+                _changed.timed_wait(lk.boost(), boost::posix_time::milliseconds(millis));
+            return _nParked >= _nRunning;
+        }
+
+        /** Lets the stopped scan threads go on. */
+        void resume() {
+            scoped_lock lk(_mutex);
+            _parking = false;
+            _changed.notify_all();
+        }
+
+    private:
+        mongo::mutex _mutex;
+        boost::condition _changed;
+        size_t _nRunning;
+        size_t _nParked;
+        bool _parking;
+        set<DiskLoc*> _parkedPositions;
+    };
+
+    /**
+     * Stands in for the stopped scan threads in ClientCursor's registry while the read lock is
+     * yielded.  Moves them on from records that are deleted, and is killed by a drop, rename or
+     * compact of the collection, which would free or move the extents being scanned.
+     */
+    class YieldedScanRunner : public Runner {
+    public:
+        YieldedScanRunner(const string& ns, const ExtentManager* em, YieldGate* gate)
+            : _ns(ns), _em(em), _gate(gate), _killed(false) { }
+
+        virtual void setYieldPolicy(Runner::YieldPolicy policy) { }
+        virtual RunnerState getNext(BSONObj* objOut, DiskLoc* dlOut) {
+            return _killed ? Runner::RUNNER_DEAD : Runner::RUNNER_EOF;
+        }
+        virtual bool isEOF() { return true; }
+        virtual void invalidate(const DiskLoc& dl) { _gate->invalidate(dl, _em); }
+        virtual void kill() { _killed = true; }
+        virtual void saveState() { }
+        virtual bool restoreState() { return !_killed; }
+        virtual const string& ns() { return _ns; }
+        virtual Status getExplainPlan(TypeExplain** explain) const {
+            return Status(ErrorCodes::InternalError, "a parallel $group scan has no plan");
+        }
+
+    private:
+        const string _ns;
+        const ExtentManager* _em;
+        YieldGate* const _gate;
+        bool _killed;
+    };
+
+    /**
+     * Returns the records of a range of extents that match a query, with the fields a pipeline
+     * depends on.  The thread that started the scan holds the read lock, and may only yield it
+     * while this source waits in 'gate'.
+     */
+    class ExtentRangeSource : public DocumentSource {
+    public:
+        ExtentRangeSource(const ExtentManager* em,
+                          YieldGate* gate,
+                          const vector<DiskLoc>& extents,
+                          const BSONObj& query,
+                          const set<string>& deps,
+                          const intrusive_ptr<ExpressionContext>& pExpCtx)
+            : DocumentSource(pExpCtx)
+            , _em(em)
+            , _gate(gate)
+            , _extents(extents)
+            , _nextExtent(0)
+            , _sinceCheckpoint(0)
+            , _query(query)
+            , _wholeDocument(deps.count(string()))
+        {
+            if (!_query.isEmpty())
+                _matcher.reset(new Matcher(_query));
+            if (!_wholeDocument)
+                _dependencies = DocumentSource::parseDeps(deps);
+        }
+
+        virtual boost::optional<Document> getNext() {
+            BSONObj obj;
+            if (!nextMatch(&obj))
+                return boost::none;
+
+            return _wholeDocument ? Document(obj)
+                                  : documentFromBsonWithDeps(obj, _dependencies);
+        }
+
+        virtual bool getNextBatch(ColumnBatch* batch) {
+            batch->clear();
+            BSONObj obj;
+            while (batch->memUsage() < MaxBytesToReturnToClientAtOnce && nextMatch(&obj)) {
+                batch->append(obj);
+            }
+            batch->finish();
+            return batch->size() > 0;
+        }
+
+        virtual const char *getSourceName() const { return "$extentRange"; }
+
+        virtual void setSource(DocumentSource *pSource) {
+            /* this doesn't take a source */
+            verify(false);
+        }
+
+        virtual bool isValidInitialSource() const { return true; }
+
+    private:
+        virtual Value serialize(bool explain) const { return Value(); }
+
+        /** Finds the next record in the range that matches the query. */
+        bool nextMatch(BSONObj* obj) {
+            while (true) {
+                pExpCtx->checkForInterrupt();
+
+                if (_loc.isNull()) {
+                    if (_nextExtent == _extents.size())
+                        return false;
+                    // the read lock may be yielded here; a drop while it was shows up as a stop
+                    _gate->checkpoint(NULL);
+                    pExpCtx->checkForInterrupt();
+                    _loc = _em->getExtent(_extents[_nextExtent++])->firstRecord;
+                    continue;
+                }
+
+                if (++_sinceCheckpoint == recordsPerCheckpoint) {
+                    _sinceCheckpoint = 0;
+                    // as above; a delete of _loc while stopped moves it on, perhaps to null
+                    _gate->checkpoint(&_loc);
+                    continue;
+                }
+
+                *obj = BSONObj(_em->recordFor(_loc)->data());
+                _loc = _em->getNextRecordInExtent(_loc);
+
+                if (!_matcher || _matcher->matches(*obj))
+                    return true;
+            }
+        }
+
+        const ExtentManager* _em;
+        YieldGate* const _gate;
+        const vector<DiskLoc> _extents;
+        size_t _nextExtent;
+        DiskLoc _loc;
+        int _sinceCheckpoint;
+
+        // BSONObj members must outlive _matcher.
+        BSONObj _query;
+        boost::scoped_ptr<Matcher> _matcher;
+        const bool _wholeDocument;
+        ParsedDeps _dependencies;
+    };
+}
+
+    /**
+     * Lets the workers stop each other, and the thread that started them stop them all.
+     */
+    class DocumentSourceParallelGroup::AbortStatus : public InterruptStatus {
+    public:
+        virtual void checkForInterrupt() const {
+            uassert(stoppedCode, "parallel $group stopped", !aborted.load());
+        }
+
+        virtual const char *checkForInterruptNoAssert() const {
+            return aborted.load() ? "parallel $group stopped" : "";
+        }
+
+        AtomicUInt32 aborted;
+    };
+
+    /** One thread's copy of the stages and what it produced. */
+    struct DocumentSourceParallelGroup::Worker {
+        Worker() : exhausted(false), errCode(0), abortStatus(NULL), gate(NULL) { }
+
+        intrusive_ptr<Pipeline> pipeline;
+
+        // Pulled on the worker's thread, so that it groups all of its range there.
+        boost::optional<Document> first;
+        bool exhausted;
+
+        int errCode;
+        string errMsg;
+        AbortStatus* abortStatus;
+        YieldGate* gate;
+    };
+
+    DocumentSourceParallelGroup::~DocumentSourceParallelGroup() {
+        dispose();
+    }
+
+    const char *DocumentSourceParallelGroup::getSourceName() const {
+        return parallelGroupName;
+    }
+
+    boost::optional<Document> DocumentSourceParallelGroup::getNext() {
+        pExpCtx->checkForInterrupt();
+
+        if (!_populated)
+            populate();
+
+        // Return the partials of each worker in the order of their ranges.
+        while (_currentWorker < _workers.size()) {
+            Worker* worker = _workers[_currentWorker].get();
+
+            if (worker->first) {
+                Document out = *worker->first;
+                worker->first = boost::none;
+                return out;
+            }
+
+            if (!worker->exhausted) {
+                if (boost::optional<Document> next = worker->pipeline->output()->getNext())
+                    return next;
+                worker->exhausted = true;
+            }
+
+            _workers[_currentWorker].reset();
+            _currentWorker++;
+        }
+
+        return boost::none;
+    }
+
+    void DocumentSourceParallelGroup::runWorker(Worker* worker) {
+        // the matcher and expression code the stages run may use the current Client
+        Client::initThread("parallelGroup");
+        try {
+            worker->first = worker->pipeline->output()->getNext();
+            worker->exhausted = !worker->first;
+        }
+        catch (DBException& e) {
+            worker->errCode = e.getCode();
+            worker->errMsg = e.what();
+            worker->abortStatus->aborted.store(1);
+        }
+        catch (std::exception& e) {
+            worker->errCode = 17293;
+            worker->errMsg = str::stream() << "parallel $group thread failed: " << e.what();
+            worker->abortStatus->aborted.store(1);
+        }
+        worker->gate->done();
+        cc().shutdown();
+    }
+
+    void DocumentSourceParallelGroup::populate() {
+        _populated = true;
+
+        // We have already validated the sharding version when we prepared the pipeline so we
+        // shouldn't check it again.
+        Lock::DBRead lk(_ns);
+        Client::Context ctx(_ns, storageGlobalParams.dbpath, /*doVersion=*/false);
+
+        const Collection* collection = ctx.db()->getCollection(_ns);
+        if (!collection)
+            return; // dropped since the pipeline was prepared
+
+        const ExtentManager* em = collection->getExtentManager();
+        vector<DiskLoc> extents;
+        vector<long long> lengths;
+        long long totalLength = 0;
+        for (DiskLoc e = collection->details()->firstExtent();
+             !e.isNull();
+             e = em->getExtent(e)->xnext) {
+            extents.push_back(e);
+            lengths.push_back(em->getExtent(e)->length);
+            totalLength += lengths.back();
+        }
+
+        // Each worker runs its own copy of the stages, parsed as a shard's would be so that it
+        // produces mergeable partials.
+        MutableDocument cmd;
+        cmd["aggregate"] = Value(pExpCtx->ns.coll());
+        cmd["pipeline"] = Value(_stages);
+        cmd["fromRouter"] = Value(true);
+        cmd["allowDiskUsage"] = Value(pExpCtx->extSortAllowed);
+        const BSONObj cmdObj = cmd.freeze().toBson();
+
+        // Split the extents into contiguous ranges of about the same length.
+        const size_t nWorkers = std::min(static_cast<size_t>(_nThreads), extents.size());
+        YieldGate gate(nWorkers);
+        size_t begin = 0;
+        long long covered = 0;
+        for (size_t k = 0; k < nWorkers; k++) {
+            const long long target = totalLength * static_cast<long long>(k + 1) / nWorkers;
+            const size_t last = extents.size() - (nWorkers - k - 1); // leave one for each later
+            size_t end = begin;
+            while (end < last && (end == begin || covered < target || k == nWorkers - 1)) {
+                covered += lengths[end];
+                end++;
+            }
+
+            intrusive_ptr<ExpressionContext> workerCtx =
+                new ExpressionContext(*_abortStatus, pExpCtx->ns);
+            workerCtx->tempDir = pExpCtx->tempDir;
+
+            boost::shared_ptr<Worker> worker(new Worker());
+            worker->abortStatus = _abortStatus.get();
+            worker->gate = &gate;
+
+            string errmsg;
+            worker->pipeline = Pipeline::parseCommand(errmsg, cmdObj, workerCtx);
+            massert(17295, str::stream() << "could not parse parallel $group stages: " << errmsg,
+                    worker->pipeline);
+            worker->pipeline->addInitialSource(
+                new ExtentRangeSource(em,
+                                      &gate,
+                                      vector<DiskLoc>(extents.begin() + begin,
+                                                      extents.begin() + end),
+                                      _query.copy(),
+                                      _deps,
+                                      workerCtx));
+            worker->pipeline->stitch();
+            _workers.push_back(worker);
+
+            begin = end;
+        }
+
+        LOG(1) << "running $group over " << _ns << " on " << _workers.size() << " threads"
+               << endl;
+
+        YieldedScanRunner yieldedScan(_ns, em, &gate);
+
+        {
+            ThreadPool pool(_workers.size());
+            // For tests, stop the workers at their first checkpoint, so the yield is taken
+            // however little there is to scan.
+            if (MONGO_FAIL_POINT(parallelGroupHangWhileYielded))
+                gate.park();
+            for (size_t k = 0; k < _workers.size(); k++) {
+                pool.schedule(&DocumentSourceParallelGroup::runWorker, _workers[k].get());
+            }
+
+            // The workers take no locks, so interrupts are handled here.  The read lock is yielded
+            // to waiting operations once all the workers have stopped between records.
+            Timer sinceYield;
+            try {
+                while (pool.tasks_remaining() > 0) {
+                    sleepmillis(10);
+                    pExpCtx->interruptStatus.checkForInterrupt();
+
+                    if (sinceYield.millis() < yieldIntervalMillis)
+                        continue;
+                    const int micros = Client::recommendedYieldMicros();
+                    if (micros <= 0 && !MONGO_FAIL_POINT(parallelGroupHangWhileYielded))
+                        continue;
+
+                    gate.park();
+                    while (!gate.waitParked(10)) {
+                        pExpCtx->interruptStatus.checkForInterrupt();
+                    }
+
+                    yieldedScan.saveState();
+                    ClientCursor::registerRunner(&yieldedScan);
+                    try {
+                        do {
+                            RunnerYieldPolicy::staticYield(micros);
+                        } while (MONGO_FAIL_POINT(parallelGroupHangWhileYielded));
+                    }
+                    catch (...) {
+                        ClientCursor::deregisterRunner(&yieldedScan);
+                        throw;
+                    }
+                    ClientCursor::deregisterRunner(&yieldedScan);
+                    const bool valid = yieldedScan.restoreState();
+
+                    if (!valid)
+                        _abortStatus->aborted.store(1);
+                    gate.resume();
+                    uassert(17305, str::stream() << _ns << " was dropped, renamed or compacted "
+                                                 << "during a parallel $group",
+                            valid);
+                    sinceYield.reset();
+                }
+            }
+            catch (...) {
+                _abortStatus->aborted.store(1);
+                gate.resume();
+                pool.join();
+                throw;
+            }
+            pool.join();
+        }
+
+        // Report the error that stopped the other workers, rather than theirs.
+        for (size_t k = 0; k < _workers.size(); k++) {
+            if (_workers[k]->errCode && _workers[k]->errCode != stoppedCode)
+                uasserted(_workers[k]->errCode, _workers[k]->errMsg);
+        }
+    }
+
+    void DocumentSourceParallelGroup::dispose() {
+        _workers.clear();
+        _currentWorker = 0;
+    }
+
+    void DocumentSourceParallelGroup::setSource(DocumentSource *pSource) {
+        /* this doesn't take a source */
+        verify(false);
+    }
+
+    Value DocumentSourceParallelGroup::serialize(bool explain) const {
+        // we never parse a DocumentSourceParallelGroup, so we only serialize for explain
+        if (!explain)
+            return Value();
+
+        return Value(DOC(getSourceName() <<
+            DOC("query" << Value(_query)
+             << "threads" << Value(static_cast<int>(_nThreads))
+             << "pipeline" << Value(_stages)
+        )));
+    }
+
+    DocumentSourceParallelGroup::DocumentSourceParallelGroup(
+            const string& ns,
+            const BSONObj& query,
+            const set<string>& deps,
+            const vector<Value>& stages,
+            unsigned nThreads,
+            const intrusive_ptr<ExpressionContext> &pExpCtx)
+        : DocumentSource(pExpCtx)
+        , _ns(ns)
+        , _query(query.getOwned())
+        , _deps(deps)
+        , _stages(stages)
+        , _nThreads(nThreads)
+        , _abortStatus(new AbortStatus())
+        , _populated(false)
+        , _currentWorker(0)
+    {}
+
+    intrusive_ptr<DocumentSourceParallelGroup> DocumentSourceParallelGroup::create(
+            const string& ns,
+            const BSONObj& query,
+            const set<string>& deps,
+            const vector<Value>& stages,
+            unsigned nThreads,
+            const intrusive_ptr<ExpressionContext> &pExpCtx) {
+        return new DocumentSourceParallelGroup(ns, query, deps, stages, nThreads, pExpCtx);
+    }
+}
@@ -32,13 +32,16 @@
 
 #include "mongo/client/dbclientinterface.h"
 #include "mongo/db/cursor.h"
+#include "mongo/db/index/index_descriptor.h"
 #include "mongo/db/instance.h"
 #include "mongo/db/parsed_query.h"
 #include "mongo/db/pipeline/document_source.h"
 #include "mongo/db/pipeline/pipeline.h"
 #include "mongo/db/query/query_planner.h"
 #include "mongo/db/query/new_find.h"
+#include "mongo/db/structure/collection.h"
 #include "mongo/s/d_logic.h"
+#include "mongo/util/processinfo.h"
 
 
 namespace mongo {
@@ -62,6 +65,35 @@ namespace {
     private:
         DBDirectClient _client;
     };
+
+    /**
+     * Returns true if the only plan for 'query' is a collection scan.
+     */
+    bool onlyCollectionScan(Collection* collection, const BSONObj& query) {
+        CanonicalQuery* rawCanonicalQuery;
+        if (!CanonicalQuery::canonicalize(collection->ns().ns(), query, &rawCanonicalQuery).isOK())
+            return false;
+        auto_ptr<CanonicalQuery> canonicalQuery(rawCanonicalQuery);
+
+        QueryPlannerParams plannerParams;
+        NamespaceDetails* nsd = collection->details();
+        for (int i = 0; i < nsd->getCompletedIndexCount(); ++i) {
+            IndexDescriptor* desc = collection->getIndexCatalog()->getDescriptor(i);
+            plannerParams.indices.push_back(IndexEntry(desc->keyPattern(),
+                                                       desc->isMultikey(),
+                                                       desc->isSparse(),
+                                                       desc->indexName()));
+        }
+
+        vector<QuerySolution*> solutions;
+        QueryPlanner::plan(*canonicalQuery, plannerParams, &solutions);
+        const bool collScan = solutions.size() == 1
+                              && solutions[0]->root->getType() == STAGE_COLLSCAN;
+        for (size_t i = 0; i < solutions.size(); ++i) {
+            delete solutions[i];
+        }
+        return collScan;
+    }
 }
 
     void PipelineD::prepareCursorSource(
@@ -109,8 +141,8 @@ namespace {
         bool haveProjection = false;
         BSONObj projection;
         DocumentSource::ParsedDeps dependencies;
+        set<string> deps;
         {
-            set<string> deps;
             DocumentSource::GetDepsReturn status = DocumentSource::SEE_NEXT;
             for (size_t i=0; i < sources.size() && status == DocumentSource::SEE_NEXT; i++) {
                 status = sources[i]->getDependencies(deps);
@@ -159,6 +191,15 @@ namespace {
         // Note: this may throw if the sharding version for this connection is out of date.
         Client::ReadContext context(fullName);
 
+        // An empty string in deps means the whole document is needed.
+        if (!haveProjection) {
+            deps.clear();
+            deps.insert(string());
+        }
+        if (!sortStage && addParallelGroupSource(pPipeline, pExpCtx, queryObj, deps)) {
+            return;
+        }
+
         // Create the Runner.
         //
         // If we try to create a Runner that includes both the match and the
@@ -250,4 +291,55 @@ namespace {
         pPipeline->addInitialSource(pSource);
     }
 
+    bool PipelineD::addParallelGroupSource(const intrusive_ptr<Pipeline>& pPipeline,
+                                           const intrusive_ptr<ExpressionContext>& pExpCtx,
+                                           const BSONObj& queryObj,
+                                           const set<string>& deps) {
+        Pipeline::SourceContainer& sources = pPipeline->sources;
+
+        const int threads = DocumentSourceParallelGroup::groupThreads;
+        const unsigned nThreads = threads > 0 ? threads : ProcessInfo().getNumCores();
+        if (nThreads < 2)
+            return false;
+
+        size_t groupIndex = 0;
+        while (groupIndex < sources.size()
+               && (dynamic_cast<DocumentSourceMatch*>(sources[groupIndex].get())
+                   || dynamic_cast<DocumentSourceProject*>(sources[groupIndex].get()))) {
+            groupIndex++;
+        }
+        if (groupIndex == sources.size())
+            return false;
+        DocumentSourceGroup* group = dynamic_cast<DocumentSourceGroup*>(sources[groupIndex].get());
+        if (!group)
+            return false;
+
+        // The threads scan extents directly, so they can't filter out the documents of chunks a
+        // shard doesn't own, and wouldn't follow a capped collection's natural order.
+        const string& ns = pExpCtx->ns.ns();
+        if (shardingState.needCollectionMetadata(ns))
+            return false;
+
+        Collection* collection = cc().database()->getCollection(ns);
+        if (!collection
+                || collection->details()->isCapped()
+                || static_cast<long long>(collection->numRecords())
+                       < DocumentSourceParallelGroup::minRecords
+                || !onlyCollectionScan(collection, queryObj)) {
+            return false;
+        }
+
+        vector<Value> stages;
+        for (size_t i = 0; i <= groupIndex; i++) {
+            sources[i]->serializeToArray(stages);
+        }
+
+        intrusive_ptr<DocumentSource> merger = group->getMergeSource();
+        sources.erase(sources.begin(), sources.begin() + groupIndex + 1);
+        sources.push_front(merger);
+        pPipeline->addInitialSource(
+            DocumentSourceParallelGroup::create(ns, queryObj, deps, stages, nThreads, pExpCtx));
+        return true;
+    }
+
 } // namespace mongo
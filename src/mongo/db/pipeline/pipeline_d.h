@@ -31,6 +31,7 @@
 #include "mongo/pch.h"
 
 namespace mongo {
+    class BSONObj;
     class DocumentSourceCursor;
     struct ExpressionContext;
     class Pipeline;
@@ -69,6 +70,20 @@ namespace mongo {
 
     private:
         PipelineD(); // does not exist:  prevent instantiation
+
+        /**
+         * If the pipeline starts with $match and $project stages followed by a $group over a
+         * big enough collection that can only be scanned, runs them on several threads.
+         * Replaces them with a DocumentSourceParallelGroup and the $group that merges its
+         * partials, and returns true.
+         *
+         * @param queryObj the initial $match, already removed from the pipeline
+         * @param deps the fields the pipeline depends on, or an empty string for all of them
+         */
+        static bool addParallelGroupSource(const intrusive_ptr<Pipeline>& pPipeline,
+                                           const intrusive_ptr<ExpressionContext>& pExpCtx,
+                                           const BSONObj& queryObj,
+                                           const set<string>& deps);
     };
 
 } // namespace mongo
@@ -36,6 +36,7 @@
 #include "mongo/db/query/explain_plan.h"
 #include "mongo/db/query/plan_cache.h"
 #include "mongo/db/query/plan_executor.h"
+#include "mongo/db/query/qlog.h"
 #include "mongo/db/query/type_explain.h"
 
 namespace mongo {
@@ -120,24 +121,17 @@ namespace mongo {
         // We're done.  Update the cache.
         PlanCache* cache = PlanCache::get(_canonicalQuery->ns());
 
-        // TODO: Is this an error?
+        // The collection may have been dropped out from under us.
         if (NULL == cache) { return; }
 
-        // TODO: How do we decide this?
-        bool shouldRemovePlan = false;
-
-        if (shouldRemovePlan) {
-            if (!cache->remove(*_canonicalQuery, *_cachedQuery->solution)) {
-                warning() << "Cached plan runner couldn't remove plan from cache.  Maybe"
-                    " somebody else did already?";
-                return;
-            }
-        }
-
-        // We're done running.  Update cache.
+        // We're done running.  Update cache.  If the plan did far worse than it did when it was
+        // picked, the cache evicts it and the next query of this shape is planned from scratch.
         auto_ptr<CachedSolutionFeedback> feedback(new CachedSolutionFeedback());
         feedback->stats = _exec->getStats();
-        cache->feedback(*_canonicalQuery, *_cachedQuery->solution, feedback.release());
+        if (!cache->feedback(*_canonicalQuery, *_cachedQuery->solution, feedback.release())) {
+            QLOG() << "Cached plan runner couldn't give feedback for plan.  Maybe somebody"
+                      " removed it already?" << endl;
+        }
     }
 
 } // namespace mongo
@@ -67,6 +67,7 @@ namespace mongo {
         const PlanStageStats* leaf = root;
 
         uint64_t chunkSkips = 0;
+        uint64_t sortSpills = 0;
 
         while (leaf->children.size() > 0) {
             // We're failing a plan with multiple children other than OR.
@@ -90,6 +91,8 @@ namespace mongo {
 
             if (leaf->stageType == STAGE_SORT) {
                 sortPresent = true;
+                const SortStats* ss = static_cast<const SortStats*>(leaf->specific.get());
+                sortSpills = ss->spills;
             }
 
             if (STAGE_SHARDING_FILTER == leaf->stageType) {
@@ -189,6 +192,9 @@ namespace mongo {
         }
 
         res->setScanAndOrder(sortPresent);
+        if (sortPresent) {
+            res->setNSortSpills(sortSpills);
+        }
 
         res->setNChunkSkips(chunkSkips);
 
@@ -34,6 +34,7 @@
 #include "mongo/db/exec/working_set_common.h"
 #include "mongo/db/query/canonical_query.h"
 #include "mongo/db/query/explain_plan.h"
+#include "mongo/db/query/plan_cache.h"
 #include "mongo/db/query/plan_executor.h"
 #include "mongo/db/query/qlog.h"
 #include "mongo/db/query/query_solution.h"
@@ -291,7 +292,8 @@ namespace mongo {
 
         if (_failure || _killed) { return false; }
 
-        size_t bestChild = PlanRanker::pickBestPlan(_candidates, NULL);
+        auto_ptr<PlanRankingDecision> decision(new PlanRankingDecision());
+        size_t bestChild = PlanRanker::pickBestPlan(_candidates, decision.get());
 
         // Run the best plan.  Store it.
         _bestPlan.reset(new PlanExecutor(_candidates[bestChild].ws,
@@ -318,11 +320,14 @@ namespace mongo {
             }
         }
 
-        // TODO:
-        // Store the choice we just made in the cache.
-        // QueryPlanCache* cache = PlanCache::get(somenamespace);
-        // cache->add(_query, *_candidates[bestChild]->solution, decision->bestPlanStats);
-        // delete decision;
+        // Store the choice we just made in the cache.  If the winner needed a backup plan we
+        // don't: a run out of the cache has no backup to fall back on.
+        if (NULL == _backupSolution) {
+            PlanCache* cache = PlanCache::get(_query->ns());
+            if (NULL != cache) {
+                cache->add(*_query, *_bestSolution, decision.release());
+            }
+        }
 
         // Clear out the candidate plans, leaving only stats as we're all done w/them.
         for (size_t i = 0; i < _candidates.size(); ++i) {
@@ -177,24 +177,6 @@ namespace mongo {
         verify(rawCanonicalQuery);
         auto_ptr<CanonicalQuery> canonicalQuery(rawCanonicalQuery);
 
-        // Try to look up a cached solution for the query.
-        // TODO: Can the cache have negative data about a solution?
-        PlanCache* localCache = PlanCache::get(canonicalQuery->ns());
-        if (NULL != localCache) {
-            CachedSolution* cs = localCache->get(*canonicalQuery);
-            if (NULL != cs) {
-                // We have a cached solution.  Hand the canonical query and cached solution off to
-                // the cached plan runner, which takes ownership of both.
-                WorkingSet* ws;
-                PlanStage* root;
-                verify(StageBuilder::build(*cs->solution, &root, &ws));
-                *out = new CachedPlanRunner(canonicalQuery.release(), cs, root, ws);
-                return Status::OK();
-            }
-        }
-
-        // No entry in cache for the query.  We have to solve the query ourself.
-
         // Get the indices that we could possibly use.
         Database* db = cc().database();
         verify( db );
@@ -298,7 +280,32 @@ namespace mongo {
             return Status::OK();
         }
         else {
-            // Many solutions.  Let the MultiPlanRunner pick the best, update the cache, and so on.
+            // Many solutions.  If we've seen a query of this shape before, the plan cache knows
+            // which of them won.  Explain always races the plans so it can show all of them.
+            // TODO: Can the cache have negative data about a solution?
+            PlanCache* cache = collection->infoCache()->getPlanCache();
+            if (!canonicalQuery->getParsed().isExplain()) {
+                auto_ptr<CachedSolution> cs(cache->get(*canonicalQuery));
+                size_t cachedIdx = PlanCache::findCachedSolution(cs.get(), solutions);
+
+                if (cachedIdx < solutions.size()) {
+                    for (size_t i = 0; i < solutions.size(); ++i) {
+                        if (i != cachedIdx) { delete solutions[i]; }
+                    }
+                    cs->solution.reset(solutions[cachedIdx]);
+
+                    // Hand the canonical query and cached solution off to the cached plan
+                    // runner, which takes ownership of both.
+                    WorkingSet* ws;
+                    PlanStage* root;
+                    verify(StageBuilder::build(*cs->solution, &root, &ws));
+                    *out = new CachedPlanRunner(canonicalQuery.release(), cs.release(), root, ws);
+                    return Status::OK();
+                }
+            }
+
+            // No usable entry in cache for the query.  Let the MultiPlanRunner pick the best,
+            // update the cache, and so on.
             auto_ptr<MultiPlanRunner> mpr(new MultiPlanRunner(canonicalQuery.release()));
             for (size_t i = 0; i < solutions.size(); ++i) {
                 WorkingSet* ws;
@@ -315,13 +322,12 @@ namespace mongo {
     /**
      * Also called by db/ops/query.cpp.  This is the new getMore entry point.
      */
-    QueryResult* newGetMore(const char* ns, int ntoreturn, long long cursorid, CurOp& curop,
-                            int pass, bool& exhaust, bool* isCursorAuthorized) {
+    bool newGetMore(const char* ns, int ntoreturn, long long cursorid, CurOp& curop,
+                    int pass, bool& exhaust, bool* isCursorAuthorized, Message& result) {
         exhaust = false;
         int bufSize = 512 + sizeof(QueryResult) + MaxBytesToReturnToClientAtOnce;
 
-        BufBuilder bb(bufSize);
-        bb.skip(sizeof(QueryResult));
+        QueryReplyBuilder bb(bufSize);
 
         // This is a read lock.  TODO: There is a cursor flag for not needing this.  Do we care?
         Client::ReadContext ctx(ns);
@@ -389,7 +395,7 @@ namespace mongo {
             Runner::RunnerState state;
             while (Runner::RUNNER_ADVANCED == (state = runner->getNext(&obj, NULL))) {
                 // Add result to output buffer.
-                bb.appendBuf((void*)obj.objdata(), obj.objsize());
+                bb.append(obj);
 
                 // Count the result.
                 ++numResults;
@@ -413,7 +419,7 @@ namespace mongo {
                 && (queryOptions & QueryOption_AwaitData) && (pass < 1000)) {
                 // If the cursor is tailable we don't kill it if it's eof.  We let it try to get
                 // data some # of times first.
-                return 0;
+                return false;
             }
 
             bool saveClientCursor = false;
@@ -470,16 +476,13 @@ namespace mongo {
             }
         }
 
-        QueryResult* qr = reinterpret_cast<QueryResult*>(bb.buf());
-        qr->len = bb.len();
-        qr->setOperation(opReply);
+        QueryResult* qr = bb.done(result);
         qr->_resultFlags() = resultFlags;
         qr->cursorId = cursorid;
         qr->startingFrom = startingResult;
         qr->nReturned = numResults;
-        bb.decouple();
         QLOG() << "getMore returned " << numResults << " results\n";
-        return qr;
+        return true;
     }
 
     Status getOplogStartHack(CanonicalQuery* cq, Runner** runnerOut) {
@@ -601,8 +604,7 @@ namespace mongo {
         // bb is used to hold query results
         // this buffer should contain either requested documents per query or
         // explain information, but not both
-        BufBuilder bb(32768);
-        bb.skip(sizeof(QueryResult));
+        QueryReplyBuilder bb;
 
         // How many results have we obtained from the runner?
         int numResults = 0;
@@ -631,7 +633,7 @@ namespace mongo {
         while (Runner::RUNNER_ADVANCED == (state = runner->getNext(&obj, NULL))) {
             // Add result to output buffer. This is unnecessary if explain info is requested
             if (!isExplain) {
-                bb.appendBuf((void*)obj.objdata(), obj.objsize());
+                bb.append(obj);
             }
 
             // Count the result.
@@ -718,8 +720,7 @@ namespace mongo {
                         << "', error: " << res.reason();
                 // If numResults and the data in bb don't correspond, we'll crash later when rooting
                 // through the reply msg.
-                BSONObj emptyObj;
-                bb.appendBuf((void*)emptyObj.objdata(), emptyObj.objsize());
+                bb.append(BSONObj());
                 // The explain output is actually a result.
                 numResults = 1;
                 // TODO: we can fill out millis etc. here just fine even if the plan screwed up.
@@ -741,7 +742,7 @@ namespace mongo {
                 explain->setMillis(curop.elapsedMillis());
 
                 BSONObj explainObj = explain->toBSON();
-                bb.appendBuf((void*)explainObj.objdata(), explainObj.objsize());
+                bb.append(explainObj);
 
                 // The explain output is actually a result.
                 numResults = 1;
@@ -788,15 +789,12 @@ namespace mongo {
         }
 
         // Add the results from the query into the output buffer.
-        result.appendData(bb.buf(), bb.len());
-        bb.decouple();
+        QueryResult* qr = bb.done(result);
 
         // Fill out the output buffer's header.
-        QueryResult* qr = static_cast<QueryResult*>(result.header());
         qr->cursorId = ccId;
         curop.debug().cursorid = (0 == ccId ? -1 : ccId);
         qr->setResultFlagsToOk();
-        qr->setOperation(opReply);
         qr->startingFrom = 0;
         qr->nReturned = numResults;
 
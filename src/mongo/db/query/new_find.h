@@ -61,10 +61,11 @@ namespace mongo {
     void enableNewQueryFramework();
 
     /**
-     * Called from the getMore entry point in ops/query.cpp.
+     * Called from the getMore entry point in ops/query.cpp.  Returns false, leaving 'result'
+     * empty, if a tailable cursor should wait for more data.
      */
-    QueryResult* newGetMore(const char* ns, int ntoreturn, long long cursorid, CurOp& curop,
-                            int pass, bool& exhaust, bool* isCursorAuthorized);
+    bool newGetMore(const char* ns, int ntoreturn, long long cursorid, CurOp& curop,
+                    int pass, bool& exhaust, bool* isCursorAuthorized, Message& result);
 
     /**
      * Called from the runQuery entry point in ops/query.cpp.
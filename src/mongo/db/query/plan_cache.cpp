@@ -0,0 +1,436 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects for
+ *    all of the code used other than as permitted herein. If you modify file(s)
+ *    with this exception, you may extend this exception to your version of the
+ *    file(s), but you are not obligated to do so. If you do not wish to do so,
+ *    delete this exception statement from your version. If you delete this
+ *    exception statement from all source files in the program, then also delete
+ *    it in the license file.
+ */
+
+#include "mongo/db/query/plan_cache.h"
+
+#include <algorithm>
+#include <sstream>
+
+#include "mongo/base/counter.h"
+#include "mongo/db/client.h"
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/database.h"
+#include "mongo/db/matcher/expression_compiled.h"
+#include "mongo/db/query/canonical_query.h"
+#include "mongo/db/query/qlog.h"
+#include "mongo/db/structure/collection.h"
+
+namespace mongo {
+
+    static Counter64 planCacheHits;
+    static Counter64 planCacheMisses;
+    static Counter64 planCacheEvictions;
+
+    static ServerStatusMetricField<Counter64> displayPlanCacheHits(
+                                                    "queryExecutor.planCache.hits",
+                                                    &planCacheHits );
+    static ServerStatusMetricField<Counter64> displayPlanCacheMisses(
+                                                    "queryExecutor.planCache.misses",
+                                                    &planCacheMisses );
+    static ServerStatusMetricField<Counter64> displayPlanCacheEvictions(
+                                                    "queryExecutor.planCache.evictions",
+                                                    &planCacheEvictions );
+
+    // static
+    const size_t PlanCache::kMaxCacheSize = 5000;
+    // static
+    const double PlanCache::kEvictionProductivityRatio = 10.0;
+    // static
+    const size_t PlanCache::kMinWorksForEviction = 1000;
+    // static
+    const size_t PlanCache::kMaxFeedback = 20;
+
+    namespace {
+
+        /**
+         * Appends the shape of the tree rooted at 'tree' to 'ss'.  The children of AND, OR and NOR
+         * are sorted so that {a: 1, b: 1} and {b: 1, a: 1} have the same shape.
+         */
+        void encodeMatchShape(const MatchExpression* tree, stringstream* ss) {
+            *ss << tree->matchType();
+
+            StringData path = tree->path();
+            if (!path.empty()) {
+                *ss << ':' << path.toString();
+            }
+
+            if (0 == tree->numChildren()) {
+                return;
+            }
+
+            vector<string> children;
+            for (size_t i = 0; i < tree->numChildren(); ++i) {
+                stringstream childSS;
+                encodeMatchShape(tree->getChild(i), &childSS);
+                children.push_back(childSS.str());
+            }
+
+            MatchExpression::MatchType type = tree->matchType();
+            if (MatchExpression::AND == type || MatchExpression::OR == type
+                || MatchExpression::NOR == type) {
+                std::sort(children.begin(), children.end());
+            }
+
+            *ss << '[';
+            for (size_t i = 0; i < children.size(); ++i) {
+                if (0 != i) { *ss << ','; }
+                *ss << children[i];
+            }
+            *ss << ']';
+        }
+
+        void encodeEndpoint(const BSONElement& elt, stringstream* ss) {
+            if (MinKey == elt.type()) {
+                *ss << "min";
+            }
+            else if (MaxKey == elt.type()) {
+                *ss << "max";
+            }
+            else {
+                *ss << 'v';
+            }
+        }
+
+        /**
+         * Appends the shape of an index bound to 'ss': for each field, whether each interval is
+         * a point or a range, which ends are inclusive and which ends are open (MinKey/MaxKey).
+         * The values themselves are left out, as they come from the query that was planned.
+         */
+        void encodeBoundsShape(const IndexBounds& bounds, stringstream* ss) {
+            if (bounds.isSimpleRange) {
+                *ss << "simple";
+                return;
+            }
+            for (size_t i = 0; i < bounds.fields.size(); ++i) {
+                const OrderedIntervalList& oil = bounds.fields[i];
+                *ss << (0 == i ? "" : ",") << oil.name << ':';
+                for (size_t j = 0; j < oil.intervals.size(); ++j) {
+                    const Interval& interval = oil.intervals[j];
+                    if (interval.isPoint()) {
+                        *ss << 'p';
+                        continue;
+                    }
+                    *ss << (interval.startInclusive ? '[' : '(');
+                    encodeEndpoint(interval.start, ss);
+                    *ss << ' ';
+                    encodeEndpoint(interval.end, ss);
+                    *ss << (interval.endInclusive ? ']' : ')');
+                }
+            }
+        }
+
+        void encodeSolutionNode(const QuerySolutionNode* node, stringstream* ss) {
+            *ss << node->getType();
+
+            switch (node->getType()) {
+            case STAGE_COLLSCAN: {
+                const CollectionScanNode* csn = static_cast<const CollectionScanNode*>(node);
+                *ss << ':' << csn->direction;
+                break;
+            }
+            case STAGE_IXSCAN: {
+                const IndexScanNode* isn = static_cast<const IndexScanNode*>(node);
+                *ss << ':' << isn->indexKeyPattern.toString() << ':' << isn->direction << '{';
+                encodeBoundsShape(isn->bounds, ss);
+                *ss << '}';
+                break;
+            }
+            case STAGE_GEO_2D: {
+                const Geo2DNode* gn = static_cast<const Geo2DNode*>(node);
+                *ss << ':' << gn->indexKeyPattern.toString();
+                break;
+            }
+            case STAGE_GEO_NEAR_2D: {
+                const GeoNear2DNode* gnn = static_cast<const GeoNear2DNode*>(node);
+                *ss << ':' << gnn->indexKeyPattern.toString();
+                break;
+            }
+            case STAGE_GEO_NEAR_2DSPHERE: {
+                const GeoNear2DSphereNode* gnn = static_cast<const GeoNear2DSphereNode*>(node);
+                *ss << ':' << gnn->indexKeyPattern.toString();
+                break;
+            }
+            case STAGE_SORT: {
+                const SortNode* sn = static_cast<const SortNode*>(node);
+                *ss << ':' << sn->pattern.toString();
+                break;
+            }
+            default:
+                break;
+            }
+
+            if (NULL != node->filter) {
+                *ss << '?';
+                encodeMatchShape(node->filter.get(), ss);
+            }
+
+            if (node->children.empty()) {
+                return;
+            }
+
+            *ss << '[';
+            for (size_t i = 0; i < node->children.size(); ++i) {
+                if (0 != i) { *ss << ','; }
+                encodeSolutionNode(node->children[i], ss);
+            }
+            *ss << ']';
+        }
+
+        /**
+         * Results produced per call to work(), or -1 if there isn't enough data to say.
+         */
+        double productivity(const PlanStageStats* stats) {
+            if (NULL == stats || 0 == stats->common.works) {
+                return -1;
+            }
+            return static_cast<double>(stats->common.advanced)
+                 / static_cast<double>(stats->common.works);
+        }
+
+    }  // namespace
+
+    PlanCache::PlanCacheEntry::~PlanCacheEntry() {
+        for (std::list<CachedSolutionFeedback*>::iterator it = feedback.begin();
+             it != feedback.end(); ++it) {
+            delete *it;
+        }
+    }
+
+    PlanCache::PlanCache() : _mutex("PlanCache") { }
+
+    PlanCache::~PlanCache() {
+        clear();
+    }
+
+    // static
+    PlanCache* PlanCache::get(const string& ns) {
+        Database* db = cc().database();
+        if (NULL == db) { return NULL; }
+
+        Collection* collection = db->getCollection(ns);
+        if (NULL == collection) { return NULL; }
+
+        return collection->infoCache()->getPlanCache();
+    }
+
+    // static
+    PlanCacheKey PlanCache::getPlanCacheKey(const CanonicalQuery& query) {
+        stringstream ss;
+        encodeMatchShape(query.root(), &ss);
+
+        const LiteParsedQuery& pq = query.getParsed();
+        ss << "|sort:" << pq.getSort().toString()
+           << "|proj:" << pq.getProj().toString()
+           << "|hint:" << pq.getHint().toString();
+        if (pq.isSnapshot()) {
+            ss << "|snapshot";
+        }
+        return ss.str();
+    }
+
+    // static
+    std::string PlanCache::getSolutionKey(const QuerySolution& solution) {
+        if (NULL == solution.root) {
+            return "";
+        }
+        stringstream ss;
+        encodeSolutionNode(solution.root.get(), &ss);
+        return ss.str();
+    }
+
+    bool PlanCache::add(const CanonicalQuery& query, const QuerySolution& solution,
+                        PlanRankingDecision* why) {
+        auto_ptr<PlanRankingDecision> decision(why);
+
+        std::string solutionKey = getSolutionKey(solution);
+        if (solutionKey.empty()) {
+            return false;
+        }
+
+        PlanCacheKey key = getPlanCacheKey(query);
+
+        scoped_lock lk(_mutex);
+        if (_entries.end() != _entries.find(key)) {
+            return false;
+        }
+
+        // Make room, oldest entry first.
+        while (_entries.size() >= kMaxCacheSize && !_insertionOrder.empty()) {
+            EntryMap::iterator oldest = _entries.find(_insertionOrder.front());
+            verify(_entries.end() != oldest);
+            _remove_inlock(oldest);
+            planCacheEvictions.increment();
+        }
+
+        PlanCacheEntry* entry = new PlanCacheEntry(solutionKey, decision.release());
+        entry->position = _insertionOrder.insert(_insertionOrder.end(), key);
+        _entries[key] = entry;
+
+        QLOG() << "Plan cache: added solution " << solutionKey << " for shape " << key << endl;
+        return true;
+    }
+
+    CachedSolution* PlanCache::get(const CanonicalQuery& query) {
+        PlanCacheKey key = getPlanCacheKey(query);
+
+        scoped_lock lk(_mutex);
+        EntryMap::const_iterator it = _entries.find(key);
+        if (_entries.end() == it) {
+            return NULL;
+        }
+
+        const PlanCacheEntry* entry = it->second;
+        auto_ptr<CachedSolution> cs(new CachedSolution());
+        cs->solutionKey = entry->solutionKey;
+        if (NULL != entry->decision) {
+            cs->decision.reset(entry->decision->clone());
+        }
+        return cs.release();
+    }
+
+    // static
+    size_t PlanCache::findCachedSolution(const CachedSolution* cs,
+                                         const std::vector<QuerySolution*>& solutions) {
+        if (NULL != cs) {
+            for (size_t i = 0; i < solutions.size(); ++i) {
+                if (getSolutionKey(*solutions[i]) == cs->solutionKey) {
+                    planCacheHits.increment();
+                    return i;
+                }
+            }
+        }
+        planCacheMisses.increment();
+        return solutions.size();
+    }
+
+    bool PlanCache::feedback(const CanonicalQuery& query, const QuerySolution& solution,
+                             CachedSolutionFeedback* feedback) {
+        auto_ptr<CachedSolutionFeedback> autoFeedback(feedback);
+
+        scoped_lock lk(_mutex);
+        EntryMap::iterator it = _find_inlock(query, solution);
+        if (_entries.end() == it) {
+            return false;
+        }
+
+        PlanCacheEntry* entry = it->second;
+
+        // Did the plan do much worse out of the cache than it did when it won the ranking?  If
+        // so the data must have changed under us.  Forget about the plan and race again.
+        double ranked = productivity(entry->decision->statsOfWinner);
+        double actual = productivity(feedback->stats);
+        if (ranked > 0 && actual >= 0
+            && feedback->stats->common.works >= kMinWorksForEviction
+            && actual * kEvictionProductivityRatio < ranked) {
+            QLOG() << "Plan cache: evicting " << entry->solutionKey << ", productivity "
+                   << actual << " vs. " << ranked << " when ranked" << endl;
+            _remove_inlock(it);
+            planCacheEvictions.increment();
+            return true;
+        }
+
+        entry->feedback.push_back(autoFeedback.release());
+        if (entry->feedback.size() > kMaxFeedback) {
+            delete entry->feedback.front();
+            entry->feedback.pop_front();
+        }
+        return true;
+    }
+
+    bool PlanCache::remove(const CanonicalQuery& query, const QuerySolution& solution) {
+        scoped_lock lk(_mutex);
+        EntryMap::iterator it = _find_inlock(query, solution);
+        if (_entries.end() == it) {
+            return false;
+        }
+        _remove_inlock(it);
+        return true;
+    }
+
+    CompiledMatchExpression* PlanCache::getCompiledFilter(const MatchExpression* filter) {
+        stringstream ss;
+        encodeMatchShape(filter, &ss);
+        const std::string shapeKey = ss.str();
+
+        boost::shared_ptr<const CompiledMatchShape> shape;
+        {
+            scoped_lock lk(_mutex);
+            CompiledShapeMap::const_iterator it = _compiledShapes.find(shapeKey);
+            if (_compiledShapes.end() != it) {
+                shape = it->second;
+            }
+            else {
+                shape.reset(CompiledMatchShape::make(filter));
+                if (_compiledShapes.size() >= kMaxCacheSize) {
+                    _compiledShapes.clear();
+                }
+                _compiledShapes[shapeKey] = shape;
+            }
+        }
+
+        if (NULL == shape) {
+            return NULL;
+        }
+        return CompiledMatchExpression::bind(shape, filter);
+    }
+
+    void PlanCache::clear() {
+        scoped_lock lk(_mutex);
+        for (EntryMap::iterator it = _entries.begin(); it != _entries.end(); ++it) {
+            delete it->second;
+        }
+        _entries.clear();
+        _insertionOrder.clear();
+        _compiledShapes.clear();
+    }
+
+    size_t PlanCache::size() const {
+        scoped_lock lk(_mutex);
+        return _entries.size();
+    }
+
+    PlanCache::EntryMap::iterator PlanCache::_find_inlock(const CanonicalQuery& query,
+                                                          const QuerySolution& solution) {
+        EntryMap::iterator it = _entries.find(getPlanCacheKey(query));
+        if (_entries.end() == it) {
+            return it;
+        }
+        // Someone may have replaced the plan since the caller looked it up.
+        if (it->second->solutionKey != getSolutionKey(solution)) {
+            return _entries.end();
+        }
+        return it;
+    }
+
+    void PlanCache::_remove_inlock(EntryMap::iterator it) {
+        _insertionOrder.erase(it->second->position);
+        delete it->second;
+        _entries.erase(it);
+    }
+
+}  // namespace mongo
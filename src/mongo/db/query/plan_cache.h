@@ -28,12 +28,25 @@
 
 #pragma once
 
+#include <boost/scoped_ptr.hpp>
+#include <boost/shared_ptr.hpp>
+#include <list>
+#include <string>
+#include <vector>
+
 #include "mongo/db/exec/plan_stats.h"
 #include "mongo/db/query/plan_ranker.h"
 #include "mongo/db/query/query_solution.h"
+#include "mongo/platform/unordered_map.h"
+#include "mongo/util/concurrency/mutex.h"
 
 namespace mongo {
 
+    class CanonicalQuery;
+    class CompiledMatchExpression;
+    class CompiledMatchShape;
+    class MatchExpression;
+
     /**
      * TODO: Debug commands:
      * 1. show canonical form of query
@@ -42,33 +55,47 @@ namespace mongo {
      * 4. clear all elements from cache / otherwise manipulate cache.
      */
 
+    /**
+     * The shape of a query: the structure of its match expression tree along with its sort,
+     * projection and hint, but none of the values the predicates compare against.  Queries with
+     * the same shape share a cache entry.
+     */
+    typedef std::string PlanCacheKey;
+
     /**
      * When the CachedPlanRunner runs a cached query, it can provide feedback to the cache.  This
      * feedback is available to anyone who retrieves that query in the future.
      */
     struct CachedSolutionFeedback {
+        CachedSolutionFeedback() : stats(NULL) { }
+        ~CachedSolutionFeedback() { delete stats; }
+
+        // Owned here.
         PlanStageStats* stats;
+    private:
+        MONGO_DISALLOW_COPYING(CachedSolutionFeedback);
     };
 
     /**
-     * A cached solution to a query.
+     * A cached solution to a query.  This is what PlanCache::get hands out, and the caller owns
+     * it.
+     *
+     * The cache cannot hand out the QuerySolution it raced as-is: index bounds and filters in a
+     * solution are built from the values of the query that was planned.  Instead the cache
+     * remembers the solution's 'solutionKey' (see PlanCache::getSolutionKey).  The caller plans
+     * the new query and uses the candidate with the same key, which it places in 'solution'.
      */
     struct CachedSolution {
-        ~CachedSolution() {
-            for (size_t i = 0; i < feedback.size(); ++i) {
-                delete feedback[i];
-            }
-        }
+        CachedSolution() { }
 
-        // The best solution for the CanonicalQuery.
+        // Identifies which of the planner's candidate solutions won.
+        std::string solutionKey;
+
+        // The best solution for the CanonicalQuery.  Filled in by the caller.
         scoped_ptr<QuerySolution> solution;
 
         // Why the best solution was picked.
         scoped_ptr<PlanRankingDecision> decision;
-
-        // Annotations from cached runs.
-        // TODO: How many of these do we really want to keep?
-        vector<CachedSolutionFeedback*> feedback;
     private:
         MONGO_DISALLOW_COPYING(CachedSolution);
     };
@@ -77,57 +104,160 @@ namespace mongo {
      * Caches the best solution to a query.  Aside from the (CanonicalQuery -> QuerySolution)
      * mapping, the cache contains information on why that mapping was made, and statistics on the
      * cache entry's actual performance on subsequent runs.
+     *
+     * There is one PlanCache per collection, owned by its CollectionInfoCache.  The cache is
+     * cleared whenever an index is created or dropped.  All methods are thread safe.
      */
     class PlanCache {
     public:
+        PlanCache();
+        ~PlanCache();
+
+        // Entries beyond this are evicted, oldest first.
+        static const size_t kMaxCacheSize;
+
+        // A cached plan is evicted if a run out of the cache is this many times less productive
+        // (results per call to work()) than the plan was when it won the ranking...
+        static const double kEvictionProductivityRatio;
+
+        // ...provided the run did at least this much work.  Short runs are too noisy to judge.
+        static const size_t kMinWorksForEviction;
+
+        // At most this many feedback entries are retained per cached plan.
+        static const size_t kMaxFeedback;
+
+        /**
+         * Get the cache for the provided namespace, or NULL if the collection doesn't exist.  The
+         * caller must hold a lock on the namespace.  The returned pointer must not be held across
+         * yields.
+         */
+        static PlanCache* get(const string& ns);
+
+        /**
+         * Compute the shape of 'query'.  See PlanCacheKey.
+         */
+        static PlanCacheKey getPlanCacheKey(const CanonicalQuery& query);
+
         /**
-         * Get the (global) cache for the provided namespace.  Must not be held across yields.
-         * As such, there is no locking required.
+         * Compute a key for 'solution' from the stages used, the indices they scan, the shape
+         * of the index bounds and the shape of each stage's filter, but not from the values in
+         * them.  Two solutions for queries of the same shape share a key iff they access the
+         * data the same way.
          */
-        static PlanCache* get(const string& ns) { return NULL; }
+        static std::string getSolutionKey(const QuerySolution& solution);
 
         /**
          * Record 'solution' as the best plan for 'query' which was picked for reasons detailed in
          * 'why'.
          *
-         * Takes ownership of all arguments.
+         * Takes ownership of 'why'.
          *
          * If the mapping was added successfully, returns true.
          * If the mapping already existed or some other error occurred, returns false;
          */
-        bool add(CanonicalQuery* query, QuerySolution* solution, PlanRankingDecision* why) {
-            return false;
-        }
+        bool add(const CanonicalQuery& query, const QuerySolution& solution,
+                 PlanRankingDecision* why);
+
+        /**
+         * Look up the cached solution for the shape of the provided query.  If a cached solution
+         * exists, return a copy of it which the caller then owns.  If no cached solution exists,
+         * returns NULL.
+         */
+        CachedSolution* get(const CanonicalQuery& query);
 
         /**
-         * Look up the cached solution for the provided query.  If a cached solution exists, return
-         * a copy of it which the caller then owns.  If no cached solution exists, returns NULL.
+         * Returns the index of the candidate in 'solutions' with the solution key of 'cs', or
+         * solutions.size() if 'cs' is NULL or no candidate has that key.
          *
-         * TODO: Allow querying for exact query and querying for the shape of the query.
+         * Counts towards the plan cache hit/miss counters in serverStatus: a lookup is only a hit
+         * if one of the candidates can run out of the cache.
          */
-        CachedSolution* get(const CanonicalQuery& query) {
-            return NULL;
-        }
+        static size_t findCachedSolution(const CachedSolution* cs,
+                                         const std::vector<QuerySolution*>& solutions);
 
         /**
          * When the CachedPlanRunner runs a plan out of the cache, we want to record data about the
          * plan's performance.  Cache takes ownership of 'feedback'.
          *
+         * If the feedback shows that the plan performed much worse than it did when it was
+         * ranked, the entry is evicted so that the next query of this shape is planned again.
+         *
          * If the (query, solution) pair isn't in the cache, the cache deletes feedback and returns
          * false.  Otherwise, returns true.
          */
         bool feedback(const CanonicalQuery& query, const QuerySolution& solution,
-                      const CachedSolutionFeedback* feedback) {
-            return false;
-        }
+                      CachedSolutionFeedback* feedback);
 
         /**
          * Remove the (query, solution) pair from our cache.  Returns true if the plan was removed,
          * false if it wasn't found.
          */
-        bool remove(const CanonicalQuery& query, const QuerySolution& solution) {
-            return false;
-        }
+        bool remove(const CanonicalQuery& query, const QuerySolution& solution);
+
+        /**
+         * Returns the compiled form of 'filter' for a CollectionScan or a FetchStage, or NULL if
+         * it can't be compiled.  What only depends on the shape of the filter is made once and
+         * shared by filters of the same shape.  The caller owns the result, which refers to
+         * 'filter'.
+         */
+        CompiledMatchExpression* getCompiledFilter(const MatchExpression* filter);
+
+        /**
+         * Remove everything from the cache.
+         */
+        void clear();
+
+        size_t size() const;
+
+    private:
+        /**
+         * What we store per query shape.
+         */
+        struct PlanCacheEntry {
+            PlanCacheEntry(const std::string& key, PlanRankingDecision* why)
+                : solutionKey(key), decision(why) { }
+            ~PlanCacheEntry();
+
+            std::string solutionKey;
+
+            // Why the solution was picked.  Owned here.
+            scoped_ptr<PlanRankingDecision> decision;
+
+            // Annotations from cached runs, oldest first.  Owned here.
+            std::list<CachedSolutionFeedback*> feedback;
+
+            // Where our key is in '_insertionOrder'.
+            std::list<PlanCacheKey>::iterator position;
+        private:
+            MONGO_DISALLOW_COPYING(PlanCacheEntry);
+        };
+
+        typedef unordered_map<PlanCacheKey, PlanCacheEntry*> EntryMap;
+
+        /**
+         * Looks up the entry for 'query' that was cached for 'solution'.  Returns an iterator
+         * to the end of '_entries' if there isn't one.  Caller must hold '_mutex'.
+         */
+        EntryMap::iterator _find_inlock(const CanonicalQuery& query,
+                                        const QuerySolution& solution);
+
+        void _remove_inlock(EntryMap::iterator it);
+
+        mutable mongo::mutex _mutex;
+
+        // Owns the entries.
+        EntryMap _entries;
+
+        // Keys of '_entries' in the order they were added.
+        std::list<PlanCacheKey> _insertionOrder;
+
+        // The compiled shapes of filters, by their shape.  NULL for shapes that can't be
+        // compiled, so we only try once.
+        typedef unordered_map<std::string, boost::shared_ptr<const CompiledMatchShape> >
+            CompiledShapeMap;
+        CompiledShapeMap _compiledShapes;
+
+        MONGO_DISALLOW_COPYING(PlanCache);
     };
 
 }  // namespace mongo
@@ -33,11 +33,23 @@
 #include "mongo/db/exec/working_set.h"
 #include "mongo/db/exec/working_set_common.h"
 #include "mongo/db/pdfile.h"
+#include "mongo/db/server_parameters.h"
 
 namespace mongo {
 
+    int PlanExecutor::workBatchSize = 64;
+
+    namespace {
+        ExportedServerParameter<int> queryWorkBatchSizeParameter(ServerParameterSet::getGlobal(),
+                                                                 "queryWorkBatchSize",
+                                                                 &PlanExecutor::workBatchSize,
+                                                                 true,
+                                                                 true);
+    }
+
     PlanExecutor::PlanExecutor(WorkingSet* ws, PlanStage* rt)
-        : _workingSet(ws) , _root(rt) , _killed(false) {
+        : _workingSet(ws) , _root(rt) , _killed(false), _nextResult(0), _hasEndState(false),
+          _endState(Runner::RUNNER_EOF) {
     }
 
     PlanExecutor::~PlanExecutor() {
@@ -63,7 +75,17 @@ namespace mongo {
     }
 
     void PlanExecutor::invalidate(const DiskLoc& dl) {
-        if (!_killed) { _root->invalidate(dl); }
+        if (_killed) { return; }
+
+        _root->invalidate(dl);
+
+        // Buffered results keep what the DiskLoc points to by fetching it now.
+        for (size_t i = _nextResult; i < _results.size(); ++i) {
+            WorkingSetMember* member = _workingSet->get(_results[i]);
+            if (member->hasLoc() && member->loc == dl) {
+                WorkingSetCommon::fetchAndInvalidateLoc(member);
+            }
+        }
     }
 
     void PlanExecutor::setYieldPolicy(Runner::YieldPolicy policy) {
@@ -79,6 +101,17 @@ namespace mongo {
         if (_killed) { return Runner::RUNNER_DEAD; }
 
         for (;;) {
+            // Hand out what the last batch of work produced first.
+            if (_nextResult < _results.size()) {
+                return returnResult(_results[_nextResult++], objOut, dlOut);
+            }
+
+            if (_hasEndState) {
+                // Tailable plans can produce more after EOF, so we only report it once.
+                _hasEndState = false;
+                return _endState;
+            }
+
             // Yield, if we can yield ourselves.
             if (NULL != _yieldPolicy.get() && _yieldPolicy->shouldYield()) {
                 saveState();
@@ -87,42 +120,23 @@ namespace mongo {
                 restoreState();
             }
 
-            WorkingSetID id;
-            PlanStage::StageState code = _root->work(&id);
+            // Callers that want the DiskLoc usually modify the document it points to before asking
+            // for the next one, so we don't work ahead of them.
+            size_t maxWorks = 1;
+            if (NULL == dlOut && workBatchSize > 1) {
+                maxWorks = workBatchSize;
+            }
 
-            if (PlanStage::ADVANCED == code) {
-                WorkingSetMember* member = _workingSet->get(id);
+            WorkBatch batch;
+            batch.results.swap(_results);
+            batch.clear();
+            _nextResult = 0;
 
-                if (NULL != objOut) {
-                    if (WorkingSetMember::LOC_AND_IDX == member->state) {
-                        if (1 != member->keyData.size()) {
-                            _workingSet->free(id);
-                            return Runner::RUNNER_ERROR;
-                        }
-                        *objOut = member->keyData[0].keyData;
-                    }
-                    else if (member->hasObj()) {
-                        *objOut = member->obj;
-                    }
-                    else {
-                        _workingSet->free(id);
-                        return Runner::RUNNER_ERROR;
-                    }
-                }
+            WorkingSetID id;
+            PlanStage::StageState code = _root->workBatch(maxWorks, &batch, &id);
+            _results.swap(batch.results);
 
-                if (NULL != dlOut) {
-                    if (member->hasLoc()) {
-                        *dlOut = member->loc;
-                    }
-                    else {
-                        _workingSet->free(id);
-                        return Runner::RUNNER_ERROR;
-                    }
-                }
-                _workingSet->free(id);
-                return Runner::RUNNER_ADVANCED;
-            }
-            else if (PlanStage::NEED_TIME == code) {
+            if (PlanStage::NEED_TIME == code) {
                 // Fall through to yield check at end of large conditional.
             }
             else if (PlanStage::NEED_FETCH == code) {
@@ -137,7 +151,8 @@ namespace mongo {
                 // Actually bring record into memory.
                 Record* record = member->loc.rec();
 
-                // If we're allowed to, go to disk outside of the lock.
+                // If we're allowed to, go to disk outside of the lock.  Results buffered from this
+                // batch are invalidated like the ones stages hold.
                 if (NULL != _yieldPolicy.get()) {
                     saveState();
                     _yieldPolicy->yield(record);
@@ -159,21 +174,58 @@ namespace mongo {
 
                 // Note that we're not freeing id.  Fetch semantics say that we shouldn't.
             }
-            else if (PlanStage::IS_EOF == code) {
-                return Runner::RUNNER_EOF;
+            else {
+                if (PlanStage::IS_EOF == code) {
+                    _endState = Runner::RUNNER_EOF;
+                }
+                else if (PlanStage::DEAD == code) {
+                    _endState = Runner::RUNNER_DEAD;
+                }
+                else {
+                    verify(PlanStage::FAILURE == code);
+                    _endState = Runner::RUNNER_ERROR;
+                }
+                _hasEndState = true;
             }
-            else if (PlanStage::DEAD == code) {
-                return Runner::RUNNER_DEAD;
+        }
+    }
+
+    Runner::RunnerState PlanExecutor::returnResult(WorkingSetID id, BSONObj* objOut,
+                                                   DiskLoc* dlOut) {
+        WorkingSetMember* member = _workingSet->get(id);
+
+        if (NULL != objOut) {
+            if (WorkingSetMember::LOC_AND_IDX == member->state) {
+                if (1 != member->keyData.size()) {
+                    _workingSet->free(id);
+                    return Runner::RUNNER_ERROR;
+                }
+                *objOut = member->keyData[0].keyData;
+            }
+            else if (member->hasObj()) {
+                *objOut = member->obj;
+            }
+            else {
+                _workingSet->free(id);
+                return Runner::RUNNER_ERROR;
+            }
+        }
+
+        if (NULL != dlOut) {
+            if (member->hasLoc()) {
+                *dlOut = member->loc;
             }
             else {
-                verify(PlanStage::FAILURE == code);
+                _workingSet->free(id);
                 return Runner::RUNNER_ERROR;
             }
         }
+        _workingSet->free(id);
+        return Runner::RUNNER_ADVANCED;
     }
 
     bool PlanExecutor::isEOF() {
-        return _killed || _root->isEOF();
+        return _killed || (_nextResult == _results.size() && _root->isEOF());
     }
 
     void PlanExecutor::kill() {
@@ -29,8 +29,10 @@
 #pragma once
 
 #include <boost/scoped_ptr.hpp>
+#include <vector>
 
 #include "mongo/base/status.h"
+#include "mongo/db/exec/working_set.h"
 #include "mongo/db/query/runner.h"
 #include "mongo/db/query/runner_yield_policy.h"
 
@@ -98,7 +100,18 @@ namespace mongo {
          */
         void kill();
 
+        /**
+         * Units of work getNext() asks the plan for at a time, set with the queryWorkBatchSize
+         * server parameter.  Results of a batch are handed out by later calls to getNext().
+         */
+        static int workBatchSize;
+
     private:
+        /**
+         * Fill in *objOut and *dlOut from the result 'id' and free it.
+         */
+        Runner::RunnerState returnResult(WorkingSetID id, BSONObj* objOut, DiskLoc* dlOut);
+
         boost::scoped_ptr<WorkingSet> _workingSet;
         boost::scoped_ptr<PlanStage> _root;
         boost::scoped_ptr<RunnerYieldPolicy> _yieldPolicy;
@@ -106,6 +119,15 @@ namespace mongo {
         // Did somebody drop an index we care about or the namespace we're looking at?  If so,
         // we'll be killed.
         bool _killed;
+
+        // Results of the last batch of work not yet returned by getNext(), from _nextResult on.
+        // They're WSIDs like the ones stages hold, so we deal with invalidations for them.
+        std::vector<WorkingSetID> _results;
+        size_t _nextResult;
+
+        // If the last batch of work ended the plan, what getNext() returns after _results.
+        bool _hasEndState;
+        Runner::RunnerState _endState;
     };
 
 }  // namespace mongo
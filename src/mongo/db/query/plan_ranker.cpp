@@ -67,6 +67,7 @@ namespace mongo {
         if (NULL != why) {
             // Record the stats of the winner.
             why->statsOfWinner = statTrees[bestChild];
+            why->score = maxScore;
         }
 
         // Clean up stats of losers.
@@ -82,15 +82,37 @@ namespace mongo {
      * and used by the CachedPlanRunner to compare expected performance with actual.
      */
     struct PlanRankingDecision {
-        PlanRankingDecision() : statsOfWinner(NULL), onlyOneSolution(false) { }
+        PlanRankingDecision() : statsOfWinner(NULL), score(0), onlyOneSolution(false) { }
+
+        ~PlanRankingDecision() { delete statsOfWinner; }
+
+        /**
+         * Returns a copy of this decision which the caller owns.  Only the root of the winner's
+         * stats tree is copied; that is all the cache needs to judge later runs.
+         */
+        PlanRankingDecision* clone() const {
+            PlanRankingDecision* decision = new PlanRankingDecision();
+            if (NULL != statsOfWinner) {
+                decision->statsOfWinner = new PlanStageStats(statsOfWinner->common,
+                                                             statsOfWinner->stageType);
+            }
+            decision->score = score;
+            decision->onlyOneSolution = onlyOneSolution;
+            return decision;
+        }
 
         // Owned by us.
         PlanStageStats* statsOfWinner;
 
+        // The score PlanRanker gave the winner.
+        double score;
+
         bool onlyOneSolution;
 
         // TODO: We can place anything we want here.  What's useful to the cache?  What's useful to
         // planning and optimization?
+    private:
+        MONGO_DISALLOW_COPYING(PlanRankingDecision);
     };
 
 }  // namespace mongo
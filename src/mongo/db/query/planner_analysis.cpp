@@ -66,6 +66,7 @@ namespace mongo {
         }
 
         bool blockingSort = false;
+        SortNode* sortNode = NULL;
 
         // Sort the results, if there is a sort specified.
         if (!query.getParsed().getSort().isEmpty()) {
@@ -112,6 +113,7 @@ namespace mongo {
                         sort->children.push_back(solnRoot);
                         solnRoot = sort;
                         blockingSort = true;
+                        sortNode = sort;
                     }
                 }
             }
@@ -182,6 +184,11 @@ namespace mongo {
             limit->limit = query.getParsed().getNumToReturn();
             limit->children.push_back(solnRoot);
             solnRoot = limit;
+
+            // The sort only needs to keep the results that make it past the skip and limit.
+            if (NULL != sortNode) {
+                sortNode->limit = query.getParsed().getSkip() + query.getParsed().getNumToReturn();
+            }
         }
 
         soln->root.reset(solnRoot);
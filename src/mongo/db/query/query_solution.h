@@ -406,7 +406,7 @@ namespace mongo {
     };
 
     struct SortNode : public QuerySolutionNode {
-        SortNode() { }
+        SortNode() : limit(0) { }
         virtual ~SortNode() { }
 
         virtual StageType getType() const { return STAGE_SORT; }
@@ -432,6 +432,9 @@ namespace mongo {
         BSONObj pattern;
 
         BSONObj query;
+
+        // Sum of any skip and limit applied above the sort.  0 for no limit.
+        size_t limit;
     };
 
     struct LimitNode : public QuerySolutionNode {
@@ -45,11 +45,24 @@
 #include "mongo/db/exec/skip.h"
 #include "mongo/db/exec/text.h"
 #include "mongo/db/index/fts_access_method.h"
+#include "mongo/db/matcher/expression_compiled.h"
 #include "mongo/db/namespace_details.h"
+#include "mongo/db/query/plan_cache.h"
 #include "mongo/db/structure/collection.h"
 
 namespace mongo {
 
+    /**
+     * The compiled form of 'filter' from the plan cache of 'ns', or NULL.
+     */
+    static CompiledMatchExpression* compileFilter(const string& ns,
+                                                  const MatchExpression* filter) {
+        if (NULL == filter) { return NULL; }
+        PlanCache* cache = PlanCache::get(ns);
+        if (NULL == cache) { return NULL; }
+        return cache->getCompiledFilter(filter);
+    }
+
     PlanStage* buildStages(const string& ns, const QuerySolutionNode* root, WorkingSet* ws) {
         if (STAGE_COLLSCAN == root->getType()) {
             const CollectionScanNode* csn = static_cast<const CollectionScanNode*>(root);
@@ -58,7 +71,8 @@ namespace mongo {
             params.tailable = csn->tailable;
             params.direction = (csn->direction == 1) ? CollectionScanParams::FORWARD
                                                      : CollectionScanParams::BACKWARD;
-            return new CollectionScan(params, ws, csn->filter.get());
+            return new CollectionScan(params, ws, csn->filter.get(),
+                                      compileFilter(ns, csn->filter.get()));
         }
         else if (STAGE_IXSCAN == root->getType()) {
             const IndexScanNode* ixn = static_cast<const IndexScanNode*>(root);
@@ -93,7 +107,8 @@ namespace mongo {
             const FetchNode* fn = static_cast<const FetchNode*>(root);
             PlanStage* childStage = buildStages(ns, fn->children[0], ws);
             if (NULL == childStage) { return NULL; }
-            return new FetchStage(ws, childStage, fn->filter.get());
+            return new FetchStage(ws, childStage, fn->filter.get(),
+                                  compileFilter(ns, fn->filter.get()));
         }
         else if (STAGE_SORT == root->getType()) {
             const SortNode* sn = static_cast<const SortNode*>(root);
@@ -102,6 +117,7 @@ namespace mongo {
             SortStageParams params;
             params.pattern = sn->pattern;
             params.query = sn->query;
+            params.limit = sn->limit;
             return new SortStage(params, ws, childStage);
         }
         else if (STAGE_PROJECTION == root->getType()) {
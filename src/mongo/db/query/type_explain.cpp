@@ -35,6 +35,7 @@ namespace mongo {
     const BSONField<bool> TypeExplain::indexOnly("indexOnly");
     const BSONField<long long> TypeExplain::nYields("nYields");
     const BSONField<long long> TypeExplain::nChunkSkips("nChunkSkips");
+    const BSONField<long long> TypeExplain::nSortSpills("nSortSpills");
     const BSONField<long long> TypeExplain::millis("millis");
     const BSONField<BSONObj> TypeExplain::indexBounds("indexBounds");
     const BSONField<std::vector<TypeExplain*> > TypeExplain::allPlans("allPlans");
@@ -127,6 +128,8 @@ namespace mongo {
 
         if (_isNChunkSkipsSet) builder.appendNumber(nChunkSkips(), _nChunkSkips);
 
+        if (_isNSortSpillsSet) builder.appendNumber(nSortSpills(), _nSortSpills);
+
         if (_isMillisSet) builder.appendNumber(millis(), _millis);
 
         if (_isIndexBoundsSet) builder.append(indexBounds(), _indexBounds);
@@ -209,6 +212,10 @@ namespace mongo {
         if (fieldState == FieldParser::FIELD_INVALID) return false;
         _isNChunkSkipsSet = fieldState == FieldParser::FIELD_SET;
 
+        fieldState = FieldParser::extract(source, nSortSpills, &_nSortSpills, errMsg);
+        if (fieldState == FieldParser::FIELD_INVALID) return false;
+        _isNSortSpillsSet = fieldState == FieldParser::FIELD_SET;
+
         fieldState = FieldParser::extract(source, millis, &_millis, errMsg);
         if (fieldState == FieldParser::FIELD_INVALID) return false;
         _isMillisSet = fieldState == FieldParser::FIELD_SET;
@@ -270,6 +277,9 @@ namespace mongo {
         _nChunkSkips = 0;
         _isNChunkSkipsSet = false;
 
+        _nSortSpills = 0;
+        _isNSortSpillsSet = false;
+
         _millis = 0;
         _isMillisSet = false;
 
@@ -332,6 +342,9 @@ namespace mongo {
         other->_nChunkSkips = _nChunkSkips;
         other->_isNChunkSkipsSet = _isNChunkSkipsSet;
 
+        other->_nSortSpills = _nSortSpills;
+        other->_isNSortSpillsSet = _isNSortSpillsSet;
+
         other->_millis = _millis;
         other->_isMillisSet = _isMillisSet;
 
@@ -611,6 +624,24 @@ namespace mongo {
         return _nChunkSkips;
     }
 
+    void TypeExplain::setNSortSpills(long long nSortSpills) {
+        _nSortSpills = nSortSpills;
+        _isNSortSpillsSet = true;
+    }
+
+    void TypeExplain::unsetNSortSpills() {
+         _isNSortSpillsSet = false;
+     }
+
+    bool TypeExplain::isNSortSpillsSet() const {
+         return _isNSortSpillsSet;
+    }
+
+    long long TypeExplain::getNSortSpills() const {
+        dassert(_isNSortSpillsSet);
+        return _nSortSpills;
+    }
+
     void TypeExplain::setMillis(long long millis) {
         _millis = millis;
         _isMillisSet = true;
@@ -47,6 +47,7 @@ namespace mongo {
         static const BSONField<bool> indexOnly;
         static const BSONField<long long> nYields;
         static const BSONField<long long> nChunkSkips;
+        static const BSONField<long long> nSortSpills;
         static const BSONField<long long> millis;
         static const BSONField<BSONObj> indexBounds;
         static const BSONField<std::vector<TypeExplain*> > allPlans;
@@ -140,6 +141,11 @@ namespace mongo {
         bool isNChunkSkipsSet() const;
         long long getNChunkSkips() const;
 
+        void setNSortSpills(long long nSortSpills);
+        void unsetNSortSpills();
+        bool isNSortSpillsSet() const;
+        long long getNSortSpills() const;
+
         void setMillis(long long millis);
         void unsetMillis();
         bool isMillisSet() const;
@@ -218,6 +224,10 @@ namespace mongo {
         long long _nChunkSkips;
         bool _isNChunkSkipsSet;
 
+        // (O)  number of sorted runs a blocking sort wrote to disk
+        long long _nSortSpills;
+        bool _isNSortSpillsSet;
+
         // (O)  elapsed time this plan took running, in milliseconds
         long long _millis;
         bool _isMillisSet;
@@ -72,20 +72,61 @@ namespace replset {
     static Counter64 bufferSizeGauge;
     static ServerStatusMetricField<Counter64> displayBufferSize( "repl.buffer.sizeBytes",
                                                                 &bufferSizeGauge );
-    //The max size (bytes) of the buffer
-    static int bufferMaxSizeGauge = 256*1024*1024;
+    //The max size (bytes) of the buffer, which follows the apply throughput between these bounds
+    static const int bufferMinSizeBytes = 32*1024*1024;
+    static const int bufferMaxSizeBytes = 256*1024*1024;
+    static int bufferMaxSizeGauge = bufferMaxSizeBytes;
     static ServerStatusMetricField<int> displayBufferMaxSize( "repl.buffer.maxSizeBytes",
                                                                 &bufferMaxSizeGauge );
+    //The buffer holds about this many seconds of apply work.  More is memory that a sync target
+    //change or rollback throws away; less leaves the appliers idle across slow getmores.
+    static const int bufferSecondsOfApply = 10;
+
+    //The number and time of waits for room in the full buffer
+    static TimerStats bufferFullStats;
+    static ServerStatusMetricField<TimerStats> displayBufferFullWaits( "repl.buffer.fullWaits",
+                                                                       &bufferFullStats );
+    //The number and time of waits by the sync thread for ops in the empty buffer
+    static TimerStats bufferEmptyStats;
+    static ServerStatusMetricField<TimerStats> displayBufferEmptyWaits( "repl.buffer.emptyWaits",
+                                                                        &bufferEmptyStats );
 
 
     BackgroundSyncInterface::~BackgroundSyncInterface() {}
 
-    size_t getSize(const BSONObj& o) {
-        // SERVER-9808 Avoid Fortify complaint about implicit signed->unsigned conversion
-        return static_cast<size_t>(o.objsize());
+    OplogBatch::OplogBatch(const std::vector<BSONObj>& ops) : _bytes(0) {
+        for (std::vector<BSONObj>::const_iterator it = ops.begin(); it != ops.end(); ++it) {
+            _bytes += it->objsize();
+        }
+        _data.reset(new char[_bytes]);
+
+        // The ops are normally adjacent in the reply message, so copy runs of them at once.
+        size_t pos = 0;
+        size_t i = 0;
+        while (i < ops.size()) {
+            const char* start = ops[i].objdata();
+            const char* end = start + ops[i].objsize();
+            for (++i; i < ops.size() && ops[i].objdata() == end; ++i) {
+                end += ops[i].objsize();
+            }
+            memcpy(_data.get() + pos, start, end - start);
+            pos += end - start;
+        }
+
+        _ops.reserve(ops.size());
+        for (pos = 0; pos < _bytes; pos += _ops.back().objsize()) {
+            _ops.push_back(BSONObj(_data.get() + pos));
+        }
+    }
+
+    size_t getSize(const OplogBatchPtr& batch) {
+        return batch->bytes();
     }
 
     BackgroundSync::BackgroundSync() : _buffer(bufferMaxSizeGauge, &getSize),
+                                       _applyPos(0),
+                                       _consumedBytes(0),
+                                       _applyBytesPerSec(0),
                                        _lastOpTimeFetched(0, 0),
                                        _lastH(0),
                                        _pause(true),
@@ -108,7 +149,7 @@ namespace replset {
         notify();
     }
 
-    void BackgroundSync::notify() {
+    void BackgroundSync::notifyOpWritten() {
         {
             boost::unique_lock<boost::mutex> lock(s_mutex);
             if (s_instance == NULL) {
@@ -116,16 +157,25 @@ namespace replset {
             }
         }
 
+        boost::unique_lock<boost::mutex> opLock(s_instance->_lastOpMutex);
+        s_instance->_lastOpCond.notify_all();
+    }
+
+    void BackgroundSync::notify() {
         {
-            boost::unique_lock<boost::mutex> opLock(s_instance->_lastOpMutex);
-            s_instance->_lastOpCond.notify_all();
+            boost::unique_lock<boost::mutex> lock(s_mutex);
+            if (s_instance == NULL) {
+                return;
+            }
         }
 
+        notifyOpWritten();
+
         {
             boost::unique_lock<boost::mutex> lock(s_instance->_mutex);
 
             // If all ops in the buffer have been applied, unblock waitForRepl (if it's waiting)
-            if (s_instance->_buffer.empty()) {
+            if (s_instance->_bufferEmpty_inlock()) {
                 s_instance->_appliedBuffer = true;
                 s_instance->_condvar.notify_all();
             }
@@ -419,28 +469,71 @@ namespace replset {
 
             // At this point, we are guaranteed to have at least one thing to read out
             // of the oplogreader cursor.
-            BSONObj o = r.nextSafe().getOwned();
-            opsReadStats.increment();
+            _queueCurrentBatch(r);
+        }
+    }
 
-            {
-                boost::unique_lock<boost::mutex> lock(_mutex);
-                _appliedBuffer = false;
-            }
+    void BackgroundSync::_queueCurrentBatch(OplogReader& r) {
+        std::vector<BSONObj> fetched;
+        while (r.moreInCurrentBatch()) {
+            fetched.push_back(r.nextSafe());
+        }
+        // one copy of the batch rather than one per op
+        OplogBatchPtr batch(new OplogBatch(fetched));
+        opsReadStats.increment(fetched.size());
 
-            OCCASIONALLY {
-                LOG(2) << "bgsync buffer has " << _buffer.size() << " bytes" << rsLog;
-            }
+        {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            _appliedBuffer = false;
+        }
+
+        OCCASIONALLY {
+            LOG(2) << "bgsync buffer has " << _buffer.size() << " bytes" << rsLog;
+        }
+        {
             // the blocking queue will wait (forever) until there's room for us to push
-            _buffer.push(o);
-            bufferCountGauge.increment();
-            bufferSizeGauge.increment(getSize(o));
+            Timer waitTimer;
+            _buffer.push(batch);
+            const int millis = waitTimer.millis();
+            if (millis > 0) {
+                bufferFullStats.recordMillis(millis);
+            }
+        }
+        bufferCountGauge.increment(batch->ops().size());
+        bufferSizeGauge.increment(batch->bytes());
 
-            {
-                boost::unique_lock<boost::mutex> lock(_mutex);
-                _lastH = o["h"].numberLong();
-                _lastOpTimeFetched = o["ts"]._opTime();
+        {
+            const BSONObj& last = batch->ops().back();
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            _lastH = last["h"].numberLong();
+            _lastOpTimeFetched = last["ts"]._opTime();
+        }
+
+        _adjustBufferSize();
+    }
+
+    void BackgroundSync::_adjustBufferSize() {
+        double bytesPerSec;
+        {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            const int millis = _applyRateTimer.millis();
+            if (millis < 1000) {
+                return;
             }
+            const double rate = _consumedBytes * 1000.0 / millis;
+            // smooth it so that one slow or idle second doesn't empty the buffer
+            _applyBytesPerSec = _applyBytesPerSec * 0.8 + rate * 0.2;
+            _consumedBytes = 0;
+            _applyRateTimer.reset();
+            bytesPerSec = _applyBytesPerSec;
         }
+
+        const double target = bytesPerSec * bufferSecondsOfApply;
+        const int maxSize = target < bufferMinSizeBytes ? bufferMinSizeBytes :
+                            target > bufferMaxSizeBytes ? bufferMaxSizeBytes :
+                            static_cast<int>(target);
+        _buffer.setMaxSize(maxSize);
+        bufferMaxSizeGauge = maxSize;
     }
 
     bool BackgroundSync::shouldChangeSyncTarget() {
@@ -457,31 +550,75 @@ namespace replset {
     }
 
 
-    bool BackgroundSync::peek(BSONObj* op) {
-        {
-            boost::unique_lock<boost::mutex> lock(_mutex);
+    bool BackgroundSync::_bufferEmpty_inlock() {
+        return !_applyBatch && _buffer.empty();
+    }
 
-            if (_currentSyncTarget != _oplogMarkerTarget &&
-                _currentSyncTarget != NULL) {
-                _oplogMarkerTarget = NULL;
+    bool BackgroundSync::peek(BSONObj* op, OplogBatchPtr* batch) {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+
+        if (_currentSyncTarget != _oplogMarkerTarget &&
+            _currentSyncTarget != NULL) {
+            _oplogMarkerTarget = NULL;
+        }
+
+        // move on to the next fetched batch once the last one is consumed
+        if (!_applyBatch) {
+            if (!_buffer.tryPop(_applyBatch)) {
+                return false;
             }
+            _applyPos = 0;
+        }
+
+        *op = _applyBatch->ops()[_applyPos];
+        if (batch) {
+            *batch = _applyBatch;
         }
-        return _buffer.peek(*op);
+        return true;
     }
 
     void BackgroundSync::waitForMore() {
-        BSONObj op;
+        TimerHolder waitTimer(&bufferEmptyStats);
+        OplogBatchPtr batch;
         // Block for one second before timing out.
-        // Ignore the value of the op we peeked at.
-        _buffer.blockingPeek(op, 1);
+        // Ignore the value of the batch we peeked at.
+        _buffer.blockingPeek(batch, 1);
     }
 
     void BackgroundSync::consume() {
+        boost::unique_lock<boost::mutex> lock(_mutex);
+
         // this is just to get the op off the queue, it's been peeked at
         // and queued for application already
-        BSONObj op = _buffer.blockingPop();
+        verify(_applyBatch);
+        const size_t size = _applyBatch->ops()[_applyPos].objsize();
         bufferCountGauge.decrement(1);
-        bufferSizeGauge.decrement(getSize(op));
+        bufferSizeGauge.decrement(size);
+        _consumedBytes += size;
+
+        if (++_applyPos == _applyBatch->ops().size()) {
+            _applyBatch.reset();
+        }
+    }
+
+    BSONObj BackgroundSync::getCounters() {
+        double applyBytesPerSec;
+        {
+            boost::unique_lock<boost::mutex> lock(_mutex);
+            applyBytesPerSec = _applyBytesPerSec;
+        }
+
+        BSONObjBuilder b;
+        b.append("fetch", BSON("getmores" << getmoreReplStats.getReport() <<
+                               "ops" << opsReadStats.get() <<
+                               "bytes" << networkByteStats.get()));
+        b.append("buffer", BSON("count" << bufferCountGauge.get() <<
+                                "sizeBytes" << bufferSizeGauge.get() <<
+                                "maxSizeBytes" << static_cast<long long>(_buffer.maxSize()) <<
+                                "applyBytesPerSec" << applyBytesPerSec <<
+                                "fullWaits" << bufferFullStats.getReport() <<
+                                "emptyWaits" << bufferEmptyStats.getReport()));
+        return b.obj();
     }
 
     bool BackgroundSync::isStale(OplogReader& r, BSONObj& remoteOldestOp) {
@@ -626,9 +763,9 @@ namespace replset {
     }
 
     void BackgroundSync::start() {
-        massert(16235, "going to start syncing, but buffer is not empty", _buffer.empty());
-
         boost::unique_lock<boost::mutex> lock(_mutex);
+        massert(16235, "going to start syncing, but buffer is not empty", _bufferEmpty_inlock());
+
         _pause = false;
 
         // reset _last fields with current data
@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <boost/scoped_array.hpp>
 #include <boost/thread/mutex.hpp>
 
 #include "mongo/util/queue.h"
@@ -38,6 +39,24 @@
 namespace mongo {
 namespace replset {
 
+    /**
+     * The ops of one batch fetched from the sync source, copied into a single buffer.  ops() are
+     * unowned BSONObjs pointing into it, valid as long as a reference to the OplogBatch is kept.
+     */
+    class OplogBatch : boost::noncopyable {
+    public:
+        // copies 'ops', which may point into the cursor's reply message, into one buffer
+        explicit OplogBatch(const std::vector<BSONObj>& ops);
+
+        const std::vector<BSONObj>& ops() const { return _ops; }
+        size_t bytes() const { return _bytes; }
+
+    private:
+        boost::scoped_array<char> _data;
+        size_t _bytes;
+        std::vector<BSONObj> _ops;
+    };
+
     // This interface exists to facilitate easier testing;
     // the test infrastructure implements these functions with stubs.
     class BackgroundSyncInterface {
@@ -47,7 +66,9 @@ namespace replset {
         // Gets the head of the buffer, but does not remove it. 
         // Returns true if an element was present at the head;
         // false if the queue was empty.
-        virtual bool peek(BSONObj* op) = 0;
+        // If 'batch' is given it is set to the batch 'op' points into, to be held for as long
+        // as 'op' is used; it is set to NULL if 'op' is owned.
+        virtual bool peek(BSONObj* op, OplogBatchPtr* batch = NULL) = 0;
 
         // Deletes objects in the queue;
         // called by sync thread after it has applied an op
@@ -79,7 +100,16 @@ namespace replset {
         boost::mutex _mutex;
 
         // Production thread
-        BlockingQueue<BSONObj> _buffer;
+        BlockingQueue<OplogBatchPtr> _buffer;
+        // The batch the sync thread is taking ops from and the position of the next one.
+        // Protected by _mutex.
+        OplogBatchPtr _applyBatch;
+        size_t _applyPos;
+        // Bytes of ops consumed since _applyRateTimer was reset, for sizing the buffer.
+        // Protected by _mutex.
+        long long _consumedBytes;
+        Timer _applyRateTimer;
+        double _applyBytesPerSec;
 
         OpTime _lastOpTimeFetched;
         long long _lastH;
@@ -108,6 +138,12 @@ namespace replset {
         void _producerThread();
         // Adds elements to the list, up to maxSize.
         void produce();
+        // Queues the ops left in the reader's current batch as one OplogBatch
+        void _queueCurrentBatch(OplogReader& r);
+        // Sets the buffer's max size to hold about bufferSecondsOfApply of apply work
+        void _adjustBufferSize();
+        // True if every op fetched has been consumed.  Must hold _mutex.
+        bool _bufferEmpty_inlock();
         // Check if rollback is necessary
         bool isRollbackRequired(OplogReader& r);
         void getOplogReader(OplogReader& r);
@@ -134,7 +170,11 @@ namespace replset {
     public:
         static BackgroundSync* get();
         static void shutdown();
+        // Wakes the notifier thread and, if every op in the buffer has been applied and
+        // written to the oplog, anyone waiting for the buffer to drain
         static void notify();
+        // Only wakes the notifier thread, for each op written to the oplog
+        static void notifyOpWritten();
 
         virtual ~BackgroundSync() {}
 
@@ -145,12 +185,12 @@ namespace replset {
 
         // Interface implementation
 
-        virtual bool peek(BSONObj* op);
+        virtual bool peek(BSONObj* op, OplogBatchPtr* batch = NULL);
         virtual void consume();
         virtual const Member* getSyncTarget();
         virtual void waitForMore();
 
-        // For monitoring
+        // For monitoring: fetch, buffer and apply timings, reported by replSetGetStatus
         BSONObj getCounters();
 
         // Wait for replication to finish and buffer to be applied so that the member can become
@@ -443,6 +443,10 @@ namespace mongo {
                 bb.append("maintenanceMode", maintenance);
             }
 
+            if (myState.startup2() && !_initialSyncProgress.empty()) {
+                bb.append("initialSyncProgress", _initialSyncProgress.toBSON());
+            }
+
             if (theReplSet) {
                 string s = theReplSet->hbmsg();
                 if( !s.empty() )
@@ -502,6 +506,13 @@ namespace mongo {
             b.append("syncingTo", syncTarget->fullName());
         }
         b.append("members", v);
+        if (!_self->config().arbiterOnly) {
+            // how fetching, buffering and applying ops are keeping up on this member
+            BSONObjBuilder sync(b.subobjStart("syncCounters"));
+            sync.appendElements(replset::BackgroundSync::get()->getCounters());
+            sync.append("apply", replset::SyncTail::getCounters());
+            sync.done();
+        }
         if( replSetBlind )
             b.append("blind",true); // to avoid confusion if set...normally never set except for testing.
     }
@@ -120,7 +120,8 @@ namespace mongo {
                 theReplSet->lastH = h;
                 ctx.getClient()->setLastOp( ts );
 
-                replset::BackgroundSync::notify();
+                // the sync thread says when the whole buffer has been applied and written
+                replset::BackgroundSync::notifyOpWritten();
             }
         }
 
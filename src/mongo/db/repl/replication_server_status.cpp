@@ -33,6 +33,7 @@
 #include <boost/scoped_ptr.hpp>
 
 #include "mongo/client/connpool.h"
+#include "mongo/db/client_basic.h"
 #include "mongo/db/commands/server_status.h"
 #include "mongo/db/jsobj.h"
 #include "mongo/db/query/internal_plans.h"
@@ -42,6 +43,7 @@
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/db/wire_version.h"
+#include "mongo/util/net/message_compressor.h"
 
 namespace mongo {
 
@@ -181,6 +183,7 @@ namespace mongo {
             result.appendDate("localTime", jsTime());
             result.append("maxWireVersion", maxWireVersion);
             result.append("minWireVersion", minWireVersion);
+            MessageCompressor::negotiate(cmdObj, ClientBasic::getCurrent()->port(), &result);
             return true;
         }
     } cmdismaster;
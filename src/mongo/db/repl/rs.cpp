@@ -487,6 +487,7 @@ namespace {
         ghost(0),
         _writerPool(replWriterThreadCount),
         _prefetcherPool(replPrefetcherThreadCount),
+        _oplogWriterPool(1),
         oplogVersion(0),
         initialSyncRequested(false), // only used for resync
         _indexPrefetchConfig(PREFETCH_ALL) {
@@ -31,6 +31,7 @@
 #pragma once
 
 #include "mongo/bson/optime.h"
+#include "mongo/db/cloner.h"
 #include "mongo/db/commands.h"
 #include "mongo/db/index/index_descriptor.h"
 #include "mongo/db/storage/index_details.h"
@@ -567,6 +568,10 @@ namespace mongo {
         threadpool::ThreadPool _writerPool;
         // persistent pool of worker threads for prefetching
         threadpool::ThreadPool _prefetcherPool;
+        // single thread that appends applied batches to local.oplog.rs, in order
+        threadpool::ThreadPool _oplogWriterPool;
+        // collections copied by the initial sync data pass, for replSetGetStatus
+        CloneProgress _initialSyncProgress;
 
     public:
         // Allow index prefetching to be turned on/off
@@ -585,6 +590,7 @@ namespace mongo {
         static const int replPrefetcherThreadCount;
         threadpool::ThreadPool& getPrefetchPool() { return _prefetcherPool; }
         threadpool::ThreadPool& getWriterPool() { return _writerPool; }
+        threadpool::ThreadPool& getOplogWriterPool() { return _oplogWriterPool; }
 
         static const int maxSyncSourceLagSecs;
 
@@ -659,6 +665,9 @@ namespace mongo {
         void fillIsMaster(BSONObjBuilder& b) { _fillIsMaster(b); }
         threadpool::ThreadPool& getPrefetchPool() { return ReplSetImpl::getPrefetchPool(); }
         threadpool::ThreadPool& getWriterPool() { return ReplSetImpl::getWriterPool(); }
+        threadpool::ThreadPool& getOplogWriterPool() {
+            return ReplSetImpl::getOplogWriterPool();
+        }
 
         /**
          * We have a new config (reconfig) - apply it.
@@ -41,6 +41,8 @@
 #include "mongo/bson/optime.h"
 #include "mongo/db/repl/replication_server_status.h"  // replSettings
 #include "mongo/db/repl/rs_sync.h"
+#include "mongo/db/server_parameters.h"
+#include "mongo/util/fail_point_service.h"
 #include "mongo/util/mongoutils/str.h"
 
 namespace mongo {
@@ -50,6 +52,23 @@ namespace mongo {
 
     void dropAllDatabasesExceptLocal();
 
+    // Pauses initial sync after the data is cloned, while its progress is still reported.
+    MONGO_FP_DECLARE(initialSyncHangAfterDataCloning);
+
+    namespace {
+        // collections, or _id ranges of one, the data pass copies at once
+        int replInitialSyncCloneThreads = 4;
+        ExportedServerParameter<int> replInitialSyncCloneThreadsParameter(
+                ServerParameterSet::getGlobal(), "replInitialSyncCloneThreads",
+                &replInitialSyncCloneThreads, true, true);
+
+        // collections larger than this are split into _id ranges copied in parallel
+        int replInitialSyncCloneRangeMB = 256;
+        ExportedServerParameter<int> replInitialSyncCloneRangeMBParameter(
+                ServerParameterSet::getGlobal(), "replInitialSyncCloneRangeMB",
+                &replInitialSyncCloneRangeMB, true, true);
+    }
+
     // add try/catch with sleep
 
     void isyncassert(const string& msg, bool expr) {
@@ -108,6 +127,13 @@ namespace mongo {
             options.mayBeInterrupted = false;
             options.syncData = dataPass;
             options.syncIndexes = ! dataPass;
+            if (dataPass) {
+                // indexes other than _id are built by the second pass, from the copied data
+                options.cloneThreads = replInitialSyncCloneThreads;
+                options.cloneRangeBytes =
+                    static_cast<long long>(replInitialSyncCloneRangeMB) * 1024 * 1024;
+                options.progress = &_initialSyncProgress;
+            }
 
             if (!cloner.go(master, options, err, &errCode)) {
                 sethbmsg(str::stream() << "initial sync: error while "
@@ -407,6 +433,7 @@ namespace mongo {
             dropAllDatabasesExceptLocal();
 
             sethbmsg("initial sync clone all databases", 0);
+            _initialSyncProgress.reset();
 
             list<string> dbs = r.conn()->getDatabaseNames();
 
@@ -417,6 +444,12 @@ namespace mongo {
                 return;
             }
 
+            while (MONGO_FAIL_POINT(initialSyncHangAfterDataCloning)) {
+                log() << "initial sync - initialSyncHangAfterDataCloning fail point enabled"
+                      << rsLog;
+                sleepsecs(1);
+            }
+
             sethbmsg("initial sync data copy, starting syncup",0);
 
             log() << "oplog sync 1 of 3" << endl;
@@ -66,6 +66,12 @@ namespace mongo {
 namespace replset {
 
     MONGO_FP_DECLARE(rsSyncApplyStop);
+    // For holding the oplog writer between groups of ops in tests
+    MONGO_FP_DECLARE(rsOplogWriterHang);
+
+    // Ops the oplog writer appends under one lock on "local".  The sync thread's setMinValid()
+    // for the next batch waits for at most one such group.
+    static const size_t oplogWriterGroupSize = 64;
 
     // Number and time of each ApplyOps worker pool round
     static TimerStats applyBatchStats;
@@ -84,8 +90,14 @@ namespace replset {
 
     SyncTail::~SyncTail() {}
 
+    // static
+    BSONObj SyncTail::getCounters() {
+        return BSON("batches" << applyBatchStats.getReport() <<
+                    "ops" << opsAppliedStats.get());
+    }
+
     bool SyncTail::peek(BSONObj* op) {
-        return _networkQueue->peek(op);
+        return _networkQueue->peek(op, NULL);
     }
     /* apply the log op that is in param o
        @return bool success (true) or failure (false)
@@ -147,6 +159,22 @@ namespace replset {
         }
     }
 
+    void initializeOplogWriterThread() {
+        if (!ClientBasic::getCurrent()) {
+            Client::initThread("repl oplog writer");
+            // the next batch holds the barrier while this one is written
+            Lock::ParallelBatchWriterMode::iAmABatchParticipant();
+            replLocalAuth();
+        }
+    }
+
+    // Waits for the batch handed to the oplog writer thread, if any, to be written.  Once the
+    // bgsync buffer is empty too, everything fetched has been applied and logged.
+    static void drainOplogWriter() {
+        theReplSet->getOplogWriterPool().join();
+        BackgroundSync::notify();
+    }
+
     // This free function is used by the writer threads to apply each op
     void multiSyncApply(const std::vector<BSONObj>& ops, SyncTail* st) {
         initializeWriterThread();
@@ -224,17 +252,6 @@ namespace replset {
         }
     }
 
-    // Doles out all the work to the reader pool threads and waits for them to complete
-    void SyncTail::prefetchOps(const std::deque<BSONObj>& ops) {
-        threadpool::ThreadPool& prefetcherPool = theReplSet->getPrefetchPool();
-        for (std::deque<BSONObj>::const_iterator it = ops.begin();
-             it != ops.end();
-             ++it) {
-            prefetcherPool.schedule(&prefetchOp, *it);
-        }
-        prefetcherPool.join();
-    }
-    
     // Doles out all the work to the writer pool threads and waits for them to complete
     void SyncTail::applyOps(const std::vector< std::vector<BSONObj> >& writerVectors, 
                                      MultiSyncApplyFunc applyFunc) {
@@ -253,8 +270,9 @@ namespace replset {
     // Doles out all the work to the writer pool threads and waits for them to complete
     void SyncTail::multiApply( std::deque<BSONObj>& ops, MultiSyncApplyFunc applyFunc ) {
 
-        // Use a ThreadPool to prefetch all the operations in a batch.
-        prefetchOps(ops);
+        // tryPopAndWaitForMore() scheduled the prefetch of each op as it was popped; the readers
+        // would block on the batch writer lock, so let them finish first.
+        theReplSet->getPrefetchPool().join();
         
         std::vector< std::vector<BSONObj> > writerVectors(theReplSet->replWriterThreadCount);
         fillWriterVectors(ops, &writerVectors);
@@ -342,8 +360,9 @@ namespace replset {
                 }
             }
 
-            // we want to keep a record of the last op applied, to compare with minvalid
-            lastOp = ops.getDeque().back();
+            // we want to keep a record of the last op applied, to compare with minvalid.
+            // it must outlive the fetched batch it points into.
+            lastOp = ops.getDeque().back().getOwned();
             OpTime tempTs = lastOp["ts"]._opTime();
             applyOpsToOplog(&ops.getDeque());
 
@@ -386,8 +405,29 @@ namespace replset {
         }
     }
 
-    /* tail an oplog.  ok to return, will be re-called. */
+    namespace {
+        // Leaves the oplog caught up with the applied data when oplogApplication() returns
+        class OplogWriterDrainer : boost::noncopyable {
+        public:
+            ~OplogWriterDrainer() {
+                drainOplogWriter();
+            }
+        };
+    }
+
+    /* tail an oplog.  ok to return, will be re-called.
+
+       Batches are pipelined: while batch N is applied, batch N-1 is still being written to
+       local.oplog.rs by the oplog writer thread, and the ops of batch N+1 are prefetched as they
+       are popped.  The writer only holds the lock on "local" for a small group of ops at a time,
+       so setting minValid for batch N, which needs that lock too, doesn't wait for all of batch
+       N-1 to be written.  minValid is set to the last op of a batch before it is applied, so a
+       crash with the oplog ending anywhere in batch N-1 or N still restarts in RECOVERING,
+       replaying from the end of the oplog until minValid is reached.
+    */
     void SyncTail::oplogApplication() {
+        OplogWriterDrainer drainer;
+
         while( 1 ) {
             OpQueue ops;
 
@@ -427,6 +467,8 @@ namespace replset {
                     // we have to check this before calling mgr, as we must be a secondary to
                     // become primary
                     if (!theReplSet->isSecondary()) {
+                        // minValid is compared with the last op written to the oplog
+                        drainOplogWriter();
                         OpTime minvalid;
                         theReplSet->tryToGoLiveAsASecondary(minvalid);
                     }
@@ -482,7 +524,7 @@ namespace replset {
 
             multiApply(ops.getDeque(), multiSyncApply);
 
-            applyOpsToOplog(&ops.getDeque());
+            scheduleOpsToOplog(&ops);
 
             // If we're just testing (no manager), don't keep looping if we exhausted the bgqueue
             if (!theReplSet->mgr) {
@@ -503,12 +545,16 @@ namespace replset {
     // to periodically check in the loop.
     bool SyncTail::tryPopAndWaitForMore(SyncTail::OpQueue* ops) {
         BSONObj op;
+        OplogBatchPtr batch;
         // Check to see if there are ops waiting in the bgsync queue
-        bool peek_success = peek(&op);
+        bool peek_success = _networkQueue->peek(&op, &batch);
 
         if (!peek_success) {
             // if we don't have anything in the queue, wait a bit for something to appear
             if (ops->empty()) {
+                // everything fetched so far has been applied, so let the last batch reach the
+                // oplog rather than leave it waiting behind a batch that isn't coming
+                drainOplogWriter();
                 // block up to 1 second
                 _networkQueue->waitForMore();
                 return false;
@@ -528,8 +574,9 @@ namespace replset {
 
             if (ops->empty()) {
                 // apply commands one-at-a-time
-                ops->push_back(op);
+                ops->push_back(op, batch);
                 _networkQueue->consume();
+                theReplSet->getPrefetchPool().schedule(&prefetchOp, op);
             }
 
             // otherwise, apply what we have so far and come back for the command
@@ -559,9 +606,12 @@ namespace replset {
         }
     
         // Copy the op to the deque and remove it from the bgsync queue.
-        ops->push_back(op);
+        ops->push_back(op, batch);
         _networkQueue->consume();
 
+        // Start prefetching it while the rest of the batch is gathered.
+        theReplSet->getPrefetchPool().schedule(&prefetchOp, op);
+
         // Go back for more ops
         return false;
     }
@@ -581,6 +631,43 @@ namespace replset {
         BackgroundSync::notify();
     }
 
+    void SyncTail::scheduleOpsToOplog(OpQueue* ops) {
+        ThreadPool& oplogWriterPool = theReplSet->getOplogWriterPool();
+        oplogWriterPool.join();
+
+        // this keeps the fetched batches the ops point into, too
+        boost::shared_ptr<OpQueue> batch(new OpQueue());
+        batch->swap(*ops);
+        oplogWriterPool.schedule(&writeOpsToOplog, batch);
+    }
+
+    // The oplog writer thread calls this to write each batch
+    void SyncTail::writeOpsToOplog(const boost::shared_ptr<OpQueue>& ops) {
+        initializeOplogWriterThread();
+
+        try {
+            const std::deque<BSONObj>& deque = ops->getDeque();
+            std::deque<BSONObj>::const_iterator it = deque.begin();
+            while (it != deque.end()) {
+                {
+                    Lock::DBWrite lk("local");
+                    for (size_t n = 0; n < oplogWriterGroupSize && it != deque.end(); ++n, ++it) {
+                        // this updates theReplSet->lastOpTimeWritten and wakes the notifier
+                        _logOpObjRS(*it);
+                    }
+                }
+
+                while (MONGO_FAIL_POINT(rsOplogWriterHang)) {
+                    sleepmillis(10);
+                }
+            }
+        }
+        catch (const DBException& e) {
+            error() << "oplog writer caught exception: " << causedBy(e) << endl;
+            fassertFailedNoTrace(17298);
+        }
+    }
+
     void SyncTail::handleSlaveDelay(const BSONObj& lastOp) {
         int sd = theReplSet->myConfig().slaveDelay;
 
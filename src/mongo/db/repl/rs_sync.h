@@ -28,6 +28,7 @@
 
 #pragma once
 
+#include <boost/shared_ptr.hpp>
 #include <deque>
 #include <vector>
 
@@ -41,6 +42,8 @@ namespace mongo {
 namespace replset {
 
     class BackgroundSyncInterface;
+    class OplogBatch;
+    typedef boost::shared_ptr<const OplogBatch> OplogBatchPtr;
 
     /**
      * "Normal" replica set syncing
@@ -79,25 +82,39 @@ namespace replset {
         void oplogApplication();
         bool peek(BSONObj* obj);
 
+        // For monitoring: apply batch timings and ops applied, reported by replSetGetStatus
+        static BSONObj getCounters();
+
         class OpQueue {
         public:
             OpQueue() : _size(0) {}
             size_t getSize() { return _size; }
             std::deque<BSONObj>& getDeque() { return _deque; }
-            void push_back(BSONObj& op) {
+            // 'batch' is the fetched batch 'op' points into, if any; it is kept with the queue
+            void push_back(BSONObj& op, const OplogBatchPtr& batch = OplogBatchPtr()) {
                 _deque.push_back(op);
                 _size += op.objsize();
+                if (batch && (_batches.empty() || _batches.back() != batch)) {
+                    _batches.push_back(batch);
+                }
             }
             bool empty() {
                 return _deque.empty();
             }
+            void swap(OpQueue& other) {
+                _deque.swap(other._deque);
+                std::swap(_size, other._size);
+                _batches.swap(other._batches);
+            }
         private:
             std::deque<BSONObj> _deque;
             size_t _size;
+            std::vector<OplogBatchPtr> _batches;
         };
 
         // returns true if we should continue waiting for BSONObjs, false if we should
         // stop waiting and apply the queue we have.  Only returns false if !ops.empty().
+        // Each op popped is handed to the prefetch pool right away.
         bool tryPopAndWaitForMore(OpQueue* ops);
         
         // After ops have been written to db, call this
@@ -106,6 +123,11 @@ namespace replset {
         // Ops are removed from the deque.
         void applyOpsToOplog(std::deque<BSONObj>* ops);
 
+        // Like applyOpsToOplog, but hands the ops to the oplog writer thread so that the next
+        // batch can be applied while they are written.  Waits for the previous batch's write
+        // first, so at most one batch is outstanding.  Ops are removed from the queue.
+        void scheduleOpsToOplog(OpQueue* ops);
+
     protected:
         // Cap the batches using the limit on journal commits.
         // This works out to be 100 MB (64 bit) or 50 MB (32 bit)
@@ -123,10 +145,11 @@ namespace replset {
     private:
         BackgroundSyncInterface* _networkQueue;
 
-        // Doles out all the work to the reader pool threads and waits for them to complete
-        void prefetchOps(const std::deque<BSONObj>& ops);
         // Used by the thread pool readers to prefetch an op
         static void prefetchOp(const BSONObj& op);
+        // Used by the oplog writer thread to write a batch to local.oplog.rs, locking "local"
+        // for a small group of ops at a time
+        static void writeOpsToOplog(const boost::shared_ptr<OpQueue>& ops);
 
         // Doles out all the work to the writer pool threads and waits for them to complete
         void applyOps(const std::vector< std::vector<BSONObj> >& writerVectors, 
@@ -28,6 +28,7 @@ namespace mongo {
             configsvr(false), cpu(false), objcheck(true), defaultProfile(0),
             slowMS(100), defaultLocalThresholdMillis(15), moveParanoia(true),
             noUnixSocket(false), doFork(0), socket("/tmp"), maxConns(DEFAULT_MAX_CONN),
+            netWorkerThreads(0),
             logAppend(false), logWithSyslog(false), isHttpInterfaceEnabled(false)
         {
             started = time(0);
@@ -68,6 +69,7 @@ namespace mongo {
         std::string socket;    // UNIX domain socket directory
 
         int maxConns;          // Maximum number of simultaneous open connections.
+        int netWorkerThreads;  // --netWorkerThreads, 0 for a thread per connection.
 
         std::string keyFile;   // Path to keyfile, or empty if none.
         std::string pidFile;   // Path to pid file, or empty if none.
@@ -158,6 +158,10 @@ namespace {
         options->addOptionChaining("maxConns", "maxConns", moe::Int,
                 maxConnInfoBuilder.str().c_str());
 
+        options->addOptionChaining("netWorkerThreads", "netWorkerThreads", moe::Int,
+                "serve client connections from an epoll loop with this many worker threads, "
+                "instead of a thread per connection (linux only)");
+
         options->addOptionChaining("logpath", "logpath", moe::String,
                 "log file to send write to instead of stdout - has to be a file, not directory");
 
@@ -439,6 +443,14 @@ namespace {
             }
         }
 
+        if (params.count("netWorkerThreads")) {
+            serverGlobalParams.netWorkerThreads = params["netWorkerThreads"].as<int>();
+
+            if (serverGlobalParams.netWorkerThreads < 1) {
+                return Status(ErrorCodes::BadValue, "netWorkerThreads has to be at least 1");
+            }
+        }
+
         if (params.count("objcheck")) {
             serverGlobalParams.objcheck = true;
         }
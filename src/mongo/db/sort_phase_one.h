@@ -42,6 +42,11 @@ namespace mongo {
         shared_ptr<BSONObjExternalSorter> sorter;
         shared_ptr<ExternalSortComparison> sortCmp;
 
+        // the sorted keys once phase one is done.  when phase one ran on several threads this
+        // merges the output of the sorters in parts, which must outlive it.
+        shared_ptr<BSONObjExternalSorter::Iterator> sorted;
+        vector<shared_ptr<SortPhaseOne> > parts;
+
         unsigned long long n; // # of records
         unsigned long long nkeys;
         bool multi; // multikey index
@@ -0,0 +1,135 @@
+// hmem_storage.cpp
+
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#include "mongo/pch.h"
+
+#include "mongo/db/storage/hmem_storage.h"
+
+#include "mongo/db/commands/server_status.h"
+#include "mongo/db/storage_options.h"
+#include "mongo/util/hmem/hybrid_memory_lib.h"
+#include "mongo/util/log.h"
+#include "mongo/util/mongoutils/str.h"
+
+namespace mongo {
+
+    void initHmemStorage() {
+        if (!storageGlobalParams.hmem)
+            return;
+
+        // hmem names its flash cache files by appending to the directory path.
+        string flashPath = storageGlobalParams.hmemFlashPath;
+        if (flashPath.empty() || flashPath[flashPath.size() - 1] != '/')
+            flashPath += '/';
+
+        log() << "hmem: flash cache in " << flashPath
+              << " page cache: " << storageGlobalParams.hmemPageCacheSize / (1024 * 1024) << "MB"
+              << " ram cache: " << storageGlobalParams.hmemRAMCacheSize / (1024 * 1024) << "MB"
+              << " flash cache: " << storageGlobalParams.hmemFlashCacheSize / (1024 * 1024)
+              << "MB instances: " << storageGlobalParams.hmemInstances
+              << " replacement policy: " << storageGlobalParams.hmemReplacementPolicy << endl;
+
+        ReplacementPolicyType policy;
+        uassert(17290, str::stream() << "unknown hmem replacement policy "
+                                     << storageGlobalParams.hmemReplacementPolicy,
+                ParseReplacementPolicy(storageGlobalParams.hmemReplacementPolicy, &policy));
+
+        uassert(17287, str::stream() << "couldn't initialize hybrid memory in " << flashPath,
+                InitHybridMemory(flashPath,
+                                 "hmem",
+                                 storageGlobalParams.hmemPageCacheSize,
+                                 storageGlobalParams.hmemRAMCacheSize,
+                                 storageGlobalParams.hmemFlashCacheSize,
+                                 storageGlobalParams.hmemInstances,
+                                 policy));
+    }
+
+    void shutdownHmemStorage() {
+        if (!storageGlobalParams.hmem)
+            return;
+
+        HybridMemoryStatistics stats;
+        GetHybridMemoryStatistics(&stats);
+        log() << "hmem: saving flash cache metadata for " << stats.detached_pages
+              << " pages of unmapped files" << endl;
+        ReleaseHybridMemory();
+    }
+
+    namespace {
+
+        class HmemSSS : public ServerStatusSection {
+        public:
+            HmemSSS() : ServerStatusSection( "hmem" ){}
+            virtual bool includeByDefault() const { return storageGlobalParams.hmem; }
+
+            BSONObj generateSection(const BSONElement& configElement) const {
+                if (!storageGlobalParams.hmem)
+                    return BSONObj();
+
+                HybridMemoryStatistics stats;
+                GetHybridMemoryStatistics(&stats);
+
+                BSONObjBuilder b;
+                b.appendNumber("pageFaults", static_cast<long long>(stats.page_faults));
+                {
+                    BSONObjBuilder in(b.subobjStart("pageIns"));
+                    in.appendNumber("ramCache", static_cast<long long>(stats.page_in_ram_cache));
+                    in.appendNumber("flashCache",
+                                    static_cast<long long>(stats.page_in_flash_cache));
+                    in.appendNumber("disk", static_cast<long long>(stats.page_in_hdd_file));
+                    in.appendNumber("readAhead",
+                                    static_cast<long long>(stats.readahead_pages));
+                    in.done();
+                }
+                {
+                    BSONObjBuilder out(b.subobjStart("pageOuts"));
+                    out.appendNumber("flashCache",
+                                     static_cast<long long>(stats.page_out_flash_cache));
+                    out.appendNumber("disk", static_cast<long long>(stats.page_out_hdd_file));
+                    out.appendNumber("writebackIOs",
+                                     static_cast<long long>(stats.writeback_ios));
+                    out.done();
+                }
+                {
+                    BSONObjBuilder flash(b.subobjStart("flashCache"));
+                    flash.appendNumber("detachedPages",
+                                       static_cast<long long>(stats.detached_pages));
+                    flash.appendNumber("reattachedPages",
+                                       static_cast<long long>(stats.reattached_pages));
+                    flash.done();
+                }
+                return b.obj();
+            }
+
+        } hmemSSS;
+
+    }
+
+}
@@ -0,0 +1,53 @@
+// hmem_storage.h
+
+/**
+*    Copyright (C) 2013 10gen Inc.
+*
+*    This program is free software: you can redistribute it and/or  modify
+*    it under the terms of the GNU Affero General Public License, version 3,
+*    as published by the Free Software Foundation.
+*
+*    This program is distributed in the hope that it will be useful,
+*    but WITHOUT ANY WARRANTY; without even the implied warranty of
+*    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+*    GNU Affero General Public License for more details.
+*
+*    You should have received a copy of the GNU Affero General Public License
+*    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+*
+*    As a special exception, the copyright holders give permission to link the
+*    code of portions of this program with the OpenSSL library under certain
+*    conditions as described in each individual source file and distribute
+*    linked combinations including the program with the OpenSSL library. You
+*    must comply with the GNU Affero General Public License in all respects for
+*    all of the code used other than as permitted herein. If you modify file(s)
+*    with this exception, you may extend this exception to your version of the
+*    file(s), but you are not obligated to do so. If you do not wish to do so,
+*    delete this exception statement from your version. If you delete this
+*    exception statement from all source files in the program, then also delete
+*    it in the license file.
+*/
+
+#pragma once
+
+namespace mongo {
+
+    /**
+     * Sets up the util/hmem hybrid memory (page cache, RAM cache and flash cache) from the
+     * --hmem* options, after which MemoryMappedFile maps data files with hmem_map() instead of
+     * mmap().  A no-op unless --hmem was given.
+     *
+     * hmem serves faults from a SIGSEGV handler, so this must run after the process' own
+     * signal handlers are installed and before the first data file is mapped.
+     */
+    void initHmemStorage();
+
+    /**
+     * Releases hybrid memory at clean shutdown, after all data files are unmapped.  Flash cache
+     * pages of the unmapped files are kept along with a metadata file, so the next start with
+     * the same --hmemFlashPath maps unchanged data files with a warm flash cache.
+     * A no-op unless --hmem was given.
+     */
+    void shutdownHmemStorage();
+
+}
@@ -53,7 +53,11 @@ namespace mongo {
             journalCommitInterval(0), // 0 means use default
             quota(false), quotaFiles(8),
             syncdelay(60),
-            useHints(true)
+            useHints(true),
+            hmem(false),
+            hmemPageCacheSize(0), hmemRAMCacheSize(0), hmemFlashCacheSize(0),
+            hmemInstances(0),
+            hmemReplacementPolicy("lru")
         {
             repairpath = dbpath;
             dur = false;
@@ -102,6 +106,14 @@ namespace mongo {
         double syncdelay;      // seconds between fsyncs
 
         bool useHints;         // only off if --nohints
+
+        bool hmem;                               // --hmem map data files through util/hmem
+        std::string hmemFlashPath;               // --hmemFlashPath dir for flash cache files
+        unsigned long long hmemPageCacheSize;    // --hmemPageCacheMB
+        unsigned long long hmemRAMCacheSize;     // --hmemRAMCacheMB
+        unsigned long long hmemFlashCacheSize;   // --hmemFlashCacheMB
+        unsigned hmemInstances;                  // --hmemInstances
+        std::string hmemReplacementPolicy;       // --hmemReplacementPolicy lru, 2q or arc
     };
 
     extern StorageGlobalParams storageGlobalParams;
@@ -112,6 +112,12 @@ namespace mongo {
 
         int64_t storageSize( int* numExtents = NULL, BSONArrayBuilder* extentInfo = NULL ) const;
 
+        /**
+         * For reading the extents and records of this collection directly, under at least a
+         * read lock.  Only available through a const Collection.
+         */
+        const ExtentManager* getExtentManager() const;
+
         // -----------
 
         // this is temporary, moving up from DB for now
@@ -141,7 +147,6 @@ namespace mongo {
         int largestFileNumberInQuota() const;
 
         ExtentManager* getExtentManager();
-        const ExtentManager* getExtentManager() const;
 
         int _magic;
 
@@ -81,8 +81,11 @@ namespace mongo {
     }
 
     void CollectionInfoCache::clearQueryCache() {
-        scoped_lock lk( _qcCacheMutex );
-        _clearQueryCache_inlock();
+        {
+            scoped_lock lk( _qcCacheMutex );
+            _clearQueryCache_inlock();
+        }
+        _planCache.clear();
     }
 
     void CollectionInfoCache::_clearQueryCache_inlock() {
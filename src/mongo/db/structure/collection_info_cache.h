@@ -31,6 +31,7 @@
 #pragma once
 
 #include "mongo/db/index_set.h"
+#include "mongo/db/query/plan_cache.h"
 #include "mongo/db/querypattern.h"
 
 
@@ -67,8 +68,12 @@ namespace mongo {
 
         void addedIndex() { reset(); }
 
+        /* clears both the old query optimizer's cache and the plan cache */
         void clearQueryCache();
 
+        /* the new query system's plan cache for this collection */
+        PlanCache* getPlanCache() { return &_planCache; }
+
         /* you must notify the cache if you are doing writes, as query plan utility will change */
         void notifyOfWriteOp();
 
@@ -95,6 +100,10 @@ namespace mongo {
         int _qcWriteCount;
         std::map<QueryPattern,CachedQueryPlan> _qcCache;
 
+        // --- for new query system
+
+        PlanCache _planCache;
+
     };
 
 }
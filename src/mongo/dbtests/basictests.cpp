@@ -502,6 +502,25 @@ namespace BasicTests {
         }
     };
 
+    size_t queueItemSize(const int& i) {
+        return i;
+    }
+
+    class QueueMaxSizeTest {
+    public:
+        void run() {
+            BlockingQueue<int> q(10, &queueItemSize);
+            // an empty queue takes an item bigger than its max size
+            q.push(20);
+            ASSERT_EQUALS(20U, q.size());
+
+            q.setMaxSize(100);
+            ASSERT_EQUALS(100U, q.maxSize());
+            q.push(30);
+            ASSERT_EQUALS(2, q.count());
+        }
+    };
+
     class StrTests {
     public:
 
@@ -587,6 +606,7 @@ namespace BasicTests {
             add< IsValidUTF8Test >();
 
             add< QueueTest >();
+            add< QueueMaxSizeTest >();
 
             add< StrTests >();
 
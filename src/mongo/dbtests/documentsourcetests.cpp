@@ -21,11 +21,13 @@
 #include <boost/thread/thread.hpp>
 
 #include "mongo/db/interrupt_status_mongod.h"
+#include "mongo/db/json.h"
 #include "mongo/db/pipeline/document_source.h"
 #include "mongo/db/pipeline/expression_context.h"
 #include "mongo/db/query/new_find.h"
 #include "mongo/db/storage_options.h"
 #include "mongo/dbtests/dbtests.h"
+#include "mongo/util/fail_point_service.h"
 
 namespace DocumentSourceTests {
 
@@ -1861,6 +1863,263 @@ namespace DocumentSourceTests {
         };
     } // namespace DocumentSourceMatch
 
+    namespace DocumentSourceParallelGroup {
+
+        using mongo::DocumentSourceParallelGroup;
+
+        /**
+         * A leading $match/$project/$group run on several threads gives the same groups, in the
+         * same order within each group, as when it runs on one.
+         */
+        class MatchesSerial : public CollectionBase {
+        public:
+            MatchesSerial()
+                : _oldThreads(DocumentSourceParallelGroup::groupThreads)
+                , _oldMinRecords(DocumentSourceParallelGroup::minRecords)
+            {}
+
+            ~MatchesSerial() {
+                DocumentSourceParallelGroup::groupThreads = _oldThreads;
+                DocumentSourceParallelGroup::minRecords = _oldMinRecords;
+            }
+
+            void run() {
+                // Enough documents for several extents.
+                string filler(200, 'x');
+                for (int i = 0; i < 5000; ++i) {
+                    client.insert(ns, BSON("_id" << i << "a" << i % 13 << "b" << i
+                                           << "filler" << filler));
+                }
+                DocumentSourceParallelGroup::minRecords = 0;
+
+                // fromjson cannot parse an array, so place the array within an object.
+                BSONObj pipeline = fromjson(
+                    "{p: [{$match: {b: {$mod: [3, 0]}}},"
+                    "     {$project: {a: 1, b: 1}},"
+                    "     {$group: {_id: '$a', n: {$sum: 1}, total: {$sum: '$b'},"
+                    "               avg: {$avg: '$b'}, first: {$first: '$b'},"
+                    "               last: {$last: '$b'}, all: {$push: '$b'}}},"
+                    "     {$sort: {_id: 1}}]}")["p"].Obj().getOwned();
+
+                DocumentSourceParallelGroup::groupThreads = 1;
+                BSONObj serial = aggregate(pipeline);
+                ASSERT_EQUALS(13, serial.nFields());
+                ASSERT(!explainHasParallelGroup(pipeline));
+
+                DocumentSourceParallelGroup::groupThreads = 4;
+                ASSERT(explainHasParallelGroup(pipeline));
+                ASSERT_EQUALS(serial, aggregate(pipeline));
+            }
+
+        private:
+            BSONObj aggregate(const BSONObj& pipeline) {
+                BSONObj result;
+                ASSERT(client.runCommand("unittests",
+                                         BSON("aggregate" << "documentsourcetests"
+                                              << "pipeline" << pipeline),
+                                         result));
+                return result["result"].Obj().getOwned();
+            }
+
+            bool explainHasParallelGroup(const BSONObj& pipeline) {
+                BSONObj result;
+                ASSERT(client.runCommand("unittests",
+                                         BSON("aggregate" << "documentsourcetests"
+                                              << "pipeline" << pipeline
+                                              << "explain" << true),
+                                         result));
+                BSONObj first = result["stages"].Obj().firstElement().Obj();
+                return str::equals(first.firstElementFieldName(),
+                                   DocumentSourceParallelGroup::parallelGroupName);
+            }
+
+            const int _oldThreads;
+            const long long _oldMinRecords;
+        };
+
+        /**
+         * A parallel $group whose collection is changed by modify() while the read lock is
+         * yielded fails with 17305, rather than reading extents that may have been freed.
+         */
+        class ModifiedDuringYield : public CollectionBase {
+        public:
+            ModifiedDuringYield()
+                : _oldThreads(DocumentSourceParallelGroup::groupThreads)
+                , _oldMinRecords(DocumentSourceParallelGroup::minRecords)
+                , _hang(getGlobalFailPointRegistry()->getFailPoint(
+                            "parallelGroupHangWhileYielded"))
+                , _mutex("ModifiedDuringYield")
+                , _aggregator(NULL)
+                , _done(false)
+                , _code(0)
+            {}
+
+            virtual ~ModifiedDuringYield() {
+                _hang->setMode(FailPoint::off);
+                DocumentSourceParallelGroup::groupThreads = _oldThreads;
+                DocumentSourceParallelGroup::minRecords = _oldMinRecords;
+            }
+
+            void run() {
+                for (int i = 0; i < 1000; ++i) {
+                    client.insert(ns, BSON("_id" << i << "a" << i % 7));
+                }
+                DocumentSourceParallelGroup::groupThreads = 4;
+                DocumentSourceParallelGroup::minRecords = 0;
+
+                _hang->setMode(FailPoint::alwaysOn);
+                boost::thread aggregator(boost::bind(&ModifiedDuringYield::aggregate, this));
+                while (!yielded()) {
+                    sleepmillis(1);
+                }
+                modify();
+                _hang->setMode(FailPoint::off);
+                aggregator.join();
+
+                ASSERT_EQUALS(17305, _code);
+            }
+
+        protected:
+            virtual void modify() = 0;
+
+        private:
+            void aggregate() {
+                Client::initThread("parallel group");
+                {
+                    scoped_lock lk(_mutex);
+                    _aggregator = &cc();
+                }
+                DBDirectClient aggregatorClient;
+                BSONObj result;
+                aggregatorClient.runCommand("unittests",
+                                            BSON("aggregate" << "documentsourcetests"
+                                                 << "pipeline" << BSON_ARRAY(
+                                                     BSON("$group" << BSON(
+                                                         "_id" << "$a"
+                                                         << "n" << BSON("$sum" << 1))))),
+                                            result);
+                {
+                    scoped_lock lk(_mutex);
+                    _aggregator = NULL;
+                    _done = true;
+                    _code = result["code"].numberInt();
+                }
+                cc().shutdown();
+            }
+
+            /** True once the aggregation has yielded its read lock, or has finished. */
+            bool yielded() {
+                scoped_lock lk(_mutex);
+                return _done || (_aggregator && _aggregator->curop()->numYields() > 0);
+            }
+
+            const int _oldThreads;
+            const long long _oldMinRecords;
+            FailPoint* const _hang;
+            mongo::mutex _mutex;
+            Client* _aggregator;
+            bool _done;
+            int _code;
+        };
+
+        class DroppedDuringYield : public ModifiedDuringYield {
+            void modify() {
+                ASSERT(client.dropCollection(ns));
+            }
+        };
+
+        class RenamedDuringYield : public ModifiedDuringYield {
+        public:
+            ~RenamedDuringYield() {
+                client.dropCollection(renamedNs());
+            }
+        private:
+            void modify() {
+                BSONObj info;
+                ASSERT(client.runCommand("admin",
+                                         BSON("renameCollection" << ns << "to" << renamedNs()),
+                                         info));
+            }
+            static string renamedNs() { return string(ns) + "_renamed"; }
+        };
+
+    } // namespace DocumentSourceParallelGroup
+
+    namespace DocumentSourceGroupColumns {
+
+        /**
+         * A $group that reads its input as columns gives the same results as one that reads
+         * Documents, for columns of ints, longs, doubles and NaN, for large longs mixed with
+         * doubles, and for columns that mix in strings and missing fields.
+         */
+        class MatchesDocuments : public CollectionBase {
+        public:
+            void run() {
+                for (int i = 0; i < 3000; ++i) {
+                    BSONObjBuilder b;
+                    b.append("_id", i);
+                    b.append("k", i % 7);
+                    b.append("i", i);
+                    b.append("l", static_cast<long long>(i) << 33);
+                    b.append("d", i % 11 == 0 ? std::numeric_limits<double>::quiet_NaN()
+                                              : i * 0.25);
+                    if (i % 5 == 0)
+                        b.append("m", "str");
+                    else if (i % 5 == 1)
+                        b.append("m", i * 1.5);
+                    else if (i % 5 == 2)
+                        b.append("m", i);
+                    // longs that only differ below a double's precision, among doubles
+                    if (i % 3 == 0)
+                        b.append("x", static_cast<double>(1LL << 60));
+                    else
+                        b.append("x", (1LL << 60) + (i % 13) * 7);
+                    b.append("filler", string(100, 'x'));
+                    client.insert(ns, b.obj());
+                }
+
+                const char* groups[] = {
+                    "{$group: {_id: null, n: {$sum: 1}, si: {$sum: '$i'}, sl: {$sum: '$l'},"
+                    "          sd: {$sum: '$d'}, sm: {$sum: '$m'}, ai: {$avg: '$i'},"
+                    "          am: {$avg: '$m'}, mini: {$min: '$i'}, maxl: {$max: '$l'},"
+                    "          mind: {$min: '$d'}, maxd: {$max: '$d'}, minm: {$min: '$m'},"
+                    "          maxm: {$max: '$m'}, f: {$first: '$m'}, minx: {$min: '$x'},"
+                    "          maxx: {$max: '$x'}}}",
+                    "{$group: {_id: '$k', n: {$sum: 1}, si: {$sum: '$i'}, sd: {$sum: '$d'},"
+                    "          am: {$avg: '$m'}, mind: {$min: '$d'}, maxm: {$max: '$m'},"
+                    "          all: {$push: '$m'}}}",
+                    "{$group: {_id: '$m', n: {$sum: 1}, maxl: {$max: '$l'}}}",
+                    "{$group: {_id: '$k', minx: {$min: '$x'}, maxx: {$max: '$x'}}}",
+                };
+                BSONObj project = fromjson("{$project: {k: 1, i: 1, l: 1, d: 1, m: 1, x: 1}}");
+                BSONObj sort = fromjson("{$sort: {_id: 1}}");
+
+                for (size_t i = 0; i < sizeof(groups) / sizeof(groups[0]); ++i) {
+                    BSONObj group = fromjson(groups[i]);
+
+                    // $group reads columns straight from the cursor ...
+                    BSONObj columns = aggregate(BSON_ARRAY(group << sort));
+                    // ... but Documents from a $project.
+                    BSONObj documents = aggregate(BSON_ARRAY(project << group << sort));
+
+                    ASSERT(!columns.isEmpty());
+                    ASSERT_EQUALS(documents, columns);
+                }
+            }
+
+        private:
+            BSONObj aggregate(const BSONArray& pipeline) {
+                BSONObj result;
+                ASSERT(client.runCommand("unittests",
+                                         BSON("aggregate" << "documentsourcetests"
+                                              << "pipeline" << pipeline),
+                                         result));
+                return result["result"].Obj().getOwned();
+            }
+        };
+
+    } // namespace DocumentSourceGroupColumns
+
     class All : public Suite {
     public:
         All() : Suite( "documentsource" ) {
@@ -1967,6 +2226,12 @@ namespace DocumentSourceTests {
 
             add<DocumentSourceMatch::RedactSafePortion>();
             add<DocumentSourceMatch::Coalesce>();
+
+            add<DocumentSourceParallelGroup::MatchesSerial>();
+            add<DocumentSourceParallelGroup::DroppedDuringYield>();
+            add<DocumentSourceParallelGroup::RenamedDuringYield>();
+
+            add<DocumentSourceGroupColumns::MatchesDocuments>();
         }
     } myall;
 
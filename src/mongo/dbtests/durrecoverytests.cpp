@@ -0,0 +1,213 @@
+// @file durrecoverytests.cpp
+
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mongo/pch.h"
+
+#include <boost/filesystem/operations.hpp>
+
+#include "mongo/db/dur_journalformat.h"
+#include "mongo/db/dur_recover.h"
+#include "mongo/dbtests/dbtests.h"
+#include "mongo/util/compress.h"
+#include "mongo/util/file.h"
+#include "mongo/util/timer.h"
+
+namespace DurRecoveryTests {
+
+    using namespace mongo::dur;
+
+    /** replays a synthetic journal of random writes spread over several data files, single
+        threaded and then with the default number of threads, and checks the data files end
+        up with the last write to each slot.
+    */
+    class ReplaySyntheticJournal {
+        static const unsigned NFiles = 8;
+        static const unsigned SlotSize = 16 * 1024;
+        static const unsigned WritesPerSection = 64;
+
+        const string _db;
+        const boost::filesystem::path _journalDir;
+        unsigned long long _journalBytes;
+        unsigned _slotsPerFile;
+
+        // id of the last write to each slot, 0 if never written
+        vector<unsigned> _lastWrite;
+
+        string dataFile(unsigned fileNo) const {
+            return (boost::filesystem::path(storageGlobalParams.dbpath) /
+                    (_db + '.' + BSONObjBuilder::numStr(fileNo))).string();
+        }
+
+        /** contents of a write are a function of its id so we can check them afterwards */
+        static void fill(char *p, unsigned writeId) {
+            unsigned long long x = writeId * 0x9E3779B97F4A7C15ULL + 1;
+            for( unsigned k = 0; k < SlotSize; k += sizeof(x) ) {
+                x ^= x << 13; x ^= x >> 7; x ^= x << 17;
+                memcpy(p + k, &x, sizeof(x));
+            }
+        }
+
+        void createDataFiles() {
+            for( unsigned i = 0; i < NFiles; i++ ) {
+                string fn = dataFile(i);
+                try { boost::filesystem::remove(fn); }
+                catch(...) { }
+                File f;
+                f.open(fn.c_str());
+                ASSERT( f.is_open() );
+                char zero = 0;
+                f.write((fileofs) _slotsPerFile * SlotSize - 1, &zero, 1);
+                ASSERT( !f.bad() );
+            }
+        }
+
+        void writeJournal(const string& fn) {
+            File f;
+            f.open(fn.c_str());
+            ASSERT( f.is_open() );
+            f.truncate(0);
+
+            JHeader h(fn);
+            f.write(0, (const char *) &h, sizeof(h));
+            fileofs ofs = sizeof(h);
+
+            const unsigned nSections = _journalBytes / (WritesPerSection * SlotSize);
+            unsigned rand = 1;
+            unsigned writeId = 0;
+            vector<char> raw;
+            vector<char> section;
+            for( unsigned s = 0; s < nSections; s++ ) {
+                raw.clear();
+                JDbContext ctx;
+                raw.insert(raw.end(), (const char *) &ctx, ((const char *) &ctx) + sizeof(ctx));
+                raw.insert(raw.end(), _db.c_str(), _db.c_str() + _db.size() + 1);
+                for( unsigned w = 0; w < WritesPerSection; w++ ) {
+                    rand = rand * 1103515245 + 12345;
+                    unsigned slot = (rand >> 8) % (NFiles * _slotsPerFile);
+                    JEntry e;
+                    e.len = SlotSize;
+                    e.ofs = (slot % _slotsPerFile) * SlotSize;
+                    e.setFileNo(slot / _slotsPerFile);
+                    raw.insert(raw.end(), (const char *) &e, ((const char *) &e) + sizeof(e));
+                    size_t at = raw.size();
+                    raw.resize(at + SlotSize);
+                    fill(&raw[at], ++writeId);
+                    _lastWrite[slot] = writeId;
+                }
+
+                section.resize(sizeof(JSectHeader) + maxCompressedLength(raw.size()) + sizeof(JSectFooter) + Alignment);
+                JSectHeader *sh = (JSectHeader *) &section[0];
+                size_t compressedLen;
+                rawCompress(&raw[0], raw.size(), &section[sizeof(JSectHeader)], &compressedLen);
+                sh->setSectionLen(sizeof(JSectHeader) + compressedLen + sizeof(JSectFooter));
+                sh->seqNumber = s + 1;
+                sh->fileId = h.fileId;
+                JSectFooter footer(sh, sizeof(JSectHeader) + compressedLen);
+                memcpy(&section[sizeof(JSectHeader) + compressedLen], &footer, sizeof(footer));
+                unsigned padded = sh->sectionLenWithPadding();
+                memset(&section[sh->sectionLen()], 0, padded - sh->sectionLen());
+                f.write(ofs, &section[0], padded);
+                ofs += padded;
+            }
+            ASSERT( !f.bad() );
+            f.fsync();
+            mongo::unittest::log() << "durrecovery journal " << ofs / (1024 * 1024) << "MB, "
+                                   << writeId << " writes in " << nSections << " sections" << endl;
+        }
+
+        void checkDataFiles() {
+            vector<char> expected(SlotSize);
+            vector<char> actual(SlotSize);
+            for( unsigned i = 0; i < NFiles; i++ ) {
+                File f;
+                f.open(dataFile(i).c_str(), true);
+                ASSERT( f.is_open() );
+                for( unsigned k = 0; k < _slotsPerFile; k++ ) {
+                    unsigned id = _lastWrite[i * _slotsPerFile + k];
+                    if( id )
+                        fill(&expected[0], id);
+                    else
+                        memset(&expected[0], 0, SlotSize);
+                    f.read((fileofs) k * SlotSize, &actual[0], SlotSize);
+                    ASSERT( !f.bad() );
+                    ASSERT( memcmp(&expected[0], &actual[0], SlotSize) == 0 );
+                }
+            }
+        }
+
+        int replay(vector<boost::filesystem::path>& files, unsigned threads) {
+            createDataFiles();
+            Timer t;
+            {
+                Lock::GlobalWrite lk;
+                RecoveryJob::get().setThreads(threads);
+                RecoveryJob::get().replay(files);
+                RecoveryJob::get().setThreads(0);
+            }
+            int ms = t.millis();
+            checkDataFiles();
+            return ms;
+        }
+
+    public:
+        ReplaySyntheticJournal() :
+            _db("durrecoverytest"),
+            _journalDir(boost::filesystem::path(storageGlobalParams.dbpath) / "durrecoverytest_journal"),
+            _journalBytes(1024ULL * 1024 * 1024) {
+            DEV {
+                // don't take long with _DEBUG
+                _journalBytes = 64 * 1024 * 1024;
+            }
+            // the data files are half the size of the journal so that slots get overwritten
+            _slotsPerFile = _journalBytes / 2 / NFiles / SlotSize;
+            _lastWrite.resize(NFiles * _slotsPerFile, 0);
+        }
+
+        ~ReplaySyntheticJournal() {
+            try {
+                boost::filesystem::remove_all(_journalDir);
+                for( unsigned i = 0; i < NFiles; i++ )
+                    boost::filesystem::remove(dataFile(i));
+            }
+            catch(...) { }
+        }
+
+        void run() {
+            boost::filesystem::create_directories(_journalDir);
+            boost::filesystem::path journalFile = _journalDir / "j._0";
+            writeJournal(journalFile.string());
+
+            vector<boost::filesystem::path> files;
+            files.push_back(journalFile);
+
+            int serialMs = replay(files, 1);
+            int parallelMs = replay(files, 0);
+            mongo::unittest::log() << "durrecovery replay single threaded: " << serialMs << "ms, "
+                                   << "parallel: " << parallelMs << "ms" << endl;
+        }
+    };
+
+    class All : public Suite {
+    public:
+        All() : Suite( "durrecovery" ) {}
+        void setupTests() {
+            add< ReplaySyntheticJournal >();
+        }
+    } myall;
+
+} // namespace DurRecoveryTests
@@ -532,6 +532,75 @@ namespace IndexUpdateTests {
         }
     };
 
+    /**
+     * A foreground build that scans and sorts keys on several threads builds the same index as a
+     * single threaded build.  Logs the time each took.
+     */
+    class ParallelBuildMatchesSerial : public IndexBuildBase {
+    public:
+        ParallelBuildMatchesSerial() : _buildThreadsOld( BtreeBasedBuilder::buildThreads ) {
+        }
+        ~ParallelBuildMatchesSerial() {
+            BtreeBasedBuilder::buildThreads = _buildThreadsOld;
+        }
+        void run() {
+            // Enough documents to take the parallel path, in several extents.
+            int32_t nDocs = 200000;
+            Collection* coll = collection();
+            for( int32_t i = 0; i < nDocs; ++i ) {
+                if ( i % 10 == 0 ) {
+                    coll->insertDocument( BSON( "a" << BSON_ARRAY( i % 997 << -1 ) << "b" << i ),
+                                          true );
+                }
+                else {
+                    coll->insertDocument( BSON( "a" << i % 997 << "b" << i ), true );
+                }
+            }
+
+            vector<pair<BSONObj, DiskLoc> > serialKeys;
+            BtreeBasedBuilder::buildThreads = 1;
+            int serialMillis = build( &serialKeys );
+
+            vector<pair<BSONObj, DiskLoc> > parallelKeys;
+            BtreeBasedBuilder::buildThreads = 4;
+            int parallelMillis = build( &parallelKeys );
+
+            ASSERT_EQUALS( static_cast<size_t>( nDocs + nDocs / 10 ), serialKeys.size() );
+            ASSERT_EQUALS( serialKeys.size(), parallelKeys.size() );
+            for( size_t i = 0; i < serialKeys.size(); ++i ) {
+                ASSERT_EQUALS( serialKeys[ i ].first, parallelKeys[ i ].first );
+                ASSERT_EQUALS( serialKeys[ i ].second, parallelKeys[ i ].second );
+            }
+            mongo::unittest::log() << "index build of " << nDocs << " documents: 1 thread "
+                                   << serialMillis << "ms, 4 threads " << parallelMillis << "ms"
+                                   << endl;
+        }
+    private:
+        /** Builds index a_1_b_1 and returns its keys in order, then drops it. */
+        int build( vector<pair<BSONObj, DiskLoc> >* keys ) {
+            Timer t;
+            Helpers::ensureIndex( _ns, BSON( "a" << 1 << "b" << 1 ), false, "a_1_b_1" );
+            int millis = t.millis();
+            IndexDescriptor* id = collection()->getIndexCatalog()->findIndexByName( "a_1_b_1" );
+            ASSERT( id );
+            ASSERT( id->isMultikey() );
+            scoped_ptr<BtreeCursor> cursor(
+                    BtreeCursor::make( nsdetails( _ns ),
+                                       id->getOnDisk(),
+                                       BSON( "" << MINKEY << "" << MINKEY ),
+                                       BSON( "" << MAXKEY << "" << MAXKEY ),
+                                       true,
+                                       1 ) );
+            for( ; cursor->ok(); cursor->advance() ) {
+                keys->push_back( make_pair( cursor->currKey().getOwned(), cursor->currLoc() ) );
+            }
+            cursor.reset();
+            ASSERT_OK( collection()->getIndexCatalog()->dropIndex( id ) );
+            return millis;
+        }
+        int _buildThreadsOld;
+    };
+
     class IndexBuildInProgressTest : public IndexBuildBase {
     public:
         void run() {
@@ -771,6 +840,7 @@ namespace IndexUpdateTests {
             add<InsertBuildIdIndexInterruptDisallowed>();
             add<DirectClientEnsureIndexInterruptDisallowed>();
             add<HelpersEnsureIndexInterruptDisallowed>();
+            add<ParallelBuildMatchesSerial>();
             add<IndexBuildInProgressTest>();
             add<SameSpecDifferentOption>();
             add<SameSpecSameOptions>();
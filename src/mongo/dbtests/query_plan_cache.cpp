@@ -0,0 +1,280 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "mongo/db/instance.h"
+#include "mongo/db/json.h"
+#include "mongo/db/matcher/expression_parser.h"
+#include "mongo/db/query/canonical_query.h"
+#include "mongo/db/query/new_find.h"
+#include "mongo/db/query/plan_cache.h"
+#include "mongo/db/query/query_solution.h"
+#include "mongo/db/query/runner.h"
+#include "mongo/db/structure/collection.h"
+#include "mongo/dbtests/dbtests.h"
+
+namespace QueryPlanCache {
+
+    static const char* ns = "unittests.QueryPlanCache";
+
+    CanonicalQuery* canonicalize(const BSONObj& query) {
+        CanonicalQuery* cq = NULL;
+        verify(CanonicalQuery::canonicalize(ns, query, &cq).isOK());
+        return cq;
+    }
+
+    QuerySolution* collscanSolution() {
+        QuerySolution* soln = new QuerySolution();
+        soln->root.reset(new CollectionScanNode());
+        return soln;
+    }
+
+    // An index scan over {a: 1} with one interval built from 'interval', optionally filtered.
+    QuerySolution* ixscanSolution(const BSONObj& interval, bool startInclusive,
+                                  bool endInclusive, const char* filter = NULL) {
+        IndexScanNode* isn = new IndexScanNode();
+        isn->indexKeyPattern = BSON("a" << 1);
+        isn->direction = 1;
+        OrderedIntervalList oil("a");
+        oil.intervals.push_back(Interval(interval, startInclusive, endInclusive));
+        isn->bounds.fields.push_back(oil);
+
+        QuerySolution* soln = new QuerySolution();
+        if (NULL != filter) {
+            soln->filterData = fromjson(filter);
+            StatusWithMatchExpression swme = MatchExpressionParser::parse(soln->filterData);
+            verify(swme.isOK());
+            isn->filter.reset(swme.getValue());
+        }
+        soln->root.reset(isn);
+        return soln;
+    }
+
+    // Works and advanced for the root of a fake stats tree.
+    PlanStageStats* makeStats(size_t works, size_t advanced) {
+        CommonStats common;
+        common.works = works;
+        common.advanced = advanced;
+        return new PlanStageStats(common, STAGE_COLLSCAN);
+    }
+
+    PlanRankingDecision* makeDecision(size_t works, size_t advanced) {
+        PlanRankingDecision* why = new PlanRankingDecision();
+        why->statsOfWinner = makeStats(works, advanced);
+        return why;
+    }
+
+    // Queries which differ only in their values share a shape.
+    class ShapeIgnoresValues {
+    public:
+        void run() {
+            scoped_ptr<CanonicalQuery> first(canonicalize(fromjson("{a: 1, b: {$gt: 5}}")));
+            scoped_ptr<CanonicalQuery> second(canonicalize(fromjson("{a: 7, b: {$gt: 2}}")));
+            scoped_ptr<CanonicalQuery> reordered(canonicalize(fromjson("{b: {$gt: 2}, a: 7}")));
+            ASSERT_EQUALS(PlanCache::getPlanCacheKey(*first), PlanCache::getPlanCacheKey(*second));
+            ASSERT_EQUALS(PlanCache::getPlanCacheKey(*first),
+                          PlanCache::getPlanCacheKey(*reordered));
+        }
+    };
+
+    // Different paths, operators or sorts make different shapes.
+    class ShapeSeesStructure {
+    public:
+        void run() {
+            scoped_ptr<CanonicalQuery> base(canonicalize(fromjson("{a: 1}")));
+            scoped_ptr<CanonicalQuery> path(canonicalize(fromjson("{b: 1}")));
+            scoped_ptr<CanonicalQuery> op(canonicalize(fromjson("{a: {$gt: 1}}")));
+            CanonicalQuery* rawSorted = NULL;
+            verify(CanonicalQuery::canonicalize(ns, fromjson("{a: 1}"), fromjson("{b: 1}"),
+                                                BSONObj(), &rawSorted).isOK());
+            scoped_ptr<CanonicalQuery> sorted(rawSorted);
+
+            PlanCacheKey key = PlanCache::getPlanCacheKey(*base);
+            ASSERT_NOT_EQUALS(key, PlanCache::getPlanCacheKey(*path));
+            ASSERT_NOT_EQUALS(key, PlanCache::getPlanCacheKey(*op));
+            ASSERT_NOT_EQUALS(key, PlanCache::getPlanCacheKey(*sorted));
+        }
+    };
+
+    class AddAndGet {
+    public:
+        void run() {
+            PlanCache cache;
+            scoped_ptr<CanonicalQuery> cq(canonicalize(fromjson("{a: 1}")));
+            scoped_ptr<QuerySolution> soln(collscanSolution());
+
+            ASSERT(NULL == cache.get(*cq));
+            ASSERT(cache.add(*cq, *soln, makeDecision(100, 50)));
+            // Only one entry per shape.
+            ASSERT_FALSE(cache.add(*cq, *soln, makeDecision(100, 50)));
+            ASSERT_EQUALS(size_t(1), cache.size());
+
+            // A query of the same shape hits.
+            scoped_ptr<CanonicalQuery> other(canonicalize(fromjson("{a: 3}")));
+            scoped_ptr<CachedSolution> cs(cache.get(*other));
+            ASSERT(NULL != cs.get());
+            ASSERT_EQUALS(PlanCache::getSolutionKey(*soln), cs->solutionKey);
+            ASSERT(NULL != cs->decision.get());
+            ASSERT_EQUALS(uint64_t(50), cs->decision->statsOfWinner->common.advanced);
+
+            ASSERT(cache.remove(*other, *soln));
+            ASSERT(NULL == cache.get(*cq));
+        }
+    };
+
+    // Index scans over the same index which differ in the shape of their bounds or filter
+    // access the data differently.  Differing values alone don't change the key.
+    class SolutionKeySeesBoundsAndFilter {
+    public:
+        void run() {
+            scoped_ptr<QuerySolution> point(ixscanSolution(BSON("" << 1 << "" << 1), true, true));
+            scoped_ptr<QuerySolution> otherPoint(ixscanSolution(BSON("" << 7 << "" << 7),
+                                                                true, true));
+            scoped_ptr<QuerySolution> range(ixscanSolution(BSON("" << 1 << "" << 7), true, false));
+            scoped_ptr<QuerySolution> open(ixscanSolution(BSON("" << 1 << "" << MAXKEY),
+                                                          true, true));
+            scoped_ptr<QuerySolution> filtered(ixscanSolution(BSON("" << 1 << "" << 1), true, true,
+                                                              "{a: {$mod: [2, 1]}}"));
+
+            std::string key = PlanCache::getSolutionKey(*point);
+            ASSERT_EQUALS(key, PlanCache::getSolutionKey(*otherPoint));
+            ASSERT_NOT_EQUALS(key, PlanCache::getSolutionKey(*range));
+            ASSERT_NOT_EQUALS(key, PlanCache::getSolutionKey(*open));
+            ASSERT_NOT_EQUALS(PlanCache::getSolutionKey(*range), PlanCache::getSolutionKey(*open));
+            ASSERT_NOT_EQUALS(key, PlanCache::getSolutionKey(*filtered));
+
+            // Only a candidate with the cached key is picked.
+            CachedSolution cs;
+            cs.solutionKey = PlanCache::getSolutionKey(*range);
+            vector<QuerySolution*> candidates;
+            candidates.push_back(point.get());
+            candidates.push_back(filtered.get());
+            ASSERT_EQUALS(size_t(2), PlanCache::findCachedSolution(&cs, candidates));
+            ASSERT_EQUALS(size_t(2), PlanCache::findCachedSolution(NULL, candidates));
+            candidates.push_back(range.get());
+            ASSERT_EQUALS(size_t(2), PlanCache::findCachedSolution(&cs, candidates));
+        }
+    };
+
+    // Solutions without a root (as built by some tests) aren't cached.
+    class NoEmptySolutions {
+    public:
+        void run() {
+            PlanCache cache;
+            scoped_ptr<CanonicalQuery> cq(canonicalize(fromjson("{a: 1}")));
+            QuerySolution soln;
+            ASSERT_FALSE(cache.add(*cq, soln, makeDecision(100, 50)));
+            ASSERT_EQUALS(size_t(0), cache.size());
+        }
+    };
+
+    // A cached plan which does far worse than when it was ranked is evicted.
+    class FeedbackEvicts {
+    public:
+        void run() {
+            PlanCache cache;
+            scoped_ptr<CanonicalQuery> cq(canonicalize(fromjson("{a: 1}")));
+            scoped_ptr<QuerySolution> soln(collscanSolution());
+            ASSERT(cache.add(*cq, *soln, makeDecision(100, 50)));
+
+            // Comparable performance keeps the entry.
+            CachedSolutionFeedback* good = new CachedSolutionFeedback();
+            good->stats = makeStats(10000, 4000);
+            ASSERT(cache.feedback(*cq, *soln, good));
+            ASSERT_EQUALS(size_t(1), cache.size());
+
+            // Bad performance over a short run keeps the entry too.
+            CachedSolutionFeedback* shortRun = new CachedSolutionFeedback();
+            shortRun->stats = makeStats(10, 0);
+            ASSERT(cache.feedback(*cq, *soln, shortRun));
+            ASSERT_EQUALS(size_t(1), cache.size());
+
+            // Bad performance over a long run evicts it.
+            CachedSolutionFeedback* bad = new CachedSolutionFeedback();
+            bad->stats = makeStats(100000, 10);
+            ASSERT(cache.feedback(*cq, *soln, bad));
+            ASSERT_EQUALS(size_t(0), cache.size());
+
+            // Feedback for something not in the cache is dropped.
+            CachedSolutionFeedback* orphan = new CachedSolutionFeedback();
+            orphan->stats = makeStats(10, 10);
+            ASSERT_FALSE(cache.feedback(*cq, *soln, orphan));
+        }
+    };
+
+    // End to end: the second query of a shape skips the plan race.  Adding an index clears the
+    // cache.
+    class CachedAcrossQueries {
+    public:
+        CachedAcrossQueries() { }
+        ~CachedAcrossQueries() { _client.dropCollection(ns); }
+
+        void run() {
+            Client::WriteContext ctx(ns);
+            for (int i = 0; i < 100; ++i) {
+                _client.insert(ns, BSON("a" << i << "b" << i % 10));
+            }
+            _client.ensureIndex(ns, BSON("a" << 1));
+            _client.ensureIndex(ns, BSON("b" << 1));
+
+            PlanCache* cache = PlanCache::get(ns);
+            ASSERT(NULL != cache);
+            ASSERT_EQUALS(size_t(0), cache->size());
+
+            runQuery(fromjson("{a: 5, b: 5}"));
+            ASSERT_EQUALS(size_t(1), cache->size());
+
+            runQuery(fromjson("{a: 6, b: 6}"));
+            ASSERT_EQUALS(size_t(1), cache->size());
+
+            _client.ensureIndex(ns, BSON("a" << 1 << "b" << 1));
+            ASSERT_EQUALS(size_t(0), PlanCache::get(ns)->size());
+        }
+
+    private:
+        void runQuery(const BSONObj& query) {
+            Runner* rawRunner;
+            ASSERT_OK(getRunner(canonicalize(query), &rawRunner));
+            scoped_ptr<Runner> runner(rawRunner);
+
+            int results = 0;
+            BSONObj obj;
+            while (Runner::RUNNER_ADVANCED == runner->getNext(&obj, NULL)) {
+                ++results;
+            }
+            ASSERT_EQUALS(1, results);
+        }
+
+        static DBDirectClient _client;
+    };
+
+    DBDirectClient CachedAcrossQueries::_client;
+
+    class All : public Suite {
+    public:
+        All() : Suite( "query_plan_cache" ) { }
+
+        void setupTests() {
+            add<ShapeIgnoresValues>();
+            add<ShapeSeesStructure>();
+            add<AddAndGet>();
+            add<SolutionKeySeesBoundsAndFilter>();
+            add<NoEmptySolutions>();
+            add<FeedbackEvicts>();
+            add<CachedAcrossQueries>();
+        }
+    }  queryPlanCacheAll;
+
+}  // namespace QueryPlanCache
@@ -387,6 +387,96 @@ namespace QueryStageAnd {
         }
     };
 
+    /**
+     * An AND whose first child doesn't fit in the memory limit spills to sorted runs.  It must
+     * return the same results with the key data of both indices, and drop a DiskLoc that's
+     * invalidated while it's only in a run.
+     */
+    class QueryStageAndHashSpill : public QueryStageAndBase {
+    public:
+        void run() {
+            Client::WriteContext ctx(ns());
+            Database* db = ctx.ctx().db();
+            Collection* coll = db->getCollection(ns());
+            if (!coll) {
+                coll = db->createCollection(ns());
+            }
+
+            for (int i = 0; i < 2000; ++i) {
+                insert(BSON("foo" << i << "bar" << i));
+            }
+
+            addIndex(BSON("foo" << 1));
+            addIndex(BSON("bar" << 1));
+
+            WorkingSet ws;
+            scoped_ptr<AndHashStage> ah(new AndHashStage(&ws, NULL, 16 * 1024));
+
+            // Foo <= 1500
+            IndexScanParams params;
+            params.descriptor = getIndex(BSON("foo" << 1), coll);
+            params.bounds.isSimpleRange = true;
+            params.bounds.startKey = BSON("" << 1500);
+            params.bounds.endKey = BSONObj();
+            params.bounds.endKeyInclusive = true;
+            params.direction = -1;
+            ah->addChild(new IndexScan(params, &ws, NULL));
+
+            // Bar >= 500
+            params.descriptor = getIndex(BSON("bar" << 1), coll);
+            params.bounds.startKey = BSON("" << 500);
+            params.bounds.endKey = BSONObj();
+            params.bounds.endKeyInclusive = true;
+            params.direction = 1;
+            ah->addChild(new IndexScan(params, &ws, NULL));
+
+            // Run until the first result, then invalidate a later one.
+            int count = 0;
+            bool invalidated = false;
+            while (!ah->isEOF()) {
+                WorkingSetID id;
+                PlanStage::StageState status = ah->work(&id);
+                ASSERT_NOT_EQUALS(PlanStage::FAILURE, status);
+                if (PlanStage::ADVANCED != status) { continue; }
+
+                ++count;
+                WorkingSetMember* member = ws.get(id);
+                ASSERT_EQUALS(WorkingSetMember::LOC_AND_IDX, member->state);
+                BSONElement foo, bar;
+                ASSERT_TRUE(member->getFieldDotted("foo", &foo));
+                ASSERT_TRUE(member->getFieldDotted("bar", &bar));
+                ASSERT_EQUALS(foo.numberInt(), bar.numberInt());
+                ASSERT_GREATER_THAN_OR_EQUALS(foo.numberInt(), 500);
+                ASSERT_LESS_THAN_OR_EQUALS(foo.numberInt(), 1500);
+                ASSERT_NOT_EQUALS(1000, foo.numberInt());
+                ws.free(id);
+
+                if (!invalidated) {
+                    ah->prepareToYield();
+                    set<DiskLoc> data;
+                    getLocs(&data, coll);
+                    for (set<DiskLoc>::const_iterator it = data.begin(); it != data.end(); ++it) {
+                        if (it->obj()["foo"].numberInt() == 1000) {
+                            ah->invalidate(*it);
+                            remove(it->obj());
+                            break;
+                        }
+                    }
+                    ah->recoverFromYield();
+                    invalidated = true;
+                }
+            }
+
+            ASSERT_EQUALS(1000, count);
+
+            scoped_ptr<PlanStageStats> stats(ah->getStats());
+            const AndHashStats* specific = static_cast<const AndHashStats*>(stats->specific.get());
+            ASSERT_TRUE(specific->spilled);
+            ASSERT_EQUALS(size_t(16 * 1024), specific->memLimit);
+            ASSERT_GREATER_THAN(specific->memUsage, size_t(16 * 1024));
+        }
+    };
+
     //
     // Sorted AND tests
     //
@@ -707,6 +797,7 @@ namespace QueryStageAnd {
             add<QueryStageAndHashWithNothing>();
             add<QueryStageAndHashProducesNothing>();
             add<QueryStageAndHashWithMatcher>();
+            add<QueryStageAndHashSpill>();
             add<QueryStageAndSortedInvalidation>();
             add<QueryStageAndSortedThreeLeaf>();
             add<QueryStageAndSortedWithNothing>();
@@ -0,0 +1,257 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/**
+ * This file tests PlanStage::workBatch(...) and batched execution in PlanExecutor.  Every plan is
+ * run a unit of work at a time and in batches, and must produce the same results in the same order.
+ */
+
+#include "mongo/client/dbclientcursor.h"
+#include "mongo/db/exec/collection_scan.h"
+#include "mongo/db/exec/fetch.h"
+#include "mongo/db/exec/index_scan.h"
+#include "mongo/db/exec/limit.h"
+#include "mongo/db/exec/plan_stage.h"
+#include "mongo/db/exec/projection.h"
+#include "mongo/db/exec/skip.h"
+#include "mongo/db/instance.h"
+#include "mongo/db/json.h"
+#include "mongo/db/matcher/expression_parser.h"
+#include "mongo/db/query/plan_executor.h"
+#include "mongo/db/structure/collection.h"
+#include "mongo/db/structure/collection_iterator.h"
+#include "mongo/dbtests/dbtests.h"
+
+namespace QueryStageBatch {
+
+    static const int N = 1000;
+
+    class QueryStageBatchBase {
+    public:
+        QueryStageBatchBase() { }
+
+        virtual ~QueryStageBatchBase() {
+            _client.dropCollection(ns());
+        }
+
+        void run() {
+            Client::WriteContext ctx(ns());
+            for (int i = 0; i < N; ++i) {
+                insert(BSON("a" << i << "b" << i % 7 << "c" << "filler"));
+            }
+            addIndex(BSON("a" << 1));
+            Collection* coll = ctx.ctx().db()->getCollection(ns());
+
+            vector<BSONObj> expected;
+            {
+                WorkingSet ws;
+                scoped_ptr<PlanStage> root(makePlan(&ws, coll));
+                while (!root->isEOF()) {
+                    WorkingSetID id;
+                    PlanStage::StageState status = root->work(&id);
+                    if (PlanStage::ADVANCED != status) { continue; }
+                    expected.push_back(ws.get(id)->obj.getOwned());
+                    ws.free(id);
+                }
+            }
+            ASSERT_EQUALS(expectedCount(), static_cast<int>(expected.size()));
+
+            int batchSizes[] = { 1, 7, 64, N * 2 };
+            for (size_t i = 0; i < sizeof(batchSizes) / sizeof(batchSizes[0]); ++i) {
+                vector<BSONObj> results;
+                runBatched(coll, batchSizes[i], &results);
+                ASSERT_EQUALS(expected.size(), results.size());
+                for (size_t j = 0; j < expected.size(); ++j) {
+                    ASSERT_EQUALS(expected[j], results[j]);
+                }
+            }
+        }
+
+    protected:
+        /**
+         * Build the plan under test.  The caller owns it.
+         */
+        virtual PlanStage* makePlan(WorkingSet* ws, Collection* coll) = 0;
+
+        virtual int expectedCount() const = 0;
+
+        void runBatched(Collection* coll, int batchSize, vector<BSONObj>* out) {
+            int oldBatchSize = PlanExecutor::workBatchSize;
+            PlanExecutor::workBatchSize = batchSize;
+
+            WorkingSet* ws = new WorkingSet();
+            PlanExecutor runner(ws, makePlan(ws, coll));
+            BSONObj obj;
+            while (Runner::RUNNER_ADVANCED == runner.getNext(&obj, NULL)) {
+                out->push_back(obj.getOwned());
+            }
+            ASSERT(runner.isEOF());
+
+            PlanExecutor::workBatchSize = oldBatchSize;
+        }
+
+        const MatchExpression* parseFilter(const BSONObj& obj) {
+            StatusWithMatchExpression swme = MatchExpressionParser::parse(obj);
+            verify(swme.isOK());
+            _filters.push_back(shared_ptr<MatchExpression>(swme.getValue()));
+            return swme.getValue();
+        }
+
+        IndexDescriptor* getIndex(const BSONObj& obj, Collection* coll) {
+            NamespaceDetails* nsd = coll->details();
+            int idxNo = nsd->findIndexByKeyPattern(obj);
+            return coll->getIndexCatalog()->getDescriptor( idxNo );
+        }
+
+        void addIndex(const BSONObj& obj) {
+            _client.ensureIndex(ns(), obj);
+        }
+
+        void insert(const BSONObj& obj) {
+            _client.insert(ns(), obj);
+        }
+
+        static const char* ns() { return "unittests.QueryStageBatch"; }
+
+    private:
+        vector<shared_ptr<MatchExpression> > _filters;
+
+        static DBDirectClient _client;
+    };
+
+    DBDirectClient QueryStageBatchBase::_client;
+
+    /**
+     * Filtered collection scan under a skip, a limit and a projection.
+     */
+    class CollScanSkipLimitProject : public QueryStageBatchBase {
+        virtual PlanStage* makePlan(WorkingSet* ws, Collection* coll) {
+            CollectionScanParams params;
+            params.ns = ns();
+            params.direction = CollectionScanParams::FORWARD;
+            params.tailable = false;
+
+            PlanStage* scan = new CollectionScan(params, ws,
+                                                 parseFilter(BSON("b" << BSON("$ne" << 3))));
+            PlanStage* skip = new SkipStage(100, ws, scan);
+            PlanStage* limit = new LimitStage(500, ws, skip);
+            return new ProjectionStage(BSON("a" << 1 << "_id" << 0), NULL, ws, limit);
+        }
+
+        virtual int expectedCount() const { return 500; }
+    };
+
+    /**
+     * Index scan, with a filter on the key, under a fetch with a filter on the document.
+     */
+    class IndexScanFetch : public QueryStageBatchBase {
+        virtual PlanStage* makePlan(WorkingSet* ws, Collection* coll) {
+            IndexScanParams params;
+            params.descriptor = getIndex(BSON("a" << 1), coll);
+            params.bounds.isSimpleRange = true;
+            params.bounds.startKey = BSON("" << N);
+            params.bounds.endKey = BSON("" << 100);
+            params.bounds.endKeyInclusive = true;
+            params.direction = -1;
+
+            BSONObj keyFilter = BSON("a" << BSON("$mod" << BSON_ARRAY(2 << 0)));
+            PlanStage* scan = new IndexScan(params, ws, parseFilter(keyFilter));
+            return new FetchStage(ws, scan, parseFilter(BSON("b" << BSON("$lt" << 5))));
+        }
+
+        // Even a in [100, 999] with a % 7 < 5.
+        virtual int expectedCount() const {
+            int count = 0;
+            for (int a = 100; a < N; a += 2) {
+                if (a % 7 < 5) { ++count; }
+            }
+            return count;
+        }
+    };
+
+    /**
+     * Deleting a document that an executor has buffered but not yet returned must still return
+     * it, as stages do for the results they hold.
+     */
+    class InvalidateBufferedResult {
+    public:
+        ~InvalidateBufferedResult() {
+            _client.dropCollection(ns());
+        }
+
+        void run() {
+            Client::WriteContext ctx(ns());
+            for (int i = 0; i < 100; ++i) {
+                _client.insert(ns(), BSON("a" << i));
+            }
+
+            int oldBatchSize = PlanExecutor::workBatchSize;
+            PlanExecutor::workBatchSize = 64;
+
+            CollectionScanParams params;
+            params.ns = ns();
+            params.direction = CollectionScanParams::FORWARD;
+            params.tailable = false;
+            WorkingSet* ws = new WorkingSet();
+            PlanExecutor runner(ws, new CollectionScan(params, ws, NULL));
+
+            BSONObj obj;
+            ASSERT_EQUALS(Runner::RUNNER_ADVANCED, runner.getNext(&obj, NULL));
+            ASSERT_EQUALS(0, obj["a"].numberInt());
+
+            // The second document is buffered.  Find it and delete it.
+            Collection* coll = ctx.ctx().db()->getCollection(ns());
+            scoped_ptr<CollectionIterator> it(coll->getIterator(DiskLoc(), false,
+                                                                CollectionScanParams::FORWARD));
+            it->getNext();
+            DiskLoc second = it->getNext();
+            it.reset();
+
+            runner.saveState();
+            runner.invalidate(second);
+            _client.remove(ns(), BSON("a" << 1));
+            ASSERT(runner.restoreState());
+
+            int count = 1;
+            while (Runner::RUNNER_ADVANCED == runner.getNext(&obj, NULL)) {
+                ASSERT_EQUALS(count, obj["a"].numberInt());
+                ++count;
+            }
+            ASSERT_EQUALS(100, count);
+
+            PlanExecutor::workBatchSize = oldBatchSize;
+        }
+
+    private:
+        static const char* ns() { return "unittests.QueryStageBatchInvalidate"; }
+
+        static DBDirectClient _client;
+    };
+
+    DBDirectClient InvalidateBufferedResult::_client;
+
+    class All : public Suite {
+    public:
+        All() : Suite( "query_stage_batch" ) { }
+
+        void setupTests() {
+            add<CollScanSkipLimitProject>();
+            add<IndexScanFetch>();
+            add<InvalidateBufferedResult>();
+        }
+    }  queryStageBatchAll;
+
+}  // namespace QueryStageBatch
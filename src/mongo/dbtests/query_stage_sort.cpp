@@ -91,10 +91,12 @@ namespace QueryStageSortTests {
         /**
          * A template used by many tests below.
          * Fill out numObj objects, sort them in the order provided by 'direction'.
-         * If extAllowed is true, sorting will use use external sorting if available.
          * If limit is not zero, we limit the output of the sort stage to 'limit' results.
+         * Sorting spills to disk past 'maxMemUsage' bytes.  Returns the number of sorted runs
+         * spilled.
          */
-        void sortAndCheck(int direction, Collection* coll) {
+        uint64_t sortAndCheck(int direction, Collection* coll, size_t limit = 0,
+                              size_t maxMemUsage = SortStageParams::kDefaultMaxMemUsage) {
             WorkingSet* ws = new WorkingSet();
             MockStage* ms = new MockStage(ws);
 
@@ -103,14 +105,18 @@ namespace QueryStageSortTests {
 
             SortStageParams params;
             params.pattern = BSON("foo" << direction);
+            params.limit = limit;
+            params.maxMemUsage = maxMemUsage;
+            SortStage* sort = new SortStage(params, ws, ms);
 
             // Must fetch so we can look at the doc as a BSONObj.
-            PlanExecutor runner(ws, new FetchStage(ws, new SortStage(params, ws, ms), NULL));
+            PlanExecutor runner(ws, new FetchStage(ws, sort, NULL));
 
             // Look at pairs of objects to make sure that the sort order is pairwise (and therefore
             // totally) correct.
             BSONObj last;
             ASSERT_EQUALS(Runner::RUNNER_ADVANCED, runner.getNext(&last, NULL));
+            ASSERT_EQUALS(direction > 0 ? 0 : numObj() - 1, last["foo"].numberInt());
 
             // Count 'last'.
             int count = 1;
@@ -125,8 +131,15 @@ namespace QueryStageSortTests {
                 last = current;
             }
 
-            // No limit, should get all objects back.
-            ASSERT_EQUALS(numObj(), count);
+            // Without a limit, we should get all objects back.
+            ASSERT_EQUALS(0 == limit ? numObj() : std::min(numObj(), static_cast<int>(limit)),
+                          count);
+
+            scoped_ptr<PlanStageStats> stats(sort->getStats());
+            const SortStats* sortStats = static_cast<const SortStats*>(stats->specific.get());
+            ASSERT_EQUALS(limit, sortStats->limit);
+            ASSERT_EQUALS(maxMemUsage, sortStats->memLimit);
+            return sortStats->spills;
         }
 
         virtual int numObj() = 0;
@@ -192,6 +205,50 @@ namespace QueryStageSortTests {
         }
     };
 
+    // Sort more objects than fit in memory, spilling sorted runs to disk.
+    class QueryStageSortSpill : public QueryStageSortTestBase {
+    public:
+        virtual int numObj() { return 10000; }
+
+        void run() {
+            Client::WriteContext ctx(ns());
+            Database* db = ctx.ctx().db();
+            Collection* coll = db->getCollection(ns());
+            if (!coll) {
+                coll = db->createCollection(ns());
+            }
+
+            fillData();
+            ASSERT_NOT_EQUALS(0U, sortAndCheck(1, coll, 0, 16 * 1024));
+            ASSERT_NOT_EQUALS(0U, sortAndCheck(-1, coll, 0, 16 * 1024));
+
+            // Everything fits by default.
+            ASSERT_EQUALS(0U, sortAndCheck(1, coll));
+        }
+    };
+
+    // Keep the top results under a limit, in memory and spilled.
+    class QueryStageSortLimit : public QueryStageSortTestBase {
+    public:
+        virtual int numObj() { return 10000; }
+
+        void run() {
+            Client::WriteContext ctx(ns());
+            Database* db = ctx.ctx().db();
+            Collection* coll = db->getCollection(ns());
+            if (!coll) {
+                coll = db->createCollection(ns());
+            }
+
+            fillData();
+            ASSERT_EQUALS(0U, sortAndCheck(1, coll, 1));
+            ASSERT_EQUALS(0U, sortAndCheck(-1, coll, 100));
+            ASSERT_EQUALS(0U, sortAndCheck(1, coll, 20000));
+            ASSERT_NOT_EQUALS(0U, sortAndCheck(1, coll, 2000, 16 * 1024));
+            ASSERT_NOT_EQUALS(0U, sortAndCheck(-1, coll, 2000, 16 * 1024));
+        }
+    };
+
     // Invalidation of everything fed to sort.
     class QueryStageSortInvalidation : public QueryStageSortTestBase {
     public:
@@ -276,6 +333,8 @@ namespace QueryStageSortTests {
             add<QueryStageSortInc>();
             add<QueryStageSortDec>();
             add<QueryStageSortExt>();
+            add<QueryStageSortSpill>();
+            add<QueryStageSortLimit>();
             add<QueryStageSortInvalidation>();
         }
     }  queryStageSortTest;
@@ -1459,6 +1459,75 @@ namespace QueryTests {
         }
     };
 
+    /**
+     * Large owned documents are referenced by the reply rather than copied into it, and the
+     * reply must still hold every document in order.
+     */
+    class QueryReplyReferences {
+    public:
+        void run() {
+            string big( QueryReplyBuilder::kMinReferencedSize, 'x' );
+            BSONObj owned = BSON( "a" << 1 << "s" << big );
+            BSONObj unowned( owned.objdata() );
+            ASSERT( !unowned.isOwned() );
+            BSONObj small = BSON( "a" << 2 );
+
+            vector<BSONObj> docs;
+            docs.push_back( small );
+            docs.push_back( owned );
+            docs.push_back( owned );
+            docs.push_back( unowned );
+            docs.push_back( small );
+
+            QueryReplyBuilder builder;
+            int len = sizeof( QueryResult );
+            for( vector<BSONObj>::const_iterator i = docs.begin(); i != docs.end(); ++i ) {
+                builder.append( *i );
+                len += i->objsize();
+                ASSERT_EQUALS( len, builder.len() );
+            }
+
+            Message result;
+            QueryResult* qr = builder.done( result );
+            qr->nReturned = docs.size();
+            ASSERT_EQUALS( len, result.size() );
+            ASSERT_EQUALS( len, result.header()->len );
+            ASSERT_EQUALS( opReply, result.operation() );
+
+            result.concat();
+            qr = reinterpret_cast<QueryResult*>( result.singleData() );
+            const char* data = qr->data();
+            for( vector<BSONObj>::const_iterator i = docs.begin(); i != docs.end(); ++i ) {
+                BSONObj obj( data );
+                ASSERT_EQUALS( *i, obj );
+                data += obj.objsize();
+            }
+            ASSERT_EQUALS( reinterpret_cast<const char*>( qr ) + len, data );
+        }
+    };
+
+    /** Projected documents are sent from the buffers the projection built. */
+    class LargeProjectedDocuments : public CollectionBase {
+    public:
+        LargeProjectedDocuments() : CollectionBase( "largeprojecteddocuments" ) {}
+        void run() {
+            string big( 2 * QueryReplyBuilder::kMinReferencedSize, 'x' );
+            for( int i = 0; i < 20; ++i ) {
+                insert( ns(), BSON( "i" << i << "s" << big << "t" << i % 3 ) );
+            }
+
+            BSONObj fields = BSON( "_id" << 0 << "i" << 1 << "s" << 1 );
+            auto_ptr<DBClientCursor> c = client().query( ns(), Query().sort( "i" ), 0, 0,
+                                                         &fields, 0, 3 );
+            int i = 0;
+            while( c->more() ) {
+                ASSERT_EQUALS( BSON( "i" << i << "s" << big ), c->next() );
+                ++i;
+            }
+            ASSERT_EQUALS( 20, i );
+        }
+    };
+
     namespace parsedtests {
         class basic1 {
         public:
@@ -1736,6 +1805,8 @@ namespace QueryTests {
             add< QueryCursorTimeout >();
             add< QueryReadsAll >();
             add< KillPinnedCursor >();
+            add< QueryReplyReferences >();
+            add< LargeProjectedDocuments >();
 
             add< parsedtests::basic1 >();
 
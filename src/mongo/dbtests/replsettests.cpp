@@ -29,6 +29,7 @@
 #include "mongo/db/repl/replication_server_status.h"  // replSettings
 #include "mongo/db/repl/rs.h"
 #include "mongo/dbtests/dbtests.h"
+#include "mongo/util/fail_point_service.h"
 #include "mongo/util/time_support.h"
 
 
@@ -93,11 +94,14 @@ namespace ReplSetTests {
     public:
         BackgroundSyncTest() {}
         virtual ~BackgroundSyncTest() {}
-        virtual bool peek(BSONObj* op) {
+        virtual bool peek(BSONObj* op, replset::OplogBatchPtr* batch = NULL) {
             if (_queue.empty()) {
                 return false;
             }
             *op = _queue.front();
+            if (batch) {
+                batch->reset();
+            }
             return true;
         }
         virtual void consume() {
@@ -1030,6 +1034,7 @@ namespace ReplSetTests {
     };
 
     class TestRSSync : public Base {
+        OpTime _lastAdded;
 
         void addOp(const string& op, BSONObj o, BSONObj* o2 = NULL, const char* coll = NULL,
                    int version = 0) {
@@ -1038,6 +1043,7 @@ namespace ReplSetTests {
                 Lock::GlobalWrite lk;
                 ts = OpTime::_now();
             }
+            _lastAdded = ts;
 
             BSONObjBuilder b;
             b.appendTimestamp("ts", ts.asLL());
@@ -1119,6 +1125,8 @@ namespace ReplSetTests {
             applyOplog();
 
             ASSERT_EQUALS(expected, static_cast<int>(client()->count(ns())));
+            // the last batch has been written to the oplog by the time oplogApplication returns
+            ASSERT(_lastAdded == theReplSet->lastOpTimeWritten);
 
             drop();
             addVersionedInserts(100);
@@ -1148,6 +1156,107 @@ namespace ReplSetTests {
         }
     };
 
+    class SyncTailTest : public replset::SyncTail {
+    public:
+        SyncTailTest(replset::BackgroundSyncInterface* q) : SyncTail(q) { }
+        using SyncTail::multiApply;
+    };
+
+    // A batch is applied while the oplog writer is still holding the previous one.
+    class TestApplyWhileOplogWriterHeld : public Base {
+        OpTime addInsert(replset::SyncTail::OpQueue* ops, int id) {
+            OpTime ts;
+            {
+                Lock::GlobalWrite lk;
+                ts = OpTime::_now();
+            }
+            BSONObjBuilder b;
+            b.appendTimestamp("ts", ts.asLL());
+            b.append("op", "i");
+            b.append("ns", ns());
+            b.append("o", BSON("_id" << id));
+            BSONObj op = b.obj();
+            ops->push_back(op);
+            return ts;
+        }
+
+        // Sets minValid, applies and schedules the batch, the same as oplogApplication()
+        void applyBatch(SyncTailTest* tail, replset::SyncTail::OpQueue* ops) {
+            theReplSet->setMinValid(ops->getDeque().back());
+            tail->multiApply(ops->getDeque(), replset::multiSyncApply);
+        }
+
+    public:
+        void run() {
+            drop();
+            SyncTailTest tail(_bgsync);
+            FailPoint* hang = getGlobalFailPointRegistry()->getFailPoint("rsOplogWriterHang");
+
+            // more than one group of ops, so that the writer is held part way through
+            replset::SyncTail::OpQueue first;
+            OpTime firstGroupEnd;
+            OpTime firstEnd;
+            for (int i = 0; i < 200; i++) {
+                firstEnd = addInsert(&first, i);
+                if (i == 63) {
+                    firstGroupEnd = firstEnd;
+                }
+            }
+            replset::SyncTail::OpQueue second;
+            OpTime secondEnd;
+            for (int i = 200; i < 300; i++) {
+                secondEnd = addInsert(&second, i);
+            }
+
+            hang->setMode(FailPoint::alwaysOn);
+            applyBatch(&tail, &first);
+            tail.scheduleOpsToOplog(&first);
+            while (theReplSet->lastOpTimeWritten != firstGroupEnd) {
+                sleepmillis(10);
+            }
+
+            // the writer is held after its first group, yet the next batch goes through
+            applyBatch(&tail, &second);
+            ASSERT_EQUALS(300, static_cast<int>(client()->count(ns())));
+            ASSERT(theReplSet->lastOpTimeWritten == firstGroupEnd);
+            ASSERT(theReplSet->getMinValid() == secondEnd);
+
+            hang->setMode(FailPoint::off);
+            tail.scheduleOpsToOplog(&second);
+            theReplSet->getOplogWriterPool().join();
+            ASSERT(theReplSet->lastOpTimeWritten == secondEnd);
+
+            drop();
+        }
+    };
+
+    class TestOplogBatch {
+    public:
+        void run() {
+            // a run of adjacent ops, as in a reply message, followed by a separate one
+            BSONObj a = BSON("ts" << 1 << "op" << "i");
+            BSONObj b = BSON("ts" << 2 << "op" << "u" << "o" << BSON("x" << 1));
+            BufBuilder adjacent;
+            adjacent.appendBuf(a.objdata(), a.objsize());
+            adjacent.appendBuf(b.objdata(), b.objsize());
+            BSONObj c = BSON("ts" << 3 << "op" << "d");
+
+            std::vector<BSONObj> ops;
+            ops.push_back(BSONObj(adjacent.buf()));
+            ops.push_back(BSONObj(adjacent.buf() + a.objsize()));
+            ops.push_back(c);
+
+            replset::OplogBatch batch(ops);
+            ASSERT_EQUALS(static_cast<size_t>(a.objsize() + b.objsize() + c.objsize()),
+                          batch.bytes());
+            ASSERT_EQUALS(3U, batch.ops().size());
+            ASSERT_EQUALS(a, batch.ops()[0]);
+            ASSERT_EQUALS(b, batch.ops()[1]);
+            ASSERT_EQUALS(c, batch.ops()[2]);
+            ASSERT(batch.ops()[2].objdata() != c.objdata());
+        }
+    };
+
     class All : public Suite {
     public:
         All() : Suite( "replset" ) {
@@ -1161,6 +1270,8 @@ namespace ReplSetTests {
             add< CappedUpdate >();
             add< CappedInsert >();
             add< TestRSSync >();
+            add< TestApplyWhileOplogWriterHeld >();
+            add< TestOplogBatch >();
             add< TestDropDB >();
             add< TestDrop >();
             add< TestDropIndexes >();
@@ -57,6 +57,7 @@
 #include "mongo/s/writeback_listener.h"
 #include "mongo/util/net/listen.h"
 #include "mongo/util/net/message.h"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/processinfo.h"
 #include "mongo/util/ramlog.h"
 #include "mongo/util/stringutils.h"
@@ -1433,6 +1434,7 @@ namespace mongo {
                 result.append("maxWireVersion", maxWireVersion);
                 result.append("minWireVersion", minWireVersion);
 
+                MessageCompressor::negotiate(cmdObj, ClientBasic::getCurrent()->port(), &result);
                 return true;
             }
         } ismaster;
@@ -38,6 +38,7 @@
 
 #include <algorithm>
 #include <boost/thread/thread.hpp>
+#include <iterator>
 #include <map>
 #include <string>
 #include <vector>
@@ -67,6 +68,7 @@
 #include "mongo/db/repl/rs.h"
 #include "mongo/db/repl/rs_config.h"
 #include "mongo/db/repl/write_concern.h"
+#include "mongo/db/server_parameters.h"
 #include "mongo/logger/ramlog.h"
 #include "mongo/s/chunk.h"
 #include "mongo/s/chunk_version.h"
@@ -79,6 +81,7 @@
 #include "mongo/util/processinfo.h"
 #include "mongo/util/queue.h"
 #include "mongo/util/startup_test.h"
+#include "mongo/util/token_bucket.h"
 #include "mongo/util/fail_point_service.h"
 
 // Pause while a fail point is enabled.
@@ -198,12 +201,19 @@ namespace mongo {
     }
 
 
+    // the most disk locs of a migrating chunk the donor holds in memory at once
+    const size_t maxCloneLocsPerWindow = 256 * 1024;
+
     class MigrateFromStatus {
     public:
 
-        MigrateFromStatus() : _mutex("MigrateFromStatus") {
+        MigrateFromStatus() : _mutex("MigrateFromStatus"), _cloneMutex("MigrateFromStatus clone") {
             _active = false;
             _inCriticalSection = false;
+            _clonePos = 0;
+            _cloneEOF = false;
+            _readingCloneLocs = false;
+            _numCloned = 0;
             _memoryUsed = 0;
         }
 
@@ -231,6 +241,7 @@ namespace mongo {
             _max = max;
             _shardKeyPattern = shardKeyPattern;
 
+            verify( _cloneRunner.get() == NULL );
             verify( _cloneLocs.size() == 0 );
             verify( _deleted.size() == 0 );
             verify( _reload.size() == 0 );
@@ -241,16 +252,25 @@ namespace mongo {
         }
 
         void done() {
+            // waits out a clone batch, which may yield its read lock inside _cloneRunner
+            scoped_lock cloneLock( _cloneMutex );
+
             log() << "MigrateFromStatus::done About to acquire global write lock to exit critical "
                     "section" << endl;
             Lock::GlobalWrite lk;
             log() << "MigrateFromStatus::done Global lock acquired" << endl;
 
+            _cloneRunner.reset();
             {
                 scoped_spinlock lk( _trackerLocks );
                 _deleted.clear();
                 _reload.clear();
                 _cloneLocs.clear();
+                _cloneLocsDeleted.clear();
+                _clonePos = 0;
+                _cloneEOF = false;
+                _readingCloneLocs = false;
+                _deletedWhileReading.clear();
             }
             _memoryUsed = 0;
 
@@ -382,13 +402,17 @@ namespace mongo {
         }
 
         /**
-         * Get the disklocs that belong to the chunk migrated and sort them in _cloneLocs (to avoid seeking disk later)
+         * Checks the chunk isn't too large to move, then positions a scan of the shard key index
+         * over the chunk, from which clone() reads the chunk's disk locs a window at a time.
+         * The chunk is never materialized whole, so the memory used doesn't grow with
+         * maxChunkSize.
          *
          * @param maxChunkSize number of bytes beyond which a chunk's base data (no indices) is considered too large to move
          * @param errmsg filled with textual description of error if this call return false
          * @return false if approximate chunk size is too big to move or true otherwise
          */
-        bool storeCurrentLocs( long long maxChunkSize , string& errmsg , BSONObjBuilder& result ) {
+        bool startClone( long long maxChunkSize , string& errmsg , BSONObjBuilder& result ) {
+            scoped_lock cloneLock( _cloneMutex );
             Client::ReadContext ctx( _ns );
             Collection* collection = ctx.ctx().db()->getCollection( _ns );
             if ( !collection ) {
@@ -401,7 +425,7 @@ namespace mongo {
                                                                   true );  /* require single key */
 
             if ( idx == NULL ) {
-                errmsg = (string)"can't find index in storeCurrentLocs" + causedBy( errmsg );
+                errmsg = (string)"can't find index in startClone" + causedBy( errmsg );
                 return false;
             }
             // Assume both min and max non-empty, append MinKey's to make them fit chosen index
@@ -409,13 +433,8 @@ namespace mongo {
             BSONObj min = Helpers::toKeyFormat( kp.extendRangeBound( _min, false ) );
             BSONObj max = Helpers::toKeyFormat( kp.extendRangeBound( _max, false ) );
 
-            auto_ptr<Runner> runner(InternalPlanner::indexScan(idx, min, max, false));
-            // we can afford to yield here because any change to the base data that we might miss is
-            // already being  queued and will be migrated in the 'transferMods' stage
-            runner->setYieldPolicy(Runner::YIELD_AUTO);
-
             // use the average object size to estimate how many objects a full chunk would carry
-            // do that while traversing the chunk's range using the sharding index, below
+            // do that while counting the chunk's keys in the sharding index, below
             // there's a fair amount of slack before we determine a chunk is too large because object sizes will vary
             unsigned long long maxRecsWhenFull;
             long long avgRecSize;
@@ -429,25 +448,19 @@ namespace mongo {
                 avgRecSize = 0;
                 maxRecsWhenFull = Chunk::MaxObjectPerChunk + 1;
             }
-            
-            // do a full traversal of the chunk and don't stop even if we think it is a large chunk
-            // we want the number of records to better report, in that case
-            bool isLargeChunk = false;
-            unsigned long long recCount = 0;;
-            DiskLoc dl;
-            while (Runner::RUNNER_ADVANCED == runner->getNext(NULL, &dl)) {
-                if ( ! isLargeChunk ) {
-                    scoped_spinlock lk( _trackerLocks );
-                    _cloneLocs.insert( dl );
-                }
 
-                if ( ++recCount > maxRecsWhenFull ) {
-                    isLargeChunk = true;
+            // do a full count of the chunk and don't stop even if we think it is a large chunk
+            // we want the number of records to better report, in that case
+            unsigned long long recCount = 0;
+            {
+                auto_ptr<Runner> runner( InternalPlanner::indexScan( idx, min, max, false ) );
+                runner->setYieldPolicy( Runner::YIELD_AUTO );
+                while ( Runner::RUNNER_ADVANCED == runner->getNext( NULL, NULL ) ) {
+                    recCount++;
                 }
             }
-            runner.reset();
 
-            if ( isLargeChunk ) {
+            if ( recCount > maxRecsWhenFull ) {
                 warning() << "can't move chunk of size (approximately) " << recCount * avgRecSize
                           << " because maximum size allowed to move is " << maxChunkSize
                           << " ns: " << _ns << " " << _min << " -> " << _max
@@ -458,10 +471,18 @@ namespace mongo {
                 return false;
             }
 
-            {
-                scoped_spinlock lk( _trackerLocks );
-                log() << "moveChunk number of documents: " << _cloneLocs.size() << migrateLog;
-            }
+            log() << "moveChunk number of documents: " << recCount << migrateLog;
+
+            verify( _cloneRunner.get() == NULL );
+            _cloneRunner.reset( InternalPlanner::indexScan( idx, min, max, false ) );
+            // we can afford to yield here, and between clone batches, because any change to the
+            // base data that we might miss is already being queued and will be migrated in the
+            // 'transferMods' stage.  YIELD_AUTO also registers the runner, so it is told about
+            // deletes while it sits saved between batches.
+            _cloneRunner->setYieldPolicy( Runner::YIELD_AUTO );
+            _cloneRunner->saveState();
+
+            _numCloned = 0;
             return true;
         }
 
@@ -471,6 +492,13 @@ namespace mongo {
                 return false;
             }
 
+            // one batch at a time, since each continues the index scan where the last stopped
+            scoped_lock cloneLock( _cloneMutex );
+            if ( _cloneRunner.get() == NULL ) {
+                errmsg = "clone not started";
+                return false;
+            }
+
             ElapsedTracker tracker (128, 10); // same as ClientCursor::_yieldSometimesTracker
 
             int allocSize;
@@ -481,25 +509,32 @@ namespace mongo {
                 scoped_spinlock lk( _trackerLocks );
                 allocSize =
                     std::min(BSONObjMaxUserSize,
-                             (int)((12 + collection->averageObjectSize()) * _cloneLocs.size()));
+                             (int)((12 + collection->averageObjectSize()) *
+                                   std::max((size_t)1, _cloneLocs.size() - _clonePos)));
             }
             BSONArrayBuilder a (allocSize);
             
             while ( 1 ) {
                 bool filledBuffer = false;
+                bool cloneDone = false;
                 
                 auto_ptr<LockMongoFilesShared> fileLock;
                 Record* recordToTouch = 0;
 
                 {
                     Client::ReadContext ctx( _ns );
+                    if ( ! _nextCloneLocs( errmsg ) )
+                        return false;
+
                     scoped_spinlock lk( _trackerLocks );
-                    set<DiskLoc>::iterator i = _cloneLocs.begin();
-                    for ( ; i!=_cloneLocs.end(); ++i ) {
+                    for ( ; _clonePos < _cloneLocs.size(); ++_clonePos ) {
                         if (tracker.intervalHasElapsed()) // should I yield?
                             break;
                         
-                        DiskLoc dl = *i;
+                        if ( _cloneLocsDeleted[_clonePos] ) // deleted since its window was read
+                            continue;
+
+                        DiskLoc dl = _cloneLocs[_clonePos];
                         
                         Record* r = dl.rec();
                         if ( ! r->likelyInPhysicalMemory() ) {
@@ -519,11 +554,11 @@ namespace mongo {
                         }
                         
                         a.append( o );
+                        _numCloned++;
                     }
-                    
-                    _cloneLocs.erase( _cloneLocs.begin() , i );
-                    
-                    if ( _cloneLocs.empty() || filledBuffer )
+
+                    cloneDone = _cloneEOF && _clonePos == _cloneLocs.size();
+                    if ( cloneDone || filledBuffer )
                         break;
                 }
                 
@@ -537,6 +572,10 @@ namespace mongo {
                 
             }
 
+            if ( a.arrSize() == 0 ) {
+                log() << "moveChunk number of documents cloned: " << _numCloned << migrateLog;
+            }
+
             result.appendArray( "objects" , a.arr() );
             return true;
         }
@@ -551,17 +590,26 @@ namespace mongo {
             if ( ! db->ownsNS( _ns ) )
                 return;
 
-            
-            // not needed right now
-            // but trying to prevent a future bug
             scoped_spinlock lk( _trackerLocks ); 
 
-            _cloneLocs.erase( dl );
+            if ( _readingCloneLocs ) {
+                // the scan for the next window may have returned dl before yielding
+                _deletedWhileReading.push_back( dl );
+            }
+
+            vector<DiskLoc>::iterator i = std::lower_bound( _cloneLocs.begin() + _clonePos ,
+                                                            _cloneLocs.end() ,
+                                                            dl );
+            if ( i != _cloneLocs.end() && *i == dl )
+                _cloneLocsDeleted[ i - _cloneLocs.begin() ] = true;
         }
 
-        std::size_t cloneLocsRemaining() {
+        /**
+         * @return true once every document of the chunk has been handed to the recipient
+         */
+        bool isCloneDone() {
             scoped_spinlock lk( _trackerLocks );
-            return _cloneLocs.size();
+            return _cloneEOF && _clonePos == _cloneLocs.size();
         }
 
         long long mbUsed() const { return _memoryUsed / ( 1024 * 1024 ); }
@@ -614,16 +662,83 @@ namespace mongo {
         // even though it shouldn't be needed under normal operation
         SpinLock _trackerLocks;
 
-        // disk locs yet to be transferred from here to the other side
-        // no locking needed because built initially by 1 thread in a read lock
-        // emptied by 1 thread in a read lock
-        // updates applied by 1 thread in a write lock
-        set<DiskLoc> _cloneLocs;
+        // serializes clone batches, which share _cloneRunner
+        mongo::mutex _cloneMutex;
+
+        // scan of the shard key index over the chunk, saved between clone batches
+        scoped_ptr<Runner> _cloneRunner;
+
+        // the current window of disk locs read from _cloneRunner, sorted so the records are
+        // read in disk order.  the ones before _clonePos have been transferred.  filled and
+        // emptied by 1 thread in a read lock, updates applied by 1 thread in a write lock
+        vector<DiskLoc> _cloneLocs;
+        vector<bool> _cloneLocsDeleted;
+        size_t _clonePos;
+        bool _cloneEOF; // _cloneRunner has returned every disk loc of the chunk
+
+        // deletes seen while _cloneRunner yields reading the next window
+        bool _readingCloneLocs;
+        vector<DiskLoc> _deletedWhileReading;
+
+        long long _numCloned;
 
         list<BSONObj> _reload; // objects that were modified that must be recloned
         list<BSONObj> _deleted; // objects deleted during clone that should be deleted later
         long long _memoryUsed; // bytes in _reload + _deleted
 
+        /**
+         * Reads the next window of disk locs from the shard key index once the current one has
+         * been transferred.  Must be in a read lock on _ns, holding _cloneMutex.
+         */
+        bool _nextCloneLocs( string& errmsg ) {
+            {
+                scoped_spinlock lk( _trackerLocks );
+                if ( _cloneEOF || _clonePos < _cloneLocs.size() )
+                    return true;
+                _readingCloneLocs = true;
+            }
+
+            vector<DiskLoc> locs;
+            Runner::RunnerState state = Runner::RUNNER_DEAD;
+            if ( _cloneRunner->restoreState() ) {
+                DiskLoc dl;
+                while ( locs.size() < maxCloneLocsPerWindow ) {
+                    state = _cloneRunner->getNext( NULL, &dl );
+                    if ( Runner::RUNNER_ADVANCED != state )
+                        break;
+                    locs.push_back( dl );
+                }
+                _cloneRunner->saveState();
+            }
+
+            std::sort( locs.begin(), locs.end() );
+
+            scoped_spinlock lk( _trackerLocks );
+            _readingCloneLocs = false;
+            if ( ! _deletedWhileReading.empty() ) {
+                std::sort( _deletedWhileReading.begin(), _deletedWhileReading.end() );
+                vector<DiskLoc> live;
+                std::set_difference( locs.begin(), locs.end(),
+                                     _deletedWhileReading.begin(), _deletedWhileReading.end(),
+                                     std::back_inserter( live ) );
+                locs.swap( live );
+                _deletedWhileReading.clear();
+            }
+
+            if ( Runner::RUNNER_DEAD == state || Runner::RUNNER_ERROR == state ) {
+                errmsg = str::stream() << "shard key index scan of " << _ns
+                                       << " stopped during migration: "
+                                       << Runner::statestr( state );
+                return false;
+            }
+
+            _cloneLocs.swap( locs );
+            _cloneLocsDeleted.assign( _cloneLocs.size(), false );
+            _clonePos = 0;
+            _cloneEOF = ( Runner::RUNNER_EOF == state );
+            return true;
+        }
+
         bool _getActive() const { scoped_lock l(_mutex); return _active; }
         void _setActive( bool b ) { scoped_lock l(_mutex); _active = b; }
 
@@ -744,7 +859,7 @@ namespace mongo {
             // 1. parse options
             // 2. make sure my view is complete and lock
             // 3. start migrate
-            //    in a read lock, get all DiskLoc and sort so we can do as little seeking as possible
+            //    stream the chunk in windows of sorted DiskLocs so we can do as little seeking as possible
             //    tell to start transferring
             // 4. pause till migrate caught up
             // 5. LOCK
@@ -1009,8 +1124,8 @@ namespace mongo {
             }
 
             {
-                // this gets a read lock, so we know we have a checkpoint for mods
-                if ( ! migrateFromStatus.storeCurrentLocs( maxChunkSize , errmsg , result ) )
+                // mods are logged from here on, so documents the clone misses are recloned
+                if ( ! migrateFromStatus.startClone( maxChunkSize , errmsg , result ) )
                     return false;
 
                 ScopedDbConnection connTo(toShard.getConnString());
@@ -1137,12 +1252,11 @@ namespace mongo {
             log() << "About to check if it is safe to enter critical section" << endl;
 
             // Ensure all cloned docs have actually been transferred
-            std::size_t locsRemaining = migrateFromStatus.cloneLocsRemaining();
-            if ( locsRemaining != 0 ) {
+            if ( ! migrateFromStatus.isCloneDone() ) {
 
                 errmsg =
                     str::stream() << "moveChunk cannot enter critical section before all data is"
-                                  << " cloned, " << locsRemaining << " locs were not transferred"
+                                  << " cloned, some locs were not transferred"
                                   << " but to-shard reported " << res;
 
                 // Should never happen, but safe to abort before critical section
@@ -1508,6 +1622,130 @@ namespace mongo {
     MONGO_FP_DECLARE(migrateThreadHangAtStep4);
     MONGO_FP_DECLARE(migrateThreadHangAtStep5);
 
+    // the most bytes of replies the recipient fetches ahead of applying them
+    const size_t maxMigrateBytesInFlight = 3 * BSONObjMaxUserSize;
+
+    // the most documents the recipient writes under one write lock
+    const size_t maxMigrateDocsPerWriteLock = 128;
+
+    // MB per second of documents the recipient of a migration writes, 0 for no limit
+    int migrateRecipientMBPerSec = 0;
+    ExportedServerParameter<int> migrateRecipientMBPerSecParam( ServerParameterSet::getGlobal(),
+                                                                "migrateRecipientMBPerSec",
+                                                                &migrateRecipientMBPerSec,
+                                                                true,
+                                                                true );
+
+    /**
+     * Paces the recipient's writes to migrateRecipientMBPerSec, so a migration uses the I/O
+     * left over by the shard's own operations.  Only ever call it outside of a lock.
+     */
+    class MigrateRateLimiter {
+    public:
+        MigrateRateLimiter() : _bucket( 0 , 0 ) { }
+
+        void consume( long long bytes ) {
+            const long long rate = (long long)std::max( 0 , migrateRecipientMBPerSec ) * 1024 * 1024;
+            if ( rate != _bucket.rate() ) {
+                // allow a second's worth of writes at once
+                _bucket.setRate( rate , rate );
+            }
+            _bucket.consume( bytes );
+        }
+
+    private:
+        TokenBucket _bucket;
+    };
+
+    // a _migrateClone reply with no objects ends the clone
+    bool isLastCloneReply( const BSONObj& reply ) {
+        return ! reply["objects"].isABSONObj() || reply["objects"].Obj().isEmpty();
+    }
+
+    // a _transferMods reply with no mods ends the catch up
+    bool isLastModsReply( const BSONObj& reply ) {
+        return reply["size"].number() == 0;
+    }
+
+    /**
+     * Sends one of the migration's fetch commands to the donor repeatedly on its own
+     * connection, so the next replies are in flight while the migrate thread applies the
+     * current one.  Stops after the reply 'isLast' says ends the stream.
+     */
+    class MigrateBatchFetcher : boost::noncopyable {
+    public:
+        typedef bool (*IsLastFunc)( const BSONObj& reply );
+
+        MigrateBatchFetcher( const string& from , const string& command , IsLastFunc isLast ) :
+            _from( from ),
+            _command( command ),
+            _isLast( isLast ),
+            _replies( maxMigrateBytesInFlight , &MigrateBatchFetcher::_replySize ) {
+        }
+
+        ~MigrateBatchFetcher() {
+            if ( ! _thread )
+                return;
+            _stopped.store( 1 );
+            // unblocks a fetch waiting for room
+            _replies.clear();
+            _thread->join();
+        }
+
+        void start() {
+            verify( ! _thread );
+            _thread.reset( new boost::thread( boost::bind( &MigrateBatchFetcher::_run , this ) ) );
+        }
+
+        /**
+         * Waits for the next reply.
+         * @return false if the command failed, the reply is in 'errmsg'
+         */
+        bool next( BSONObj* reply , string& errmsg ) {
+            *reply = _replies.blockingPop();
+            if ( ! (*reply)["ok"].trueValue() ) {
+                errmsg = _command + " failed: ";
+                errmsg += reply->toString();
+                return false;
+            }
+            return true;
+        }
+
+    private:
+        static size_t _replySize( const BSONObj& reply ) { return reply.objsize(); }
+
+        void _run() {
+            Client::initThread( "migrateFetcher" );
+            if (getGlobalAuthorizationManager()->isAuthEnabled()) {
+                cc().getAuthorizationSession()->grantInternalAuthorization();
+            }
+
+            try {
+                ScopedDbConnection conn( _from );
+                while ( ! _stopped.load() ) {
+                    BSONObj res;
+                    bool ok = conn->runCommand( "admin" , BSON( _command << 1 ) , res );
+                    _replies.push( res.getOwned() );
+                    if ( ! ok || _isLast( res ) )
+                        break;
+                }
+                conn.done();
+            }
+            catch ( std::exception& e ) {
+                _replies.push( BSON( "ok" << 0 << "errmsg" << e.what() ) );
+            }
+
+            cc().shutdown();
+        }
+
+        const string _from;
+        const string _command;
+        const IsLastFunc _isLast;
+        BlockingQueue<BSONObj> _replies;
+        AtomicUInt32 _stopped;
+        scoped_ptr<boost::thread> _thread;
+    };
+
     class MigrateStatus {
     public:
         
@@ -1569,6 +1807,7 @@ namespace mongo {
 
             string errmsg;
             MoveTimingHelper timing( "to" , ns , min , max , 5 /* steps */ , errmsg );
+            MigrateRateLimiter rateLimiter;
 
             ScopedDbConnection conn(from);
             conn->getLastError(); // just test connection
@@ -1689,44 +1928,67 @@ namespace mongo {
                 // 3. initial bulk clone
                 state = CLONE;
 
+                // gets arrays of objects to copy, in disk order
+                MigrateBatchFetcher fetcher( from , "_migrateClone" , isLastCloneReply );
+                fetcher.start();
+
                 while ( true ) {
                     BSONObj res;
-                    if ( ! conn->runCommand( "admin" , BSON( "_migrateClone" << 1 ) , res ) ) {  // gets array of objects to copy, in disk order
+                    if ( ! fetcher.next( &res , errmsg ) ) {
                         state = FAIL;
-                        errmsg = "_migrateClone failed: ";
-                        errmsg += res.toString();
                         error() << errmsg << migrateLog;
                         conn.done();
                         return;
                     }
 
-                    BSONObj arr = res["objects"].Obj();
-                    int thisTime = 0;
+                    if ( state == ABORT ) {
+                        timing.note( "aborted" );
+                        return;
+                    }
 
-                    BSONObjIterator i( arr );
+                    vector<BSONObj> docs;
+                    BSONObjIterator i( res["objects"].Obj() );
                     while( i.more() ) {
-                        BSONObj o = i.next().Obj();
+                        docs.push_back( i.next().Obj() );
+                    }
+
+                    if ( docs.empty() )
+                        break;
+
+                    // upsert the batch under as few write locks as possible, resuming at the
+                    // document that faulted after a page fault
+                    size_t applied = 0;
+                    while ( applied < docs.size() ) {
+                        const size_t end = std::min( docs.size() ,
+                                                     applied + maxMigrateDocsPerWriteLock );
+                        const long long bytesBefore = clonedBytes;
                         {
                             PageFaultRetryableSection pgrs;
                             while ( 1 ) {
                                 try {
                                     Client::WriteContext cx( ns );
 
-                                    BSONObj localDoc;
-                                    if ( willOverrideLocalId( o, &localDoc ) ) {
-                                        string errMsg =
-                                            str::stream() << "cannot migrate chunk, local document "
-                                                          << localDoc
-                                                          << " has same _id as cloned "
-                                                          << "remote document " << o;
+                                    for ( ; applied < end; applied++ ) {
+                                        const BSONObj& o = docs[applied];
 
-                                        warning() << errMsg << endl;
+                                        BSONObj localDoc;
+                                        if ( willOverrideLocalId( o, &localDoc ) ) {
+                                            string errMsg =
+                                                str::stream() << "cannot migrate chunk, local document "
+                                                              << localDoc
+                                                              << " has same _id as cloned "
+                                                              << "remote document " << o;
 
-                                        // Exception will abort migration cleanly
-                                        uasserted( 16976, errMsg );
-                                    }
+                                            warning() << errMsg << endl;
 
-                                    Helpers::upsert( ns, o, true );
+                                            // Exception will abort migration cleanly
+                                            uasserted( 16976, errMsg );
+                                        }
+
+                                        Helpers::upsert( ns, o, true );
+                                        numCloned++;
+                                        clonedBytes += o.objsize();
+                                    }
                                     break;
                                 }
                                 catch ( PageFaultException& e ) {
@@ -1734,19 +1996,16 @@ namespace mongo {
                                 }
                             }
                         }
-                        thisTime++;
-                        numCloned++;
-                        clonedBytes += o.objsize();
 
-                        if ( secondaryThrottle && thisTime > 0 ) {
-                            if ( ! waitForReplication( cc().getLastOp(), 2, 60 /* seconds to wait */ ) ) {
-                                warning() << "secondaryThrottle on, but doc insert timed out after 60 seconds, continuing" << endl;
-                            }
-                        }
+                        rateLimiter.consume( clonedBytes - bytesBefore );
                     }
 
-                    if ( thisTime == 0 )
-                        break;
+                    // the next batch is already being fetched while this one replicates
+                    if ( secondaryThrottle ) {
+                        if ( ! waitForReplication( cc().getLastOp(), 2, 60 /* seconds to wait */ ) ) {
+                            warning() << "secondaryThrottle on, but clone batch insert timed out after 60 seconds, continuing" << endl;
+                        }
+                    }
                 }
 
                 timing.done(3);
@@ -1759,20 +2018,24 @@ namespace mongo {
             {
                 // 4. do bulk of mods
                 state = CATCHUP;
+
+                // the steady state below transfers mods itself, once this has seen them run dry
+                MigrateBatchFetcher fetcher( from , "_transferMods" , isLastModsReply );
+                fetcher.start();
+
                 while ( true ) {
                     BSONObj res;
-                    if ( ! conn->runCommand( "admin" , BSON( "_transferMods" << 1 ) , res ) ) {
+                    if ( ! fetcher.next( &res , errmsg ) ) {
                         state = FAIL;
-                        errmsg = "_transferMods failed: ";
-                        errmsg += res.toString();
-                        error() << "_transferMods failed: " << res << migrateLog;
+                        error() << errmsg << migrateLog;
                         conn.done();
                         return;
                     }
-                    if ( res["size"].number() == 0 )
+                    if ( isLastModsReply( res ) )
                         break;
 
                     apply( res , &lastOpApplied );
+                    rateLimiter.consume( res["size"].numberLong() );
                     
                     const int maxIterations = 3600*50;
                     int i;
@@ -1912,32 +2175,34 @@ namespace mongo {
                 while ( i.more() ) {
                     Client::WriteContext cx(ns);
 
-                    BSONObj id = i.next().Obj();
+                    for ( size_t n = 0; n < maxMigrateDocsPerWriteLock && i.more(); n++ ) {
+                        BSONObj id = i.next().Obj();
 
-                    // do not apply deletes if they do not belong to the chunk being migrated
-                    BSONObj fullObj;
-                    if ( Helpers::findById( cc() , ns.c_str() , id, fullObj ) ) {
-                        if ( ! isInRange( fullObj , min , max , shardKeyPattern ) ) {
-                            log() << "not applying out of range deletion: " << fullObj << migrateLog;
+                        // do not apply deletes if they do not belong to the chunk being migrated
+                        BSONObj fullObj;
+                        if ( Helpers::findById( cc() , ns.c_str() , id, fullObj ) ) {
+                            if ( ! isInRange( fullObj , min , max , shardKeyPattern ) ) {
+                                log() << "not applying out of range deletion: " << fullObj << migrateLog;
 
-                            continue;
+                                continue;
+                            }
                         }
-                    }
 
-                    // id object most likely has form { _id : ObjectId(...) }
-                    // infer from that correct index to use, e.g. { _id : 1 }
-                    BSONObj idIndexPattern = Helpers::inferKeyPattern( id );
+                        // id object most likely has form { _id : ObjectId(...) }
+                        // infer from that correct index to use, e.g. { _id : 1 }
+                        BSONObj idIndexPattern = Helpers::inferKeyPattern( id );
 
-                    // TODO: create a better interface to remove objects directly
-                    KeyRange range( ns, id, id, idIndexPattern );
-                    Helpers::removeRange( range ,
-                                          true , /*maxInclusive*/
-                                          false , /* secondaryThrottle */
-                                          serverGlobalParams.moveParanoia ? &rs : 0 , /*callback*/
-                                          true ); /*fromMigrate*/
+                        // TODO: create a better interface to remove objects directly
+                        KeyRange range( ns, id, id, idIndexPattern );
+                        Helpers::removeRange( range ,
+                                              true , /*maxInclusive*/
+                                              false , /* secondaryThrottle */
+                                              serverGlobalParams.moveParanoia ? &rs : 0 , /*callback*/
+                                              true ); /*fromMigrate*/
 
-                    *lastOpApplied = cx.ctx().getClient()->getLastOp().asDate();
-                    didAnything = true;
+                        *lastOpApplied = cx.ctx().getClient()->getLastOp().asDate();
+                        didAnything = true;
+                    }
                 }
             }
 
@@ -1946,27 +2211,29 @@ namespace mongo {
                 while ( i.more() ) {
                     Client::WriteContext cx(ns);
 
-                    BSONObj it = i.next().Obj();
+                    for ( size_t n = 0; n < maxMigrateDocsPerWriteLock && i.more(); n++ ) {
+                        BSONObj it = i.next().Obj();
 
-                    BSONObj localDoc;
-                    if ( willOverrideLocalId( it, &localDoc ) ) {
-                        string errMsg =
-                            str::stream() << "cannot migrate chunk, local document "
-                                          << localDoc
-                                          << " has same _id as reloaded remote document "
-                                          << it;
+                        BSONObj localDoc;
+                        if ( willOverrideLocalId( it, &localDoc ) ) {
+                            string errMsg =
+                                str::stream() << "cannot migrate chunk, local document "
+                                              << localDoc
+                                              << " has same _id as reloaded remote document "
+                                              << it;
 
-                        warning() << errMsg << endl;
+                            warning() << errMsg << endl;
 
-                        // Exception will abort migration cleanly
-                        uasserted( 16977, errMsg );
-                    }
+                            // Exception will abort migration cleanly
+                            uasserted( 16977, errMsg );
+                        }
 
-                    // We are in write lock here, so sure we aren't killing
-                    Helpers::upsert( ns , it , true );
+                        // We are in write lock here, so sure we aren't killing
+                        Helpers::upsert( ns , it , true );
 
-                    *lastOpApplied = cx.ctx().getClient()->getLastOp().asDate();
-                    didAnything = true;
+                        *lastOpApplied = cx.ctx().getClient()->getLastOp().asDate();
+                        didAnything = true;
+                    }
                 }
             }
 
@@ -341,6 +341,13 @@ static bool runMongosServer( bool doUpgrade ) {
     MessageServer::Options opts;
     opts.port = serverGlobalParams.port;
     opts.ipList = serverGlobalParams.bind_ip;
+    // ShardedMessageHandler can't move connections between threads: shard connections are
+    // pooled per thread, and getLastError must reach the connections a client wrote through.
+    // So mongos always keeps a thread per connection.
+    if (serverGlobalParams.netWorkerThreads > 0) {
+        warning() << "mongos keeps a thread per connection, ignoring netWorkerThreads" << endl;
+    }
+    opts.workerThreads = 0;
     start(opts);
 
     // listen() will return when exit code closes its socket.
@@ -31,9 +31,65 @@
 #include "mongo/util/compress.h"
 
 #include "snappy.h"
+#include "snappy-sinksource.h"
 
 namespace mongo {
 
+    namespace {
+
+        /** A snappy::Source over a list of buffers, so they needn't be copied together first. */
+        class BufferListSource : public snappy::Source {
+        public:
+            explicit BufferListSource(const std::vector<std::pair<const char*, size_t> >& buffers)
+                : _buffers(buffers), _current(0), _offset(0), _left(0) {
+                for (size_t i = 0; i < _buffers.size(); ++i) {
+                    _left += _buffers[i].second;
+                }
+                skipEmpty();
+            }
+
+            virtual size_t Available() const { return _left; }
+
+            virtual const char* Peek(size_t* len) {
+                if (_current == _buffers.size()) {
+                    *len = 0;
+                    return NULL;
+                }
+                *len = _buffers[_current].second - _offset;
+                return _buffers[_current].first + _offset;
+            }
+
+            virtual void Skip(size_t n) {
+                _left -= n;
+                while (n > 0) {
+                    const size_t inBuffer = _buffers[_current].second - _offset;
+                    if (n < inBuffer) {
+                        _offset += n;
+                        return;
+                    }
+                    n -= inBuffer;
+                    ++_current;
+                    _offset = 0;
+                }
+                skipEmpty();
+            }
+
+        private:
+            void skipEmpty() {
+                while (_current < _buffers.size() && _offset == _buffers[_current].second) {
+                    ++_current;
+                    _offset = 0;
+                }
+            }
+
+            const std::vector<std::pair<const char*, size_t> >& _buffers;
+            size_t _current;
+            size_t _offset;
+            size_t _left;
+        };
+
+    }  // namespace
+
     void rawCompress(const char* input,
         size_t input_length,
         char* compressed,
@@ -54,4 +110,21 @@ namespace mongo {
         return snappy::Uncompress(compressed, compressed_length, uncompressed);
     }
 
+    size_t rawCompress(const std::vector<std::pair<const char*, size_t> >& buffers,
+                       char* compressed) {
+        BufferListSource source(buffers);
+        snappy::UncheckedByteArraySink sink(compressed);
+        return snappy::Compress(&source, &sink);
+    }
+
+    bool getUncompressedLength(const char* compressed,
+                               size_t compressed_length,
+                               size_t* result) {
+        return snappy::GetUncompressedLength(compressed, compressed_length, result);
+    }
+
+    bool rawUncompress(const char* compressed, size_t compressed_length, char* uncompressed) {
+        return snappy::RawUncompress(compressed, compressed_length, uncompressed);
+    }
+
 }
@@ -31,6 +31,8 @@
 #pragma once
 
 #include <string>
+#include <utility>
+#include <vector>
 
 namespace mongo { 
 
@@ -44,6 +46,20 @@ namespace mongo {
         char* compressed,
         size_t* compressed_length);
 
+    /**
+     * Compresses the concatenation of 'buffers' into 'compressed', which must have room for
+     * maxCompressedLength() of their total length.  Returns the compressed length.
+     */
+    size_t rawCompress(const std::vector<std::pair<const char*, size_t> >& buffers,
+                       char* compressed);
+
+    bool getUncompressedLength(const char* compressed,
+                               size_t compressed_length,
+                               size_t* result);
+
+    /** 'uncompressed' must have room for getUncompressedLength() bytes. */
+    bool rawUncompress(const char* compressed, size_t compressed_length, char* uncompressed);
+
 }
 
 
@@ -59,6 +59,7 @@ namespace mongo {
         while( _lastDone < e ) {
             _condition.wait( lock.boost() );
         }
+        --_nWaiting;
     }
 
     void NotifyAll::awaitBeyondNow() { 
@@ -68,12 +69,14 @@ namespace mongo {
         while( _lastDone <= e ) {
             _condition.wait( lock.boost() );
         }
+        --_nWaiting;
     }
 
     void NotifyAll::notifyAll(When e) {
         scoped_lock lock( _mutex );
-        _lastDone = e;
-        _nWaiting = 0;
+        // pipelined group commits may notify out of order; never move backwards
+        if ( e > _lastDone )
+            _lastDone = e;
         _condition.notify_all();
     }
 
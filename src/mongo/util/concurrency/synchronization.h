@@ -68,7 +68,7 @@ namespace mongo {
         /** a bit faster than waitFor( now() ) */
         void awaitBeyondNow();
 
-        /** may be called multiple times. notifies all waiters */
+        /** may be called multiple times, in any order. notifies all waiters */
         void notifyAll(When);
 
         /** indicates how many threads are waiting for a notify. */
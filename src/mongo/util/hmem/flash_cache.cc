@@ -5,12 +5,14 @@
 #include <assert.h>
 #include <fcntl.h>
 #include <stdint.h>
+#include <stdio.h>
 #include <stdlib.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/mman.h>
 #include <unistd.h>
 
+#include <algorithm>
 #include <memory>
 #include <string>
 #include <vector>
@@ -58,33 +60,78 @@ bool FlashCache::Init(HybridMemory* hmem,
   // Init the page access history table.
   assert(page_stats_table_.Init(name + "-pg-stats-table", total_flash_pages) ==
          true);
-  // Open the flash-cache file.
-  flash_fd_ =
-      open(flash_filename.c_str(), O_CREAT | O_RDWR | O_TRUNC | O_DIRECT, 0666);
+  // Open the flash-cache file. Its content is kept if the detached pages
+  // saved by the last run can be loaded.
+  flash_fd_ = open(flash_filename.c_str(), O_CREAT | O_RDWR | O_DIRECT, 0666);
   if (flash_fd_ <= 0) {
     err("Unable to open flash file: %s\n", flash_filename.c_str());
     perror("Open file error.");
     assert(0);
   }
-  flash_file_size_ = total_flash_pages * PAGE_SIZE;
-  assert(ftruncate(flash_fd_, flash_file_size_) == 0);
-  dbg("Has opened flash-cache file: %s, size = %ld, %ld flash-pages\n",
-      flash_filename.c_str(), flash_file_size_, total_flash_pages);
-
   hybrid_memory_ = hmem;
   flash_filename_ = flash_filename;
+  metadata_filename_ = flash_filename + ".meta";
   name_ = name;
   total_flash_pages_ = total_flash_pages;
+  flash_file_size_ = total_flash_pages * PAGE_SIZE;
+  detached_pages_ = 0;
+  reattached_pages_ = 0;
+  bool warm = LoadMetadata();
+  // From now on the flash-cache file is modified without updating the
+  // metadata. After a crash, start cold.
+  unlink(metadata_filename_.c_str());
+  if (!warm) {
+    assert(ftruncate(flash_fd_, 0) == 0);
+  }
+  assert(ftruncate(flash_fd_, flash_file_size_) == 0);
+  dbg("Has opened flash-cache file: %s, size = %ld, %ld flash-pages, "
+      "%ld detached pages\n",
+      flash_filename.c_str(), flash_file_size_, total_flash_pages,
+      detached_pages_);
+
   hits_count_ = 0;
+  writeback_cursor_ = 0;
   overflow_pages_ = 0;
+  flash_writes_ = 0;
+  hdd_writes_ = 0;
   max_evict2hdd_latency_usec_ = 0;
   total_evict2hdd_pages_ = 0;
+
+  // Each read-ahead IO takes a request for the hdd read, and one for the
+  // flash write of each page in the chunk.
+  uint64_t chunk_size = PAGE_SIZE << VADDRESS_CHUNK_BITS;
+  assert(posix_memalign((void**)&readahead_buffer_,
+                        alignment,
+                        chunk_size * READAHEAD_MAX_IOS) == 0);
+  for (uint32_t i = 0; i < READAHEAD_MAX_IOS; ++i) {
+    readahead_ios_[i].flash_cache = this;
+    readahead_ios_[i].pending_ios = 0;
+    readahead_ios_[i].buffer = readahead_buffer_ + chunk_size * i;
+  }
+  readahead_ios_in_flight_ = 0;
+  readahead_pages_ = 0;
+  readahead_enabled_ = readahead_asyncio_manager_.Init(
+      READAHEAD_MAX_IOS * ((1ULL << VADDRESS_CHUNK_BITS) + 1));
+  if (!readahead_enabled_) {
+    err("Unable to init asyncio.  Will not read ahead hdd files.\n");
+  }
   ready_ = true;
   return ready_;
 }
 
 void FlashCache:: Release() {
   if (ready_) {
+    while (readahead_ios_in_flight_ > 0) {
+      readahead_asyncio_manager_.Wait(1, NULL);
+    }
+    readahead_asyncio_manager_.Release();
+    free(readahead_buffer_);
+    readahead_buffer_ = NULL;
+    if (detached_pages_ > 0 && SaveMetadata() == false) {
+      err("%s: unable to save detached pages, the flash-cache will start "
+          "cold\n", name_.c_str());
+    }
+    detached_files_.clear();
     page_allocate_table_.Release();
     page_stats_table_.Release();
     close(flash_fd_);
@@ -232,6 +279,7 @@ uint32_t FlashCache::MigrateToHDD(
                                                   (void *)v2hmap,
                                                   (void *)(&aux_buffer_list_));
           requests.push_back(request);
+          ++hdd_writes_;
         }
       } else {
         assert(pread(flash_fd_, data_buffer, io_size,
@@ -240,6 +288,7 @@ uint32_t FlashCache::MigrateToHDD(
                       hdd_file_offset) == io_size);
 
         aux_buffer_list_.push_back(data_buffer);
+        ++hdd_writes_;
         v2hmap->dirty_flash_cache = 0;
         v2hmap->exist_flash_cache = 0;
         v2hmap->exist_hdd_file = 1;
@@ -274,10 +323,33 @@ uint32_t FlashCache::MigrateToHDD(
 }
 
 uint32_t FlashCache::EvictItems(uint32_t pages_to_evict) {
+  std::vector<uint64_t> candidates;
+  uint32_t candidate_pages =
+      page_stats_table_.FindPagesWithMinCount(pages_to_evict, &candidates);
+  assert(candidate_pages > 0);
+
+  // Pages being written in background stay until their writes complete.
+  // Detached pages have nothing to write back, free them right away.
   std::vector<uint64_t> pages;
-  uint32_t evicted_pages =
-      page_stats_table_.FindPagesWithMinCount(pages_to_evict, &pages);
-  assert(evicted_pages > 0);
+  uint32_t detached_pages = 0;
+  for (uint32_t i = 0; i < candidate_pages; ++i) {
+    F2VMapItem* f2vmap = &f2v_map_[candidates[i]];
+    if (f2vmap->vaddress_range_id == DETACHED_VADDRESS_RANGE_ID) {
+      FreeDetachedPage(candidates[i]);
+      ++detached_pages;
+      continue;
+    }
+    if (IsValidVAddressRangeId(f2vmap->vaddress_range_id)) {
+      V2HMapMetadata* v2hmap =
+          GetVAddressRangeFromId(f2vmap->vaddress_range_id)->GetV2HMapMetadata(
+              (uint64_t)f2vmap->vaddress_page_offset << PAGE_BITS);
+      if (v2hmap->io_pending) {
+        continue;
+      }
+    }
+    pages.push_back(candidates[i]);
+  }
+  uint32_t evicted_pages = pages.size();
 
   // If have backing hdd file, shall write dirty pages to back hdd.
   std::vector<uint64_t> flash_pages_writeto_hdd;
@@ -301,6 +373,8 @@ uint32_t FlashCache::EvictItems(uint32_t pages_to_evict) {
     }
   }
   if (flash_pages_writeto_hdd.size() > 0) {
+    // The flusher should have cleaned these. Let it catch up.
+    hybrid_memory_->GetPageFlusher()->Wakeup();
     MigrateToHDD(flash_pages_writeto_hdd);
   }
 
@@ -331,7 +405,383 @@ uint32_t FlashCache::EvictItems(uint32_t pages_to_evict) {
     f2vmap->vaddress_range_id = INVALID_VADDRESS_RANGE_ID;
     f2vmap->vaddress_page_offset = 0;
   }
-  return evicted_pages;
+  return evicted_pages + detached_pages;
+}
+
+bool FlashCache::AllocatePage(V2HMapMetadata* v2hmap,
+                              uint32_t vaddress_range_id,
+                              uint64_t vaddress_page_offset,
+                              uint64_t* flash_page_number) {
+  if (v2hmap->exist_flash_cache) {
+    assert(v2hmap->flash_page_offset < total_flash_pages_);
+    *flash_page_number = v2hmap->flash_page_offset;
+    F2VMapItem* f2vmap = &f2v_map_[*flash_page_number];
+    assert(f2vmap->vaddress_page_offset == vaddress_page_offset);
+    assert(f2vmap->vaddress_range_id == vaddress_range_id);
+    return true;
+  }
+  if (page_allocate_table_.AllocateOnePage(flash_page_number) == false) {
+    // Evict some pages from flash-cache to make space.  Pages with
+    // in-flight background writes can't be evicted, so try harder if
+    // the first round only found those.
+    uint32_t pages_to_evict = 16;
+    EvictItems(pages_to_evict);
+    if (page_allocate_table_.AllocateOnePage(flash_page_number) == false) {
+      EvictItems(pages_to_evict * 16);
+    }
+    if (page_allocate_table_.AllocateOnePage(flash_page_number) == false) {
+      err("Unable to alloc flash page even after evict: virt-page %ld at "
+          "vaddr-range-id %d\n",
+          vaddress_page_offset,
+          vaddress_range_id);
+      return false;
+    }
+  }
+  assert(
+      !IsValidVAddressRangeId(f2v_map_[*flash_page_number].vaddress_range_id));
+  return true;
+}
+
+void FlashCache::MapPage(uint64_t flash_page_number,
+                         V2HMapMetadata* v2hmap,
+                         uint32_t vaddress_range_id,
+                         uint64_t vaddress_page_offset) {
+  f2v_map_[flash_page_number].vaddress_page_offset = vaddress_page_offset;
+  f2v_map_[flash_page_number].vaddress_range_id = vaddress_range_id;
+
+  v2hmap->exist_flash_cache = 1;
+  v2hmap->flash_page_offset = flash_page_number;
+  page_stats_table_.IncreaseAccessCount(flash_page_number, 1);
+}
+
+int FlashCache::FindDetachedFile(const std::string& hdd_filename) {
+  for (uint32_t i = 0; i < detached_files_.size(); ++i) {
+    if (detached_files_[i].in_use &&
+        detached_files_[i].hdd_filename == hdd_filename) {
+      return i;
+    }
+  }
+  return -1;
+}
+
+static bool SameHDDFileVersion(const HDDFileVersion& a,
+                               const HDDFileVersion& b) {
+  return a.inode == b.inode && a.size == b.size &&
+         a.generation == b.generation;
+}
+
+uint32_t FlashCache::BeginDetach(VAddressRange* vaddr_range,
+                                 const HDDFileVersion& version) {
+  int detached_file = FindDetachedFile(vaddr_range->hdd_filename());
+  if (detached_file >= 0) {
+    // Another range of the same file was unmapped before. Its pages are
+    // still good if the file hasn't changed since.
+    if (SameHDDFileVersion(detached_files_[detached_file].version, version)) {
+      return detached_file;
+    }
+    DropDetachedFile(detached_file);
+  }
+  for (detached_file = 0; detached_file < (int)detached_files_.size();
+       ++detached_file) {
+    if (!detached_files_[detached_file].in_use) {
+      break;
+    }
+  }
+  if (detached_file == (int)detached_files_.size()) {
+    // The id goes to the 24-bit page offset of F2VMapItem.
+    assert(detached_files_.size() < (1ULL << 24));
+    detached_files_.push_back(DetachedFile());
+  }
+  DetachedFile* file = &detached_files_[detached_file];
+  file->in_use = true;
+  file->hdd_filename = vaddr_range->hdd_filename();
+  file->version = version;
+  file->pages.clear();
+  return detached_file;
+}
+
+void FlashCache::DetachPage(uint32_t detached_file,
+                            uint64_t flash_page_number) {
+  assert(detached_file < detached_files_.size());
+  assert(detached_files_[detached_file].in_use);
+  F2VMapItem* f2vmap = &f2v_map_[flash_page_number];
+  assert(IsValidVAddressRangeId(f2vmap->vaddress_range_id));
+  VAddressRange* vaddress_range =
+      GetVAddressRangeFromId(f2vmap->vaddress_range_id);
+  V2HMapMetadata* v2hmap = vaddress_range->GetV2HMapMetadata(
+      (uint64_t)f2vmap->vaddress_page_offset << PAGE_BITS);
+  assert(v2hmap->dirty_flash_cache == 0);
+  assert(v2hmap->io_pending == 0);
+
+  DetachedPage page;
+  page.hdd_page = (vaddress_range->hdd_file_offset() >> PAGE_BITS) +
+                  f2vmap->vaddress_page_offset;
+  page.flash_page = flash_page_number;
+  detached_files_[detached_file].pages.push_back(page);
+  v2hmap->exist_flash_cache = 0;
+  f2vmap->vaddress_range_id = DETACHED_VADDRESS_RANGE_ID;
+  f2vmap->vaddress_page_offset = detached_file;
+  ++detached_pages_;
+}
+
+uint64_t FlashCache::ReattachPages(VAddressRange* vaddr_range) {
+  int detached_file = FindDetachedFile(vaddr_range->hdd_filename());
+  if (detached_file < 0) {
+    return 0;
+  }
+  DetachedFile* file = &detached_files_[detached_file];
+  if (!SameHDDFileVersion(file->version, vaddr_range->hdd_file_version())) {
+    dbg("%s: hdd file %s has changed since it was detached, drop %ld "
+        "pages\n",
+        name_.c_str(),
+        file->hdd_filename.c_str(),
+        file->pages.size());
+    DropDetachedFile(detached_file);
+    return 0;
+  }
+  uint64_t first_hdd_page = vaddr_range->hdd_file_offset() >> PAGE_BITS;
+  uint64_t number_pages = vaddr_range->size() >> PAGE_BITS;
+  uint32_t instance_id = hybrid_memory_->instance_id();
+  uint32_t number_instances = hybrid_memory_->number_instances();
+  uint64_t reattached = 0;
+  for (uint64_t i = 0; i < file->pages.size(); ++i) {
+    DetachedPage* page = &file->pages[i];
+    if (!IsDetachedPage(page->flash_page, detached_file)) {
+      // Evicted since.
+      continue;
+    }
+    // The range may map another part of the file, and pages may have
+    // moved to other hmem instances if the number of instances changed.
+    uint64_t page_offset = page->hdd_page - first_hdd_page;
+    if (page->hdd_page < first_hdd_page || page_offset >= number_pages ||
+        (page_offset >> VADDRESS_CHUNK_BITS) % number_instances !=
+            instance_id) {
+      FreeDetachedPage(page->flash_page);
+      continue;
+    }
+    V2HMapMetadata* v2hmap =
+        vaddr_range->GetV2HMapMetadata(page_offset << PAGE_BITS);
+    assert(v2hmap->exist_flash_cache == 0);
+    F2VMapItem* f2vmap = &f2v_map_[page->flash_page];
+    f2vmap->vaddress_range_id = vaddr_range->vaddress_range_id();
+    f2vmap->vaddress_page_offset = page_offset;
+    v2hmap->exist_flash_cache = 1;
+    v2hmap->dirty_flash_cache = 0;
+    v2hmap->flash_page_offset = page->flash_page;
+    --detached_pages_;
+    ++reattached;
+  }
+  reattached_pages_ += reattached;
+  file->in_use = false;
+  std::vector<DetachedPage>().swap(file->pages);
+  return reattached;
+}
+
+void FlashCache::FreeDetachedPage(uint64_t flash_page_number) {
+  F2VMapItem* f2vmap = &f2v_map_[flash_page_number];
+  assert(f2vmap->vaddress_range_id == DETACHED_VADDRESS_RANGE_ID);
+  page_allocate_table_.FreePage(flash_page_number);
+  f2vmap->vaddress_range_id = INVALID_VADDRESS_RANGE_ID;
+  f2vmap->vaddress_page_offset = 0;
+  --detached_pages_;
+}
+
+void FlashCache::DropDetachedFile(uint32_t detached_file) {
+  DetachedFile* file = &detached_files_[detached_file];
+  for (uint64_t i = 0; i < file->pages.size(); ++i) {
+    if (IsDetachedPage(file->pages[i].flash_page, detached_file)) {
+      FreeDetachedPage(file->pages[i].flash_page);
+    }
+  }
+  file->in_use = false;
+  std::vector<DetachedPage>().swap(file->pages);
+}
+
+// Layout of the metadata file: a MetadataHeader, then for each hdd file a
+// MetadataFile, its name, and its MetadataPage records, then the magic
+// number again to tell a complete file.
+static const uint64_t kMetadataMagic = 0x686d656d666c7368ULL;  // "hmemflsh"
+
+static const uint32_t kMetadataVersion = 1;
+
+struct MetadataHeader {
+  uint64_t magic;
+  uint32_t version;
+  uint32_t number_files;
+  uint64_t total_flash_pages;
+};
+
+struct MetadataFile {
+  HDDFileVersion version;
+  uint64_t filename_length;
+  uint64_t number_pages;
+};
+
+struct MetadataPage {
+  uint64_t hdd_page;
+  uint64_t flash_page;
+  uint64_t access_count;
+};
+
+bool FlashCache::SaveMetadata() {
+  // Detached pages must be on flash before the metadata refers to them.
+  if (fdatasync(flash_fd_) != 0) {
+    perror("fdatasync error: ");
+    return false;
+  }
+  std::string tmp_filename = metadata_filename_ + ".tmp";
+  FILE* fp = fopen(tmp_filename.c_str(), "w");
+  if (fp == NULL) {
+    err("Unable to create %s\n", tmp_filename.c_str());
+    return false;
+  }
+  MetadataHeader header;
+  header.magic = kMetadataMagic;
+  header.version = kMetadataVersion;
+  header.number_files = 0;
+  header.total_flash_pages = total_flash_pages_;
+  for (uint32_t i = 0; i < detached_files_.size(); ++i) {
+    if (detached_files_[i].in_use) {
+      ++header.number_files;
+    }
+  }
+  bool success = fwrite(&header, sizeof(header), 1, fp) == 1;
+  uint64_t saved_pages = 0;
+  for (uint32_t i = 0; success && i < detached_files_.size(); ++i) {
+    DetachedFile* file = &detached_files_[i];
+    if (!file->in_use) {
+      continue;
+    }
+    std::vector<MetadataPage> pages;
+    for (uint64_t j = 0; j < file->pages.size(); ++j) {
+      if (IsDetachedPage(file->pages[j].flash_page, i)) {
+        MetadataPage page;
+        page.hdd_page = file->pages[j].hdd_page;
+        page.flash_page = file->pages[j].flash_page;
+        page.access_count = page_stats_table_.AccessCount(page.flash_page);
+        pages.push_back(page);
+      }
+    }
+    MetadataFile record;
+    record.version = file->version;
+    record.filename_length = file->hdd_filename.size();
+    record.number_pages = pages.size();
+    success = fwrite(&record, sizeof(record), 1, fp) == 1 &&
+              fwrite(file->hdd_filename.data(),
+                     record.filename_length,
+                     1,
+                     fp) == 1 &&
+              (pages.empty() ||
+               fwrite(&pages[0], sizeof(MetadataPage), pages.size(), fp) ==
+                   pages.size());
+    saved_pages += pages.size();
+  }
+  success = success &&
+            fwrite(&kMetadataMagic, sizeof(kMetadataMagic), 1, fp) == 1 &&
+            fflush(fp) == 0 && fsync(fileno(fp)) == 0;
+  if (fclose(fp) != 0) {
+    success = false;
+  }
+  if (!success || rename(tmp_filename.c_str(), metadata_filename_.c_str())) {
+    err("Unable to write %s\n", metadata_filename_.c_str());
+    unlink(tmp_filename.c_str());
+    return false;
+  }
+  dbg("%s: saved %ld detached pages of %d hdd files to %s\n",
+      name_.c_str(),
+      saved_pages,
+      header.number_files,
+      metadata_filename_.c_str());
+  return true;
+}
+
+bool FlashCache::LoadMetadata() {
+  FILE* fp = fopen(metadata_filename_.c_str(), "r");
+  if (fp == NULL) {
+    return false;
+  }
+  // Read everything first, and take the pages only if it's all consistent.
+  std::vector<DetachedFile> files;
+  std::vector<MetadataPage> all_pages;
+  MetadataHeader header;
+  struct stat flash_stat;
+  bool success = fstat(flash_fd_, &flash_stat) == 0 &&
+                 (uint64_t)flash_stat.st_size == flash_file_size_ &&
+                 fread(&header, sizeof(header), 1, fp) == 1 &&
+                 header.magic == kMetadataMagic &&
+                 header.version == kMetadataVersion &&
+                 header.total_flash_pages == total_flash_pages_;
+  for (uint32_t i = 0; success && i < header.number_files; ++i) {
+    MetadataFile record;
+    if (fread(&record, sizeof(record), 1, fp) != 1 ||
+        record.filename_length == 0 || record.filename_length > 4096 ||
+        record.number_pages > total_flash_pages_) {
+      success = false;
+      break;
+    }
+    files.push_back(DetachedFile());
+    DetachedFile* file = &files.back();
+    file->in_use = true;
+    file->version = record.version;
+    file->hdd_filename.resize(record.filename_length);
+    std::vector<MetadataPage> pages(record.number_pages);
+    if (fread(&file->hdd_filename[0], record.filename_length, 1, fp) != 1 ||
+        (record.number_pages > 0 &&
+         fread(&pages[0], sizeof(MetadataPage), pages.size(), fp) !=
+             pages.size())) {
+      success = false;
+      break;
+    }
+    for (uint64_t j = 0; j < pages.size(); ++j) {
+      DetachedPage page;
+      page.hdd_page = pages[j].hdd_page;
+      page.flash_page = pages[j].flash_page;
+      file->pages.push_back(page);
+    }
+    all_pages.insert(all_pages.end(), pages.begin(), pages.end());
+  }
+  uint64_t magic = 0;
+  success = success && fread(&magic, sizeof(magic), 1, fp) == 1 &&
+            magic == kMetadataMagic;
+  fclose(fp);
+
+  std::vector<bool> seen(total_flash_pages_, false);
+  for (uint64_t i = 0; success && i < all_pages.size(); ++i) {
+    if (all_pages[i].flash_page >= total_flash_pages_ ||
+        seen[all_pages[i].flash_page]) {
+      success = false;
+    } else {
+      seen[all_pages[i].flash_page] = true;
+    }
+  }
+  if (!success) {
+    err("%s: ignore inconsistent metadata file %s\n",
+        name_.c_str(),
+        metadata_filename_.c_str());
+    return false;
+  }
+
+  detached_files_.swap(files);
+  for (uint32_t i = 0; i < detached_files_.size(); ++i) {
+    std::vector<DetachedPage>& pages = detached_files_[i].pages;
+    for (uint64_t j = 0; j < pages.size(); ++j) {
+      assert(page_allocate_table_.AllocateThisPage(pages[j].flash_page));
+      f2v_map_[pages[j].flash_page].vaddress_range_id =
+          DETACHED_VADDRESS_RANGE_ID;
+      f2v_map_[pages[j].flash_page].vaddress_page_offset = i;
+      ++detached_pages_;
+    }
+  }
+  for (uint64_t i = 0; i < all_pages.size(); ++i) {
+    page_stats_table_.IncreaseAccessCount(all_pages[i].flash_page,
+                                          all_pages[i].access_count);
+  }
+  dbg("%s: loaded %ld detached pages of %ld hdd files from %s\n",
+      name_.c_str(),
+      detached_pages_,
+      detached_files_.size(),
+      metadata_filename_.c_str());
+  return true;
 }
 
 bool FlashCache::AddPage(void* page,
@@ -349,42 +799,11 @@ bool FlashCache::AddPage(void* page,
 
   // A "flash-page number" is relative to the beginning of flash-cache file.
   uint64_t flash_page_number;
-  if (v2hmap->exist_flash_cache) {
-    assert(v2hmap->flash_page_offset < total_flash_pages_);
-    flash_page_number = v2hmap->flash_page_offset;
-    F2VMapItem* f2vmap = &f2v_map_[flash_page_number];
-    assert(f2vmap->vaddress_page_offset == vaddress_page_offset);
-    assert(f2vmap->vaddress_range_id == vaddress_range_id);
-    if (flash_page_number == 12288) {
-      dbg("^^^^^  pos 1: flash-page %ld for virt-page %ld, "
-          "vaddr-range %d, dirty = %d\n",
-          flash_page_number,
-          vaddress_page_offset,
-          vaddress_range_id,
-          is_dirty);
-    }
-  } else {
-    if (page_allocate_table_.AllocateOnePage(&flash_page_number) == false) {
-      // Evict some pages from flash-cache to make space.
-      uint32_t pages_to_evict = 16;
-      EvictItems(pages_to_evict);
-      if (page_allocate_table_.AllocateOnePage(&flash_page_number) == false) {
-        err("Unable to alloc flash page even after evict: virt-page %ld at "
-            "vaddr-range-id %d\n",
-            vaddress_page_offset,
-            vaddress_range_id);
-        assert(0);
-      }
-    }
-    if (flash_page_number == 12288) {
-      dbg("^^^^^  pos 2: alloc flash-page %ld for virt-page %ld, "
-          "vaddr-range %d\n",
-          flash_page_number,
-          vaddress_page_offset,
-          vaddress_range_id);
-    }
-    assert(
-        !IsValidVAddressRangeId(f2v_map_[flash_page_number].vaddress_range_id));
+  if (AllocatePage(v2hmap,
+                   vaddress_range_id,
+                   vaddress_page_offset,
+                   &flash_page_number) == false) {
+    assert(0);
   }
   if (!v2hmap->exist_flash_cache || is_dirty) {
     if (pwrite(flash_fd_, page, obj_size, flash_page_number << PAGE_BITS) !=
@@ -398,27 +817,49 @@ bool FlashCache::AddPage(void* page,
       perror("flash pwrite failed: ");
       return false;
     }
+    ++flash_writes_;
   }
 
-  f2v_map_[flash_page_number].vaddress_page_offset = vaddress_page_offset;
-  f2v_map_[flash_page_number].vaddress_range_id = vaddress_range_id;
-
-  v2hmap->exist_flash_cache = 1;
+  MapPage(flash_page_number, v2hmap, vaddress_range_id, vaddress_page_offset);
   v2hmap->dirty_flash_cache = is_dirty;
-  v2hmap->flash_page_offset = flash_page_number;
-  page_stats_table_.IncreaseAccessCount(flash_page_number, 1);
-  if (flash_page_number == 12288) {
-    dbg("flash page %ld <=> virt-page %ld: dirty=%d, access-count=%ld, "
-        "vaddress-range-id=%d\n",
-        flash_page_number,
-        vaddress_page_offset,
-        is_dirty,
-        page_stats_table_.AccessCount(flash_page_number),
-        vaddress_range_id);
-  }
   return true;
 }
 
+uint32_t FlashCache::GetDirtyPagesForWriteback(
+    uint32_t max_pages,
+    uint32_t scan_limit,
+    std::vector<uint64_t>* flash_pages) {
+  uint32_t pages_found = 0;
+  for (uint32_t scanned = 0;
+       scanned < scan_limit && scanned < total_flash_pages_ &&
+           pages_found < max_pages;
+       ++scanned) {
+    uint64_t flash_page_number = writeback_cursor_;
+    if (++writeback_cursor_ >= total_flash_pages_) {
+      writeback_cursor_ = 0;
+    }
+    F2VMapItem* f2vmap = &f2v_map_[flash_page_number];
+    if (!IsValidVAddressRangeId(f2vmap->vaddress_range_id)) {
+      continue;
+    }
+    VAddressRange* vaddress_range =
+        GetVAddressRangeFromId(f2vmap->vaddress_range_id);
+    if (vaddress_range->hdd_file_fd() <= 0) {
+      continue;
+    }
+    V2HMapMetadata* v2hmap = vaddress_range->GetV2HMapMetadata(
+        (uint64_t)f2vmap->vaddress_page_offset << PAGE_BITS);
+    // Skip pages with a newer copy in upper layers, that copy will come
+    // through flash again before it's written to hdd.
+    if (v2hmap->dirty_flash_cache && !v2hmap->dirty_ram_cache &&
+        !v2hmap->dirty_page_cache && !v2hmap->io_pending) {
+      flash_pages->push_back(flash_page_number);
+      ++pages_found;
+    }
+  }
+  return pages_found;
+}
+
 bool FlashCache::LoadPage(void* data,
                           uint64_t obj_size,
                           uint64_t flash_page_number,
@@ -430,18 +871,34 @@ bool FlashCache::LoadPage(void* data,
   assert((uint64_t)data % 512 == 0);
   assert(obj_size == PAGE_SIZE);
 
-  if (pread(flash_fd_, data, obj_size, flash_page_number << PAGE_BITS) !=
-      (ssize_t)obj_size) {
-    err("Failed to read flash-cache %s: flash-page %ld, to vaddr-range %d, "
-        "page %ld\n",
-        flash_filename_.c_str(),
+  if (ReadPage(data, flash_page_number) == false) {
+    err("Failed to load flash-page %ld to vaddr-range %d, page %ld\n",
         flash_page_number,
         vaddress_range_id,
         vaddress_page_offset);
+    return false;
+  }
+  TouchPage(flash_page_number);
+  return true;
+}
+
+uint32_t FlashCache::PageAccessCount(V2HMapMetadata* v2hmap) {
+  if (!v2hmap->exist_flash_cache) {
+    return 0;
+  }
+  return page_stats_table_.AccessCount(v2hmap->flash_page_offset);
+}
+
+bool FlashCache::ReadPage(void* data, uint64_t flash_page_number) {
+  assert(flash_page_number < total_flash_pages_);
+  if (pread(flash_fd_, data, PAGE_SIZE, flash_page_number << PAGE_BITS) !=
+      (ssize_t)PAGE_SIZE) {
+    err("Failed to read flash-cache %s: flash-page %ld\n",
+        flash_filename_.c_str(),
+        flash_page_number);
     perror("flash pread failed: ");
     return false;
   }
-  page_stats_table_.IncreaseAccessCount(flash_page_number, 1);
   return true;
 }
 
@@ -449,43 +906,271 @@ bool FlashCache::LoadFromHDDFile(VAddressRange* vaddr_range,
                                  void* page,
                                  V2HMapMetadata* v2hmap,
                                  bool read_ahead) {
+  if (read_ahead) {
+    ReadAhead(vaddr_range, page);
+  }
+  return ReadFromHDDFile(vaddr_range, page, page);
+}
+
+void FlashCache::ReadAhead(VAddressRange* vaddr_range, void* page) {
+  if (!readahead_enabled_ || vaddr_range->hdd_file_fd() <= 0) {
+    return;
+  }
+  if (readahead_ios_in_flight_ > 0) {
+    readahead_asyncio_manager_.Poll(READAHEAD_MAX_IOS);
+  }
+  // Count chunks of this instance only: with N instances, the chunk after
+  // chunk "c" in a stream that this instance sees is chunk "c + N".
+  uint32_t instances = hybrid_memory_->number_instances();
+  uint64_t page_offset = vaddr_range->GetPageOffset(page);
+  uint64_t chunk = (page_offset >> VADDRESS_CHUNK_BITS) / instances;
+  AccessStream* stream = page_stats_table_.RecordStreamAccess(
+      vaddr_range->vaddress_range_id(), chunk);
+  uint64_t total_chunks =
+      ((vaddr_range->size() >> PAGE_BITS) + (1ULL << VADDRESS_CHUNK_BITS) -
+       1) >> VADDRESS_CHUNK_BITS;
+  for (uint64_t c = std::max(chunk + 1, stream->readahead_end);
+       c <= chunk + stream->window;
+       ++c) {
+    uint64_t vaddr_chunk = c * instances + hybrid_memory_->instance_id();
+    if (vaddr_chunk >= total_chunks ||
+        StartReadAhead(vaddr_range, vaddr_chunk) == false) {
+      break;
+    }
+    stream->readahead_end = c + 1;
+  }
+}
+
+bool FlashCache::StartReadAhead(VAddressRange* vaddr_range, uint64_t chunk) {
+  ReadAheadIO* io = NULL;
+  for (uint32_t i = 0; i < READAHEAD_MAX_IOS; ++i) {
+    if (readahead_ios_[i].pending_ios == 0) {
+      io = &readahead_ios_[i];
+      break;
+    }
+  }
+  if (io == NULL) {
+    return false;
+  }
+  io->vaddr_range = vaddr_range;
+  io->first_page = chunk << VADDRESS_CHUNK_BITS;
+  io->pages = std::min<uint64_t>(1ULL << VADDRESS_CHUNK_BITS,
+                                 (vaddr_range->size() >> PAGE_BITS) -
+                                     io->first_page);
+  // Only pages that exist nowhere but in the hdd file are read ahead.
+  io->page_mask = 0;
+  for (uint32_t i = 0; i < io->pages; ++i) {
+    V2HMapMetadata* v2hmap =
+        vaddr_range->GetV2HMapMetadata((io->first_page + i) << PAGE_BITS);
+    if (v2hmap->exist_hdd_file && !v2hmap->exist_page_cache &&
+        !v2hmap->exist_ram_cache && !v2hmap->exist_flash_cache &&
+        !v2hmap->io_pending) {
+      v2hmap->io_pending = 1;
+      io->page_mask |= 1U << i;
+    }
+  }
+  if (io->page_mask == 0) {
+    return true;
+  }
+  AsyncIORequest* request = readahead_asyncio_manager_.GetRequest();
+  assert(request != NULL);
+  request->Prepare(vaddr_range->hdd_file_fd(),
+                   io->buffer,
+                   (uint64_t)io->pages << PAGE_BITS,
+                   (io->first_page << PAGE_BITS) + vaddr_range->hdd_file_offset(),
+                   READ);
+  request->AddCompletionCallback(ReadAheadReadCompletion, io, NULL);
+  io->pending_ios = 1;
+  ++readahead_ios_in_flight_;
+  if (readahead_asyncio_manager_.Submit(request) == false) {
+    request->RunCompletionCallbacks(-1);
+    readahead_asyncio_manager_.FreeRequest(request);
+    return false;
+  }
+  return true;
+}
+
+void FlashCache::ReadAheadReadCompletion(AsyncIORequest* request,
+                                         int result,
+                                         void* param1,
+                                         void* param2) {
+  ReadAheadIO* io = (ReadAheadIO*)param1;
+  io->flash_cache->InstallReadAhead(io, result);
+}
+
+void FlashCache::InstallReadAhead(ReadAheadIO* io, int result) {
+  // A short read at the end of the hdd file still brings in the pages
+  // before the end.
+  uint64_t pages_read = result > 0 ? (uint64_t)result >> PAGE_BITS : 0;
+  uint32_t vaddress_range_id = io->vaddr_range->vaddress_range_id();
+  for (uint32_t i = 0; i < io->pages; ++i) {
+    if (!(io->page_mask & (1U << i))) {
+      continue;
+    }
+    uint64_t vaddress_page_offset = io->first_page + i;
+    V2HMapMetadata* v2hmap = io->vaddr_range->GetV2HMapMetadata(
+        vaddress_page_offset << PAGE_BITS);
+    uint64_t flash_page_number;
+    if (i >= pages_read || AllocatePage(v2hmap,
+                                        vaddress_range_id,
+                                        vaddress_page_offset,
+                                        &flash_page_number) == false) {
+      v2hmap->io_pending = 0;
+      io->page_mask &= ~(1U << i);
+      continue;
+    }
+    // The page is mapped before its data is written, "io_pending" keeps
+    // faults away from it until then.
+    MapPage(flash_page_number, v2hmap, vaddress_range_id, vaddress_page_offset);
+    v2hmap->dirty_flash_cache = 0;
+    AsyncIORequest* request = readahead_asyncio_manager_.GetRequest();
+    assert(request != NULL);
+    request->Prepare(flash_fd_,
+                     io->buffer + ((uint64_t)i << PAGE_BITS),
+                     PAGE_SIZE,
+                     flash_page_number << PAGE_BITS,
+                     WRITE);
+    request->AddCompletionCallback(
+        ReadAheadWriteCompletion, io, (void*)(uint64_t)i);
+    ++io->pending_ios;
+    if (readahead_asyncio_manager_.Submit(request) == false) {
+      request->RunCompletionCallbacks(-1);
+      readahead_asyncio_manager_.FreeRequest(request);
+    }
+  }
+  // The hdd read itself.
+  if (--io->pending_ios == 0) {
+    --readahead_ios_in_flight_;
+  }
+}
+
+void FlashCache::ReadAheadWriteCompletion(AsyncIORequest* request,
+                                          int result,
+                                          void* param1,
+                                          void* param2) {
+  ReadAheadIO* io = (ReadAheadIO*)param1;
+  uint32_t i = (uint32_t)(uint64_t)param2;
+  FlashCache* flash_cache = io->flash_cache;
+  V2HMapMetadata* v2hmap = io->vaddr_range->GetV2HMapMetadata(
+      (io->first_page + i) << PAGE_BITS);
+  v2hmap->io_pending = 0;
+  if (result != (int)PAGE_SIZE) {
+    err("Failed to write read-ahead page to flash-cache %s: flash-page %d\n",
+        flash_cache->flash_filename_.c_str(),
+        v2hmap->flash_page_offset);
+    flash_cache->RemovePage(v2hmap->flash_page_offset);
+  } else {
+    ++flash_cache->flash_writes_;
+    ++flash_cache->readahead_pages_;
+  }
+  io->page_mask &= ~(1U << i);
+  if (--io->pending_ios == 0) {
+    --flash_cache->readahead_ios_in_flight_;
+  }
+}
+
+void FlashCache::WaitForReadAhead(VAddressRange* vaddr_range, void* page) {
+  if (readahead_ios_in_flight_ == 0) {
+    return;
+  }
+  uint64_t page_offset = vaddr_range->GetPageOffset(page);
+  for (uint32_t i = 0; i < READAHEAD_MAX_IOS; ++i) {
+    ReadAheadIO* io = &readahead_ios_[i];
+    // "page_mask" bits are cleared as the pages land.
+    while (io->pending_ios > 0 && io->vaddr_range == vaddr_range &&
+           page_offset >= io->first_page &&
+           page_offset < io->first_page + io->pages &&
+           (io->page_mask & (1U << (page_offset - io->first_page)))) {
+      readahead_asyncio_manager_.Wait(1, NULL);
+    }
+  }
+}
+
+void FlashCache::DrainReadAhead(uint32_t vaddress_range_id) {
+  while (readahead_ios_in_flight_ > 0) {
+    readahead_asyncio_manager_.Wait(1, NULL);
+  }
+  page_stats_table_.ResetStream(vaddress_range_id);
+}
+
+bool FlashCache::ReadFromHDDFile(VAddressRange* vaddr_range,
+                                 void* page,
+                                 void* data) {
+  assert(vaddr_range->hdd_file_fd() > 0);
   uint64_t hdd_file_offset = (uint64_t)page - (uint64_t)vaddr_range->address() +
                              vaddr_range->hdd_file_offset();
   ssize_t read_size = PAGE_SIZE;
-  assert(!read_ahead);  // NOT support read ahead right now.
-  if (!read_ahead) {
-    if (pread(vaddr_range->hdd_file_fd(), page, read_size, hdd_file_offset) !=
-        read_size) {
-      err("Failed to read hdd-file at flash-cache %s: vaddr-range %d, "
-          "page %p\n",
-          name_.c_str(),
-          vaddr_range->vaddress_range_id(),
-          page);
-      perror("flash-cache read hdd-file failed: ");
-      return false;
-    }
-  } else {
-    read_size = PAGE_SIZE << VADDRESS_CHUNK_BITS;
-    uint64_t virtual_chunk =
-        (uint64_t)page & ~((1ULL << (PAGE_BITS + VADDRESS_CHUNK_BITS)) - 1);
-    hdd_file_offset = virtual_chunk - (uint64_t)vaddr_range->address() +
-                      vaddr_range->hdd_file_offset();
-    // TODO: at read-ahead mode, read an entire chunk from hdd file,
-    // and save these pages to flash.
+  if (pread(vaddr_range->hdd_file_fd(), data, read_size, hdd_file_offset) !=
+      read_size) {
+    err("Failed to read hdd-file at flash-cache %s: vaddr-range %d, "
+        "page %p\n",
+        name_.c_str(),
+        vaddr_range->vaddress_range_id(),
+        page);
+    perror("flash-cache read hdd-file failed: ");
+    return false;
+  }
+  return true;
+}
+
+bool FlashCache::WriteToHDDFile(VAddressRange* vaddr_range,
+                                void* page,
+                                void* data) {
+  assert(vaddr_range->hdd_file_fd() > 0);
+  assert((uint64_t)data % PAGE_SIZE == 0);
+  uint64_t hdd_file_offset = (uint64_t)page - (uint64_t)vaddr_range->address() +
+                             vaddr_range->hdd_file_offset();
+  ssize_t write_size = PAGE_SIZE;
+  if (pwrite(vaddr_range->hdd_file_fd(), data, write_size, hdd_file_offset) !=
+      write_size) {
+    err("Failed to write hdd-file at flash-cache %s: vaddr-range %d, "
+        "page %p\n",
+        name_.c_str(),
+        vaddr_range->vaddress_range_id(),
+        page);
+    perror("flash-cache write hdd-file failed: ");
+    return false;
   }
+  ++hdd_writes_;
   return true;
 }
 
+void FlashCache::RemovePage(uint64_t flash_page_number) {
+  assert(flash_page_number < total_flash_pages_);
+  F2VMapItem* f2vmap = &f2v_map_[flash_page_number];
+  if (!IsValidVAddressRangeId(f2vmap->vaddress_range_id)) {
+    err("will remove flash page %ld, but its f2vmap->vaddr_rang_id "
+        "is invalid: %d\n",
+        flash_page_number,
+        f2vmap->vaddress_range_id);
+    assert(0);
+  }
+  VAddressRange* vaddress_range =
+      GetVAddressRangeFromId(f2vmap->vaddress_range_id);
+  V2HMapMetadata* v2hmap = vaddress_range->GetV2HMapMetadata(
+      (uint64_t)f2vmap->vaddress_page_offset << PAGE_BITS);
+  v2hmap->dirty_flash_cache = 0;
+  v2hmap->exist_flash_cache = 0;
+  page_allocate_table_.FreePage(flash_page_number);
+
+  f2vmap->vaddress_range_id = INVALID_VADDRESS_RANGE_ID;
+  f2vmap->vaddress_page_offset = 0;
+}
+
 void FlashCache::ShowStats() {
   printf(
       "\n\n*****\tflash-cache: %s, flash-file: %s, total-flash pages %ld,\n"
       "used-flash-pages %ld, available flash pages %ld\n"
-      "max-evict-lat %ld usec (write %ld pages)\n",
+      "max-evict-lat %ld usec (write %ld pages), read-ahead %ld pages\n"
+      "detached pages %ld, reattached pages %ld\n",
       name_.c_str(),
       flash_filename_.c_str(),
       total_flash_pages_,
       page_allocate_table_.used_pages(),
       page_allocate_table_.free_pages(),
       max_evict2hdd_latency_usec_,
-      evict2hdd_pages_);
+      evict2hdd_pages_,
+      readahead_pages_,
+      detached_pages_,
+      reattached_pages_);
 }
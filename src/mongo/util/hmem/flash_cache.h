@@ -10,11 +10,17 @@
 #include <unistd.h>
 
 #include <queue>
+#include <string>
+#include <vector>
+
+#include "asyncio_manager.h"
+#include "asyncio_request.h"
 #include "hash_table.h"
 #include "lru_list.h"
 #include "free_list.h"
 #include "page_allocation_table.h"
 #include "page_stats_table.h"
+#include "vaddr_range.h"
 
 struct V2HMapMetadata;
 class HybridMemory;
@@ -31,9 +37,27 @@ struct F2VMapItem {
 
 // Flash cache is the 3rd layer of cache that stores all
 // pages that overflows from 2st layer (RAM-cache).
+//
+// Sequential streams from hdd files are read ahead into this layer. Each
+// fault records its chunk in the vaddr-range's AccessStream, and once the
+// faults move from chunk to chunk the next "window" chunks are read with
+// async-ios. A page being read ahead has "io_pending" set until its copy is
+// in the flash-cache.
+//
+// When an hdd file is unmapped, the clean flash copies of its pages stay
+// in this layer as "detached" pages, owned by DETACHED_VADDRESS_RANGE_ID.
+// Mapping the file again reattaches them, unless the file has changed in
+// the meantime. Detached pages are evicted like any other page. On
+// Release() they are saved to a metadata file next to the flash-cache
+// file, and Init() loads them again, so the flash-cache starts warm after
+// a restart.
 class FlashCache {
  public:
-  FlashCache() : ready_(false), hybrid_memory_(NULL), f2v_map_(NULL) {}
+  FlashCache()
+      : ready_(false),
+        hybrid_memory_(NULL),
+        f2v_map_(NULL),
+        readahead_buffer_(NULL) {}
 
   virtual ~FlashCache() { Release(); }
 
@@ -57,6 +81,28 @@ class FlashCache {
                uint32_t vaddress_range_id,
                void* virtual_page_address);
 
+  // Find the flash page to cache the virtual-page described by "v2hmap".
+  // This is the page already holding a copy of the virtual-page, or
+  // a newly allocated page, evicting other pages if needed.
+  bool AllocatePage(V2HMapMetadata* v2hmap,
+                    uint32_t vaddress_range_id,
+                    uint64_t vaddress_page_offset,
+                    uint64_t* flash_page_number);
+
+  // Record that "flash_page_number" caches the given virtual-page.
+  void MapPage(uint64_t flash_page_number,
+               V2HMapMetadata* v2hmap,
+               uint32_t vaddress_range_id,
+               uint64_t vaddress_page_offset);
+
+  // Sweep up to "scan_limit" flash pages, continuing from where the last
+  // sweep stopped, and collect up to "max_pages" dirty pages that can be
+  // written back to hdd files in background.
+  // Return the number of pages collected.
+  uint32_t GetDirtyPagesForWriteback(uint32_t max_pages,
+                                     uint32_t scan_limit,
+                                     std::vector<uint64_t>* flash_pages);
+
   // Load a flash page into memory.
   bool LoadPage(void* data,
                 uint64_t obj_size,
@@ -64,17 +110,76 @@ class FlashCache {
                 uint32_t vaddress_range_id,
                 uint64_t vaddress_page_offset);
 
+  // Read a flash page into "data" without updating any state, so that the
+  // caller may run without the hmem lock provided the page has "io_pending"
+  // set. Follow with TouchPage() under the lock.
+  bool ReadPage(void* data, uint64_t flash_page_number);
+
+  // Account an access to the flash page.
+  void TouchPage(uint64_t flash_page_number) {
+    page_stats_table_.IncreaseAccessCount(flash_page_number, 1);
+  }
+
+  // Access count of the flash copy of the virtual-page described by
+  // "v2hmap", or 0 if it has none.
+  uint32_t PageAccessCount(V2HMapMetadata* v2hmap);
+
   // Load a "page" from the HDD file that backs "vaddr_range".
   // "page" is the virtual-page in vaddress range, which is also the
   // offset into HDD file.
   // "v2hmap" is V2H metadata record for this virtual-page.
-  // If "read_ahead" is true, we will perform read-ahead to load
-  // the surrounding pages to leverage spatial locality.
+  // If "read_ahead" is true, the access is also recorded for read-ahead,
+  // see ReadAhead().
   bool LoadFromHDDFile(VAddressRange* vaddr_range,
                        void* page,
                        V2HMapMetadata* v2hmap,
                        bool read_ahead);
 
+  // Read the virtual-page "page" from the HDD file that backs "vaddr_range"
+  // into "data". Doesn't update any state, see ReadPage().
+  bool ReadFromHDDFile(VAddressRange* vaddr_range, void* page, void* data);
+
+  // Record a fault on "page" of "vaddr_range", and if the range is read
+  // sequentially, start reading ahead the chunks in its window that
+  // aren't in flight yet. Also installs completed read-aheads.
+  // Caller must hold the hmem lock.
+  void ReadAhead(VAddressRange* vaddr_range, void* page);
+
+  // If "page" of "vaddr_range" is being read ahead, wait until its copy is
+  // in the flash-cache. Caller must hold the hmem lock.
+  void WaitForReadAhead(VAddressRange* vaddr_range, void* page);
+
+  // Wait for all read-aheads, and forget the access pattern of
+  // "vaddress_range_id". Caller must hold the hmem lock.
+  void DrainReadAhead(uint32_t vaddress_range_id);
+
+  // Write a page of "data" to the HDD file that backs "vaddr_range".
+  // "page" is the virtual-page in vaddress range whose content is in "data".
+  // "data" must be page-aligned because the HDD file is opened with O_DIRECT.
+  bool WriteToHDDFile(VAddressRange* vaddr_range, void* page, void* data);
+
+  // Drop the cached copy in flash page "flash_page_number", and return the
+  // flash page to the free pool. The copy is not written back to HDD.
+  void RemovePage(uint64_t flash_page_number);
+
+  // Start detaching the flash pages of file-backed "vaddr_range", whose
+  // hdd file is at "version" with all cached pages written back.
+  // Return the id to pass to DetachPage(). Caller must hold the hmem lock.
+  uint32_t BeginDetach(VAddressRange* vaddr_range,
+                       const HDDFileVersion& version);
+
+  // Keep the clean copy in flash page "flash_page_number" as a detached
+  // page of the hdd file "detached_file". Caller must hold the hmem lock.
+  void DetachPage(uint32_t detached_file, uint64_t flash_page_number);
+
+  // Reattach the detached pages of the hdd file that backs "vaddr_range",
+  // which this hmem instance caches in the range. If the file has changed
+  // since it was detached, its detached pages are dropped instead.
+  // Return the number of pages reattached. Caller must hold the hmem lock.
+  uint64_t ReattachPages(VAddressRange* vaddr_range);
+
+  int flash_fd() const { return flash_fd_; }
+
   // Get the F2V map item for a given flash page.
   F2VMapItem* GetItem(uint64_t page_number) { return &f2v_map_[page_number]; }
 
@@ -89,10 +194,113 @@ class FlashCache {
 
   void Dump();
 
+  // Number of pages that have been written to the flash-cache file.
+  uint64_t flash_writes() const { return flash_writes_; }
+
+  // Number of pages that have been written back to backing HDD files.
+  uint64_t hdd_writes() const { return hdd_writes_; }
+
+  // Number of pages read ahead from HDD files into the flash-cache.
+  uint64_t readahead_pages() const { return readahead_pages_; }
+
+  // Number of detached pages currently in the flash-cache.
+  uint64_t detached_pages() const { return detached_pages_; }
+
+  // Number of pages that have been reattached.
+  uint64_t reattached_pages() const { return reattached_pages_; }
+
  protected:
+  // A detached flash page, and the page number in the hdd file whose
+  // clean copy it holds.
+  struct DetachedPage {
+    uint64_t hdd_page;
+    uint64_t flash_page;
+  };
+
+  // The detached pages of one hdd file.
+  struct DetachedFile {
+    bool in_use;
+
+    std::string hdd_filename;
+
+    // Version of the hdd file when it was detached.
+    HDDFileVersion version;
+
+    // Pages that have been evicted since are still in this list, but
+    // they're no longer owned by this file, see IsDetachedPage().
+    std::vector<DetachedPage> pages;
+  };
+
+  // Return the id of the detached file of "hdd_filename", or -1.
+  int FindDetachedFile(const std::string& hdd_filename);
+
+  // Check if "flash_page_number" is still a detached page of
+  // "detached_file".
+  bool IsDetachedPage(uint64_t flash_page_number, uint32_t detached_file) {
+    F2VMapItem* f2vmap = &f2v_map_[flash_page_number];
+    return f2vmap->vaddress_range_id == DETACHED_VADDRESS_RANGE_ID &&
+           f2vmap->vaddress_page_offset == detached_file;
+  }
+
+  // Return a detached page to the free pool.
+  void FreeDetachedPage(uint64_t flash_page_number);
+
+  // Free all pages of "detached_file", and forget the file.
+  void DropDetachedFile(uint32_t detached_file);
+
+  // Load the detached pages saved by the last Release(), if they are
+  // consistent with this flash-cache. Return true if pages were loaded,
+  // in which case the flash-cache file content must be kept.
+  bool LoadMetadata();
+
+  // Save all detached pages to the metadata file.
+  bool SaveMetadata();
+  // An in-flight read-ahead of one chunk: an hdd read of the whole chunk,
+  // then a flash write for each page that's read ahead.
+  struct ReadAheadIO {
+    FlashCache* flash_cache;
+
+    VAddressRange* vaddr_range;
+
+    // Page offset in "vaddr_range" of the first page of the chunk.
+    uint64_t first_page;
+
+    uint32_t pages;
+
+    // Bit "i" is set while page "first_page + i" is being read ahead.
+    uint32_t page_mask;
+
+    // Async-ios not completed yet. The slot is free when it's 0.
+    uint32_t pending_ios;
+
+    // Page-aligned buffer of a chunk.
+    uint8_t* buffer;
+  };
+
+  // Start reading ahead chunk "chunk" of "vaddr_range".
+  // Return false if no more read-aheads can be started now.
+  bool StartReadAhead(VAddressRange* vaddr_range, uint64_t chunk);
+
+  // Save the pages of a completed hdd read to flash. "result" is
+  // the result of the read.
+  void InstallReadAhead(ReadAheadIO* io, int result);
+
+  static void ReadAheadReadCompletion(AsyncIORequest* request,
+                                      int result,
+                                      void* param1,
+                                      void* param2);
+
+  static void ReadAheadWriteCompletion(AsyncIORequest* request,
+                                       int result,
+                                       void* param1,
+                                       void* param2);
+
   // Backing flash-cache file.
   std::string flash_filename_;
 
+  // Detached pages are saved in this file across restarts.
+  std::string metadata_filename_;
+
   // File handle to the flash file.
   int flash_fd_;
 
@@ -138,11 +346,41 @@ class FlashCache {
 
   uint64_t total_evict2hdd_pages_;
 
+  // Next flash page to look at for background writeback.
+  uint64_t writeback_cursor_;
+
   // How many lookup are hits.
   uint64_t hits_count_;
 
   // How many pages have overflowed from this layer.
   uint64_t overflow_pages_;
+
+  uint64_t flash_writes_;
+
+  uint64_t hdd_writes_;
+
+  // Read-ahead IOs go through a private async-io context, and their
+  // completions are reaped with the hmem lock held.
+  AsyncIOManager readahead_asyncio_manager_;
+
+  bool readahead_enabled_;
+
+  ReadAheadIO readahead_ios_[READAHEAD_MAX_IOS];
+
+  uint32_t readahead_ios_in_flight_;
+
+  // READAHEAD_MAX_IOS chunk-size buffers, one for each ReadAheadIO.
+  uint8_t* readahead_buffer_;
+
+  uint64_t readahead_pages_;
+
+  // Indexed by detached file id. Ids of files that have been reattached
+  // or dropped are reused.
+  std::vector<DetachedFile> detached_files_;
+
+  uint64_t detached_pages_;
+
+  uint64_t reattached_pages_;
 };
 
 #endif  // FLASH_CACHE_H_
@@ -21,14 +21,18 @@
 // Each class T is supposed to contain following fields:
 //   "void *data":  the payload field of the obj.
 //
-// This class is NOT thread safe.
+// This class is thread safe. Available objs form a lock-free stack linked
+// by obj index. The stack top is packed with a version tag into one 64-bit
+// word, so that a CAS fails if the top was popped and pushed back in
+// between (the ABA problem).
 template <class T>
 class FreeList {
  public:
   FreeList()
       : ready_(false),
         all_objects_(NULL),
-        list_(NULL),
+        next_(NULL),
+        top_(0),
         objects_data_(NULL),
         total_objects_(0),
         available_objects_(0) {}
@@ -51,7 +55,8 @@ class FreeList {
 
   void ShowStats();
 
-  // Get number of available objects.
+  // Get number of available objects. Exact only if no other thread is
+  // calling New() or Free() at the same time.
   uint64_t AvailObjects() { return available_objects_; }
 
   uint64_t TotalObjects() { return total_objects_; }
@@ -63,8 +68,12 @@ class FreeList {
   // A contiguous memory area to store all objects.
   T* all_objects_;
 
-  // An array to store pointers to available objects.
-  T** list_;
+  // Index of the obj below all_objects_[i] in the stack of available
+  // objects, or kEmpty at the bottom.
+  uint32_t* next_;
+
+  // Stack top: version tag in high 32 bits, obj index in low 32 bits.
+  volatile uint64_t top_;
 
   // If each object has a "data" field, we pre-allocate a memory-space
   // and assign a piece of mem from this space to each object.
@@ -86,8 +95,17 @@ class FreeList {
   bool pin_memory_;
 
   std::string name_;
+
+  static const uint32_t kEmpty = 0xffffffff;
+
+  static uint64_t MakeTop(uint32_t tag, uint32_t index) {
+    return ((uint64_t)tag << 32) | index;
+  }
 };
 
+template <class T>
+const uint32_t FreeList<T>::kEmpty;
+
 template <class T>
 bool FreeList<T>::Init(const std::string& name,
                        uint64_t total_objects,
@@ -95,24 +113,25 @@ bool FreeList<T>::Init(const std::string& name,
                        bool page_align,
                        bool pin_memory) {
   assert(ready_ == false);
+  assert(total_objects < kEmpty);
   total_objects_ = total_objects;
   page_align_ = page_align;
   pin_memory_ = pin_memory;
   object_datasize_ = RoundUpToPageSize(object_datasize);
   uint64_t total_objects_size = total_objects_ * sizeof(T);
-  uint64_t total_list_size = total_objects_ * sizeof(T*);
+  uint64_t total_list_size = total_objects_ * sizeof(uint32_t);
   uint64_t total_objects_datasize = total_objects_ * object_datasize_;
   uint32_t alignment = PAGE_SIZE;
   if (page_align) {
     assert(posix_memalign((void **)&all_objects_, alignment,
                           total_objects_size) == 0);
-    assert(posix_memalign((void **)&list_, alignment, total_list_size) == 0);
+    assert(posix_memalign((void **)&next_, alignment, total_list_size) == 0);
   } else {
     dbg("FreeList<>: allocate %ld class objects with new[]\n", total_objects);
     all_objects_ = new T[total_objects];
     assert(all_objects_);
-    list_ = new T*[total_objects];
-    assert(list_);
+    next_ = new uint32_t[total_objects];
+    assert(next_);
   }
   if (object_datasize_ > 0) {
     dbg("page-align freelist %s: pre-allocate data area %ld for %ld objs\n",
@@ -123,7 +142,7 @@ bool FreeList<T>::Init(const std::string& name,
 
   if (pin_memory_) {
     assert(mlock(all_objects_, total_objects_size) == 0);
-    assert(mlock(list_, total_list_size) == 0);
+    assert(mlock(next_, total_list_size) == 0);
     if (object_datasize_ > 0) {
       assert(mlock(objects_data_, total_objects_datasize) == 0);
     }
@@ -135,8 +154,10 @@ bool FreeList<T>::Init(const std::string& name,
       all_objects_[i].data = (void *)data;
       data += object_datasize_;
     }
-    list_[i] = &all_objects_[i];
+    next_[i] = (i == 0) ? kEmpty : i - 1;
   }
+  // The last obj is on top, it's handed out first.
+  top_ = MakeTop(0, total_objects_ > 0 ? total_objects_ - 1 : kEmpty);
   available_objects_ = total_objects_;
   name_ = name;
   dbg("Have inited freelist \"%s\": %ld objs, obj-datasize %ld, "
@@ -155,17 +176,17 @@ bool FreeList<T>::Release() {
     dbg("Release free-list \"%s\"...\n", name_.c_str());
     if (pin_memory_) {
       munlock(all_objects_, total_objects_ * sizeof(T));
-      munlock(list_, total_objects_ * sizeof(T*));
+      munlock(next_, total_objects_ * sizeof(uint32_t));
       if (object_datasize_ > 0) {
         munlock(objects_data_, total_objects_ * object_datasize_);
       }
     }
     if (page_align_) {
       free(all_objects_);
-      free(list_);
+      free(next_);
     } else {
       delete[] all_objects_;
-      delete[] list_;
+      delete[] next_;
     }
     if (object_datasize_ > 0) {
       free(objects_data_);
@@ -178,15 +199,35 @@ bool FreeList<T>::Release() {
 
 template <class T>
 T* FreeList<T>::New() {
-  if (available_objects_ == 0) {
-    return NULL;
+  while (true) {
+    uint64_t top = top_;
+    uint32_t index = (uint32_t)top;
+    if (index == kEmpty) {
+      return NULL;
+    }
+    // If another thread pops "index" first, next_[index] may be stale,
+    // but then the tag has changed and the CAS fails.
+    uint64_t new_top = MakeTop((uint32_t)(top >> 32) + 1, next_[index]);
+    if (__sync_bool_compare_and_swap(&top_, top, new_top)) {
+      __sync_fetch_and_sub(&available_objects_, 1);
+      return &all_objects_[index];
+    }
   }
-  return list_[--available_objects_];
 }
 
 template <class T>
 void FreeList<T>::Free(T* x) {
-  list_[available_objects_++] = x;
+  assert(x >= all_objects_ && x < all_objects_ + total_objects_);
+  uint32_t index = x - all_objects_;
+  while (true) {
+    uint64_t top = top_;
+    next_[index] = (uint32_t)top;
+    uint64_t new_top = MakeTop((uint32_t)(top >> 32) + 1, index);
+    if (__sync_bool_compare_and_swap(&top_, top, new_top)) {
+      __sync_fetch_and_add(&available_objects_, 1);
+      return;
+    }
+  }
 }
 
 template <class T>
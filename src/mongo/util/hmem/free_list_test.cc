@@ -2,6 +2,7 @@
 // Author: Xiangyong Ouyang (neutronsharc@gmail.com)
 // Created on: 2011-11-11
 
+#include <pthread.h>
 #include <stdio.h>
 #include "free_list.h"
 
@@ -46,8 +47,65 @@ static void TestFreeList() {
   list.ShowStats();
 }
 
+struct ConcurrentTask {
+  FreeList<MyObj>* list;
+  pthread_t thread_id;
+  uint32_t id;
+  uint32_t rounds;
+};
+
+// Each thread repeatedly grabs a few objs, stamps them with its id, and
+// verifies nobody else got them before giving them back.
+static void* ConcurrentNewFree(void* arg) {
+  ConcurrentTask* task = (ConcurrentTask*)arg;
+  const uint32_t objs_per_round = 8;
+  MyObj* objs[objs_per_round];
+  for (uint32_t r = 0; r < task->rounds; ++r) {
+    uint32_t got = 0;
+    while (got < objs_per_round) {
+      MyObj* obj = task->list->New();
+      if (obj) {
+        obj->id = task->id;
+        objs[got++] = obj;
+      }
+    }
+    for (uint32_t i = 0; i < got; ++i) {
+      assert(objs[i]->id == task->id);
+      task->list->Free(objs[i]);
+    }
+  }
+  return NULL;
+}
+
+static void TestConcurrentFreeList() {
+  FreeList<MyObj> list;
+  uint32_t number_objects = 64;
+  uint32_t number_threads = 8;
+  assert(list.Init("concurrent list", number_objects, 0, false, false) ==
+         true);
+  ConcurrentTask tasks[number_threads];
+  for (uint32_t i = 0; i < number_threads; ++i) {
+    tasks[i].list = &list;
+    tasks[i].id = i;
+    tasks[i].rounds = 100000;
+    assert(pthread_create(&tasks[i].thread_id, NULL, ConcurrentNewFree,
+                          &tasks[i]) == 0);
+  }
+  for (uint32_t i = 0; i < number_threads; ++i) {
+    pthread_join(tasks[i].thread_id, NULL);
+  }
+  assert(list.AvailObjects() == number_objects);
+  // Every obj is back exactly once.
+  for (uint32_t i = 0; i < number_objects; ++i) {
+    assert(list.New() != NULL);
+  }
+  assert(list.New() == NULL);
+  list.ShowStats();
+}
+
 int main(int argc, char **argv) {
   TestFreeList();
+  TestConcurrentFreeList();
   printf("PASS.\n");
   return 0;
 }
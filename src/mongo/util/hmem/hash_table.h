@@ -2,6 +2,8 @@
 #define HASH_TABLE_H_
 
 #include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -18,12 +20,20 @@
 //   2. "hash_key" :  a field to identify the obj. Require this to be a void*.
 //   3. "key_size": byte size of the "key". == sizeof(void*)
 //
-// This class is NOT thread safe.
+// This class is thread safe. Each bucket has its own spinlock, so
+// operations on different buckets don't contend. Objs returned by Lookup()
+// and Remove() are no longer protected, the caller must ensure they stay
+// valid while being used. Stats counters are maintained with atomic ops,
+// except "deepest_collision" which is best-effort.
 template <class T>
 class HashTable {
  public:
   HashTable()
-      : ready_(false), buckets_(NULL), number_buckets_(0), number_objects_(0) {}
+      : ready_(false),
+        buckets_(NULL),
+        bucket_locks_(NULL),
+        number_buckets_(0),
+        number_objects_(0) {}
 
   virtual ~HashTable() {
     Release();
@@ -48,6 +58,7 @@ class HashTable {
   T* Remove(void* key, uint32_t key_size);
 
   // Find the address of pointer that points to an obj of "key".
+  // Caller must hold the lock of the bucket of "key".
   T** FindPrevObjPos(void* key, uint32_t key_size);
 
   uint64_t GetNumberObjects() { return number_objects_; }
@@ -63,6 +74,9 @@ class HashTable {
   // An array of hash-buckets.
   T** buckets_;
 
+  // One lock per bucket.
+  pthread_spinlock_t* bucket_locks_;
+
   // Number of elements in bucket-array.
   uint64_t number_buckets_;
 
@@ -84,6 +98,14 @@ class HashTable {
   uint64_t number_hits_;
   // How many times we get a lookup miss.
   uint64_t number_misses_;
+
+  uint64_t BucketIndex(void* key, uint32_t key_size) {
+    return hash(&key, key_size, 0) % number_buckets_;
+  }
+
+  // Walk the bucket at "bucket_idx" for "key". Caller holds the
+  // bucket lock.
+  T* LookupLocked(uint64_t bucket_idx, void* key);
 };
 
 template <class T>
@@ -97,6 +119,10 @@ bool HashTable<T>::Init(const std::string& name,
   // All buckets are empty at beginning.
   memset(buckets_, 0, total_byte_size);
   assert(mlock(buckets_, total_byte_size) == 0);
+  bucket_locks_ = new pthread_spinlock_t[number_buckets];
+  for (uint64_t i = 0; i < number_buckets; ++i) {
+    pthread_spin_init(&bucket_locks_[i], PTHREAD_PROCESS_PRIVATE);
+  }
 
   number_buckets_ = number_buckets;
   number_objects_ = 0;
@@ -119,6 +145,11 @@ bool HashTable<T>::Release() {
     uint64_t total_byte_size = number_buckets_ * sizeof(T*);
     munlock(buckets_, total_byte_size);
     free(buckets_);
+    for (uint64_t i = 0; i < number_buckets_; ++i) {
+      pthread_spin_destroy(&bucket_locks_[i]);
+    }
+    delete[] bucket_locks_;
+    bucket_locks_ = NULL;
     ready_ = 0;
     number_buckets_ = 0;
     number_objects_ = 0;
@@ -128,59 +159,61 @@ bool HashTable<T>::Release() {
 
 template <class T>
 bool HashTable<T>::Insert(T* obj, uint32_t key_size) {
-  ++number_inserts_;
-  if (Lookup((void*)obj->hash_key, key_size) != NULL) {
+  __sync_fetch_and_add(&number_inserts_, 1);
+  uint64_t bucket_idx = BucketIndex((void*)obj->hash_key, key_size);
+  pthread_spin_lock(&bucket_locks_[bucket_idx]);
+  if (LookupLocked(bucket_idx, (void*)obj->hash_key) != NULL) {
+    pthread_spin_unlock(&bucket_locks_[bucket_idx]);
     err("obj of key=%p already exists in hash table\n", obj->hash_key);
     return false;
   }
-  // In "lookup" we inc the number_lookups counter. This makes the meaning
-  // of "number_lookups" misleading.
-  // Decide to let "number_xxx" denote ONLY the number of xxx ops issued
-  // by users.
-  --number_lookups_;
-  --number_misses_;
-  uint32_t hash_value = hash(&obj->hash_key, key_size, 0);
-  uint32_t bucket_idx = hash_value % number_buckets_;
   obj->hash_next = buckets_[bucket_idx];
   buckets_[bucket_idx] = obj;
-  ++number_objects_;
+  pthread_spin_unlock(&bucket_locks_[bucket_idx]);
+  __sync_fetch_and_add(&number_objects_, 1);
   return true;
 }
 
 template <class T>
-T* HashTable<T>::Lookup(void* key, uint32_t key_size) {
-  ++number_lookups_;
-  uint32_t hash_value = hash(&key, key_size, 0);
-  uint32_t bucket_idx = hash_value % number_buckets_;
-
+T* HashTable<T>::LookupLocked(uint64_t bucket_idx, void* key) {
   T* obj = buckets_[bucket_idx];
-  uint32_t depth = 0;
+  uint64_t depth = 0;
   while (obj) {
     //if (key_size == obj->key_size &&
     //    memcmp(&key, &obj->hash_key, key_size) == key) {
     if (obj->hash_key == key) {
       break;
     }
-    ++number_collisions_;
     ++depth;
     obj = obj->hash_next;
   }
+  if (depth > 0) {
+    __sync_fetch_and_add(&number_collisions_, depth);
+  }
   if (depth > deepest_collision_) {
     deepest_collision_ = depth;
   }
+  return obj;
+}
+
+template <class T>
+T* HashTable<T>::Lookup(void* key, uint32_t key_size) {
+  __sync_fetch_and_add(&number_lookups_, 1);
+  uint64_t bucket_idx = BucketIndex(key, key_size);
+  pthread_spin_lock(&bucket_locks_[bucket_idx]);
+  T* obj = LookupLocked(bucket_idx, key);
+  pthread_spin_unlock(&bucket_locks_[bucket_idx]);
   if (obj) {
-    ++number_hits_;
+    __sync_fetch_and_add(&number_hits_, 1);
   } else {
-    ++number_misses_;
+    __sync_fetch_and_add(&number_misses_, 1);
   }
   return obj;
 }
 
 template <class T>
 T** HashTable<T>::FindPrevObjPos(void* key, uint32_t key_size) {
-  uint32_t hash_value = hash(&key, key_size, 0);
-  uint32_t bucket_idx = hash_value % number_buckets_;
-  T** obj = &(buckets_[bucket_idx]);
+  T** obj = &(buckets_[BucketIndex(key, key_size)]);
 
   while (*obj && (*obj)->hash_key != key) {
     obj = &((*obj)->hash_next);
@@ -190,18 +223,23 @@ T** HashTable<T>::FindPrevObjPos(void* key, uint32_t key_size) {
 
 template <class T>
 T* HashTable<T>::Remove(void* key, uint32_t key_size) {
-  ++number_removes_;
+  __sync_fetch_and_add(&number_removes_, 1);
+  uint64_t bucket_idx = BucketIndex(key, key_size);
+  pthread_spin_lock(&bucket_locks_[bucket_idx]);
   T** prev_obj_pos = FindPrevObjPos(key, key_size);
   T* target_obj = (*prev_obj_pos);
   if (target_obj == NULL) {
+    pthread_spin_unlock(&bucket_locks_[bucket_idx]);
     err("obj key %p not exist.\n", key);
     return NULL;
   }
 
   T* next_obj = (*prev_obj_pos)->hash_next;
   *prev_obj_pos = next_obj;
+  pthread_spin_unlock(&bucket_locks_[bucket_idx]);
 
   target_obj->hash_next = NULL;
+  __sync_fetch_and_sub(&number_objects_, 1);
   return target_obj;
 }
 
@@ -71,8 +71,62 @@ static void TestHashTable() {
   delete objs;
 }
 
+struct ConcurrentTask {
+  HashTable<TestObject>* hash_table;
+  TestObject* objs;
+  uint32_t number_objs;
+  pthread_t thread_id;
+};
+
+// Insert, look up and remove a disjoint set of objs.
+static void* ConcurrentAccess(void* arg) {
+  ConcurrentTask* task = (ConcurrentTask*)arg;
+  for (uint32_t round = 0; round < 10; ++round) {
+    for (uint32_t i = 0; i < task->number_objs; ++i) {
+      assert(task->hash_table->Insert(task->objs + i, sizeof(void*)) == true);
+    }
+    for (uint32_t i = 0; i < task->number_objs; ++i) {
+      assert(task->hash_table->Lookup(task->objs[i].hash_key,
+                                      sizeof(void*)) == task->objs + i);
+    }
+    for (uint32_t i = 0; i < task->number_objs; ++i) {
+      assert(task->hash_table->Remove(task->objs[i].hash_key,
+                                      sizeof(void*)) == task->objs + i);
+    }
+  }
+  return NULL;
+}
+
+static void TestConcurrentHashTable() {
+  HashTable<TestObject> hash_table;
+  uint32_t buckets = 1024;
+  uint32_t number_threads = 8;
+  uint32_t objs_per_thread = 10000;
+  assert(hash_table.Init("concurrent table", buckets, true) == true);
+
+  TestObject* objs = new TestObject[number_threads * objs_per_thread];
+  for (uint32_t i = 0; i < number_threads * objs_per_thread; ++i) {
+    objs[i].hash_key = (void*)((uint64_t)(i + 1) << 12);
+  }
+  ConcurrentTask tasks[number_threads];
+  for (uint32_t i = 0; i < number_threads; ++i) {
+    tasks[i].hash_table = &hash_table;
+    tasks[i].objs = objs + i * objs_per_thread;
+    tasks[i].number_objs = objs_per_thread;
+    assert(pthread_create(&tasks[i].thread_id, NULL, ConcurrentAccess,
+                          &tasks[i]) == 0);
+  }
+  for (uint32_t i = 0; i < number_threads; ++i) {
+    pthread_join(tasks[i].thread_id, NULL);
+  }
+  assert(hash_table.GetNumberObjects() == 0);
+  hash_table.ShowStats();
+  delete[] objs;
+}
+
 int main(int argc, char **argv) {
   TestHashTable();
+  TestConcurrentHashTable();
   printf("Test passed.\n");
   return 0;
 }
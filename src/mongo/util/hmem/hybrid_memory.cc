@@ -10,6 +10,7 @@
 #include "debug.h"
 #include "hybrid_memory.h"
 #include "page_cache.h"
+#include "page_flusher.h"
 #include "ram_cache.h"
 #include "sigsegv_handler.h"
 #include "vaddr_range.h"
@@ -18,7 +19,9 @@ bool HybridMemory::Init(const std::string &ssd_dirpath,
                         uint64_t page_buffer_size,
                         uint64_t ram_buffer_size,
                         uint64_t ssd_buffer_size,
-                        uint32_t hmem_intance_id) {
+                        uint32_t hmem_intance_id,
+                        uint32_t number_hmem_instances,
+                        ReplacementPolicyType replacement_policy) {
   assert(ready_ == false);
   page_buffer_size_ = page_buffer_size;
   ram_buffer_size_ = ram_buffer_size;
@@ -26,15 +29,29 @@ bool HybridMemory::Init(const std::string &ssd_dirpath,
   ssd_buffer_size_ = (ssd_buffer_size >> 20) << 20;
   assert(ssd_buffer_size_ > 0);
   hmem_instance_id_ = hmem_intance_id;
+  number_hmem_instances_ = number_hmem_instances;
   pthread_mutex_init(&lock_, NULL);
+  for (uint32_t i = 0; i < CHUNK_LOCK_STRIPES; ++i) {
+    pthread_mutex_init(&chunk_locks_[i], NULL);
+  }
 
   char name[64];
   sprintf(name, "hmem-%d", hmem_intance_id);
   std::string strname = name;
   std::string flash_filename = ssd_dirpath + "flashcache-" + strname;
-  assert(page_cache_.Init(this, strname + "-pagecache", page_buffer_size) ==
-         true);
-  assert(ram_cache_.Init(this, strname + "-ramcache", ram_buffer_size) == true);
+  assert(page_cache_.Init(this,
+                          strname + "-pagecache",
+                          page_buffer_size,
+                          replacement_policy) == true);
+  assert(ram_cache_.Init(this,
+                         strname + "-ramcache",
+                         ram_buffer_size,
+                         replacement_policy) == true);
+  assert(fault_io_buffers_.Init(strname + "-faultbuffers",
+                                FAULT_IO_BUFFERS,
+                                PAGE_SIZE,
+                                true,
+                                true) == true);
   assert(flash_cache_.Init(
       this, strname + "-flashcache", flash_filename, ssd_buffer_size) == true);
   if (asyncio_manager_.Init(MAX_OUTSTANDING_ASYNCIO) != true) {
@@ -43,15 +60,25 @@ bool HybridMemory::Init(const std::string &ssd_dirpath,
   } else {
     asyncio_enabled_ = true;
   }
+  // Without a flusher, dirty pages are still written out at eviction.
+  if (page_flusher_.Init(this,
+                         strname + "-flusher",
+                         FLUSHER_QUEUE_DEPTH,
+                         FLUSHER_BATCH_PAGES) != true) {
+    err("Unable to start page flusher.  Will write back at eviction.\n");
+  }
   ready_ = true;
   return ready_;
 }
 
 bool HybridMemory::Release() {
   if (ready_) {
+    // The flusher touches all cache layers, stop it first.
+    page_flusher_.Release();
     page_cache_.Release();
     ram_cache_.Release();
     flash_cache_.Release();
+    fault_io_buffers_.Release();
     if (asyncio_enabled_) {
       asyncio_manager_.Release();
     }
@@ -68,6 +95,23 @@ void HybridMemory::Unlock() {
   pthread_mutex_unlock(&lock_);
 }
 
+// Chunks are spread round-robin over hmem instances, so the chunks of one
+// instance are "number of instances" apart. Hash the chunk number so they
+// still cover all stripes.
+static uint32_t ChunkLockIndex(uint32_t vaddress_range_id, uint64_t chunk) {
+  uint64_t key = chunk ^ ((uint64_t)vaddress_range_id << 40);
+  return ((key * 0x9E3779B97F4A7C15ULL) >> 32) % CHUNK_LOCK_STRIPES;
+}
+
+void HybridMemory::LockChunk(uint32_t vaddress_range_id, uint64_t chunk) {
+  pthread_mutex_lock(&chunk_locks_[ChunkLockIndex(vaddress_range_id, chunk)]);
+}
+
+void HybridMemory::UnlockChunk(uint32_t vaddress_range_id, uint64_t chunk) {
+  pthread_mutex_unlock(
+      &chunk_locks_[ChunkLockIndex(vaddress_range_id, chunk)]);
+}
+
 HybridMemoryGroup::~HybridMemoryGroup() {
   Release();
 }
@@ -77,7 +121,8 @@ bool HybridMemoryGroup::Init(const std::string& ssd_dirpath,
                              uint64_t page_buffer_size,
                              uint64_t ram_buffer_size,
                              uint64_t ssd_buffer_size,
-                             uint32_t number_hmem_instances) {
+                             uint32_t number_hmem_instances,
+                             ReplacementPolicyType replacement_policy) {
   assert(number_hmem_instances <= MAX_HMEM_INSTANCES);
   ssd_dirpath_ = ssd_dirpath;
   page_buffer_size_ = page_buffer_size;
@@ -90,7 +135,9 @@ bool HybridMemoryGroup::Init(const std::string& ssd_dirpath,
                                  page_buffer_size / number_hmem_instances,
                                  ram_buffer_size / number_hmem_instances,
                                  ssd_buffer_size / number_hmem_instances,
-                                 i)) {
+                                 i,
+                                 number_hmem_instances,
+                                 replacement_policy)) {
       err("hmem instance %d failed to init.\n", i);
       return false;
     }
@@ -17,11 +17,27 @@
 #include "asyncio_request.h"
 #include "hybrid_memory_const.h"
 #include "flash_cache.h"
+#include "free_list.h"
 #include "page_cache.h"
+#include "page_flusher.h"
 #include "ram_cache.h"
 #include "sigsegv_handler.h"
 
+// A page-size buffer to read a faulting page into.
+struct FaultIOBuffer {
+  void* data;
+};
+
 // An instance of hybrid-memory.
+//
+// Two levels of locking:
+//   - a chunk lock, one of CHUNK_LOCK_STRIPES picked by chunk number, is
+//     held through a page fault, and serializes faults and hmem_sync() on
+//     pages of the chunk;
+//   - the instance lock protects the V2H metadata and all cache layers.
+// Always take a chunk lock before the instance lock. A fault drops the
+// instance lock while it reads a page from flash or hdd, so faults on other
+// chunks of this instance proceed in the meantime.
 class HybridMemory {
  public:
   HybridMemory() : ready_(false), asyncio_enabled_(false) {}
@@ -31,11 +47,15 @@ class HybridMemory {
   }
 
   // Allocate internal resources, setup internal structs.
+  // This is instance "hmem_intance_id" of a group of "number_hmem_instances".
+  // The page cache and the RAM cache use "replacement_policy".
   bool Init(const std::string &ssd_filename,
             uint64_t page_buffer_size,
             uint64_t ram_buffer_size,
             uint64_t ssd_buffer_size,
-            uint32_t hmem_intance_id);
+            uint32_t hmem_intance_id,
+            uint32_t number_hmem_instances,
+            ReplacementPolicyType replacement_policy);
 
   bool Release();
 
@@ -43,14 +63,30 @@ class HybridMemory {
 
   void Unlock();
 
+  void LockChunk(uint32_t vaddress_range_id, uint64_t chunk);
+
+  void UnlockChunk(uint32_t vaddress_range_id, uint64_t chunk);
+
+  // Return a page-aligned, page-size buffer, or NULL if all are in use.
+  // Safe without the instance lock.
+  FaultIOBuffer* GetFaultIOBuffer() { return fault_io_buffers_.New(); }
+
+  void PutFaultIOBuffer(FaultIOBuffer* buffer) {
+    fault_io_buffers_.Free(buffer);
+  }
+
   uint32_t instance_id() const { return hmem_instance_id_; }
 
+  uint32_t number_instances() const { return number_hmem_instances_; }
+
   PageCache* GetPageCache() { return &page_cache_; }
 
   RAMCache* GetRAMCache() { return &ram_cache_; }
 
   FlashCache* GetFlashCache() { return &flash_cache_; }
 
+  PageFlusher* GetPageFlusher() { return &page_flusher_; }
+
   bool support_asyncio() const { return asyncio_enabled_; }
 
   AsyncIOManager* asyncio_manager() { return &asyncio_manager_; }
@@ -67,10 +103,18 @@ class HybridMemory {
 
   pthread_mutex_t lock_;
 
+  pthread_mutex_t chunk_locks_[CHUNK_LOCK_STRIPES];
+
+  FreeList<FaultIOBuffer> fault_io_buffers_;
+
   std::string ssd_filename_;
 
   uint32_t hmem_instance_id_;
 
+  // Chunks of a vaddr-range are spread round-robin over this many
+  // instances.
+  uint32_t number_hmem_instances_;
+
   uint64_t page_buffer_size_;
   uint64_t ram_buffer_size_;
   uint64_t ssd_buffer_size_;
@@ -83,6 +127,9 @@ class HybridMemory {
 
   // L3 cache.
   FlashCache flash_cache_;
+
+  // Writes dirty pages of the RAM and flash caches in background.
+  PageFlusher page_flusher_;
 };
 
 // One process can create only one HybridMemoryGroup, because all threads in
@@ -97,7 +144,8 @@ class HybridMemoryGroup {
             uint64_t page_buffer_size,
             uint64_t ram_buffer_size,
             uint64_t ssd_buffer_size,
-            uint32_t number_hmem_instance);
+            uint32_t number_hmem_instance,
+            ReplacementPolicyType replacement_policy);
 
   bool Release();
 
@@ -110,6 +158,8 @@ class HybridMemoryGroup {
     return &hmem_instances_[hmem_id];
   }
 
+  uint32_t number_hmem_instances() const { return number_hmem_instances_; }
+
  protected:
   bool is_ready_;
 
@@ -31,4 +31,34 @@
 
 #define USE_ASYNCIO
 
+// Each hmem instance serializes faults on a chunk with one of this many
+// locks, picked by chunk number.
+#define CHUNK_LOCK_STRIPES (64)
+
+// Page-size buffers per hmem instance, for faults that read a page from
+// flash or hdd without holding the instance lock.
+#define FAULT_IO_BUFFERS (32)
+
+// Background page flusher: max outstanding async-ios, and max pages
+// written per batch.
+#define FLUSHER_QUEUE_DEPTH (32)
+#define FLUSHER_BATCH_PAGES (256)
+
+// Read-ahead from hdd files: a sequential stream reads up to this many
+// chunks ahead of the faulting page, and each hmem instance has at most
+// this many chunk reads in flight.
+#define READAHEAD_MAX_CHUNKS (8)
+#define READAHEAD_MAX_IOS (16)
+
+// Under the 2Q and ARC replacement policies, a page enters the page cache
+// and the RAM cache as a frequently used page if its access count in the
+// flash-cache's page stats table is at least this many times the moving
+// average of the counts of pages entering the cache. Counts only grow, so
+// a fixed threshold would be reached by every page that's scanned often.
+#define REPLACEMENT_FREQUENT_RATIO (4)
+
+// Weight of a new access count in the moving average is
+// 1 / 2^REPLACEMENT_AVERAGE_SHIFT.
+#define REPLACEMENT_AVERAGE_SHIFT (6)
+
 #endif  // HYBRID_MEMORY_CONST_H_
@@ -3,6 +3,8 @@
 // Created on: 2011-11-11
 
 #include <assert.h>
+#include <fcntl.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdint.h>
@@ -11,6 +13,8 @@
 #include <sys/ucontext.h>
 #include <unistd.h>
 
+#include <algorithm>
+
 #include "debug.h"
 #include "hybrid_memory.h"
 #include "hybrid_memory_lib.h"
@@ -22,8 +26,17 @@ static HybridMemoryGroup hmem_group;
 
 static VAddressRangeGroup vaddr_range_group;
 
+// Serializes allocation and release of vaddr-ranges against lookups
+// from the fault handler running in other threads. Faults only read the
+// group, so they share the lock.
+static pthread_rwlock_t vaddr_range_group_lock = PTHREAD_RWLOCK_INITIALIZER;
+
 static SigSegvHandler sigsegv_handler;
 
+// "/proc/self/mem", to fill a faulting page while it's still inaccessible
+// to other threads. -1 if unavailable.
+static int self_mem_fd = -1;
+
 static void SigSegvAction(int sig, siginfo_t* sig_info, void* ucontext);
 
 static uint64_t number_page_faults;
@@ -46,12 +59,27 @@ uint64_t FoundPages() { return found_pages; }
 
 uint64_t UnFoundPages() { return unfound_pages; }
 
+bool ParseReplacementPolicy(const std::string& name,
+                            ReplacementPolicyType* policy) {
+  if (name == "lru") {
+    *policy = REPLACEMENT_LRU;
+  } else if (name == "2q") {
+    *policy = REPLACEMENT_2Q;
+  } else if (name == "arc") {
+    *policy = REPLACEMENT_ARC;
+  } else {
+    return false;
+  }
+  return true;
+}
+
 bool InitHybridMemory(const std::string& ssd_dirpath,
                       const std::string& hmem_group_name,
                       uint64_t page_buffer_size,
                       uint64_t ram_buffer_size,
                       uint64_t ssd_buffer_size,
-                      uint32_t number_hmem_instance) {
+                      uint32_t number_hmem_instance,
+                      ReplacementPolicyType replacement_policy) {
   if (vaddr_range_group.Init() == false) {
     err("vaddr range group error\n");
     return false;
@@ -61,10 +89,16 @@ bool InitHybridMemory(const std::string& ssd_dirpath,
                       page_buffer_size,
                       ram_buffer_size,
                       ssd_buffer_size,
-                      number_hmem_instance) == false) {
+                      number_hmem_instance,
+                      replacement_policy) == false) {
     err("hmem group error\n");
     return false;
   }
+  self_mem_fd = open("/proc/self/mem", O_RDWR);
+  if (self_mem_fd < 0) {
+    err("Unable to open /proc/self/mem. Concurrent readers may see "
+        "partially loaded pages.\n");
+  }
   if (sigsegv_handler.InstallHandler(SigSegvAction) == false) {
     err("sigsegv handler error\n");
     return false;
@@ -75,31 +109,286 @@ bool InitHybridMemory(const std::string& ssd_dirpath,
 void ReleaseHybridMemory() {
   sigsegv_handler.UninstallHandler();
   hmem_group.Release();
+  if (self_mem_fd >= 0) {
+    close(self_mem_fd);
+    self_mem_fd = -1;
+  }
+}
+
+static VAddressRange* LookupVAddressRange(uint8_t* address) {
+  pthread_rwlock_rdlock(&vaddr_range_group_lock);
+  VAddressRange* vaddr_range = vaddr_range_group.FindVAddressRange(address);
+  pthread_rwlock_unlock(&vaddr_range_group_lock);
+  return vaddr_range;
 }
 
 void* hmem_map(const std::string& hdd_filename,
                uint64_t size,
                uint64_t hdd_file_offset) {
+  pthread_rwlock_wrlock(&vaddr_range_group_lock);
   VAddressRange* vaddr_range = vaddr_range_group.AllocateVAddressRange(
       size, hdd_filename, hdd_file_offset);
-  assert(vaddr_range != NULL);
+  pthread_rwlock_unlock(&vaddr_range_group_lock);
+  if (vaddr_range == NULL) {
+    err("Unable to map hdd file %s, size %ld\n", hdd_filename.c_str(), size);
+    return NULL;
+  }
+  // Pick up flash copies kept from when the file was last unmapped. No
+  // fault can hit the range before its address is returned.
+  uint64_t reattached_pages = 0;
+  for (uint32_t i = 0; i < hmem_group.number_hmem_instances(); ++i) {
+    HybridMemory* hmem = hmem_group.GetHybridMemoryFromInstanceId(i);
+    hmem->Lock();
+    reattached_pages += hmem->GetFlashCache()->ReattachPages(vaddr_range);
+    hmem->Unlock();
+  }
+  if (reattached_pages > 0) {
+    dbg("hdd file %s: reattached %ld flash pages\n",
+        hdd_filename.c_str(),
+        reattached_pages);
+  }
   return vaddr_range->address();
 }
 
 void* hmem_alloc(uint64_t size) {
+  pthread_rwlock_wrlock(&vaddr_range_group_lock);
   VAddressRange *vaddr_range = vaddr_range_group.AllocateVAddressRange(size);
+  pthread_rwlock_unlock(&vaddr_range_group_lock);
   assert(vaddr_range != NULL);
   return vaddr_range->address();
 }
 
+// Write a virtual-page back to the hdd file if any caching layer holds
+// data newer than the file. Copies in lower layers that are older than
+// the written data are dropped, the remaining copies become clean.
+// "buffer" is a page-aligned scratch page. Caller must hold hmem's lock.
+static bool SyncPage(HybridMemory* hmem,
+                     VAddressRange* vaddr_range,
+                     uint8_t* page,
+                     V2HMapMetadata* v2hmap,
+                     uint8_t* buffer) {
+  if (!v2hmap->dirty_page_cache && !v2hmap->dirty_ram_cache &&
+      !v2hmap->dirty_flash_cache) {
+    return true;
+  }
+  void* data = NULL;
+  // Set when an upper layer held data newer than the current layer.
+  bool newer_above = false;
+  if (v2hmap->exist_page_cache) {
+    if (v2hmap->dirty_page_cache) {
+      // Write-protect the page before it's written out, so an update racing
+      // with the write-back faults and marks the page dirty again.
+      if (mprotect(page, PAGE_SIZE, PROT_READ) != 0) {
+        err("sync: mprotect %p failed\n", page);
+        perror("mprotect error::  ");
+        return false;
+      }
+      v2hmap->dirty_page_cache = 0;
+      newer_above = true;
+    }
+    data = page;
+  }
+  if (v2hmap->exist_ram_cache) {
+    RAMCacheItem* ram_cache_item = hmem->GetRAMCache()->GetItem(page);
+    assert(ram_cache_item != NULL);
+    if (newer_above) {
+      hmem->GetRAMCache()->Remove(ram_cache_item);
+    } else {
+      if (data == NULL) {
+        data = ram_cache_item->data;
+      }
+      newer_above = v2hmap->dirty_ram_cache;
+      v2hmap->dirty_ram_cache = 0;
+    }
+  }
+  if (v2hmap->exist_flash_cache) {
+    if (newer_above) {
+      hmem->GetFlashCache()->RemovePage(v2hmap->flash_page_offset);
+    } else {
+      if (data == NULL) {
+        if (hmem->GetFlashCache()->LoadPage(buffer,
+                                            PAGE_SIZE,
+                                            v2hmap->flash_page_offset,
+                                            vaddr_range->vaddress_range_id(),
+                                            vaddr_range->GetPageOffset(page)) ==
+            false) {
+          return false;
+        }
+        data = buffer;
+      }
+      v2hmap->dirty_flash_cache = 0;
+    }
+  }
+  assert(data != NULL);
+  if (hmem->GetFlashCache()->WriteToHDDFile(vaddr_range, page, data) == false) {
+    return false;
+  }
+  v2hmap->exist_hdd_file = 1;
+  return true;
+}
+
+static bool SyncVAddressRange(VAddressRange* vaddr_range) {
+  uint8_t* buffer = NULL;
+  assert(posix_memalign((void**)&buffer, PAGE_SIZE, PAGE_SIZE) == 0);
+  bool success = true;
+  // All pages in a chunk are cached by the same hmem instance.
+  uint64_t chunk_size = PAGE_SIZE << VADDRESS_CHUNK_BITS;
+  for (uint64_t chunk_offset = 0; chunk_offset < vaddr_range->size();
+       chunk_offset += chunk_size) {
+    uint64_t chunk_end =
+        std::min<uint64_t>(chunk_offset + chunk_size, vaddr_range->size());
+    HybridMemory* hmem = hmem_group.GetHybridMemory(chunk_offset);
+    uint64_t chunk = (chunk_offset >> PAGE_BITS) >> VADDRESS_CHUNK_BITS;
+    hmem->LockChunk(vaddr_range->vaddress_range_id(), chunk);
+    hmem->Lock();
+    for (uint64_t offset = chunk_offset; offset < chunk_end;
+         offset += PAGE_SIZE) {
+      if (SyncPage(hmem,
+                   vaddr_range,
+                   vaddr_range->address() + offset,
+                   vaddr_range->GetV2HMapMetadata(offset),
+                   buffer) == false) {
+        success = false;
+      }
+    }
+    hmem->Unlock();
+    hmem->UnlockChunk(vaddr_range->vaddress_range_id(), chunk);
+  }
+  free(buffer);
+  return success;
+}
+
+// Drop all cached copies of pages in "vaddr_range" from every layer.
+// If "detach" is true, the range's hdd file has been synced, and its flash
+// copies are kept as detached pages instead.
+static void PurgeVAddressRange(VAddressRange* vaddr_range, bool detach) {
+  HDDFileVersion version;
+  if (detach && !GetHDDFileVersion(vaddr_range->hdd_file_fd(), &version)) {
+    detach = false;
+  }
+  uint32_t detached_files[MAX_HMEM_INSTANCES];
+  for (uint32_t i = 0; i < hmem_group.number_hmem_instances(); ++i) {
+    HybridMemory* hmem = hmem_group.GetHybridMemoryFromInstanceId(i);
+    hmem->Lock();
+    hmem->GetFlashCache()->DrainReadAhead(vaddr_range->vaddress_range_id());
+    hmem->GetPageCache()->RemoveVAddressRange(vaddr_range->vaddress_range_id());
+    if (detach) {
+      detached_files[i] =
+          hmem->GetFlashCache()->BeginDetach(vaddr_range, version);
+    }
+    hmem->Unlock();
+  }
+  uint64_t chunk_size = PAGE_SIZE << VADDRESS_CHUNK_BITS;
+  for (uint64_t chunk_offset = 0; chunk_offset < vaddr_range->size();
+       chunk_offset += chunk_size) {
+    uint64_t chunk_end =
+        std::min<uint64_t>(chunk_offset + chunk_size, vaddr_range->size());
+    HybridMemory* hmem = hmem_group.GetHybridMemory(chunk_offset);
+    uint64_t chunk = (chunk_offset >> PAGE_BITS) >> VADDRESS_CHUNK_BITS;
+    hmem->LockChunk(vaddr_range->vaddress_range_id(), chunk);
+    hmem->Lock();
+    for (uint64_t offset = chunk_offset; offset < chunk_end;
+         offset += PAGE_SIZE) {
+      V2HMapMetadata* v2hmap = vaddr_range->GetV2HMapMetadata(offset);
+      if (v2hmap->exist_ram_cache) {
+        RAMCacheItem* ram_cache_item =
+            hmem->GetRAMCache()->GetItem(vaddr_range->address() + offset);
+        assert(ram_cache_item != NULL);
+        hmem->GetRAMCache()->Remove(ram_cache_item);
+      }
+      if (v2hmap->exist_flash_cache) {
+        if (detach) {
+          hmem->GetFlashCache()->DetachPage(
+              detached_files[hmem->instance_id()], v2hmap->flash_page_offset);
+        } else {
+          hmem->GetFlashCache()->RemovePage(v2hmap->flash_page_offset);
+        }
+      }
+    }
+    hmem->Unlock();
+    hmem->UnlockChunk(vaddr_range->vaddress_range_id(), chunk);
+  }
+}
+
+// Background writes race with SyncPage() and with purging the caches,
+// keep the flushers idle around both.
+static void PauseFlushers() {
+  for (uint32_t i = 0; i < hmem_group.number_hmem_instances(); ++i) {
+    hmem_group.GetHybridMemoryFromInstanceId(i)->GetPageFlusher()->Pause();
+  }
+}
+
+static void ResumeFlushers() {
+  for (uint32_t i = 0; i < hmem_group.number_hmem_instances(); ++i) {
+    hmem_group.GetHybridMemoryFromInstanceId(i)->GetPageFlusher()->Resume();
+  }
+}
+
+bool hmem_sync(void* address) {
+  VAddressRange* vaddr_range = LookupVAddressRange((uint8_t*)address);
+  if (vaddr_range == NULL) {
+    err("Address %p not exist in vaddr-range-group.\n", address);
+    return false;
+  }
+  if (vaddr_range->hdd_file_fd() <= 0) {
+    err("Vaddr-range %d isn't backed by hdd file.\n",
+        vaddr_range->vaddress_range_id());
+    return false;
+  }
+  PauseFlushers();
+  bool success = SyncVAddressRange(vaddr_range);
+  ResumeFlushers();
+  return success;
+}
+
 void hmem_free(void* address) {
-  VAddressRange* vaddr_range =
-      vaddr_range_group.FindVAddressRange((uint8_t*)address);
+  VAddressRange* vaddr_range = LookupVAddressRange((uint8_t*)address);
   if (vaddr_range == NULL) {
     err("Address %p not exist in vaddr-range-group.\n", address);
     return;
   }
+  PauseFlushers();
+  bool synced = false;
+  if (vaddr_range->hdd_file_fd() > 0) {
+    synced = SyncVAddressRange(vaddr_range);
+    if (!synced) {
+      err("Vaddr-range %d: failed to write back dirty pages.\n",
+          vaddr_range->vaddress_range_id());
+    }
+  }
+  // Flash copies of a synced file are all clean, keep them for the next
+  // time the file is mapped.
+  PurgeVAddressRange(vaddr_range, synced);
+  ResumeFlushers();
+  pthread_rwlock_wrlock(&vaddr_range_group_lock);
   vaddr_range_group.ReleaseVAddressRange(vaddr_range);
+  pthread_rwlock_unlock(&vaddr_range_group_lock);
+}
+
+void GetHybridMemoryStatistics(HybridMemoryStatistics* stats) {
+  stats->page_faults = number_page_faults;
+  stats->page_in_ram_cache = hit_ram_cache;
+  stats->page_in_flash_cache = hit_flash_cache;
+  stats->page_in_hdd_file = hit_hdd_file;
+  stats->page_out_flash_cache = 0;
+  stats->page_out_hdd_file = 0;
+  stats->writeback_ios = 0;
+  stats->readahead_pages = 0;
+  stats->detached_pages = 0;
+  stats->reattached_pages = 0;
+  for (uint32_t i = 0; i < hmem_group.number_hmem_instances(); ++i) {
+    HybridMemory* hmem = hmem_group.GetHybridMemoryFromInstanceId(i);
+    FlashCache* flash_cache = hmem->GetFlashCache();
+    PageFlusher* page_flusher = hmem->GetPageFlusher();
+    stats->page_out_flash_cache +=
+        flash_cache->flash_writes() + page_flusher->flash_pages_written();
+    stats->page_out_hdd_file +=
+        flash_cache->hdd_writes() + page_flusher->hdd_pages_written();
+    stats->writeback_ios += page_flusher->write_ios();
+    stats->readahead_pages += flash_cache->readahead_pages();
+    stats->detached_pages += flash_cache->detached_pages();
+    stats->reattached_pages += flash_cache->reattached_pages();
+  }
 }
 
 uint64_t GetPageOffsetInVAddressRange(uint32_t vaddress_range_id, void* page) {
@@ -146,7 +435,7 @@ static bool LoadDataFromHybridMemory(void* fault_page,
       _exit(0);
     }
     memcpy(fault_page, ram_cache_item->data, PAGE_SIZE);
-    ++hit_ram_cache;
+    __sync_fetch_and_add(&hit_ram_cache, 1);
     return true;
   } else if (v2hmap->exist_flash_cache) {
     //  V2h records in-flash offset. Load from flash.
@@ -162,7 +451,7 @@ static bool LoadDataFromHybridMemory(void* fault_page,
           fault_page);
       _exit(0);
     }
-    ++hit_flash_cache;
+    __sync_fetch_and_add(&hit_flash_cache, 1);
     return true;
   } else if (v2hmap->exist_hdd_file) {
     // If v2h shows it exists in hdd-file, the offset in vaddr-range
@@ -176,21 +465,51 @@ static bool LoadDataFromHybridMemory(void* fault_page,
           fault_page);
       _exit(0);
     }
-    ++hit_hdd_file;
+    __sync_fetch_and_add(&hit_hdd_file, 1);
     return true;
   }
   return false;
 }
 
+// Read the newest copy of "fault_page" from flash-cache or hdd file into
+// "buffer". May run without the hmem lock: then the caller has set
+// "io_pending" so the flash page can't be evicted or reused, and holds the
+// chunk lock so no other fault or hmem_sync() changes the page meanwhile.
+static void ReadPageToBuffer(void* fault_page,
+                                void* buffer,
+                                VAddressRange* vaddr_range,
+                                HybridMemory* hmem,
+                                V2HMapMetadata* v2hmap) {
+  if (v2hmap->exist_flash_cache) {
+    if (hmem->GetFlashCache()->ReadPage(buffer, v2hmap->flash_page_offset) ==
+        false) {
+      err("v2hmap shows address %p exists in flash-cache, but cannot read "
+          "it.\n",
+          fault_page);
+      _exit(0);
+    }
+    __sync_fetch_and_add(&hit_flash_cache, 1);
+  } else {
+    assert(v2hmap->exist_hdd_file);
+    if (hmem->GetFlashCache()->ReadFromHDDFile(
+            vaddr_range, fault_page, buffer) == false) {
+      err("v2hmap shows address %p exists in hdd-file, but cannot read "
+          "it.\n",
+          fault_page);
+      _exit(0);
+    }
+    __sync_fetch_and_add(&hit_hdd_file, 1);
+  }
+}
+
 // It appears sigsegv_action should not be a class method.
 static void SigSegvAction(int sig, siginfo_t* sig_info, void* ucontext) {
-  ++number_page_faults;
+  __sync_fetch_and_add(&number_page_faults, 1);
   // Violating virtual address.
   uint8_t* fault_address = (uint8_t*)sig_info->si_addr;
   if (!fault_address) {  // Invalid address, shall exit now.
     err("Invalid address=%p\n", fault_address);
-    signal(SIGSEGV, SIG_DFL);
-    kill(getpid(), SIGSEGV);
+    sigsegv_handler.ForwardToOldHandler(sig, sig_info, ucontext);
     return;
   }
 
@@ -211,23 +530,28 @@ static void SigSegvAction(int sig, siginfo_t* sig_info, void* ucontext) {
         rwerror);
   }
 
-  VAddressRange* vaddr_range = vaddr_range_group.FindVAddressRange(fault_page);
+  VAddressRange* vaddr_range = LookupVAddressRange(fault_page);
   if (vaddr_range == NULL) {
     err("address=%p not within hybrid-memory range, "
-        "forward to default sigsegv.\n",
+        "forward to previous sigsegv handler.\n",
         fault_address);
-    signal(SIGSEGV, SIG_DFL);
-    kill(getpid(), SIGSEGV);
+    sigsegv_handler.ForwardToOldHandler(sig, sig_info, ucontext);
     return;
   }
   // Find the instance of hmem to which this virtual-page is associated.
-  HybridMemory* hmem =
-      hmem_group.GetHybridMemory(fault_address - vaddr_range->address());
+  uint64_t fault_offset = fault_address - vaddr_range->address();
+  HybridMemory* hmem = hmem_group.GetHybridMemory(fault_offset);
+  uint32_t vaddr_range_id = vaddr_range->vaddress_range_id();
+  uint64_t chunk = (fault_offset >> PAGE_BITS) >> VADDRESS_CHUNK_BITS;
+  hmem->LockChunk(vaddr_range_id, chunk);
   hmem->Lock();
+  // Let a read-ahead of this page land first, it's mapped to the
+  // flash-cache before its data is there.
+  FlashCache* flash_cache = hmem->GetFlashCache();
+  flash_cache->WaitForReadAhead(vaddr_range, fault_page);
   //  using page-offset (fault_page - vaddr_range_start) >> 12 to get
   //  index to virt-to-hybrid table to get metadata;
-  V2HMapMetadata* v2hmap =
-      vaddr_range->GetV2HMapMetadata(fault_address - vaddr_range->address());
+  V2HMapMetadata* v2hmap = vaddr_range->GetV2HMapMetadata(fault_offset);
   uint64_t  prot_size = PAGE_SIZE;
   if (v2hmap->exist_page_cache) {
     if (rwerror == 0) {
@@ -244,27 +568,82 @@ static void SigSegvAction(int sig, siginfo_t* sig_info, void* ucontext) {
       v2hmap->dirty_page_cache = 1;
     }
     hmem->Unlock();
+    hmem->UnlockChunk(vaddr_range_id, chunk);
     return;
   }
-  // Enable write to the fault page so we can populate it with data.
-  if (mprotect(fault_page, prot_size, PROT_WRITE) != 0) {
-    err("in sigsegv: read mprotect %p failed...\n", fault_page);
-    perror("mprotect error::  ");
-    assert(0);
+  // Read ahead of a sequential stream before this fault does its own IO.
+  flash_cache->ReadAhead(vaddr_range, fault_page);
+
+  // Gather the page data first, and only then make the page accessible:
+  // once it's writable, other threads read it without faulting.
+  // A page read from flash or hdd goes through a buffer, so the instance
+  // lock can be dropped during the IO unless the page already has IO in
+  // flight by the flusher.
+  void* data = NULL;
+  FaultIOBuffer* io_buffer = NULL;
+  if (v2hmap->exist_ram_cache) {
+    RAMCacheItem* ram_cache_item = hmem->GetRAMCache()->GetItem(fault_page);
+    if (!ram_cache_item) {
+      err("v2hmap shows address %p exists in ram-cache, but cannot find.\n",
+          fault_page);
+      _exit(0);
+    }
+    data = ram_cache_item->data;
+    __sync_fetch_and_add(&hit_ram_cache, 1);
+  } else if ((v2hmap->exist_flash_cache || v2hmap->exist_hdd_file) &&
+             (io_buffer = hmem->GetFaultIOBuffer()) != NULL) {
+    bool drop_lock = !v2hmap->io_pending;
+    if (drop_lock) {
+      v2hmap->io_pending = 1;
+      hmem->Unlock();
+    }
+    ReadPageToBuffer(fault_page, io_buffer->data, vaddr_range, hmem, v2hmap);
+    if (drop_lock) {
+      hmem->Lock();
+      v2hmap->io_pending = 0;
+    }
+    if (v2hmap->exist_flash_cache) {
+      flash_cache->TouchPage(v2hmap->flash_page_offset);
+    }
+    data = io_buffer->data;
   }
-  if (LoadDataFromHybridMemory(fault_page, vaddr_range, hmem, v2hmap) ==
-      false) {
-    ++unfound_pages;
+  int final_prot = rwerror ? PROT_WRITE : PROT_READ;
+  if (data && self_mem_fd >= 0 &&
+      pwrite(self_mem_fd, data, PAGE_SIZE, (off_t)fault_page) ==
+          (ssize_t)PAGE_SIZE) {
+    if (mprotect(fault_page, prot_size, final_prot) != 0) {
+      err("in sigsegv: mprotect %p failed...\n", fault_page);
+      perror("mprotect error::  ");
+      assert(0);
+    }
+    __sync_fetch_and_add(&found_pages, 1);
   } else {
-    ++found_pages;
-  }
-  if (rwerror == 0) {
-    // a read fault. Set the page to READ_ONLY.
-    if (mprotect(fault_page, prot_size, PROT_READ) != 0) {
+    // Enable write to the fault page so we can populate it with data.
+    if (mprotect(fault_page, prot_size, PROT_WRITE) != 0) {
       err("in sigsegv: read mprotect %p failed...\n", fault_page);
       perror("mprotect error::  ");
       assert(0);
     }
+    if (data) {
+      memcpy(fault_page, data, PAGE_SIZE);
+      __sync_fetch_and_add(&found_pages, 1);
+    } else if (LoadDataFromHybridMemory(
+                   fault_page, vaddr_range, hmem, v2hmap) == false) {
+      __sync_fetch_and_add(&unfound_pages, 1);
+    } else {
+      __sync_fetch_and_add(&found_pages, 1);
+    }
+    if (rwerror == 0) {
+      // a read fault. Set the page to READ_ONLY.
+      if (mprotect(fault_page, prot_size, PROT_READ) != 0) {
+        err("in sigsegv: read mprotect %p failed...\n", fault_page);
+        perror("mprotect error::  ");
+        assert(0);
+      }
+    }
+  }
+  if (io_buffer) {
+    hmem->PutFaultIOBuffer(io_buffer);
   }
   // The "fault_page" has been materialized by OS.  We should add this page
   // to "page-cache", a list of materialized pages.
@@ -274,7 +653,8 @@ static void SigSegvAction(int sig, siginfo_t* sig_info, void* ucontext) {
                                 prot_size,
                                 is_dirty,
                                 v2hmap,
-                                vaddr_range->vaddress_range_id());
+                                vaddr_range_id);
   hmem->Unlock();
+  hmem->UnlockChunk(vaddr_range_id, chunk);
   return;
 }
@@ -8,13 +8,29 @@
 #include <stdint.h>
 #include <string>
 
+// Replacement policy of the page cache and the RAM cache.
+enum ReplacementPolicyType {
+  REPLACEMENT_LRU = 0,
+  // Scan resistant: 2Q and ARC.
+  REPLACEMENT_2Q = 1,
+  REPLACEMENT_ARC = 2,
+};
+
+// Parse "lru", "2q" or "arc". Return false for other names.
+bool ParseReplacementPolicy(const std::string& name,
+                            ReplacementPolicyType* policy);
+
 bool InitHybridMemory(const std::string& ssd_dirpath,
                       const std::string& hmem_group_name,
                       uint64_t page_buffer_size,
                       uint64_t ram_buffer_size,
                       uint64_t ssd_buffer_size,
-                      uint32_t number_hmem_instance);
+                      uint32_t number_hmem_instance,
+                      ReplacementPolicyType replacement_policy);
 
+// Flash-cache copies of hdd files that have been unmapped with hmem_free()
+// are saved in the flash-cache dir, and the next InitHybridMemory() with
+// the same dir and sizes picks them up.
 void ReleaseHybridMemory();
 
 void* hmem_alloc(uint64_t size);
@@ -25,6 +41,47 @@ void* hmem_map(const std::string& hdd_filename,
                uint64_t size,
                uint64_t hdd_file_offset);
 
+// Write dirty pages of the vaddr-range starting at "address" back to
+// its backing hdd file. Return false if the range isn't backed by
+// a hdd file, or if some pages failed to be written.
+bool hmem_sync(void* address);
+
+// Release the vaddr-range starting at "address". A file-backed range
+// writes its dirty pages back to the hdd file first, and its flash-cache
+// copies are kept until the file is mapped again, unless the file is
+// modified in the meantime.
 void hmem_free(void *address);
 
+// Counters of page movement in and out of hybrid-memory.
+struct HybridMemoryStatistics {
+  // Number of SIGSEGV faults taken on hybrid-memory addresses.
+  uint64_t page_faults;
+
+  // Page-ins: pages loaded into a faulting virtual-page from each layer.
+  uint64_t page_in_ram_cache;
+  uint64_t page_in_flash_cache;
+  uint64_t page_in_hdd_file;
+
+  // Page-outs: pages written to the flash-cache file, and pages written
+  // back to backing hdd files (by eviction, by the background flusher,
+  // or by hmem_sync()).
+  uint64_t page_out_flash_cache;
+  uint64_t page_out_hdd_file;
+
+  // Write IOs issued by the background flusher. Adjacent pages share an
+  // IO, so this is at most the flusher's share of the page-outs.
+  uint64_t writeback_ios;
+
+  // Pages read ahead from hdd files into the flash-cache. Faults on them
+  // count as flash-cache page-ins.
+  uint64_t readahead_pages;
+
+  // Flash-cache pages of unmapped hdd files, and pages that have been
+  // reattached when their files were mapped again.
+  uint64_t detached_pages;
+  uint64_t reattached_pages;
+};
+
+void GetHybridMemoryStatistics(HybridMemoryStatistics* stats);
+
 #endif  // HYBRID_MEMORY_LIB_H_
@@ -8,13 +8,16 @@
 #include <sys/mman.h>
 #include <sys/time.h>
 #include <time.h>
+#include <fcntl.h>
 #include <pthread.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/wait.h>
 #include <unistd.h>
 
 #include <algorithm>
+#include <cmath>
 #include <vector>
 
 #include "debug.h"
@@ -286,7 +289,8 @@ static void TestMultithreadAccess(char* flash_dir, char* hdd_file) {
                           page_buffer_size,
                           ram_buffer_size,
                           ssd_buffer_size,
-                          num_hmem_instances) == true);
+                          num_hmem_instances,
+                          REPLACEMENT_LRU) == true);
 
   // Allocate a big virt-memory, shared by all threads.
 #ifdef USE_MMAP
@@ -449,6 +453,386 @@ static void TestMultithreadAccess(char* flash_dir, char* hdd_file) {
   ReleaseHybridMemory();
 }
 
+struct FaultTask {
+  uint8_t* buffer;
+  uint64_t number_pages;
+  uint64_t number_access;
+  uint32_t id;
+  pthread_t thread_id;
+};
+
+// Read one word from random pages. Nearly every access faults because the
+// page cache is tiny compared to the buffer.
+static void* FaultRandomPages(void* arg) {
+  FaultTask* task = (FaultTask*)arg;
+  uint32_t rand_seed = NowInUsec() + task->id;
+  for (uint64_t i = 0; i < task->number_access; ++i) {
+    uint64_t page = rand_r(&rand_seed) % task->number_pages;
+    uint64_t value = *(uint64_t*)(task->buffer + (page << PAGE_BITS));
+    if (value != page) {
+      err("thread %d: page %ld has %ld\n", task->id, page, value);
+      assert(0);
+    }
+  }
+  return NULL;
+}
+
+// Measure fault throughput with 1 to 32 threads faulting on a buffer that
+// lives mostly in ram-cache and flash-cache.
+static void TestFaultScaling(char* flash_dir) {
+  uint32_t num_hmem_instances = 8;
+  uint32_t max_threads = 32;
+  uint64_t page_buffer_size = PAGE_SIZE * 64 * num_hmem_instances;
+  uint64_t ram_buffer_size = PAGE_SIZE * 2048 * num_hmem_instances;
+  uint64_t ssd_buffer_size = 256ULL * 1024 * 1024;
+  uint64_t number_pages = 32768;
+  uint64_t total_access = 400000;
+  if (!IsDir(flash_dir)) {
+    err("Please give a flash dir: \"%s\" is not a dir\n", flash_dir);
+    return;
+  }
+  assert(InitHybridMemory(flash_dir,
+                          "hmem",
+                          page_buffer_size,
+                          ram_buffer_size,
+                          ssd_buffer_size,
+                          num_hmem_instances,
+                          REPLACEMENT_LRU) == true);
+  uint8_t* buffer = (uint8_t*)hmem_alloc(number_pages << PAGE_BITS);
+  assert(buffer != NULL);
+
+  // Populate every page once, this pushes most of them down to ram-cache
+  // and flash-cache.
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    *(uint64_t*)(buffer + (i << PAGE_BITS)) = i;
+  }
+  uint64_t expected_sum = 0;
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    expected_sum += *(uint64_t*)(buffer + (i << PAGE_BITS));
+  }
+  assert(expected_sum == number_pages * (number_pages - 1) / 2);
+
+  FaultTask tasks[max_threads];
+  printf("\nthreads\tfaults\ttime(sec)\tfaults/sec\n");
+  for (uint32_t number_threads = 1; number_threads <= max_threads;
+       number_threads *= 2) {
+    uint64_t p1_faults = NumberOfPageFaults();
+    uint64_t tstart = NowInUsec();
+    for (uint32_t i = 0; i < number_threads; ++i) {
+      tasks[i].buffer = buffer;
+      tasks[i].number_pages = number_pages;
+      tasks[i].number_access = total_access / number_threads;
+      tasks[i].id = i;
+      assert(pthread_create(
+                 &tasks[i].thread_id, NULL, FaultRandomPages, &tasks[i]) == 0);
+    }
+    for (uint32_t i = 0; i < number_threads; ++i) {
+      pthread_join(tasks[i].thread_id, NULL);
+    }
+    uint64_t total_usec = NowInUsec() - tstart;
+    uint64_t number_faults = NumberOfPageFaults() - p1_faults;
+    printf("%d\t%ld\t%f\t%ld\n",
+           number_threads,
+           number_faults,
+           total_usec / 1000000.0,
+           (uint64_t)(number_faults / (total_usec / 1000000.0)));
+  }
+
+  hmem_free(buffer);
+  ReleaseHybridMemory();
+}
+
+// Scan an hdd file sequentially, then read random pages of it. Every page
+// starts with its page number. The sequential scan should find most pages
+// already read ahead into the flash-cache.
+static void TestReadAhead(char* flash_dir, char* hdd_file) {
+  uint32_t num_hmem_instances = 4;
+  uint64_t page_buffer_size = PAGE_SIZE * 64 * num_hmem_instances;
+  uint64_t ram_buffer_size = PAGE_SIZE * 256 * num_hmem_instances;
+  uint64_t ssd_buffer_size = 256ULL * 1024 * 1024;
+  uint64_t number_pages = 16384;
+  uint64_t random_access = 20000;
+  if (!IsDir(flash_dir)) {
+    err("Please give a flash dir: \"%s\" is not a dir\n", flash_dir);
+    return;
+  }
+  uint8_t* page = NULL;
+  assert(posix_memalign((void**)&page, PAGE_SIZE, PAGE_SIZE) == 0);
+  memset(page, 0, PAGE_SIZE);
+  int fd = open(hdd_file, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  assert(fd > 0);
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    *(uint64_t*)page = i;
+    assert(pwrite(fd, page, PAGE_SIZE, i << PAGE_BITS) == (ssize_t)PAGE_SIZE);
+  }
+  close(fd);
+  free(page);
+
+  assert(InitHybridMemory(flash_dir,
+                          "hmem",
+                          page_buffer_size,
+                          ram_buffer_size,
+                          ssd_buffer_size,
+                          num_hmem_instances,
+                          REPLACEMENT_LRU) == true);
+  uint8_t* buffer =
+      (uint8_t*)hmem_map(hdd_file, number_pages << PAGE_BITS, 0);
+  assert(buffer != NULL);
+
+  HybridMemoryStatistics stats;
+  uint64_t tstart = NowInUsec();
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    assert(*(uint64_t*)(buffer + (i << PAGE_BITS)) == i);
+  }
+  uint64_t total_usec = NowInUsec() - tstart;
+  GetHybridMemoryStatistics(&stats);
+  printf("sequential: %ld pages in %f sec, %ld from hdd, %ld read ahead\n",
+         number_pages,
+         total_usec / 1000000.0,
+         stats.page_in_hdd_file,
+         stats.readahead_pages);
+  assert(stats.readahead_pages > number_pages / 2);
+
+  uint64_t readahead_pages = stats.readahead_pages;
+  uint32_t rand_seed = NowInUsec();
+  tstart = NowInUsec();
+  for (uint64_t i = 0; i < random_access; ++i) {
+    uint64_t page_number = rand_r(&rand_seed) % number_pages;
+    assert(*(uint64_t*)(buffer + (page_number << PAGE_BITS)) == page_number);
+  }
+  total_usec = NowInUsec() - tstart;
+  GetHybridMemoryStatistics(&stats);
+  printf("random: %ld accesses in %f sec, %ld more read ahead\n",
+         random_access,
+         total_usec / 1000000.0,
+         stats.readahead_pages - readahead_pages);
+
+  hmem_free(buffer);
+  ReleaseHybridMemory();
+}
+
+// Zipfian point lookups over a buffer larger than RAM, with a full scan of
+// the buffer between rounds of lookups. Report the fraction of lookups that
+// hit the page-cache, and the fraction served from memory (page-cache or
+// ram-cache) rather than flash, with the given replacement policy.
+static void RunPolicyWorkload(char* flash_dir,
+                              const char* policy_name,
+                              ReplacementPolicyType policy) {
+  uint32_t num_hmem_instances = 4;
+  uint64_t page_buffer_size = PAGE_SIZE * 64 * num_hmem_instances;
+  uint64_t ram_buffer_size = PAGE_SIZE * 512 * num_hmem_instances;
+  uint64_t ssd_buffer_size = 256ULL * 1024 * 1024;
+  uint64_t number_pages = 16384;
+  uint32_t rounds = 10;
+  uint64_t lookups_per_round = 10000;
+  // Zipf exponent of the lookups.
+  double theta = 0.99;
+
+  assert(InitHybridMemory(flash_dir,
+                          "hmem",
+                          page_buffer_size,
+                          ram_buffer_size,
+                          ssd_buffer_size,
+                          num_hmem_instances,
+                          policy) == true);
+  uint8_t* buffer = (uint8_t*)hmem_alloc(number_pages << PAGE_BITS);
+  assert(buffer != NULL);
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    *(uint64_t*)(buffer + (i << PAGE_BITS)) = i;
+  }
+
+  // cdf[r]: probability of picking a page of rank <= r.
+  std::vector<double> cdf(number_pages);
+  double sum = 0;
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    sum += 1.0 / pow(i + 1, theta);
+    cdf[i] = sum;
+  }
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    cdf[i] /= sum;
+  }
+
+  uint32_t rand_seed = 12345;
+  uint64_t lookups = 0;
+  uint64_t faults = 0;
+  uint64_t flash_ins = 0;
+  uint64_t tstart = NowInUsec();
+  for (uint32_t round = 0; round < rounds; ++round) {
+    HybridMemoryStatistics before, after;
+    GetHybridMemoryStatistics(&before);
+    for (uint64_t i = 0; i < lookups_per_round; ++i) {
+      double u = rand_r(&rand_seed) / (RAND_MAX + 1.0);
+      uint64_t rank = std::lower_bound(cdf.begin(), cdf.end(), u) - cdf.begin();
+      rank = std::min(rank, number_pages - 1);
+      // Spread hot pages over the buffer, and so over all hmem instances.
+      uint64_t page_number = (rank * 7919) % number_pages;
+      assert(*(uint64_t*)(buffer + (page_number << PAGE_BITS)) ==
+             page_number);
+    }
+    GetHybridMemoryStatistics(&after);
+    lookups += lookups_per_round;
+    faults += after.page_faults - before.page_faults;
+    flash_ins += (after.page_in_flash_cache - before.page_in_flash_cache) +
+                 (after.page_in_hdd_file - before.page_in_hdd_file);
+
+    for (uint64_t i = 0; i < number_pages; ++i) {
+      assert(*(uint64_t*)(buffer + (i << PAGE_BITS)) == i);
+    }
+  }
+  uint64_t total_usec = NowInUsec() - tstart;
+  printf("%s\t%ld\t%.3f\t\t%.3f\t\t%f\n",
+         policy_name,
+         lookups,
+         1.0 - (double)faults / lookups,
+         1.0 - (double)flash_ins / lookups,
+         total_usec / 1000000.0);
+
+  hmem_free(buffer);
+  ReleaseHybridMemory();
+}
+
+// Compare replacement policies under a scan-polluted zipfian workload.
+// hmem can only be initialized once per process, so each policy runs in
+// a child process.
+static void TestReplacementPolicies(char* flash_dir) {
+  if (!IsDir(flash_dir)) {
+    err("Please give a flash dir: \"%s\" is not a dir\n", flash_dir);
+    return;
+  }
+  const char* names[] = {"lru", "2q", "arc"};
+  ReplacementPolicyType policies[] = {REPLACEMENT_LRU,
+                                      REPLACEMENT_2Q,
+                                      REPLACEMENT_ARC};
+  printf("\npolicy\tlookups\tpage-cache hit\tmemory hit\ttime(sec)\n");
+  for (uint32_t i = 0; i < 3; ++i) {
+    fflush(stdout);
+    pid_t pid = fork();
+    assert(pid >= 0);
+    if (pid == 0) {
+      RunPolicyWorkload(flash_dir, names[i], policies[i]);
+      fflush(stdout);
+      _exit(0);
+    }
+    int status = 0;
+    assert(waitpid(pid, &status, 0) == pid);
+    assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  }
+}
+
+// Map "hdd_file" with a fresh hmem, read all "number_pages" pages checking
+// that each starts with "first_value" + its page number, and unmap it.
+// Return the statistics after the reads.
+static HybridMemoryStatistics ReadMappedFile(char* flash_dir,
+                                             char* hdd_file,
+                                             uint64_t number_pages,
+                                             uint64_t first_value) {
+  uint32_t num_hmem_instances = 4;
+  uint64_t page_buffer_size = PAGE_SIZE * 64 * num_hmem_instances;
+  uint64_t ram_buffer_size = PAGE_SIZE * 256 * num_hmem_instances;
+  uint64_t ssd_buffer_size = 256ULL * 1024 * 1024;
+  assert(InitHybridMemory(flash_dir,
+                          "hmem",
+                          page_buffer_size,
+                          ram_buffer_size,
+                          ssd_buffer_size,
+                          num_hmem_instances,
+                          REPLACEMENT_LRU) == true);
+  uint8_t* buffer =
+      (uint8_t*)hmem_map(hdd_file, number_pages << PAGE_BITS, 0);
+  assert(buffer != NULL);
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    assert(*(uint64_t*)(buffer + (i << PAGE_BITS)) == first_value + i);
+  }
+  HybridMemoryStatistics stats;
+  GetHybridMemoryStatistics(&stats);
+  hmem_free(buffer);
+  ReleaseHybridMemory();
+  return stats;
+}
+
+// Run ReadMappedFile() in a child process, since hmem can only be
+// initialized once per process. Return the child's statistics.
+static HybridMemoryStatistics ReadMappedFileInChild(char* flash_dir,
+                                                    char* hdd_file,
+                                                    uint64_t number_pages,
+                                                    uint64_t first_value) {
+  int fds[2];
+  assert(pipe(fds) == 0);
+  fflush(stdout);
+  pid_t pid = fork();
+  assert(pid >= 0);
+  if (pid == 0) {
+    close(fds[0]);
+    HybridMemoryStatistics stats =
+        ReadMappedFile(flash_dir, hdd_file, number_pages, first_value);
+    assert(write(fds[1], &stats, sizeof(stats)) == sizeof(stats));
+    _exit(0);
+  }
+  close(fds[1]);
+  HybridMemoryStatistics stats;
+  assert(read(fds[0], &stats, sizeof(stats)) == sizeof(stats));
+  close(fds[0]);
+  int status = 0;
+  assert(waitpid(pid, &status, 0) == pid);
+  assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  return stats;
+}
+
+// Read an hdd file through hmem, restart hmem and read it again. The
+// second run should find the pages in the flash-cache. After the file is
+// modified behind hmem's back, the flash-cache copies must not be used.
+static void TestRestart(char* flash_dir, char* hdd_file) {
+  uint64_t number_pages = 8192;
+  if (!IsDir(flash_dir)) {
+    err("Please give a flash dir: \"%s\" is not a dir\n", flash_dir);
+    return;
+  }
+  uint8_t* page = NULL;
+  assert(posix_memalign((void**)&page, PAGE_SIZE, PAGE_SIZE) == 0);
+  memset(page, 0, PAGE_SIZE);
+  int fd = open(hdd_file, O_CREAT | O_TRUNC | O_WRONLY, 0666);
+  assert(fd > 0);
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    *(uint64_t*)page = i;
+    assert(pwrite(fd, page, PAGE_SIZE, i << PAGE_BITS) == (ssize_t)PAGE_SIZE);
+  }
+  close(fd);
+
+  HybridMemoryStatistics stats =
+      ReadMappedFileInChild(flash_dir, hdd_file, number_pages, 0);
+  printf("cold: %ld pages from hdd, %ld from flash, %ld reattached\n",
+         stats.page_in_hdd_file,
+         stats.page_in_flash_cache,
+         stats.reattached_pages);
+  assert(stats.reattached_pages == 0);
+
+  stats = ReadMappedFileInChild(flash_dir, hdd_file, number_pages, 0);
+  printf("warm: %ld pages from hdd, %ld from flash, %ld reattached\n",
+         stats.page_in_hdd_file,
+         stats.page_in_flash_cache,
+         stats.reattached_pages);
+  assert(stats.reattached_pages > number_pages / 2);
+  assert(stats.page_in_hdd_file < number_pages / 2);
+
+  // Change every page of the file.
+  fd = open(hdd_file, O_WRONLY);
+  assert(fd > 0);
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    *(uint64_t*)page = i + number_pages;
+    assert(pwrite(fd, page, PAGE_SIZE, i << PAGE_BITS) == (ssize_t)PAGE_SIZE);
+  }
+  close(fd);
+  free(page);
+
+  stats = ReadMappedFileInChild(flash_dir, hdd_file, number_pages,
+                                number_pages);
+  printf("modified: %ld pages from hdd, %ld from flash, %ld reattached\n",
+         stats.page_in_hdd_file,
+         stats.page_in_flash_cache,
+         stats.reattached_pages);
+  assert(stats.reattached_pages == 0);
+}
+
 static void TestHybridMemory() {
   uint32_t num_hmem_instances = 64;
   uint64_t page_buffer_size = PAGE_SIZE * 1000 * num_hmem_instances;
@@ -459,7 +843,8 @@ static void TestHybridMemory() {
                           page_buffer_size,
                           ram_buffer_size,
                           ssd_buffer_size,
-                          num_hmem_instances) == true);
+                          num_hmem_instances,
+                          REPLACEMENT_LRU) == true);
 
   uint64_t number_pages = 1000ULL * 1000 * 10;
   uint64_t buffer_size = number_pages * 4096;
@@ -516,10 +901,37 @@ int main(int argc, char **argv) {
     printf("Hybrid memory basic test.\n"
            "Usage 1: %s  [flash-cache dir] \n"
            "Usage 2: %s  [flash-cache dir] [hdd backing file]\n"
+           "Usage 3: %s  [flash-cache dir] scaling\n"
+           "Usage 4: %s  [flash-cache dir] [hdd backing file] readahead\n"
+           "Usage 5: %s  [flash-cache dir] policy\n"
+           "Usage 6: %s  [flash-cache dir] [hdd backing file] restart\n"
            "Usage 1 allocates a virtual addr space on flash, \n"
            "usage 2 maps the hdd file to virtul address and \n"
-           "uses the flash as a huge cache.\n",
-           argv[0], argv[0]);
+           "uses the flash as a huge cache.\n"
+           "Usage 3 measures page fault throughput from 1 to 32 threads.\n"
+           "Usage 4 overwrites the hdd file, and reads it sequentially\n"
+           "and randomly to exercise read-ahead.\n"
+           "Usage 5 compares hit rates of the replacement policies\n"
+           "under zipfian lookups mixed with full scans.\n"
+           "Usage 6 overwrites the hdd file, and reads it through hmem\n"
+           "before and after a restart of hmem.\n",
+           argv[0], argv[0], argv[0], argv[0], argv[0], argv[0]);
+    return 0;
+  }
+  if (argc > 2 && strcmp(argv[2], "scaling") == 0) {
+    TestFaultScaling(argv[1]);
+    return 0;
+  }
+  if (argc > 2 && strcmp(argv[2], "policy") == 0) {
+    TestReplacementPolicies(argv[1]);
+    return 0;
+  }
+  if (argc > 3 && strcmp(argv[3], "restart") == 0) {
+    TestRestart(argv[1], argv[2]);
+    return 0;
+  }
+  if (argc > 3 && strcmp(argv[3], "readahead") == 0) {
+    TestReadAhead(argv[1], argv[2]);
     return 0;
   }
   TestMultithreadAccess(argv[1], argv[2]);
@@ -6,6 +6,7 @@
 #define LRU_LIST_H_
 
 #include <assert.h>
+#include <pthread.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/types.h>
@@ -27,12 +28,17 @@
 // "head" points to the Most-Recent-obj, head->lru_prev == NULL;
 // "tail" points the Least-Recent-obj, and tail->lru_next == NULL;
 //
-// This class is NOT thread safe.
+// Each list has its own lock. Link(), Unlink() and Update() take it
+// internally. Callers that walk the list through head()/tail() and the
+// obj links must hold it with Lock()/Unlock(), and must not modify the
+// list while holding it.
 template <class T>
 class LRUList {
  public:
-  LRUList() : head_(NULL), tail_(NULL), number_objects_(0) {}
-  virtual ~LRUList() {}
+  LRUList() : head_(NULL), tail_(NULL), number_objects_(0) {
+    pthread_spin_init(&lock_, PTHREAD_PROCESS_PRIVATE);
+  }
+  virtual ~LRUList() { pthread_spin_destroy(&lock_); }
 
   // Insert the obj as a most-recent one.
   void Link(T* x);
@@ -43,6 +49,10 @@ class LRUList {
   // Move the obj to the most-recent end of LRU list.
   void Update(T* x);
 
+  void Lock() { pthread_spin_lock(&lock_); }
+
+  void Unlock() { pthread_spin_unlock(&lock_); }
+
   T* head() { return head_; }
 
   T* tail() { return tail_; }
@@ -58,10 +68,38 @@ class LRUList {
 
   // Number of objects currently in the LRU cache.
   uint64_t number_objects_;
+
+  pthread_spinlock_t lock_;
+
+  void LinkLocked(T* x);
+
+  void UnlinkLocked(T* x);
 };
 
 template <class T>
 void LRUList<T>::Link(T* x) {
+  Lock();
+  LinkLocked(x);
+  Unlock();
+}
+
+template <class T>
+void LRUList<T>::Unlink(T* x) {
+  Lock();
+  UnlinkLocked(x);
+  Unlock();
+}
+
+template <class T>
+void LRUList<T>::Update(T* x) {
+  Lock();
+  UnlinkLocked(x);
+  LinkLocked(x);
+  Unlock();
+}
+
+template <class T>
+void LRUList<T>::LinkLocked(T* x) {
   if (head_) {
     // x is the new "most-recent" one.
     x->lru_prev = NULL;
@@ -79,7 +117,7 @@ void LRUList<T>::Link(T* x) {
 }
 
 template <class T>
-void LRUList<T>::Unlink(T* x) {
+void LRUList<T>::UnlinkLocked(T* x) {
   assert(number_objects_ > 0);
   T* prev = x->lru_prev;
   T* next = x->lru_next;
@@ -103,10 +141,4 @@ void LRUList<T>::Unlink(T* x) {
   --number_objects_;
 }
 
-template <class T>
-void LRUList<T>::Update(T* x) {
-  Unlink(x);
-  Link(x);
-}
-
 #endif  // LRU_LIST_H_
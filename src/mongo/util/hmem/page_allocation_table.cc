@@ -89,6 +89,16 @@ void PageAllocationTableNode::ReleasePages(uint64_t child_index,
   assert(number_free_pages_ + number_used_pages_ == number_total_pages_);
 }
 
+void PageAllocationTableNode::TakePages(uint64_t child_index,
+                                        uint64_t used_pages) {
+  assert(child_index < number_entries_);
+  assert(entries_[child_index] >= used_pages);
+  entries_[child_index] -= used_pages;
+  number_free_pages_ -= used_pages;
+  number_used_pages_ += used_pages;
+  assert(number_free_pages_ + number_used_pages_ == number_total_pages_);
+}
+
 void PageAllocationTableNode::ShowStats() {
   fprintf(stderr,
           "%ld entries, total-pages=%ld, "
@@ -395,6 +405,31 @@ void PageAllocationTable::FreePage(uint64_t page) {
   --used_pages_;
 }
 
+bool PageAllocationTable::AllocateThisPage(uint64_t page) {
+  assert(page < total_pages_);
+  if (!IsPageFree(page)) {
+    return false;
+  }
+  uint64_t offset_in_bitmap = page & bitmap_mask_;
+  if (levels_ == 1) {
+    bitmaps_[0].clear(offset_in_bitmap + 1);
+  } else if (levels_ == 2) {
+    uint64_t bitmap_index = page >> bitmap_bits_;
+    bitmaps_[bitmap_index].clear(offset_in_bitmap + 1);
+    pgd_.TakePages(bitmap_index, 1);
+  } else {
+    uint64_t offset_in_pgd_node = (page >> (bitmap_bits_ + pmd_bits_)) & pgd_mask_;
+    uint64_t offset_in_pmd_node = (page >> bitmap_bits_) & pmd_mask_;
+    uint64_t bitmap_index = page >> bitmap_bits_;
+    bitmaps_[bitmap_index].clear(offset_in_bitmap + 1);
+    pmds_[offset_in_pgd_node].TakePages(offset_in_pmd_node, 1);
+    pgd_.TakePages(offset_in_pgd_node, 1);
+  }
+  --free_pages_;
+  ++used_pages_;
+  return true;
+}
+
 bool PageAllocationTable::IsPageFree(uint64_t page) {
   assert(page >= 0 && page < total_pages_);
   uint64_t offset_in_bitmap = page & bitmap_mask_;
@@ -44,6 +44,9 @@ struct PageAllocationTableNode {
 
   void ReleasePages(uint64_t child_index, uint64_t free_pages);
 
+  // Take "used_pages" free pages from child node "child_index".
+  void TakePages(uint64_t child_index, uint64_t used_pages);
+
   void ShowStats();
 
   // Aggregated-stats of all subtrees rooted from this node.
@@ -91,6 +94,9 @@ class PageAllocationTable {
   // Grab one free page.
   bool AllocateOnePage(uint64_t* page);
 
+  // Grab the given page. Return false if it's not free.
+  bool AllocateThisPage(uint64_t page);
+
   // Free up a page.
   void FreePage(uint64_t page);
 
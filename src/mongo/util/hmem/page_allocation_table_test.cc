@@ -191,10 +191,40 @@ void TestLevel3_vector() {
   pat.ShowStats();
 }
 
+// Grab specific pages at each table level, the others are still handed
+// out by AllocateOnePage().
+void TestAllocateThisPage() {
+  uint64_t sizes[] = {17, (3 << BITMAP_BITS) + 5, (3ULL << 20) + 7};
+  for (int level = 0; level < 3; ++level) {
+    uint64_t total_pages = sizes[level];
+    PageAllocationTable pat;
+    assert(pat.Init("table-this-page", total_pages) == true);
+    uint64_t taken[] = {0, total_pages / 2, total_pages - 1};
+    for (int i = 0; i < 3; ++i) {
+      assert(pat.AllocateThisPage(taken[i]) == true);
+      assert(pat.AllocateThisPage(taken[i]) == false);
+      assert(pat.IsPageFree(taken[i]) == false);
+    }
+    assert(pat.used_pages() == 3);
+    assert(pat.SanityCheck() == true);
+    uint64_t page;
+    for (uint64_t i = 0; i < total_pages - 3; ++i) {
+      assert(pat.AllocateOnePage(&page) == true);
+      assert(page != taken[0] && page != taken[1] && page != taken[2]);
+    }
+    assert(pat.AllocateOnePage(&page) == false);
+    pat.FreePage(taken[1]);
+    assert(pat.AllocateOnePage(&page) == true);
+    assert(page == taken[1]);
+    dbg("allocate-this-page test with %ld pages passed.\n", total_pages);
+  }
+}
+
 int main(int argc, char **argv) {
   //TestLevel1();
   //TestLevel2();
   TestLevel3();
+  TestAllocateThisPage();
   //TestLevel3_vector();
   printf("\nPASS\n");
   return 0;
@@ -10,6 +10,7 @@
 
 #include <memory>
 #include <string>
+#include <vector>
 
 #include "avl.h"
 #include "hybrid_memory.h"
@@ -19,7 +20,8 @@
 
 bool PageCache::Init(HybridMemory* hmem,
                      const std::string& name,
-                     uint64_t max_cache_size) {
+                     uint64_t max_cache_size,
+                     ReplacementPolicyType replacement_policy) {
   max_cache_size_ = RoundUpToPageSize(max_cache_size);
   assert(max_cache_size_ > 0);
   bool page_align = true;
@@ -30,6 +32,12 @@ bool PageCache::Init(HybridMemory* hmem,
                          payload_data,
                          page_align,
                          pin_memory) == true);
+  if (policy_.Init(name + "-policy",
+                   replacement_policy,
+                   max_cache_size_ >> PAGE_BITS) == false) {
+    err("Unable to init replacement policy of %s\n", name.c_str());
+    return false;
+  }
   hybrid_memory_ = hmem;
   name_ = name;
   return true;
@@ -37,10 +45,11 @@ bool PageCache::Init(HybridMemory* hmem,
 
 bool PageCache::Release() {
   if (ready_) {
-    if (queue_.size() > 0) {
+    if (policy_.GetNumberObjects() > 0) {
       // TODO: release pages still in the queue.
-      dbg("Has %ld pages in page-cache\n", queue_.size());
+      dbg("Has %ld pages in page-cache\n", policy_.GetNumberObjects());
     }
+    policy_.Release();
     item_list_.Release();
     ready_ = false;
   }
@@ -49,12 +58,26 @@ bool PageCache::Release() {
 
 uint32_t PageCache::EvictItems() {
   // Try to free up this many cached pages.
-  uint32_t to_release = 10;
+  const uint32_t to_release = 10;
+  PageCacheItem* items[to_release];
   uint32_t released = 0;
-  for (released = 0; queue_.size() > 0 && released < to_release; ++released) {
-    PageCacheItem* olditem = (PageCacheItem*)queue_.front();
-    queue_.pop();
-    assert(olditem != NULL);
+  policy_.Lock();
+  for (PageCacheItem* item = policy_.FirstVictim();
+       item && released < to_release;
+       item = policy_.NextVictim(item)) {
+    items[released++] = item;
+  }
+  policy_.Unlock();
+  for (uint32_t i = 0; i < released; ++i) {
+    PageCacheItem* olditem = items[i];
+    policy_.Remove(olditem, olditem->page, true);
+    // Other threads may access the page meanwhile. Block writes before
+    // copying it out so none is lost, and block all access before
+    // dropping it so nobody reads the zero-filled page. Their faults wait
+    // for the hmem lock and load the page from ram-cache.
+    if (olditem->v2hmap->dirty_page_cache) {
+      assert(mprotect(olditem->page, olditem->size, PROT_READ) == 0);
+    }
     hybrid_memory_->GetRAMCache()->AddPage(olditem->page,
                                            olditem->size,
                                            olditem->v2hmap->dirty_page_cache,
@@ -62,8 +85,8 @@ uint32_t PageCache::EvictItems() {
                                            olditem->vaddr_range_id);
     olditem->v2hmap->exist_page_cache = 0;
     olditem->v2hmap->dirty_page_cache = 0;
-    assert(madvise(olditem->page, olditem->size, MADV_DONTNEED) == 0);
     assert(mprotect(olditem->page, olditem->size, PROT_NONE) == 0);
+    assert(madvise(olditem->page, olditem->size, MADV_DONTNEED) == 0);
     item_list_.Free(olditem);
   }
   return released;
@@ -86,6 +109,29 @@ bool PageCache::AddPage(void* page,
   item->v2hmap = v2hmap;
   item->v2hmap->exist_page_cache = 1;
   item->v2hmap->dirty_page_cache = is_dirty ? 1 : 0;
-  queue_.push(item);
+  policy_.Insert(
+      item, page, hybrid_memory_->GetFlashCache()->PageAccessCount(v2hmap));
   return true;
 }
+
+uint32_t PageCache::RemoveVAddressRange(uint32_t vaddr_range_id) {
+  std::vector<PageCacheItem*> items;
+  policy_.Lock();
+  for (PageCacheItem* item = policy_.FirstVictim(); item;
+       item = policy_.NextVictim(item)) {
+    if (item->vaddr_range_id == vaddr_range_id) {
+      items.push_back(item);
+    }
+  }
+  policy_.Unlock();
+  for (uint32_t i = 0; i < items.size(); ++i) {
+    PageCacheItem* item = items[i];
+    policy_.Remove(item, item->page, false);
+    item->v2hmap->exist_page_cache = 0;
+    item->v2hmap->dirty_page_cache = 0;
+    assert(mprotect(item->page, item->size, PROT_NONE) == 0);
+    assert(madvise(item->page, item->size, MADV_DONTNEED) == 0);
+    item_list_.Free(item);
+  }
+  return items.size();
+}
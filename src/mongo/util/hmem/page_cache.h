@@ -9,14 +9,23 @@
 #include <sys/types.h>
 #include <unistd.h>
 
-#include <queue>
+#include <string>
+
 #include "free_list.h"
+#include "replacement_policy.h"
 
 struct V2HMapMetadata;
 struct HybridMemory;
 
 // Each materialized page is represented by a page-buffer-item.
 struct PageCacheItem {
+  // Pointers to link this item to the replacement policy's lists.
+  PageCacheItem* lru_prev;
+  PageCacheItem* lru_next;
+
+  // Which list of the replacement policy this item is on.
+  uint8_t policy_list;
+
   // The virt-address page which is materialized.
   void* page;
 
@@ -37,6 +46,10 @@ struct PageCacheItem {
 
 // Page cache is the 1st layer of cache that stores all
 // materialized pages (virtual pages that have physical pages allocated by OS).
+//
+// Accesses to a materialized page don't fault, so the replacement policy
+// only learns about a page when it's added: from its access count in the
+// flash-cache, and from whether it was evicted recently.
 class PageCache {
  public:
   PageCache() : ready_(false), hybrid_memory_(NULL) {}
@@ -44,7 +57,8 @@ class PageCache {
 
   bool Init(HybridMemory* hmem,
             const std::string& name,
-            uint64_t max_cache_size);
+            uint64_t max_cache_size,
+            ReplacementPolicyType replacement_policy);
 
   bool Release();
 
@@ -58,6 +72,11 @@ class PageCache {
   // Evict to the next caching layer beneath this layer.
   uint32_t EvictItems();
 
+  // Drop all pages that belong to the vaddr-range "vaddr_range_id" without
+  // demoting them to the next layer. The caller must have written back
+  // dirty pages before calling this.
+  uint32_t RemoveVAddressRange(uint32_t vaddr_range_id);
+
   const std::string& name() const { return name_; }
 
  protected:
@@ -65,8 +84,8 @@ class PageCache {
 
   HybridMemory* hybrid_memory_;
 
-  // The queue of materialized pages in the page buffer.
-  std::queue<PageCacheItem*> queue_;
+  // Orders the materialized pages for eviction.
+  ReplacementPolicy<PageCacheItem> policy_;
 
   // A free-list of page-buffer-item metadata objs.
   FreeList<PageCacheItem> item_list_;
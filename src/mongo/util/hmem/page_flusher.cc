@@ -0,0 +1,413 @@
+// SSD-Assisted Hybrid Memory.
+// Author: Xiangyong Ouyang (neutronsharc@gmail.com)
+// Created on: 2011-11-11
+
+#include <assert.h>
+#include <errno.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/time.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <string>
+#include <vector>
+
+#include "debug.h"
+#include "flash_cache.h"
+#include "hybrid_memory.h"
+#include "hybrid_memory_const.h"
+#include "hybrid_memory_inl.h"
+#include "page_flusher.h"
+#include "ram_cache.h"
+#include "vaddr_range.h"
+
+// Without wakeups, the flusher looks for dirty pages this often.
+#define FLUSHER_IDLE_INTERVAL_USEC (100 * 1000)
+
+PageFlusher::PageFlusher()
+    : ready_(false),
+      hybrid_memory_(NULL),
+      queue_depth_(0),
+      batch_pages_(0),
+      staging_buffer_(NULL),
+      stop_(false),
+      wakeup_(false),
+      busy_(false),
+      pause_count_(0),
+      flash_pages_written_(0),
+      hdd_pages_written_(0),
+      write_ios_(0) {}
+
+bool PageFlusher::Init(HybridMemory* hmem,
+                       const std::string& name,
+                       uint32_t queue_depth,
+                       uint32_t batch_pages) {
+  assert(ready_ == false);
+  assert(queue_depth > 0 && batch_pages > 0);
+  if (asyncio_manager_.Init(queue_depth) == false) {
+    err("%s: unable to init asyncio.\n", name.c_str());
+    return false;
+  }
+  if (posix_memalign((void**)&staging_buffer_,
+                     PAGE_SIZE,
+                     (uint64_t)batch_pages << PAGE_BITS) != 0) {
+    err("%s: unable to allocate staging buffer.\n", name.c_str());
+    asyncio_manager_.Release();
+    return false;
+  }
+  batch_.reserve(batch_pages);
+  hybrid_memory_ = hmem;
+  name_ = name;
+  queue_depth_ = queue_depth;
+  batch_pages_ = batch_pages;
+  stop_ = false;
+  wakeup_ = false;
+  busy_ = false;
+  pause_count_ = 0;
+  pthread_mutex_init(&lock_, NULL);
+  pthread_cond_init(&cond_, NULL);
+  if (pthread_create(&thread_, NULL, ThreadMain, this) != 0) {
+    err("%s: unable to start flusher thread.\n", name.c_str());
+    free(staging_buffer_);
+    staging_buffer_ = NULL;
+    asyncio_manager_.Release();
+    return false;
+  }
+  ready_ = true;
+  return ready_;
+}
+
+void PageFlusher::Release() {
+  if (ready_) {
+    pthread_mutex_lock(&lock_);
+    stop_ = true;
+    pthread_cond_broadcast(&cond_);
+    pthread_mutex_unlock(&lock_);
+    pthread_join(thread_, NULL);
+
+    pthread_mutex_destroy(&lock_);
+    pthread_cond_destroy(&cond_);
+    free(staging_buffer_);
+    staging_buffer_ = NULL;
+    asyncio_manager_.Release();
+    ready_ = false;
+  }
+}
+
+void PageFlusher::Wakeup() {
+  if (!ready_) {
+    return;
+  }
+  pthread_mutex_lock(&lock_);
+  wakeup_ = true;
+  pthread_cond_signal(&cond_);
+  pthread_mutex_unlock(&lock_);
+}
+
+void PageFlusher::Pause() {
+  if (!ready_) {
+    return;
+  }
+  pthread_mutex_lock(&lock_);
+  ++pause_count_;
+  while (busy_) {
+    pthread_cond_wait(&cond_, &lock_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+void PageFlusher::Resume() {
+  if (!ready_) {
+    return;
+  }
+  pthread_mutex_lock(&lock_);
+  assert(pause_count_ > 0);
+  --pause_count_;
+  pthread_cond_broadcast(&cond_);
+  pthread_mutex_unlock(&lock_);
+}
+
+void* PageFlusher::ThreadMain(void* arg) {
+  static_cast<PageFlusher*>(arg)->Run();
+  return NULL;
+}
+
+void PageFlusher::Run() {
+  pthread_mutex_lock(&lock_);
+  while (!stop_) {
+    if (pause_count_ > 0 || !wakeup_) {
+      struct timeval now;
+      gettimeofday(&now, NULL);
+      uint64_t deadline_usec = now.tv_sec * 1000000ULL + now.tv_usec +
+                               FLUSHER_IDLE_INTERVAL_USEC;
+      struct timespec deadline;
+      deadline.tv_sec = deadline_usec / 1000000;
+      deadline.tv_nsec = (deadline_usec % 1000000) * 1000;
+      if (pthread_cond_timedwait(&cond_, &lock_, &deadline) == ETIMEDOUT) {
+        wakeup_ = true;
+      }
+      continue;
+    }
+    wakeup_ = false;
+    busy_ = true;
+    pthread_mutex_unlock(&lock_);
+
+    uint32_t pages_written = FlushRAMCache();
+    pages_written += FlushFlashCache();
+
+    pthread_mutex_lock(&lock_);
+    busy_ = false;
+    if (pages_written > 0) {
+      // There is probably more to do.
+      wakeup_ = true;
+    }
+    pthread_cond_broadcast(&cond_);
+  }
+  pthread_mutex_unlock(&lock_);
+}
+
+// Orders pages to write to flash by flash offset.
+bool PageFlusher::FlashPageLess(const WritebackPage& a,
+                                const WritebackPage& b) {
+  return a.flash_page_number < b.flash_page_number;
+}
+
+// Orders pages to write to hdd by target file, then file offset.
+bool PageFlusher::HDDPageLess(const WritebackPage& a,
+                              const WritebackPage& b) {
+  if (a.hdd_file_fd != b.hdd_file_fd) {
+    return a.hdd_file_fd < b.hdd_file_fd;
+  }
+  return a.hdd_file_offset < b.hdd_file_offset;
+}
+
+uint32_t PageFlusher::FlushRAMCache() {
+  RAMCache* ram_cache = hybrid_memory_->GetRAMCache();
+  FlashCache* flash_cache = hybrid_memory_->GetFlashCache();
+  std::vector<RAMCacheItem*> items;
+  batch_.clear();
+
+  hybrid_memory_->Lock();
+  ram_cache->GetDirtyItemsNearTail(batch_pages_, batch_pages_ * 4, &items);
+  for (uint32_t i = 0; i < items.size(); ++i) {
+    RAMCacheItem* item = items[i];
+    V2HMapMetadata* v2hmap = item->v2hmap;
+    uint64_t vaddress_page_offset =
+        GetPageOffsetInVAddressRange(item->vaddress_range_id, item->hash_key);
+    WritebackPage page;
+    if (flash_cache->AllocatePage(v2hmap,
+                                  item->vaddress_range_id,
+                                  vaddress_page_offset,
+                                  &page.flash_page_number) == false) {
+      break;
+    }
+    if (!v2hmap->exist_flash_cache) {
+      flash_cache->MapPage(page.flash_page_number,
+                           v2hmap,
+                           item->vaddress_range_id,
+                           vaddress_page_offset);
+    }
+    // The flash copy is dirty as soon as it's mapped: if the write fails,
+    // the item is dirty again and the stale flash copy is never used.
+    v2hmap->dirty_flash_cache = 1;
+    v2hmap->dirty_ram_cache = 0;
+    v2hmap->io_pending = 1;
+    page.v2hmap = v2hmap;
+    page.hdd_file_fd = -1;
+    page.hdd_file_offset = 0;
+    page.buffer = (uint8_t*)item->data;
+    page.failed = false;
+    batch_.push_back(page);
+  }
+  std::sort(batch_.begin(), batch_.end(), FlashPageLess);
+  // Copy to the staging buffer, so that writes don't race with updates to
+  // the items once the lock is released.
+  for (uint32_t i = 0; i < batch_.size(); ++i) {
+    uint8_t* slot = staging_buffer_ + ((uint64_t)i << PAGE_BITS);
+    memcpy(slot, batch_[i].buffer, PAGE_SIZE);
+    batch_[i].buffer = slot;
+  }
+  hybrid_memory_->Unlock();
+
+  if (batch_.empty()) {
+    return 0;
+  }
+  std::vector<WritebackPage*> pages;
+  for (uint32_t i = 0; i < batch_.size(); ++i) {
+    pages.push_back(&batch_[i]);
+  }
+  SubmitAndWait(pages, true, WRITE);
+
+  uint32_t pages_written = 0;
+  hybrid_memory_->Lock();
+  for (uint32_t i = 0; i < batch_.size(); ++i) {
+    V2HMapMetadata* v2hmap = batch_[i].v2hmap;
+    v2hmap->io_pending = 0;
+    if (batch_[i].failed) {
+      v2hmap->dirty_ram_cache = 1;
+    } else {
+      ++pages_written;
+    }
+  }
+  flash_pages_written_ += pages_written;
+  hybrid_memory_->Unlock();
+  return pages_written;
+}
+
+uint32_t PageFlusher::FlushFlashCache() {
+  FlashCache* flash_cache = hybrid_memory_->GetFlashCache();
+  std::vector<uint64_t> flash_pages;
+  batch_.clear();
+
+  hybrid_memory_->Lock();
+  flash_cache->GetDirtyPagesForWriteback(
+      batch_pages_, batch_pages_ * 8, &flash_pages);
+  for (uint32_t i = 0; i < flash_pages.size(); ++i) {
+    F2VMapItem* f2vmap = flash_cache->GetItem(flash_pages[i]);
+    VAddressRange* vaddress_range =
+        GetVAddressRangeFromId(f2vmap->vaddress_range_id);
+    uint64_t vaddress_page_offset = f2vmap->vaddress_page_offset;
+    V2HMapMetadata* v2hmap =
+        vaddress_range->GetV2HMapMetadata(vaddress_page_offset << PAGE_BITS);
+    v2hmap->dirty_flash_cache = 0;
+    v2hmap->io_pending = 1;
+    WritebackPage page;
+    page.v2hmap = v2hmap;
+    page.flash_page_number = flash_pages[i];
+    page.hdd_file_fd = vaddress_range->hdd_file_fd();
+    page.hdd_file_offset =
+        (vaddress_page_offset << PAGE_BITS) + vaddress_range->hdd_file_offset();
+    page.buffer = NULL;
+    page.failed = false;
+    batch_.push_back(page);
+  }
+  hybrid_memory_->Unlock();
+
+  if (batch_.empty()) {
+    return 0;
+  }
+  // Lay out the staging buffer in hdd order, so that the hdd writes merge
+  // as much as possible. Flash reads merge where the flash pages happen to
+  // be consecutive too.
+  std::sort(batch_.begin(), batch_.end(), HDDPageLess);
+  std::vector<WritebackPage*> pages;
+  for (uint32_t i = 0; i < batch_.size(); ++i) {
+    batch_[i].buffer = staging_buffer_ + ((uint64_t)i << PAGE_BITS);
+    pages.push_back(&batch_[i]);
+  }
+  SubmitAndWait(pages, true, READ);
+
+  pages.clear();
+  for (uint32_t i = 0; i < batch_.size(); ++i) {
+    if (!batch_[i].failed) {
+      pages.push_back(&batch_[i]);
+    }
+  }
+  if (!pages.empty()) {
+    SubmitAndWait(pages, false, WRITE);
+  }
+
+  uint32_t pages_written = 0;
+  hybrid_memory_->Lock();
+  for (uint32_t i = 0; i < batch_.size(); ++i) {
+    V2HMapMetadata* v2hmap = batch_[i].v2hmap;
+    v2hmap->io_pending = 0;
+    if (batch_[i].failed) {
+      v2hmap->dirty_flash_cache = 1;
+    } else {
+      v2hmap->exist_hdd_file = 1;
+      ++pages_written;
+    }
+  }
+  hdd_pages_written_ += pages_written;
+  hybrid_memory_->Unlock();
+  return pages_written;
+}
+
+void PageFlusher::SubmitAndWait(std::vector<WritebackPage*>& pages,
+                                bool target_is_flash,
+                                IOType io_type) {
+  int flash_fd = hybrid_memory_->GetFlashCache()->flash_fd();
+
+  // Merge runs of pages adjacent both in target file and staging buffer.
+  // Each run [run_starts[i], run_starts[i + 1]) becomes one IO.
+  std::vector<uint32_t> run_starts;
+  for (uint32_t i = 0; i < pages.size(); ++i) {
+    if (i > 0) {
+      WritebackPage* prev = pages[i - 1];
+      WritebackPage* next = pages[i];
+      bool adjacent =
+          target_is_flash
+              ? (next->flash_page_number == prev->flash_page_number + 1)
+              : (next->hdd_file_fd == prev->hdd_file_fd &&
+                 next->hdd_file_offset == prev->hdd_file_offset + PAGE_SIZE);
+      if (adjacent && next->buffer == prev->buffer + PAGE_SIZE) {
+        continue;
+      }
+    }
+    run_starts.push_back(i);
+  }
+  run_starts.push_back(pages.size());
+  uint32_t number_runs = run_starts.size() - 1;
+  if (io_type == WRITE) {
+    write_ios_ += number_runs;
+  }
+
+  // Keep at most "queue_depth_" requests outstanding. The asyncio manager
+  // has exactly that many requests.
+  uint32_t submitted = 0;
+  uint64_t outstanding = 0;
+  while (submitted < number_runs || outstanding > 0) {
+    std::vector<AsyncIORequest*> group;
+    while (submitted + group.size() < number_runs &&
+           outstanding + group.size() < queue_depth_) {
+      uint32_t run = submitted + group.size();
+      uint32_t run_start = run_starts[run];
+      uint32_t run_pages = run_starts[run + 1] - run_start;
+      WritebackPage* first = pages[run_start];
+      AsyncIORequest* request = asyncio_manager_.GetRequest();
+      assert(request != NULL);
+      request->Prepare(target_is_flash ? flash_fd : first->hdd_file_fd,
+                       first->buffer,
+                       (uint64_t)run_pages << PAGE_BITS,
+                       target_is_flash ? (first->flash_page_number << PAGE_BITS)
+                                       : first->hdd_file_offset,
+                       io_type);
+      request->AddCompletionCallback(
+          IOCompletion, &pages[run_start], (void*)(uint64_t)run_pages);
+      group.push_back(request);
+    }
+    if (group.size() > 0) {
+      if (asyncio_manager_.Submit(group)) {
+        outstanding += group.size();
+      } else {
+        // Nothing in the group was written, the pages stay dirty.
+        for (uint32_t i = 0; i < group.size(); ++i) {
+          group[i]->RunCompletionCallbacks(-EIO);
+          asyncio_manager_.FreeRequest(group[i]);
+        }
+      }
+      submitted += group.size();
+      continue;
+    }
+    outstanding -=
+        asyncio_manager_.WaitForEventsWithTimeout(1, outstanding, NULL);
+  }
+}
+
+void PageFlusher::IOCompletion(AsyncIORequest* request,
+                               int result,
+                               void* param1,
+                               void* param2) {
+  if (result == (int)request->size()) {
+    return;
+  }
+  WritebackPage** pages = (WritebackPage**)param1;
+  uint64_t number_pages = (uint64_t)param2;
+  for (uint64_t i = 0; i < number_pages; ++i) {
+    pages[i]->failed = true;
+  }
+}
@@ -0,0 +1,148 @@
+// SSD-Assisted Hybrid Memory.
+// Author: Xiangyong Ouyang (neutronsharc@gmail.com)
+// Created on: 2011-11-11
+
+#ifndef PAGE_FLUSHER_H_
+#define PAGE_FLUSHER_H_
+
+#include <pthread.h>
+#include <stdint.h>
+#include <sys/types.h>
+#include <unistd.h>
+
+#include <string>
+#include <vector>
+
+#include "asyncio_manager.h"
+#include "asyncio_request.h"
+
+struct V2HMapMetadata;
+class HybridMemory;
+
+// Background writer of dirty pages for one hmem instance.
+//
+// Foreground eviction runs in the SIGSEGV handler, and used to write every
+// dirty page it demoted with a synchronous pwrite(). The flusher cleans
+// pages before eviction gets to them: dirty RAM-cache items near the LRU
+// tail are written to flash, and dirty flash pages are written back to
+// their hdd files. Each batch is sorted by target file offset, adjacent
+// pages are merged into one IO, and the IOs go through a private
+// AsyncIOManager with a bounded queue depth.
+//
+// While a page is being written its V2H metadata has "io_pending"
+// set, and eviction leaves its RAM-cache item and flash page alone.
+class PageFlusher {
+ public:
+  PageFlusher();
+  virtual ~PageFlusher() { Release(); }
+
+  // Start the flusher thread. Up to "queue_depth" IOs are outstanding
+  // at any time, and one batch covers at most "batch_pages" pages.
+  bool Init(HybridMemory* hmem,
+            const std::string& name,
+            uint32_t queue_depth,
+            uint32_t batch_pages);
+
+  // Stop the flusher thread after the current batch completes.
+  void Release();
+
+  // Ask for a flush round now. Safe to call with the hmem lock held.
+  void Wakeup();
+
+  // Wait for the current batch to complete, and don't start new ones
+  // until Resume(). Must not be called with the hmem lock held.
+  void Pause();
+
+  void Resume();
+
+  uint64_t flash_pages_written() const { return flash_pages_written_; }
+
+  uint64_t hdd_pages_written() const { return hdd_pages_written_; }
+
+  // Number of (merged) write IOs issued.
+  uint64_t write_ios() const { return write_ios_; }
+
+ protected:
+  // A page in the current batch.
+  struct WritebackPage {
+    V2HMapMetadata* v2hmap;
+
+    uint64_t flash_page_number;
+
+    // Target hdd file and offset, for flash-to-hdd writeback.
+    int hdd_file_fd;
+    uint64_t hdd_file_offset;
+
+    // Slot in the staging buffer holding the page data.
+    uint8_t* buffer;
+
+    // Set by an IO completion callback if the IO failed.
+    bool failed;
+  };
+
+  static bool FlashPageLess(const WritebackPage& a, const WritebackPage& b);
+
+  static bool HDDPageLess(const WritebackPage& a, const WritebackPage& b);
+
+  static void* ThreadMain(void* arg);
+
+  void Run();
+
+  // Write dirty RAM-cache items near LRU tail to flash.
+  // Return the number of pages written.
+  uint32_t FlushRAMCache();
+
+  // Write dirty flash pages back to hdd files.
+  // Return the number of pages written.
+  uint32_t FlushFlashCache();
+
+  // Issue IOs of "io_type" between the staging buffer and the target
+  // (flash-cache file, or the pages' hdd files). Consecutive pages that
+  // are adjacent both in the target file and in the staging buffer share
+  // one IO. Returns after all IOs complete; failed pages are marked.
+  void SubmitAndWait(std::vector<WritebackPage*>& pages,
+                     bool target_is_flash,
+                     IOType io_type);
+
+  static void IOCompletion(AsyncIORequest* request,
+                           int result,
+                           void* param1,
+                           void* param2);
+
+  bool ready_;
+
+  HybridMemory* hybrid_memory_;
+
+  std::string name_;
+
+  // Private async-io context so that completions of the flusher's IOs
+  // are never reaped by the foreground, and vice versa.
+  AsyncIOManager asyncio_manager_;
+
+  uint32_t queue_depth_;
+
+  uint32_t batch_pages_;
+
+  // Page-aligned buffer of "batch_pages_" pages to hold batch data.
+  uint8_t* staging_buffer_;
+
+  // All pages of the current batch.
+  std::vector<WritebackPage> batch_;
+
+  pthread_t thread_;
+
+  // Protects the fields below. Never held together with the hmem lock.
+  pthread_mutex_t lock_;
+  pthread_cond_t cond_;
+
+  bool stop_;
+  bool wakeup_;
+  bool busy_;
+  uint32_t pause_count_;
+
+  uint64_t flash_pages_written_;
+  uint64_t hdd_pages_written_;
+  uint64_t write_ios_;
+};
+
+#endif  // PAGE_FLUSHER_H_
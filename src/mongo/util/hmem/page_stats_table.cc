@@ -113,6 +113,12 @@ bool PageStatsTable::Init(const std::string& name, uint64_t total_pages) {
     dbg("PGD: last entry compensation = %f\n", compensation);
   }
 
+  // Vaddr-range ids are 8 bits.
+  streams_.resize(1U << 8);
+  for (uint32_t i = 0; i < streams_.size(); ++i) {
+    ResetStream(i);
+  }
+
   name_ = name;
   ready_ = true;
   dbg("PST table %s: %ld pages, pgd_bits=%d, pmd_bits=%d, pte_bits=%d\n",
@@ -151,6 +157,31 @@ void PageStatsTable::IncreaseAccessCount(uint64_t page_number, uint32_t delta) {
   pgd_.Increase(pmd_node_number, delta);
 }
 
+AccessStream* PageStatsTable::RecordStreamAccess(uint32_t vaddress_range_id,
+                                                 uint64_t chunk) {
+  assert(vaddress_range_id < streams_.size());
+  AccessStream* stream = &streams_[vaddress_range_id];
+  if (chunk == stream->last_chunk + 1) {
+    // Sequential.
+    stream->window = stream->window ? stream->window * 2 : 1;
+    stream->window = std::min<uint32_t>(stream->window, READAHEAD_MAX_CHUNKS);
+  } else if (chunk != stream->last_chunk) {
+    // Random. What's been read ahead is of no use to the new position.
+    stream->window >>= 1;
+    stream->readahead_end = 0;
+  }
+  stream->last_chunk = chunk;
+  return stream;
+}
+
+void PageStatsTable::ResetStream(uint32_t vaddress_range_id) {
+  assert(vaddress_range_id < streams_.size());
+  AccessStream* stream = &streams_[vaddress_range_id];
+  stream->last_chunk = ~0ULL;
+  stream->window = 0;
+  stream->readahead_end = 0;
+}
+
 uint64_t PageStatsTable::AccessCount(uint64_t page_number) {
   if (page_number >= total_pages_) {
     err("page number %ld >= total pages %ld\n", page_number, total_pages_);
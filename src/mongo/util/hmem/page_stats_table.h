@@ -195,6 +195,20 @@ class PageStatsTableNode {
 };
 
 
+// Recent access pattern of one vaddr-range, used to size its read-ahead
+// window. Chunk numbers are local to the owner of the table: chunk "n + 1"
+// is the next chunk after "n" that the owner caches.
+struct AccessStream {
+  // Chunk of the last recorded access.
+  uint64_t last_chunk;
+
+  // Read ahead this many chunks past the current one. 0 means don't.
+  uint32_t window;
+
+  // Chunks below this one have been read ahead already.
+  uint64_t readahead_end;
+};
+
 // This class implements a mechanism to record the access frequency
 // of a group of pages.
 //
@@ -216,6 +230,8 @@ class PageStatsTableNode {
 // 3 fields from MSB to LSB:  PGD (pgd_bits_), PMD (pmd_bits_),
 // and PTE (pte_bits_).
 //
+// The table also keeps an AccessStream for each vaddr-range.
+//
 // This class is NOT thread safe.
 class PageStatsTable {
  public:
@@ -254,6 +270,15 @@ class PageStatsTable {
   uint64_t FindPagesWithMinCount(uint32_t pages_wanted,
                                  std::vector<uint64_t>* pages);
 
+  // Record an access to "chunk" of vaddr-range "vaddress_range_id", and
+  // adapt the range's read-ahead window: it doubles, up to
+  // READAHEAD_MAX_CHUNKS, each time the accesses move on to the next chunk,
+  // and halves when they jump anywhere else.
+  AccessStream* RecordStreamAccess(uint32_t vaddress_range_id, uint64_t chunk);
+
+  // Forget the access pattern of vaddr-range "vaddress_range_id".
+  void ResetStream(uint32_t vaddress_range_id);
+
   // Exam the PGD / PMD / PET in the PST table to see if its
   // internal structs satisfy the conditions of a well-formed PST.
   bool SanityCheck();
@@ -299,6 +324,9 @@ class PageStatsTable {
   // Total number of pages, also size of "ptes_" array.
   uint64_t total_pages_;
 
+  // One stream per vaddr-range id.
+  std::vector<AccessStream> streams_;
+
   std::string name_;
 };
 
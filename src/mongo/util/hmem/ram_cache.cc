@@ -21,7 +21,8 @@
 
 bool RAMCache::Init(HybridMemory* hmem,
                     const std::string& name,
-                    uint64_t max_cache_size) {
+                    uint64_t max_cache_size,
+                    ReplacementPolicyType replacement_policy) {
   assert(ready_ == false);
   max_cache_size_ = RoundUpToPageSize(max_cache_size);
   assert(max_cache_size_ > 0);
@@ -38,6 +39,11 @@ bool RAMCache::Init(HybridMemory* hmem,
   uint64_t hash_buckets = number_pages * 3 / 4;
   assert(hash_table_.Init(name + "-hashtable", hash_buckets, pin_memory) ==
          true);
+  if (policy_.Init(name + "-policy", replacement_policy, number_pages) ==
+      false) {
+    err("Unable to init replacement policy of %s\n", name.c_str());
+    return false;
+  }
 
   hybrid_memory_ = hmem;
   name_ = name;
@@ -51,6 +57,7 @@ bool RAMCache::Release() {
   if (ready_) {
     free_list_.Release();
     hash_table_.Release();
+    policy_.Release();
     ready_ = false;
   }
   return true;
@@ -62,30 +69,36 @@ RAMCacheItem* RAMCache::GetItem(void* virtual_address) {
       hash_table_.Lookup((void*)virtual_address, sizeof(void*));
   if (item) {
     assert(item->hash_key == virtual_address);
+    // This item gets an recent access.
+    policy_.Access(item);
   }
-  // This item gets an recent access. Move it to front of LRU list.
-  lru_list_.Update(item);
   return item;
 }
 
 uint32_t RAMCache::EvictItems() {
   uint32_t items_to_evict = 16;
   RAMCacheItem* items[items_to_evict];
-  // Scan backwards from Least-Recent-Used objs.
-  RAMCacheItem* item = lru_list_.tail();
+  // Scan in eviction order.
+  policy_.Lock();
+  RAMCacheItem* item = policy_.FirstVictim();
   uint32_t items_found = 0;
   while (item && (items_found < items_to_evict)) {
     V2HMapMetadata* v2hmap = item->v2hmap;
     assert(v2hmap->exist_ram_cache);
 
-    if (v2hmap->exist_page_cache == 0) {
+    if (v2hmap->exist_page_cache == 0 && v2hmap->io_pending == 0) {
       items[items_found++] = item;
     }
-    item = item->lru_prev;
+    item = policy_.NextVictim(item);
   }
+  policy_.Unlock();
+  bool dirty_evicted = false;
   for (uint32_t i = 0; i < items_found; ++i) {
     item = items[i];
     V2HMapMetadata* v2hmap = item->v2hmap;
+    if (v2hmap->dirty_ram_cache) {
+      dirty_evicted = true;
+    }
     if (!v2hmap->exist_flash_cache || v2hmap->dirty_ram_cache) {
       // Move these objs to the next lower cache layer.
       hybrid_memory_->GetFlashCache()->AddPage(item->data,
@@ -95,7 +108,7 @@ uint32_t RAMCache::EvictItems() {
                                                item->vaddress_range_id,
                                                item->hash_key);
     }
-    lru_list_.Unlink(item);
+    policy_.Remove(item, item->hash_key, true);
     hash_table_.Remove(item->hash_key, sizeof(void*));
 
     v2hmap->exist_ram_cache = 0;
@@ -104,11 +117,38 @@ uint32_t RAMCache::EvictItems() {
     item->hash_key = NULL;
     free_list_.Free(item);
   }
+  if (dirty_evicted) {
+    // Dirty items should have been written out by the flusher before
+    // they reached the LRU tail. Let it catch up.
+    hybrid_memory_->GetPageFlusher()->Wakeup();
+  }
+  return items_found;
+}
+
+uint32_t RAMCache::GetDirtyItemsNearTail(uint32_t max_items,
+                                         uint32_t scan_limit,
+                                         std::vector<RAMCacheItem*>* items) {
+  policy_.Lock();
+  RAMCacheItem* item = policy_.FirstVictim();
+  uint32_t items_found = 0;
+  for (uint32_t scanned = 0;
+       item && scanned < scan_limit && items_found < max_items;
+       ++scanned, item = policy_.NextVictim(item)) {
+    V2HMapMetadata* v2hmap = item->v2hmap;
+    // A dirty page-cache copy will overwrite this item when it's evicted,
+    // so writing the item out now is wasted IO.
+    if (v2hmap->dirty_ram_cache && !v2hmap->dirty_page_cache &&
+        !v2hmap->io_pending) {
+      items->push_back(item);
+      ++items_found;
+    }
+  }
+  policy_.Unlock();
   return items_found;
 }
 
 void RAMCache::Remove(RAMCacheItem* ram_cache_item) {
-  lru_list_.Unlink(ram_cache_item);
+  policy_.Remove(ram_cache_item, ram_cache_item->hash_key, false);
   hash_table_.Remove(ram_cache_item->hash_key, sizeof(void*));
   V2HMapMetadata* v2hmap = ram_cache_item->v2hmap;
   v2hmap->exist_ram_cache = 0;
@@ -136,7 +176,7 @@ bool RAMCache::AddPage(void* page,
       memcpy(item->data, page, obj_size);
       item->v2hmap->dirty_ram_cache = 1;
     }
-    lru_list_.Update(item);
+    policy_.Access(item);
   } else {
     // The virt-page hasn't been cahched in this layer.
     item = free_list_.New();
@@ -158,8 +198,8 @@ bool RAMCache::AddPage(void* page,
 
     // Insert the newly cached obj to hash-table.
     hash_table_.Insert(item, sizeof(void*));
-    // Link it to LRU list.
-    lru_list_.Link(item);
+    policy_.Insert(
+        item, page, hybrid_memory_->GetFlashCache()->PageAccessCount(v2hmap));
   }
   return true;
 }
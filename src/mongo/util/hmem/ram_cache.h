@@ -10,9 +10,11 @@
 #include <unistd.h>
 
 #include <queue>
+#include <vector>
 #include "hash_table.h"
 #include "lru_list.h"
 #include "free_list.h"
+#include "replacement_policy.h"
 
 struct RAMCacheItem;
 struct V2HMapMetadata;
@@ -37,6 +39,9 @@ struct RAMCacheItem {
   // Enclosing vaddress-range-id of this virtual-page.
   uint16_t vaddress_range_id;
 
+  // Which list of the replacement policy this item is on.
+  uint8_t policy_list;
+
   // Real memory where data of the virt-page is cached.
   // This memory should be pinned, and page-aligned to
   // facilitate direct IO to the next cache layer (flash or hdd).
@@ -55,7 +60,8 @@ class RAMCache {
 
   bool Init(HybridMemory* hmem,
             const std::string& name,
-            uint64_t max_cache_size);
+            uint64_t max_cache_size,
+            ReplacementPolicyType replacement_policy);
 
   bool Release();
 
@@ -93,6 +99,14 @@ class RAMCache {
   // Return the number of objs that have been evicted.
   uint32_t EvictItems();
 
+  // Scan up to "scan_limit" objs in eviction order, and collect up to
+  // "max_items" dirty objs that are about to be evicted, so they can be
+  // written to the next layer in background.
+  // Return the number of objs collected.
+  uint32_t GetDirtyItemsNearTail(uint32_t max_items,
+                                 uint32_t scan_limit,
+                                 std::vector<RAMCacheItem*>* items);
+
  protected:
   // if this cache layer is ready.
   bool ready_;
@@ -102,8 +116,8 @@ class RAMCache {
 
   std::string name_;
 
-  // The lru list that sorts all cached objs.
-  LRUList<RAMCacheItem> lru_list_;
+  // Sorts all cached objs for eviction.
+  ReplacementPolicy<RAMCacheItem> policy_;
 
   // A hash table to lookup a cached item given a virtual-address.
   HashTable<RAMCacheItem> hash_table_;
@@ -0,0 +1,72 @@
+// SSD-Assisted Hybrid Memory.
+// Author: Xiangyong Ouyang (neutronsharc@gmail.com)
+// Created on: 2011-11-11
+
+#include <assert.h>
+#include <stdint.h>
+
+#include <algorithm>
+#include <string>
+
+#include "debug.h"
+#include "replacement_policy.h"
+
+bool GhostList::Init(const std::string& name, uint64_t capacity) {
+  assert(ready_ == false);
+  assert(capacity > 0);
+  bool page_align = false;
+  bool pin_memory = true;
+  uint64_t payload_datasize = 0;
+  if (!free_list_.Init(name + "-freelist", capacity, payload_datasize,
+                       page_align, pin_memory)) {
+    return false;
+  }
+  // Load-factor = 4/3.
+  uint64_t hash_buckets = std::max<uint64_t>(capacity * 3 / 4, 1);
+  if (!hash_table_.Init(name + "-hashtable", hash_buckets, pin_memory)) {
+    return false;
+  }
+  capacity_ = capacity;
+  ready_ = true;
+  return ready_;
+}
+
+void GhostList::Release() {
+  if (ready_) {
+    free_list_.Release();
+    hash_table_.Release();
+    ready_ = false;
+  }
+}
+
+void GhostList::Add(void* key) {
+  if (hash_table_.Lookup(key, sizeof(void*)) != NULL) {
+    return;
+  }
+  if (size() >= capacity_) {
+    RemoveOldest();
+  }
+  GhostEntry* entry = free_list_.New();
+  assert(entry != NULL);
+  entry->hash_key = key;
+  assert(hash_table_.Insert(entry, sizeof(void*)) == true);
+  lru_list_.Link(entry);
+}
+
+bool GhostList::Remove(void* key) {
+  GhostEntry* entry = hash_table_.Lookup(key, sizeof(void*));
+  if (entry == NULL) {
+    return false;
+  }
+  hash_table_.Remove(key, sizeof(void*));
+  lru_list_.Unlink(entry);
+  free_list_.Free(entry);
+  return true;
+}
+
+void GhostList::RemoveOldest() {
+  GhostEntry* entry = lru_list_.tail();
+  if (entry != NULL) {
+    assert(Remove(entry->hash_key) == true);
+  }
+}
@@ -0,0 +1,349 @@
+// SSD-Assisted Hybrid Memory.
+// Author: Xiangyong Ouyang (neutronsharc@gmail.com)
+// Created on: 2011-11-11
+
+#ifndef REPLACEMENT_POLICY_H_
+#define REPLACEMENT_POLICY_H_
+
+#include <assert.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include <algorithm>
+#include <string>
+
+#include "debug.h"
+#include "free_list.h"
+#include "hash_table.h"
+#include "hybrid_memory_const.h"
+#include "hybrid_memory_lib.h"
+#include "lru_list.h"
+
+// Keys of objs recently evicted from a cache, up to a capacity. When full,
+// adding a key forgets the oldest one.
+//
+// This class is NOT thread safe.
+class GhostList {
+ public:
+  GhostList() : ready_(false), capacity_(0) {}
+
+  virtual ~GhostList() { Release(); }
+
+  bool Init(const std::string& name, uint64_t capacity);
+
+  void Release();
+
+  void Add(void* key);
+
+  // Forget "key". Return true if it was in the list.
+  bool Remove(void* key);
+
+  // Forget the oldest key.
+  void RemoveOldest();
+
+  uint64_t size() { return lru_list_.GetNumberObjects(); }
+
+ protected:
+  struct GhostEntry {
+    GhostEntry* lru_prev;
+    GhostEntry* lru_next;
+    void* hash_key;
+    GhostEntry* hash_next;
+    // To please the free-list. Not used.
+    void* data;
+  };
+
+  bool ready_;
+
+  uint64_t capacity_;
+
+  FreeList<GhostEntry> free_list_;
+
+  HashTable<GhostEntry> hash_table_;
+
+  // Most recently added key at head.
+  LRUList<GhostEntry> lru_list_;
+};
+
+// Replacement policy of a cache layer. It orders the cached objs for
+// eviction, and remembers keys of objs recently evicted.
+//
+//   - LRU: a single LRU list.
+//   - 2Q: new objs enter a FIFO "A1in" of 1/4 of the cache. Objs evicted
+//     from it are remembered in "A1out". An obj that is accessed again,
+//     or enters again while remembered, goes to the LRU list "Am", and so
+//     does an obj whose access count is high. A scan passes through A1in
+//     without touching Am.
+//   - ARC: recency list "T1" and frequency list "T2" share the cache, with
+//     a target size for T1 that adapts to hits in the ghost lists "B1" and
+//     "B2" of keys evicted from T1 and T2.
+//
+// Objs of type T must contain "lru_prev", "lru_next", and "policy_list".
+//
+// "access_count" passed to Insert() is what the caller knows about the
+// page's past accesses, usually its access count in the flash-cache's
+// PageStatsTable. An obj whose count is REPLACEMENT_FREQUENT_RATIO times
+// the moving average of counts passed to Insert() is treated as frequently
+// used from the start.
+//
+// Modifications take the policy lock internally. Callers that walk the
+// objs with FirstVictim() / NextVictim() must hold it with Lock() /
+// Unlock(), and must not modify the policy while holding it.
+template <class T>
+class ReplacementPolicy {
+ public:
+  ReplacementPolicy()
+      : ready_(false), type_(REPLACEMENT_LRU), access_count_average_(0) {
+    pthread_spin_init(&lock_, PTHREAD_PROCESS_PRIVATE);
+  }
+
+  virtual ~ReplacementPolicy() {
+    Release();
+    pthread_spin_destroy(&lock_);
+  }
+
+  // Manage a cache of up to "capacity" objs.
+  bool Init(const std::string& name,
+            ReplacementPolicyType type,
+            uint64_t capacity);
+
+  void Release();
+
+  // "x" with key "key" enters the cache.
+  void Insert(T* x, void* key, uint32_t access_count);
+
+  // "x" is accessed while cached.
+  void Access(T* x);
+
+  // "x" with key "key" leaves the cache. If it's "evicted", its key is
+  // remembered for a while.
+  void Remove(T* x, void* key, bool evicted);
+
+  void Lock() { pthread_spin_lock(&lock_); }
+
+  void Unlock() { pthread_spin_unlock(&lock_); }
+
+  // The obj to evict first, or NULL if the cache is empty.
+  T* FirstVictim();
+
+  // The obj to evict after "x", or NULL.
+  T* NextVictim(T* x);
+
+  uint64_t GetNumberObjects() {
+    return lists_[0].GetNumberObjects() + lists_[1].GetNumberObjects();
+  }
+
+  ReplacementPolicyType type() const { return type_; }
+
+ protected:
+  // Values of "policy_list". The LRU policy only uses kRecent.
+  // 2Q: kRecent is A1in, kFrequent is Am. ARC: kRecent is T1, kFrequent
+  // is T2.
+  enum { kRecent = 0, kFrequent = 1 };
+
+  // The list to evict from first.
+  int PrimaryList();
+
+  // Account "access_count" in the moving average, return true if it's
+  // high enough to mark a frequently used obj.
+  bool IsFrequentLocked(uint32_t access_count);
+
+  void LinkLocked(T* x, int list);
+
+  bool ready_;
+
+  ReplacementPolicyType type_;
+
+  uint64_t capacity_;
+
+  LRUList<T> lists_[2];
+
+  // 2Q: A1out and unused. ARC: B1 and B2.
+  GhostList ghosts_[2];
+
+  // 2Q: max size of A1in. ARC: target size of T1.
+  uint64_t recent_target_;
+
+  // Moving average of access counts passed to Insert(), scaled by
+  // 2^REPLACEMENT_AVERAGE_SHIFT.
+  uint64_t access_count_average_;
+
+  pthread_spinlock_t lock_;
+};
+
+template <class T>
+bool ReplacementPolicy<T>::Init(const std::string& name,
+                                ReplacementPolicyType type,
+                                uint64_t capacity) {
+  assert(ready_ == false);
+  assert(capacity > 0);
+  type_ = type;
+  capacity_ = capacity;
+  switch (type_) {
+    case REPLACEMENT_LRU:
+      recent_target_ = capacity;
+      break;
+    case REPLACEMENT_2Q:
+      recent_target_ = std::max<uint64_t>(capacity / 4, 1);
+      if (!ghosts_[0].Init(name + "-a1out",
+                           std::max<uint64_t>(capacity / 2, 1))) {
+        return false;
+      }
+      break;
+    case REPLACEMENT_ARC:
+      recent_target_ = 0;
+      if (!ghosts_[0].Init(name + "-b1", capacity) ||
+          !ghosts_[1].Init(name + "-b2", capacity)) {
+        return false;
+      }
+      break;
+    default:
+      err("Unknown replacement policy %d\n", type_);
+      return false;
+  }
+  ready_ = true;
+  return ready_;
+}
+
+template <class T>
+void ReplacementPolicy<T>::Release() {
+  if (ready_) {
+    ghosts_[0].Release();
+    ghosts_[1].Release();
+    ready_ = false;
+  }
+}
+
+template <class T>
+void ReplacementPolicy<T>::LinkLocked(T* x, int list) {
+  x->policy_list = list;
+  lists_[list].Link(x);
+}
+
+template <class T>
+bool ReplacementPolicy<T>::IsFrequentLocked(uint32_t access_count) {
+  uint64_t scaled_count = (uint64_t)access_count << REPLACEMENT_AVERAGE_SHIFT;
+  bool frequent = access_count > 0 &&
+                  scaled_count >= access_count_average_ *
+                                      REPLACEMENT_FREQUENT_RATIO;
+  access_count_average_ +=
+      access_count - (access_count_average_ >> REPLACEMENT_AVERAGE_SHIFT);
+  return frequent;
+}
+
+template <class T>
+void ReplacementPolicy<T>::Insert(T* x, void* key, uint32_t access_count) {
+  Lock();
+  bool frequent = IsFrequentLocked(access_count);
+  switch (type_) {
+    case REPLACEMENT_LRU:
+      LinkLocked(x, kRecent);
+      break;
+    case REPLACEMENT_2Q:
+      if (ghosts_[0].Remove(key) || frequent) {
+        LinkLocked(x, kFrequent);
+      } else {
+        LinkLocked(x, kRecent);
+      }
+      break;
+    case REPLACEMENT_ARC: {
+      uint64_t b1 = ghosts_[0].size();
+      uint64_t b2 = ghosts_[1].size();
+      if (ghosts_[0].Remove(key)) {
+        // T1 was too small.
+        recent_target_ = std::min<uint64_t>(
+            capacity_, recent_target_ + std::max<uint64_t>(b2 / b1, 1));
+        LinkLocked(x, kFrequent);
+      } else if (ghosts_[1].Remove(key)) {
+        // T2 was too small.
+        uint64_t delta = std::max<uint64_t>(b1 / b2, 1);
+        recent_target_ = recent_target_ > delta ? recent_target_ - delta : 0;
+        LinkLocked(x, kFrequent);
+      } else if (frequent) {
+        LinkLocked(x, kFrequent);
+      } else {
+        LinkLocked(x, kRecent);
+      }
+      break;
+    }
+  }
+  Unlock();
+}
+
+template <class T>
+void ReplacementPolicy<T>::Access(T* x) {
+  Lock();
+  if (type_ != REPLACEMENT_LRU && x->policy_list == kRecent) {
+    // Second access: from recency to frequency. Classic 2Q ignores hits
+    // in A1in as correlated references, but here the mapped page absorbs
+    // those, and an access seen by the policy is a real re-reference.
+    lists_[kRecent].Unlink(x);
+    LinkLocked(x, kFrequent);
+  } else {
+    lists_[x->policy_list].Update(x);
+  }
+  Unlock();
+}
+
+template <class T>
+void ReplacementPolicy<T>::Remove(T* x, void* key, bool evicted) {
+  Lock();
+  int list = x->policy_list;
+  lists_[list].Unlink(x);
+  if (evicted) {
+    if (type_ == REPLACEMENT_2Q && list == kRecent) {
+      ghosts_[0].Add(key);
+    } else if (type_ == REPLACEMENT_ARC) {
+      ghosts_[list].Add(key);
+      // Keep |T1| + |B1| <= c, and all ghosts <= c.
+      while (ghosts_[0].size() > 0 &&
+             lists_[kRecent].GetNumberObjects() + ghosts_[0].size() >
+                 capacity_) {
+        ghosts_[0].RemoveOldest();
+      }
+      while (ghosts_[0].size() + ghosts_[1].size() > capacity_) {
+        ghosts_[list == kRecent ? 1 : 0].RemoveOldest();
+      }
+    }
+  }
+  Unlock();
+}
+
+template <class T>
+int ReplacementPolicy<T>::PrimaryList() {
+  if (type_ == REPLACEMENT_LRU) {
+    return kRecent;
+  }
+  uint64_t recent = lists_[kRecent].GetNumberObjects();
+  if (recent > 0 &&
+      (recent > recent_target_ ||
+       lists_[kFrequent].GetNumberObjects() == 0)) {
+    return kRecent;
+  }
+  return kFrequent;
+}
+
+template <class T>
+T* ReplacementPolicy<T>::FirstVictim() {
+  int list = PrimaryList();
+  T* x = lists_[list].tail();
+  if (x == NULL && type_ != REPLACEMENT_LRU) {
+    x = lists_[1 - list].tail();
+  }
+  return x;
+}
+
+template <class T>
+T* ReplacementPolicy<T>::NextVictim(T* x) {
+  if (x->lru_prev) {
+    return x->lru_prev;
+  }
+  // Reached the head of the primary list, continue with the other one.
+  if (type_ != REPLACEMENT_LRU && x->policy_list == PrimaryList()) {
+    return lists_[1 - x->policy_list].tail();
+  }
+  return NULL;
+}
+
+#endif  // REPLACEMENT_POLICY_H_
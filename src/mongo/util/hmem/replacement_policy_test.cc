@@ -0,0 +1,144 @@
+// SSD-Assisted Hybrid Memory.
+// Author: Xiangyong Ouyang (neutronsharc@gmail.com)
+// Created on: 2011-11-11
+
+#include <assert.h>
+#include <stdint.h>
+#include <stdio.h>
+
+#include <vector>
+
+#include "replacement_policy.h"
+
+struct Item {
+  Item* lru_prev;
+  Item* lru_next;
+  uint8_t policy_list;
+
+  // Key of the cached obj, or -1 if the item is free.
+  int64_t key;
+};
+
+// A cache of "capacity" items in front of keys 0 .. "number_keys" - 1.
+class TestCache {
+ public:
+  TestCache(ReplacementPolicyType type, uint32_t capacity, uint32_t number_keys)
+      : items_(capacity), slots_(number_keys, (Item*)NULL) {
+    assert(policy_.Init("test-policy", type, capacity) == true);
+    for (uint32_t i = 0; i < capacity; ++i) {
+      items_[i].key = -1;
+      free_items_.push_back(&items_[i]);
+    }
+  }
+
+  // Return true on a hit.
+  bool Get(uint32_t key) {
+    Item* item = slots_[key];
+    if (item) {
+      policy_.Access(item);
+      return true;
+    }
+    if (free_items_.empty()) {
+      policy_.Lock();
+      Item* victim = policy_.FirstVictim();
+      policy_.Unlock();
+      assert(victim != NULL);
+      policy_.Remove(victim, Key(victim->key), true);
+      slots_[victim->key] = NULL;
+      victim->key = -1;
+      free_items_.push_back(victim);
+    }
+    item = free_items_.back();
+    free_items_.pop_back();
+    item->key = key;
+    slots_[key] = item;
+    policy_.Insert(item, Key(key), 0);
+    return false;
+  }
+
+  bool Cached(uint32_t key) { return slots_[key] != NULL; }
+
+ private:
+  static void* Key(int64_t key) { return (void*)(key + 1); }
+
+  ReplacementPolicy<Item> policy_;
+
+  std::vector<Item> items_;
+
+  std::vector<Item*> free_items_;
+
+  // Cached item of each key.
+  std::vector<Item*> slots_;
+};
+
+// Warm up a hot set of half the cache size, scan 4x the cache size of
+// cold keys once, and count hot keys still cached.
+static uint32_t HotKeysAfterScan(ReplacementPolicyType type) {
+  uint32_t capacity = 1000;
+  uint32_t hot_keys = capacity / 2;
+  uint32_t cold_keys = capacity;
+  uint32_t scan_keys = capacity * 4;
+  TestCache cache(type, capacity, hot_keys + cold_keys + scan_keys);
+
+  // Hot keys are touched several times, with cold keys in between so that
+  // the cache is full.
+  for (uint32_t round = 0; round < 4; ++round) {
+    for (uint32_t i = 0; i < hot_keys; ++i) {
+      cache.Get(i);
+    }
+    for (uint32_t i = 0; i < cold_keys / 4; ++i) {
+      cache.Get(hot_keys + round * cold_keys / 4 + i);
+    }
+  }
+
+  // Keys never seen before.
+  for (uint32_t i = 0; i < scan_keys; ++i) {
+    cache.Get(hot_keys + cold_keys + i);
+  }
+  uint32_t cached = 0;
+  for (uint32_t i = 0; i < hot_keys; ++i) {
+    if (cache.Cached(i)) {
+      ++cached;
+    }
+  }
+  return cached;
+}
+
+static void TestScanResistance() {
+  uint32_t lru = HotKeysAfterScan(REPLACEMENT_LRU);
+  uint32_t two_q = HotKeysAfterScan(REPLACEMENT_2Q);
+  uint32_t arc = HotKeysAfterScan(REPLACEMENT_ARC);
+  printf("hot keys cached after a scan: lru %d, 2q %d, arc %d (of 500)\n",
+         lru,
+         two_q,
+         arc);
+  assert(lru == 0);
+  assert(two_q > 400);
+  assert(arc > 400);
+}
+
+// Ghost lists forget the oldest keys at capacity.
+static void TestGhostList() {
+  GhostList ghosts;
+  assert(ghosts.Init("test-ghosts", 4) == true);
+  for (uint64_t i = 1; i <= 6; ++i) {
+    ghosts.Add((void*)i);
+  }
+  assert(ghosts.size() == 4);
+  assert(ghosts.Remove((void*)1) == false);
+  assert(ghosts.Remove((void*)2) == false);
+  assert(ghosts.Remove((void*)3) == true);
+  assert(ghosts.size() == 3);
+  ghosts.RemoveOldest();
+  assert(ghosts.Remove((void*)4) == false);
+  assert(ghosts.Remove((void*)6) == true);
+  assert(ghosts.size() == 1);
+  ghosts.Release();
+}
+
+int main(int argc, char** argv) {
+  TestGhostList();
+  TestScanResistance();
+  printf("PASS\n");
+  return 0;
+}
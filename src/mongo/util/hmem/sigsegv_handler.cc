@@ -110,6 +110,26 @@ bool SigSegvHandler::InstallHandler(signal_handler_t handler) {
   return true;
 }
 
+void SigSegvHandler::ForwardToOldHandler(int sig,
+                                         siginfo_t* sig_info,
+                                         void* ucontext) {
+  if (have_installed_handler_) {
+    if (old_action_.sa_flags & SA_SIGINFO) {
+      old_action_.sa_sigaction(sig, sig_info, ucontext);
+      return;
+    }
+    // Ignoring a real fault would only fault again, so SIG_IGN is treated
+    // as SIG_DFL.
+    if (old_action_.sa_handler != SIG_DFL &&
+        old_action_.sa_handler != SIG_IGN) {
+      old_action_.sa_handler(sig);
+      return;
+    }
+  }
+  signal(SIGSEGV, SIG_DFL);
+  kill(getpid(), SIGSEGV);
+}
+
 bool SigSegvHandler::UninstallHandler() {
   if (!have_installed_handler_) {
     return true;
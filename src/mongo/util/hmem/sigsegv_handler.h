@@ -29,6 +29,10 @@ class SigSegvHandler {
   // Uninstall the new handler and restore to previous handler.
   bool UninstallHandler();
 
+  // Hand a fault outside hybrid-memory to the handler that was installed
+  // before ours, or to the default action if there was none.
+  void ForwardToOldHandler(int sig, siginfo_t* sig_info, void* ucontext);
+
  protected:
   // Indicate if we have installed the new sigsegv handler.
   bool have_installed_handler_;
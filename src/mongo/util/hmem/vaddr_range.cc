@@ -16,7 +16,25 @@
 #include "utils.h"
 
 bool IsValidVAddressRangeId(uint32_t vaddress_range_id) {
-  return vaddress_range_id < INVALID_VADDRESS_RANGE_ID;
+  return vaddress_range_id < DETACHED_VADDRESS_RANGE_ID;
+}
+
+static void StatToHDDFileVersion(const struct stat& file_stat,
+                                 HDDFileVersion* version) {
+  version->inode = file_stat.st_ino;
+  version->size = file_stat.st_size;
+  version->generation =
+      file_stat.st_mtim.tv_sec * 1000000000ULL + file_stat.st_mtim.tv_nsec;
+}
+
+bool GetHDDFileVersion(int fd, HDDFileVersion* version) {
+  struct stat file_stat;
+  if (fstat(fd, &file_stat) != 0) {
+    perror("fstat error: ");
+    return false;
+  }
+  StatToHDDFileVersion(file_stat, version);
+  return true;
 }
 
 bool VAddressRange::Init(uint64_t size) {
@@ -65,6 +83,9 @@ bool VAddressRange::Init(uint64_t size,
         hdd_filename.c_str());
     return false;
   }
+  // Taken before the file is extended below, to compare with the version
+  // saved along with its detached flash pages.
+  StatToHDDFileVersion(hdd_file_stat, &hdd_file_version_);
   bool should_truncate = false;
   uint64_t hddfile_old_size = hdd_file_stat.st_size;
   uint64_t hddfile_new_size = 0;
@@ -167,7 +188,7 @@ bool VAddressRangeGroup::Init() {
   for (uint32_t i = 0; i < num_vaddr_ranges; ++i) {
     vaddr_range_list_[i].set_vaddress_range_id(i);
   }
-  num_vaddr_ranges = INVALID_VADDRESS_RANGE_ID;  // from 0 to 255.
+  num_vaddr_ranges = DETACHED_VADDRESS_RANGE_ID;  // from 0 to 253.
   total_vaddr_ranges_ = num_vaddr_ranges;
   free_vaddr_ranges_ = num_vaddr_ranges;
   inuse_vaddr_ranges_ = 0;
@@ -189,7 +210,12 @@ VAddressRange* VAddressRangeGroup::AllocateVAddressRange(
   for (uint32_t i = 0; i < total_vaddr_ranges_; ++i) {
     if (vaddr_range_bitmap_[i] == 1) {
       VAddressRange *vaddr_range = &vaddr_range_list_[i];
-      assert(vaddr_range->Init(size, hdd_filename, hdd_file_offset) == true);
+      if (vaddr_range->Init(size, hdd_filename, hdd_file_offset) == false) {
+        err("Failed to map hdd file %s at offset %ld\n",
+            hdd_filename.c_str(),
+            hdd_file_offset);
+        return NULL;
+      }
       vaddr_range_bitmap_[i] = 0;
       --free_vaddr_ranges_;
       ++inuse_vaddr_ranges_;
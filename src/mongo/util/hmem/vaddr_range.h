@@ -17,9 +17,26 @@
 #include "avl.h"
 #include "hybrid_memory_const.h"
 
-// Assume 8 bits vaddress-ranges, usable vaddress-range-id from 0 to 254.
+// Assume 8 bits vaddress-ranges, usable vaddress-range-id from 0 to 253.
 #define INVALID_VADDRESS_RANGE_ID (0xff)
 
+// Owner of a flash page that caches a page of an hdd file which is no
+// longer mapped, see FlashCache::DetachPage().
+#define DETACHED_VADDRESS_RANGE_ID (0xfe)
+
+// Identifies the content of an hdd file. A file with the same inode and
+// size, and whose modification time ("generation") hasn't changed since
+// hmem last wrote it, still holds what hmem wrote.
+struct HDDFileVersion {
+  uint64_t inode;
+  uint64_t size;
+  // Modification time in nsec.
+  uint64_t generation;
+};
+
+// Get the current version of the open file "fd".
+bool GetHDDFileVersion(int fd, HDDFileVersion* version);
+
 // Vritual-address to hybrid-memory mapping metadata to record
 // mapping information for each virtual-page.
 struct V2HMapMetadata {
@@ -30,7 +47,10 @@ struct V2HMapMetadata {
   uint32_t dirty_page_cache : 1;
   uint32_t dirty_ram_cache : 1;
   uint32_t dirty_flash_cache : 1;
-  uint32_t reserved : 1;
+  // An IO on a copy of this page runs without the hmem lock: a background
+  // write by the flusher, or a fault reading the page in. Its RAM-cache
+  // item and flash page must not be evicted or reused until it completes.
+  uint32_t io_pending : 1;
 
   // There is no need to store a hmem_id for a virtual-page.
   // We can compute the hmem_id a virtual-page belongs to by round-robin
@@ -81,6 +101,8 @@ class VAddressRange {
 
   uint8_t *address() const { return address_; }
 
+  uint64_t size() const { return size_; }
+
   uint32_t vaddress_range_id() const { return vaddress_range_id_; }
 
   void set_vaddress_range_id(uint32_t vaddress_range_id) {
@@ -101,6 +123,11 @@ class VAddressRange {
 
   uint64_t hdd_file_offset() const { return hdd_file_offset_; }
 
+  const std::string& hdd_filename() const { return hdd_filename_; }
+
+  // Version of the backing hdd file before it was mapped.
+  const HDDFileVersion& hdd_file_version() const { return hdd_file_version_; }
+
   bool is_active() const { return is_active_; }
 
  protected:
@@ -134,6 +161,8 @@ class VAddressRange {
   // byte-offset onwards and extends to "size_" bytes.
   uint64_t hdd_file_offset_;
 
+  HDDFileVersion hdd_file_version_;
+
   // An array of metadata record, one entry per virt-page.
   V2HMapMetadata *v2h_map_;
 
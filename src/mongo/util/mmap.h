@@ -213,6 +213,7 @@ namespace mongo {
         HANDLE maphandle;
         std::vector<void *> views;
         unsigned long long len;
+        bool hmemMapped;  // views[0] is a util/hmem range rather than a kernel mapping
         
 #ifdef _WIN32
         boost::shared_ptr<mutex> _flushMutex;
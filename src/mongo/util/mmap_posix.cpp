@@ -24,7 +24,9 @@
 #include <sys/types.h>
 
 #include "mongo/db/d_concurrency.h"
+#include "mongo/db/storage_options.h"
 #include "mongo/util/file_allocator.h"
+#include "mongo/util/hmem/hybrid_memory_lib.h"
 #include "mongo/util/mmap.h"
 #include "mongo/util/mongoutils/str.h"
 #include "mongo/util/processinfo.h"
@@ -43,15 +45,20 @@ namespace mongo {
         fd = 0;
         maphandle = 0;
         len = 0;
+        hmemMapped = false;
         created();
     }
 
     void MemoryMappedFile::close() {
         LockMongoFilesShared::assertExclusivelyLocked();
         for( vector<void*>::iterator i = views.begin(); i != views.end(); i++ ) {
-            munmap(*i,len);
+            if ( hmemMapped )
+                hmem_free(*i); // writes back dirty pages
+            else
+                munmap(*i,len);
         }
         views.clear();
+        hmemMapped = false;
 
         if ( fd )
             ::close(fd);
@@ -113,6 +120,18 @@ namespace mongo {
         uassert(10447,  str::stream() << "map file alloc failed, wanted: " << length << " filelen: " << filelen << ' ' << sizeof(size_t), filelen == length );
         lseek( fd, 0, SEEK_SET );
 
+        if ( storageGlobalParams.hmem ) {
+            void* view = hmem_map(filename, length, 0);
+            if ( view == NULL ) {
+                error() << "  hmem_map() failed for " << filename << " len:" << length
+                        << ", hmem can map at most 254 files" << endl;
+                return 0;
+            }
+            hmemMapped = true;
+            views.push_back( view );
+            return view;
+        }
+
         void * view = mmap(NULL, length, PROT_READ|PROT_WRITE, MAP_SHARED, fd, 0);
         if ( view == MAP_FAILED ) {
             error() << "  mmap() failed for " << filename << " len:" << length << " " << errnoWithDescription() << endl;
@@ -142,6 +161,7 @@ namespace mongo {
     }
 
     void* MemoryMappedFile::createReadOnlyMap() {
+        massert( 17288, "read only views aren't supported with --hmem", !hmemMapped );
         void * x = mmap( /*start*/0 , len , PROT_READ , MAP_SHARED , fd , 0 );
         if( x == MAP_FAILED ) {
             if ( errno == ENOMEM ) {
@@ -156,6 +176,7 @@ namespace mongo {
     }
 
     void* MemoryMappedFile::createPrivateMap() {
+        massert( 17289, "private views aren't supported with --hmem", !hmemMapped );
         void * x = mmap( /*start*/0 , len , PROT_READ|PROT_WRITE , MAP_PRIVATE|MAP_NORESERVE , fd , 0 );
         if( x == MAP_FAILED ) {
             if ( errno == ENOMEM ) {
@@ -198,30 +219,41 @@ namespace mongo {
     void MemoryMappedFile::flush(bool sync) {
         if ( views.empty() || fd == 0 )
             return;
+        if ( hmemMapped ) {
+            // hmem writes pages with O_DIRECT, so there is nothing to wait for when !sync
+            if ( !hmem_sync(viewForFlushing()) )
+                problem() << "hmem_sync failed for " << filename() << endl;
+            return;
+        }
         if ( msync(viewForFlushing(), len, sync ? MS_SYNC : MS_ASYNC) )
             problem() << "msync " << errnoWithDescription() << endl;
     }
 
     class PosixFlushable : public MemoryMappedFile::Flushable {
     public:
-        PosixFlushable( void * view , HANDLE fd , long len )
-            : _view( view ) , _fd( fd ) , _len(len) {
+        PosixFlushable( void * view , HANDLE fd , long len , bool hmemMapped )
+            : _view( view ) , _fd( fd ) , _len(len) , _hmemMapped( hmemMapped ) {
         }
 
         void flush() {
-            if ( _view && _fd )
-                if ( msync(_view, _len, MS_SYNC ) )
-                    problem() << "msync " << errnoWithDescription() << endl;
-
+            if ( !_view || !_fd )
+                return;
+            if ( _hmemMapped ) {
+                if ( !hmem_sync( _view ) )
+                    problem() << "hmem_sync failed" << endl;
+            }
+            else if ( msync(_view, _len, MS_SYNC ) )
+                problem() << "msync " << errnoWithDescription() << endl;
         }
 
         void * _view;
         HANDLE _fd;
         long _len;
+        bool _hmemMapped;
     };
 
     MemoryMappedFile::Flushable * MemoryMappedFile::prepareFlush() {
-        return new PosixFlushable( viewForFlushing() , fd , len );
+        return new PosixFlushable( viewForFlushing() , fd , len , hmemMapped );
     }
 
 
@@ -76,6 +76,7 @@ namespace mongo {
         fd = 0;
         maphandle = 0;
         len = 0;
+        hmemMapped = false;
         created();
     }
 
@@ -19,6 +19,7 @@
 
 #include <vector>
 
+#include "mongo/bson/bsonobj.h"
 #include "mongo/bson/util/atomic_int.h"
 #include "mongo/util/goodies.h"
 #include "mongo/util/net/hostandport.h"
@@ -46,7 +47,8 @@ namespace mongo {
         dbQuery = 2004,
         dbGetMore = 2005,
         dbDelete = 2006,
-        dbKillCursors = 2007
+        dbKillCursors = 2007,
+        dbCompressed = 2012 /* another message, compressed. see MessageCompressor */
     };
 
     bool doesOpGetAResponse( int op );
@@ -62,6 +64,7 @@ namespace mongo {
         case dbGetMore: return "getmore";
         case dbDelete: return "remove";
         case dbKillCursors: return "killcursors";
+        case dbCompressed: return "compressed";
         default:
             massert( 16141, str::stream() << "cannot translate opcode " << op, !op );
             return "";
@@ -77,6 +80,7 @@ namespace mongo {
         case dbQuery:
         case dbGetMore:
         case dbKillCursors:
+        case dbCompressed:
             return false;
 
         case dbUpdate:
@@ -195,6 +199,17 @@ namespace mongo {
 
         int dataSize() const { return size() - sizeof(MSGHEADER); }
 
+        // the buffers that make up the message, in order
+        void getBuffers(std::vector< std::pair< const char *, size_t > >* out) const {
+            if ( _buf ) {
+                out->push_back(std::make_pair((const char*)_buf, (size_t)_buf->len));
+                return;
+            }
+            for (MsgVec::const_iterator it = _data.begin(); it != _data.end(); ++it) {
+                out->push_back(std::make_pair((const char*)it->first, (size_t)it->second));
+            }
+        }
+
         // concat multiple buffers - noop if <2 buffers already, otherwise can be expensive copy
         // can get rid of this if we make response handling smarter
         void concat() {
@@ -227,6 +242,7 @@ namespace mongo {
             r._buf = 0;
             if ( r._data.size() > 0 ) {
                 _data.swap( r._data );
+                _objs.swap( r._objs );
             }
             r._freeIt = false;
             _freeIt = true;
@@ -238,13 +254,19 @@ namespace mongo {
                 if ( _buf ) {
                     free( _buf );
                 }
-                for (std::vector< std::pair< char *, int > >::const_iterator i = _data.begin();
-                     i != _data.end(); ++i) {
-                    free(i->first);
+                // skip the buffers referenced by appendObj(), which _objs keeps alive
+                ObjVec::const_iterator obj = _objs.begin();
+                for (size_t i = 0; i < _data.size(); ++i) {
+                    if ( obj != _objs.end() && obj->first == i ) {
+                        ++obj;
+                        continue;
+                    }
+                    free(_data[i].first);
                 }
             }
             _buf = 0;
             _data.clear();
+            _objs.clear();
             _freeIt = false;
         }
 
@@ -269,6 +291,19 @@ namespace mongo {
             header()->len += size;
         }
 
+        // use to add the buffer of an owned BSONObj without copying it
+        // the message holds a reference to 'obj' instead of freeing the buffer
+        void appendObj(const BSONObj& obj) {
+            verify( !empty() && _freeIt && obj.isOwned() );
+            if ( _buf ) {
+                _data.push_back(std::make_pair((char*)_buf, _buf->len));
+                _buf = 0;
+            }
+            _objs.push_back(std::make_pair(_data.size(), obj));
+            _data.push_back(std::make_pair(const_cast<char*>(obj.objdata()), obj.objsize()));
+            header()->len += obj.objsize();
+        }
+
         // use to set first buffer if empty
         void setData(MsgData *d, bool freeIt) {
             verify( empty() );
@@ -305,6 +340,9 @@ namespace mongo {
         // byte buffer(s) - the first must contain at least a full MsgData unless using _buf for storage instead
         typedef std::vector< std::pair< char*, int > > MsgVec;
         MsgVec _data;
+        // owned objects added by appendObj() and their index in _data
+        typedef std::vector< std::pair< size_t, BSONObj > > ObjVec;
+        ObjVec _objs;
         bool _freeIt;
     };
 
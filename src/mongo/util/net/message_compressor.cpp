@@ -0,0 +1,237 @@
+// message_compressor.cpp
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/pch.h"
+
+#include "mongo/util/net/message_compressor.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/platform/atomic_word.h"
+#include "mongo/util/compress.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/message_port.h"
+#include "mongo/util/timer.h"
+
+namespace mongo {
+
+    bool MessageCompressor::enabled = false;
+    int MessageCompressor::minSize = 1024;
+
+    namespace {
+
+        const char kSnappy = 1;
+
+        // original opcode, original body length, compressor id
+        const size_t kCompressedHeaderSize = sizeof(int) + sizeof(int) + sizeof(char);
+
+        /** Counters for one direction.  Lengths are of message bodies, without headers. */
+        struct CompressionStats {
+            AtomicInt64 messages;
+            AtomicInt64 uncompressedBytes;
+            AtomicInt64 compressedBytes;
+            AtomicInt64 micros;
+
+            void hit(long long uncompressed, long long compressed, long long elapsed) {
+                messages.fetchAndAdd(1);
+                uncompressedBytes.fetchAndAdd(uncompressed);
+                compressedBytes.fetchAndAdd(compressed);
+                micros.fetchAndAdd(elapsed);
+            }
+
+            BSONObj toBSON() const {
+                const long long uncompressed = uncompressedBytes.load();
+                const long long compressed = compressedBytes.load();
+                BSONObjBuilder b;
+                b.appendNumber("messages", messages.load());
+                b.appendNumber("uncompressedBytes", uncompressed);
+                b.appendNumber("compressedBytes", compressed);
+                b.append("ratio",
+                         compressed ? static_cast<double>(uncompressed) / compressed : 0.0);
+                b.appendNumber("micros", micros.load());
+                return b.obj();
+            }
+        };
+
+        CompressionStats compressorStats;
+        CompressionStats decompressorStats;
+
+        // messages large enough to compress that didn't get shorter, and went out as is
+        AtomicInt64 incompressibleMessages;
+
+    }  // namespace
+
+    // static
+    const char* MessageCompressor::name() {
+        return "snappy";
+    }
+
+    // static
+    bool MessageCompressor::compress(const Message& in, Message* out) {
+        verify(out->empty());
+        const int size = in.size();
+        if (size < minSize || size < static_cast<int>(sizeof(MSGHEADER))) {
+            return false;
+        }
+
+        // Compress everything but the header, which the first buffer holds.
+        std::vector<std::pair<const char*, size_t> > buffers;
+        in.getBuffers(&buffers);
+        verify(!buffers.empty() && buffers[0].second >= sizeof(MSGHEADER));
+        buffers[0].first += sizeof(MSGHEADER);
+        buffers[0].second -= sizeof(MSGHEADER);
+        const size_t bodySize = size - sizeof(MSGHEADER);
+
+        const size_t bound = sizeof(MSGHEADER) + kCompressedHeaderSize
+                             + maxCompressedLength(bodySize);
+        char* buf = static_cast<char*>(malloc(bound));
+        verify(buf);
+
+        Timer t;
+        const size_t compressedSize =
+            rawCompress(buffers, buf + sizeof(MSGHEADER) + kCompressedHeaderSize);
+        const long long elapsed = t.micros();
+
+        if (compressedSize + kCompressedHeaderSize >= bodySize) {
+            free(buf);
+            incompressibleMessages.fetchAndAdd(1);
+            return false;
+        }
+        compressorStats.hit(bodySize, compressedSize, elapsed);
+
+        MsgData* md = reinterpret_cast<MsgData*>(buf);
+        md->len = sizeof(MSGHEADER) + kCompressedHeaderSize + compressedSize;
+        md->id = in.header()->id;
+        md->responseTo = in.header()->responseTo;
+        md->setOperation(dbCompressed);
+
+        char* p = md->_data;
+        const int originalOp = in.operation();
+        const int originalSize = bodySize;
+        memcpy(p, &originalOp, sizeof(int));
+        memcpy(p + sizeof(int), &originalSize, sizeof(int));
+        p[2 * sizeof(int)] = kSnappy;
+
+        out->setData(md, true);
+        return true;
+    }
+
+    // static
+    bool MessageCompressor::decompress(Message& m) {
+        MsgData* md = m.singleData();
+        verify(dbCompressed == md->operation());
+
+        const int dataLen = md->dataLen();
+        if (dataLen < static_cast<int>(kCompressedHeaderSize)) {
+            LOG(0) << "compressed message too short: " << dataLen << endl;
+            return false;
+        }
+
+        int originalOp;
+        int originalSize;
+        memcpy(&originalOp, md->_data, sizeof(int));
+        memcpy(&originalSize, md->_data + sizeof(int), sizeof(int));
+        const char compressor = md->_data[2 * sizeof(int)];
+        const char* compressed = md->_data + kCompressedHeaderSize;
+        const size_t compressedSize = dataLen - kCompressedHeaderSize;
+
+        size_t uncompressedSize;
+        if (kSnappy != compressor
+            || originalSize < 0
+            || originalSize > MaxMessageSizeBytes - static_cast<int>(sizeof(MSGHEADER))
+            || dbCompressed == originalOp
+            || !getUncompressedLength(compressed, compressedSize, &uncompressedSize)
+            || uncompressedSize != static_cast<size_t>(originalSize)) {
+            LOG(0) << "invalid compressed message, compressor: " << static_cast<int>(compressor)
+                   << " length: " << originalSize << endl;
+            return false;
+        }
+
+        MsgData* original = static_cast<MsgData*>(malloc(sizeof(MSGHEADER) + originalSize));
+        verify(original);
+
+        Timer t;
+        if (!rawUncompress(compressed, compressedSize, original->_data)) {
+            free(original);
+            LOG(0) << "corrupt compressed message" << endl;
+            return false;
+        }
+        decompressorStats.hit(originalSize, compressedSize, t.micros());
+
+        original->len = sizeof(MSGHEADER) + originalSize;
+        original->id = md->id;
+        original->responseTo = md->responseTo;
+        original->setOperation(originalOp);
+
+        m.reset();
+        m.setData(original, true);
+        return true;
+    }
+
+    // static
+    void MessageCompressor::negotiate(const BSONObj& isMasterCmd,
+                                      AbstractMessagingPort* port,
+                                      BSONObjBuilder* result) {
+        BSONElement offer = isMasterCmd["compression"];
+        if (!enabled || !port || Array != offer.type()) {
+            return;
+        }
+
+        BSONObjIterator it(offer.embeddedObject());
+        while (it.more()) {
+            BSONElement e = it.next();
+            if (String == e.type() && e.String() == name()) {
+                port->setCompression(true);
+                result->append("compression", BSON_ARRAY(name()));
+                return;
+            }
+        }
+    }
+
+    // static
+    void MessageCompressor::appendOffer(BSONObjBuilder* isMasterCmd) {
+        isMasterCmd->append("compression", BSON_ARRAY(name()));
+    }
+
+    // static
+    bool MessageCompressor::accepted(const BSONObj& isMasterReply) {
+        BSONElement accepted = isMasterReply["compression"];
+        if (Array != accepted.type()) {
+            return false;
+        }
+
+        BSONObjIterator it(accepted.embeddedObject());
+        while (it.more()) {
+            BSONElement e = it.next();
+            if (String == e.type() && e.String() == name()) {
+                return true;
+            }
+        }
+        return false;
+    }
+
+    // static
+    void MessageCompressor::appendStats(BSONObjBuilder* b) {
+        BSONObjBuilder compression(b->subobjStart("compression"));
+        compression.appendBool("enabled", enabled);
+        compression.append("minSize", minSize);
+        compression.append("compressor", compressorStats.toBSON());
+        compression.append("decompressor", decompressorStats.toBSON());
+        compression.appendNumber("incompressible", incompressibleMessages.load());
+        compression.done();
+    }
+
+} // namespace mongo
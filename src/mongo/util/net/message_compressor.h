@@ -0,0 +1,82 @@
+// message_compressor.h
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+namespace mongo {
+
+    class AbstractMessagingPort;
+    class BSONObj;
+    class BSONObjBuilder;
+    class Message;
+
+    /**
+     * Compresses messages on the wire with snappy.
+     *
+     * A compressed message is a dbCompressed message with the header of the original message
+     * (its length and opcode aside), followed by
+     *     int32  original opcode
+     *     int32  length of the original message, less its header
+     *     int8   compressor id, 1 for snappy
+     *     the compressed body of the original message
+     *
+     * A connection only carries compressed messages after both sides agree to it in isMaster:
+     * the client sends compression: ["snappy"] and the server answers with the same field.
+     * MessagingPort::recv() always accepts compressed messages and hands on the original.
+     */
+    class MessageCompressor {
+    public:
+        /** whether this process offers and accepts compression.  "networkCompression" */
+        static bool enabled;
+
+        /** messages shorter than this are sent as is.  "networkCompressionMinSize" */
+        static int minSize;
+
+        /** name of the only compressor, as used in isMaster */
+        static const char* name();
+
+        /**
+         * Compresses 'in' into 'out', which must be empty.  Returns false, leaving 'out' empty,
+         * if the message is too short or doesn't get any shorter.
+         */
+        static bool compress(const Message& in, Message* out);
+
+        /**
+         * Replaces the dbCompressed message 'm' with the original.  Returns false if 'm' is
+         * corrupt or uses an unknown compressor.
+         */
+        static bool decompress(Message& m);
+
+        /**
+         * Server side of the negotiation in isMaster: if compression is enabled and the client
+         * asked for it, turns it on for 'port' and says so in 'result'.
+         */
+        static void negotiate(const BSONObj& isMasterCmd,
+                              AbstractMessagingPort* port,
+                              BSONObjBuilder* result);
+
+        /** Client side: the isMaster request field offering compression. */
+        static void appendOffer(BSONObjBuilder* isMasterCmd);
+
+        /** Client side: whether the server agreed to compression in 'isMasterReply'. */
+        static bool accepted(const BSONObj& isMasterReply);
+
+        /** Appends counters, compression ratios and time spent, for serverStatus. */
+        static void appendStats(BSONObjBuilder* b);
+    };
+
+} // namespace mongo
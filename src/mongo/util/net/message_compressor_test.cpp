@@ -0,0 +1,187 @@
+/**
+ *    Copyright (C) 2013 10gen Inc.
+ *
+ *    This program is free software: you can redistribute it and/or  modify
+ *    it under the terms of the GNU Affero General Public License, version 3,
+ *    as published by the Free Software Foundation.
+ *
+ *    This program is distributed in the hope that it will be useful,
+ *    but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *    MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *    GNU Affero General Public License for more details.
+ *
+ *    You should have received a copy of the GNU Affero General Public License
+ *    along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ *
+ *    As a special exception, the copyright holders give permission to link the
+ *    code of portions of this program with the OpenSSL library under certain
+ *    conditions as described in each individual source file and distribute
+ *    linked combinations including the program with the OpenSSL library. You
+ *    must comply with the GNU Affero General Public License in all respects
+ *    for all of the code used other than as permitted herein. If you modify
+ *    file(s) with this exception, you may extend this exception to your
+ *    version of the file(s), but you are not obligated to do so. If you do not
+ *    wish to do so, delete this exception statement from your version. If you
+ *    delete this exception statement from all source files in the program,
+ *    then also delete it in the license file.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/net/message_compressor.h"
+
+#include "mongo/db/jsobj.h"
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/net/message.h"
+#include "mongo/util/net/message_port.h"
+
+namespace {
+
+    using namespace mongo;
+
+    // A message made of a header and 'parts', each in its own buffer.
+    void buildMessage(int op, const std::vector<std::string>& parts, Message* m) {
+        for (size_t i = 0; i < parts.size(); ++i) {
+            BufBuilder b;
+            if (0 == i) {
+                b.skip(sizeof(MSGHEADER));
+            }
+            b.appendBuf(parts[i].data(), parts[i].size());
+            const int len = b.len();
+            if (0 == len) {
+                continue;
+            }
+            m->appendData(b.buf(), len);
+            b.decouple();
+        }
+        m->header()->id = 1234;
+        m->header()->responseTo = 5678;
+        m->header()->setOperation(op);
+    }
+
+    std::string body(const Message& m) {
+        std::vector<std::pair<const char*, size_t> > buffers;
+        m.getBuffers(&buffers);
+        std::string s;
+        for (size_t i = 0; i < buffers.size(); ++i) {
+            s.append(buffers[i].first, buffers[i].second);
+        }
+        return s.substr(sizeof(MSGHEADER));
+    }
+
+    class TestPort : public AbstractMessagingPort {
+    public:
+        virtual void reply(Message& received, Message& response, MSGID responseTo) {}
+        virtual void reply(Message& received, Message& response) {}
+        virtual HostAndPort remote() const { return HostAndPort(); }
+        virtual unsigned remotePort() const { return 0; }
+        virtual SockAddr remoteAddr() const { return SockAddr(); }
+        virtual SockAddr localAddr() const { return SockAddr(); }
+    };
+
+    TEST(MessageCompressor, RoundTrip) {
+        std::vector<std::string> parts;
+        parts.push_back(std::string(3000, 'a'));
+        parts.push_back("");
+        parts.push_back(std::string(5000, 'b'));
+        parts.push_back("some tail");
+        Message m;
+        buildMessage(dbQuery, parts, &m);
+        const std::string original = body(m);
+
+        Message compressed;
+        ASSERT(MessageCompressor::compress(m, &compressed));
+        ASSERT_EQUALS(dbCompressed, compressed.operation());
+        ASSERT_LESS_THAN(compressed.size(), m.size());
+        ASSERT_EQUALS(1234, static_cast<int>(compressed.header()->id));
+        ASSERT_EQUALS(5678, static_cast<int>(compressed.header()->responseTo));
+
+        // The original is left alone.
+        ASSERT_EQUALS(dbQuery, m.operation());
+        ASSERT_EQUALS(original, body(m));
+
+        ASSERT(MessageCompressor::decompress(compressed));
+        ASSERT_EQUALS(dbQuery, compressed.operation());
+        ASSERT_EQUALS(m.size(), compressed.size());
+        ASSERT_EQUALS(1234, static_cast<int>(compressed.header()->id));
+        ASSERT_EQUALS(5678, static_cast<int>(compressed.header()->responseTo));
+        ASSERT_EQUALS(original, body(compressed));
+    }
+
+    TEST(MessageCompressor, ShortMessagesAreNotCompressed) {
+        std::vector<std::string> parts(1, std::string(MessageCompressor::minSize / 2, 'a'));
+        Message m;
+        buildMessage(opReply, parts, &m);
+        Message compressed;
+        ASSERT(!MessageCompressor::compress(m, &compressed));
+        ASSERT(compressed.empty());
+    }
+
+    TEST(MessageCompressor, IncompressibleMessagesAreNotCompressed) {
+        std::string random;
+        unsigned x = 12345;
+        for (int i = 0; i < 4096; ++i) {
+            x = x * 1103515245 + 12345;
+            random.push_back(static_cast<char>(x >> 16));
+        }
+        Message m;
+        buildMessage(opReply, std::vector<std::string>(1, random), &m);
+        Message compressed;
+        ASSERT(!MessageCompressor::compress(m, &compressed));
+        ASSERT(compressed.empty());
+    }
+
+    TEST(MessageCompressor, CorruptMessagesAreRejected) {
+        Message m;
+        buildMessage(opReply, std::vector<std::string>(1, std::string(4096, 'a')), &m);
+        Message compressed;
+        ASSERT(MessageCompressor::compress(m, &compressed));
+
+        // Claim a different original length.
+        int* originalSize = reinterpret_cast<int*>(compressed.singleData()->_data + sizeof(int));
+        *originalSize += 1;
+        ASSERT(!MessageCompressor::decompress(compressed));
+
+        // Truncated.
+        Message truncated;
+        buildMessage(dbCompressed, std::vector<std::string>(1, std::string(3, '\0')), &truncated);
+        ASSERT(!MessageCompressor::decompress(truncated));
+    }
+
+    TEST(MessageCompressor, Negotiate) {
+        const bool wasEnabled = MessageCompressor::enabled;
+        TestPort port;
+
+        BSONObjBuilder offer;
+        offer.append("isMaster", 1);
+        MessageCompressor::appendOffer(&offer);
+        const BSONObj cmd = offer.obj();
+
+        MessageCompressor::enabled = false;
+        BSONObjBuilder disabled;
+        MessageCompressor::negotiate(cmd, &port, &disabled);
+        ASSERT(!MessageCompressor::accepted(disabled.obj()));
+        ASSERT(!port.compression());
+
+        MessageCompressor::enabled = true;
+        BSONObjBuilder noOffer;
+        MessageCompressor::negotiate(BSON("isMaster" << 1), &port, &noOffer);
+        ASSERT(!MessageCompressor::accepted(noOffer.obj()));
+        ASSERT(!port.compression());
+
+        BSONObjBuilder unknown;
+        MessageCompressor::negotiate(BSON("isMaster" << 1 << "compression" << BSON_ARRAY("zzz")),
+                                     &port,
+                                     &unknown);
+        ASSERT(!MessageCompressor::accepted(unknown.obj()));
+        ASSERT(!port.compression());
+
+        BSONObjBuilder agreed;
+        MessageCompressor::negotiate(cmd, &port, &agreed);
+        ASSERT(MessageCompressor::accepted(agreed.obj()));
+        ASSERT(port.compression());
+
+        MessageCompressor::enabled = wasEnabled;
+    }
+
+}  // namespace
@@ -26,6 +26,7 @@
 #include "mongo/util/goodies.h"
 #include "mongo/util/net/listen.h"
 #include "mongo/util/net/message.h"
+#include "mongo/util/net/message_compressor.h"
 #include "mongo/util/net/ssl_manager.h"
 #include "mongo/util/net/ssl_options.h"
 #include "mongo/util/scopeguard.h"
@@ -222,6 +223,11 @@ again:
 
             guard.Dismiss();
             m.setData(md, true);
+
+            if ( header.opCode == dbCompressed && !MessageCompressor::decompress( m ) ) {
+                m.reset();
+                return false;
+            }
             return true;
 
         }
@@ -279,6 +285,18 @@ again:
         toSend.header()->id = nextMessageId();
         toSend.header()->responseTo = responseTo;
 
+        // callers may look at toSend after it is sent, so it is compressed into a copy
+        if ( compression() ) {
+            Message compressed;
+            if ( MessageCompressor::compress( toSend, &compressed ) ) {
+                if ( piggyBackData ) {
+                    piggyBackData->flush();
+                }
+                compressed.send( *this, "say" );
+                return;
+            }
+        }
+
         if ( piggyBackData && piggyBackData->len() ) {
             mmm( log() << "*     have piggy back" << endl; )
             if ( ( piggyBackData->len() + toSend.header()->len ) > 1300 ) {
@@ -31,7 +31,7 @@ namespace mongo {
 
     class AbstractMessagingPort : boost::noncopyable {
     public:
-        AbstractMessagingPort() : tag(0), _connectionId(0) {}
+        AbstractMessagingPort() : tag(0), _connectionId(0), _compression(false) {}
         virtual ~AbstractMessagingPort() { }
         virtual void reply(Message& received, Message& response, MSGID responseTo) = 0; // like the reply below, but doesn't rely on received.data still being available
         virtual void reply(Message& received, Message& response) = 0;
@@ -52,6 +52,10 @@ namespace mongo {
         long long connectionId() const { return _connectionId; }
         void setConnectionId( long long connectionId );
 
+        /** whether messages sent on this port may be compressed.  see MessageCompressor */
+        bool compression() const { return _compression; }
+        void setCompression( bool compression ) { _compression = compression; }
+
     public:
         // TODO make this private with some helpers
 
@@ -61,6 +65,7 @@ namespace mongo {
     private:
         long long _connectionId;
         std::string _x509SubjectName;
+        bool _compression;
     };
 
     class MessagingPort : public AbstractMessagingPort {
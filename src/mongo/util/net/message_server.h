@@ -28,6 +28,18 @@ namespace mongo {
 
     struct LastError;
 
+    /**
+     * Per-connection state that a MessageHandler keeps in thread locals, taken off the thread
+     * that served a connection's last message.  Deleting it discards the state.
+     */
+    class DetachedConnection {
+    public:
+        virtual ~DetachedConnection() {}
+
+        /** puts the state back on the calling thread, after which this object is empty */
+        virtual void attach() = 0;
+    };
+
     class MessageHandler {
     public:
         virtual ~MessageHandler() {}
@@ -47,6 +59,18 @@ namespace mongo {
          * called once when a socket is disconnected
          */
         virtual void disconnected( AbstractMessagingPort* p ) = 0;
+
+        /**
+         * true if connected() state can move between threads with detachConnection(), which
+         * servers that don't keep a thread per connection require
+         */
+        virtual bool canMoveConnections() const { return false; }
+
+        /**
+         * called on the thread that served p, after connected() or process(), before p is
+         * served by another thread; and after disconnected(), to discard p's state
+         */
+        virtual DetachedConnection* detachConnection( AbstractMessagingPort* p ) { return NULL; }
     };
 
     class MessageServer {
@@ -54,8 +78,10 @@ namespace mongo {
         struct Options {
             int port;                   // port to bind to
             string ipList;             // addresses to bind to
+            int workerThreads;          // 0: a thread per connection, else an epoll loop
+                                        // handing ready connections to this many workers
 
-            Options() : port(0), ipList("") {}
+            Options() : port(0), ipList(""), workerThreads(0) {}
         };
 
         virtual ~MessageServer() {}
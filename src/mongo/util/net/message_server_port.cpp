@@ -26,6 +26,7 @@
 #include "mongo/db/stats/counters.h"
 #include "mongo/util/concurrency/ticketholder.h"
 #include "mongo/util/concurrency/thread_name.h"
+#include "mongo/util/concurrency/thread_pool.h"
 #include "mongo/util/net/listen.h"
 #include "mongo/util/net/message.h"
 #include "mongo/util/net/message_port.h"
@@ -33,6 +34,7 @@
 #include "mongo/util/net/ssl_manager.h"
 
 #ifdef __linux__  // TODO: consider making this ifndef _WIN32
+# include <sys/epoll.h>
 # include <sys/resource.h>
 #endif
 
@@ -243,8 +245,227 @@ namespace mongo {
         }
     };
 
+#ifdef __linux__
+    /**
+     * A message server without a thread per connection: one thread waits on all idle
+     * connections with epoll and hands each connection that has a message ready to a fixed
+     * pool of workers.  A worker serves that message, then gives the connection back to epoll,
+     * so the number of threads doesn't grow with the number of connections.
+     *
+     * Connections move between workers, so the handler must canMoveConnections().  A request
+     * that blocks (a long query, an awaitData getmore, a write behind fsyncLock) holds its
+     * worker until it returns, so the pool should cover the requests expected to run at once.
+     */
+    class ReactorMessageServer : public MessageServer , public Listener {
+    public:
+        ReactorMessageServer( const MessageServer::Options& opts, MessageHandler * handler ) :
+            Listener( "" , opts.ipList, opts.port ), _handler(handler),
+            _workers(opts.workerThreads) {
+            verify( handler->canMoveConnections() );
+            _epfd = epoll_create1( EPOLL_CLOEXEC );
+            massert( 17291, str::stream() << "epoll_create1 failed: " << errnoWithDescription(),
+                     _epfd >= 0 );
+            log() << "serving connections with " << opts.workerThreads << " worker threads"
+                  << endl;
+        }
+
+        virtual void acceptedMP(MessagingPort * p) {
+            if ( ! Listener::globalTicketHolder.tryAcquire() ) {
+                log() << "connection refused because too many open connections: " << Listener::globalTicketHolder.used() << endl;
+
+                p->shutdown();
+                delete p;
+
+                sleepmillis(2); // otherwise we'll hard loop
+                return;
+            }
+
+            // connected() runs on a worker, like every other call into the handler
+            _workers.schedule( &ReactorMessageServer::serve, this, new Connection( p ) );
+        }
+
+        virtual void setAsTimeTracker() {
+            Listener::setAsTimeTracker();
+        }
+
+        virtual void setupSockets() {
+            Listener::setupSockets();
+        }
+
+        void run() {
+            boost::thread poller( boost::bind( &ReactorMessageServer::pollConnections, this ) );
+            initAndListen();
+        }
+
+        virtual bool useUnixSockets() const { return true; }
+
+    private:
+        struct Connection {
+            explicit Connection( MessagingPort* inPort ) :
+                port(inPort), lastError(new LastError()), polled(false) {
+            }
+
+            ~Connection() {
+                delete lastError;
+            }
+
+            scoped_ptr<MessagingPort> port;
+
+            // owned here, on the serving thread's lastError while a worker serves the connection
+            LastError* lastError;
+
+            // the handler's state for the connection, NULL until connected() and while served
+            scoped_ptr<DetachedConnection> detached;
+
+            // added to the epoll set
+            bool polled;
+        };
+
+        void pollConnections() {
+            setThreadName( "netPoller" );
+
+            const int maxEvents = 256;
+            epoll_event events[maxEvents];
+            while ( ! inShutdown() ) {
+                int n = epoll_wait( _epfd, events, maxEvents, 1000 );
+                if ( n < 0 ) {
+                    if ( errno != EINTR ) {
+                        error() << "epoll_wait failed: " << errnoWithDescription() << endl;
+                        sleepmillis(10);
+                    }
+                    continue;
+                }
+                // each connection is EPOLLONESHOT, so only one worker serves it at a time
+                for ( int i = 0; i < n; i++ ) {
+                    _workers.schedule( &ReactorMessageServer::serve, this,
+                                       static_cast<Connection*>( events[i].data.ptr ) );
+                }
+            }
+        }
+
+        /**
+         * Serves c on a worker: calls connected() the first time, else receives and processes
+         * the message epoll found ready, and any that SSL already read off the socket.
+         */
+        void serve( Connection* c ) {
+            MessagingPort* p = c->port.get();
+            {
+                string threadName = "conn";
+                if ( p->connectionId() > 0 )
+                    threadName = str::stream() << threadName << p->connectionId();
+                setThreadName( threadName.c_str() );
+            }
+            lastError.reset( c->lastError );
+
+            bool open = true;
+            Message m;
+            try {
+                if ( ! c->detached ) {
+                    p->psock->setLogLevel(logger::LogSeverity::Debug(1));
+                    _handler->connected( p );
+                }
+                else {
+                    c->detached->attach();
+                    c->detached.reset();
+
+                    do {
+                        m.reset();
+                        p->psock->clearCounters();
+
+                        if ( ! p->recv(m) ) {
+                            if (!serverGlobalParams.quiet) {
+                                int conns = Listener::globalTicketHolder.used()-1;
+                                const char* word = (conns == 1 ? " connection" : " connections");
+                                log() << "end connection " << p->psock->remoteString() << " (" << conns << word << " now open)" << endl;
+                            }
+                            p->shutdown();
+                            open = false;
+                            break;
+                        }
+
+                        _handler->process( m , p , c->lastError );
+                        networkCounter.hit( p->psock->getBytesIn() , p->psock->getBytesOut() );
+                    } while ( p->psock->hasBufferedData() && ! inShutdown() );
+                }
+            }
+            catch ( AssertionException& e ) {
+                log() << "AssertionException handling request, closing client connection: " << e << endl;
+                p->shutdown();
+                open = false;
+            }
+            catch ( SocketException& e ) {
+                log() << "SocketException handling request, closing client connection: " << e << endl;
+                p->shutdown();
+                open = false;
+            }
+            catch ( const DBException& e ) { // must be right above std::exception to avoid catching subclasses
+                log() << "DBException handling request, closing client connection: " << e << endl;
+                p->shutdown();
+                open = false;
+            }
+            catch ( std::exception &e ) {
+                error() << "Uncaught std::exception: " << e.what() << ", terminating" << endl;
+                dbexit( EXIT_UNCAUGHT );
+            }
+            catch ( ... ) {
+                error() << "Uncaught exception, terminating" << endl;
+                dbexit( EXIT_UNCAUGHT );
+            }
+
+            if ( ! open )
+                _handler->disconnected( p );
+            c->detached.reset( _handler->detachConnection( p ) );
+            lastError.release();
+            setThreadName( "netWorker" );
+
+            if ( open && rearm( c ) )
+                return;
+            closeConnection( c );
+        }
+
+        /** waits for c's next message, @return false if c can't be polled */
+        bool rearm( Connection* c ) {
+            epoll_event event;
+            event.events = EPOLLIN | EPOLLONESHOT;
+            event.data.ptr = c;
+            if ( epoll_ctl( _epfd, c->polled ? EPOLL_CTL_MOD : EPOLL_CTL_ADD,
+                            c->port->psock->rawFD(), &event ) != 0 ) {
+                error() << "epoll_ctl failed, closing client connection: "
+                        << errnoWithDescription() << endl;
+                return false;
+            }
+            c->polled = true;
+            return true;
+        }
+
+        void closeConnection( Connection* c ) {
+            if ( c->polled ) {
+                epoll_event event; // ignored, but must be non-NULL before linux 2.6.9
+                epoll_ctl( _epfd, EPOLL_CTL_DEL, c->port->psock->rawFD(), &event );
+            }
+            c->port->shutdown();
+            delete c;
+            Listener::globalTicketHolder.release();
+        }
+
+        MessageHandler* _handler;
+        ThreadPool _workers;
+        int _epfd;
+    };
+#endif
+
 
     MessageServer * createServer( const MessageServer::Options& opts , MessageHandler * handler ) {
+        if ( opts.workerThreads > 0 ) {
+#ifdef __linux__
+            if ( handler->canMoveConnections() )
+                return new ReactorMessageServer( opts , handler );
+            warning() << "this server keeps a thread per connection, ignoring netWorkerThreads"
+                      << endl;
+#else
+            warning() << "netWorkerThreads is only supported on linux, ignoring it" << endl;
+#endif
+        }
         return new PortMessageServer( opts , handler );
     }
 
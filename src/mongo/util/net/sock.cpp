@@ -28,9 +28,13 @@
 # include <arpa/inet.h>
 # include <errno.h>
 # include <netdb.h>
+# include <limits.h>
 # if defined(__openbsd__)
 #  include <sys/uio.h>
 # endif
+# if !defined(IOV_MAX)
+#  define IOV_MAX 16 // the POSIX minimum
+# endif
 #endif
 
 #include "mongo/util/background.h"
@@ -631,12 +635,17 @@ namespace mongo {
                 _bytesOut += j->second;
             }
         }
+        if ( i == 0 ) {
+            return;
+        }
+        struct iovec * const end = &d[ 0 ] + i;
         struct msghdr meta;
         memset( &meta, 0, sizeof( meta ) );
         meta.msg_iov = &d[ 0 ];
-        meta.msg_iovlen = d.size();
 
-        while( meta.msg_iovlen > 0 ) {
+        while( meta.msg_iov != end ) {
+            // sendmsg() takes at most IOV_MAX buffers per call
+            meta.msg_iovlen = std::min<size_t>( end - meta.msg_iov, IOV_MAX );
             int ret = -1;
             if (MONGO_FAIL_POINT(throwSockExcep)) {
 #if defined(_WIN32)
@@ -672,7 +681,6 @@ namespace mongo {
                     else {
                         ret -= i->iov_len;
                         ++i;
-                        --(meta.msg_iovlen);
                     }
                 }
             }
@@ -791,6 +799,16 @@ namespace mongo {
     // -1 : never check
     const int Socket::errorPollIntervalSecs( 5 );
 
+    bool Socket::hasBufferedData() const {
+#ifdef MONGO_SSL
+        if ( _sslConnection ) {
+            return SSL_pending( _sslConnection->ssl ) > 0 ||
+                   BIO_ctrl_pending( _sslConnection->internalBIO ) > 0;
+        }
+#endif
+        return false;
+    }
+
     // Patch to allow better tolerance of flaky network connections that get broken
     // while we aren't looking.
     // TODO: Remove when better async changes come.
@@ -228,6 +228,12 @@ namespace mongo {
         void setTimeout( double secs );
         bool isStillConnected();
 
+        /**
+         * true if bytes already read off the fd wait to be returned by recv(), which
+         * polling the fd doesn't show (SSL reads whole records)
+         */
+        bool hasBufferedData() const;
+
         void setHandshakeReceived() {
             _awaitingHandshake = false;
         }
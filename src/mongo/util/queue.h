@@ -61,7 +61,8 @@ namespace mongo {
         void push(T const& t) {
             scoped_lock l( _lock );
             size_t tSize = _getSize(t);
-            while (_currentSize + tSize >= _maxSize) {
+            // an item larger than the max size still goes into an empty queue
+            while (!_queue.empty() && _currentSize + tSize >= _maxSize) {
                 _cvNoLongerFull.wait( l.boost() );
             }
             _queue.push( t );
@@ -86,9 +87,19 @@ namespace mongo {
          * The max size for this queue
          */
         size_t maxSize() const {
+            scoped_lock l( _lock );
             return _maxSize;
         }
 
+        /**
+         * Changes the max size.  Pushes waiting for room are woken if it grew.
+         */
+        void setMaxSize(size_t maxSize) {
+            scoped_lock l( _lock );
+            _maxSize = maxSize;
+            _cvNoLongerFull.notify_all();
+        }
+
         /**
          * The number/count of items in the queue ( _queue.size() )
          */
@@ -101,6 +112,7 @@ namespace mongo {
             scoped_lock l(_lock);
             _queue = std::queue<T>();
             _currentSize = 0;
+            _cvNoLongerFull.notify_all();
         }
 
         bool tryPop( T & t ) {
@@ -192,7 +204,7 @@ namespace mongo {
     private:
         mutable mongo::mutex _lock;
         std::queue<T> _queue;
-        const size_t _maxSize;
+        size_t _maxSize;
         size_t _currentSize;
         getSizeFunc _getSize;
 
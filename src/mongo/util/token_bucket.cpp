@@ -0,0 +1,67 @@
+// @file mongo/util/token_bucket.cpp
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/platform/basic.h"
+
+#include "mongo/util/token_bucket.h"
+
+#include <algorithm>
+
+#include "mongo/util/time_support.h"
+
+namespace mongo {
+
+    TokenBucket::TokenBucket( long long rate , long long burst ) :
+        _rate( 0 ),
+        _burst( 0 ),
+        _tokens( 0 ),
+        _lastMicros( 0 ) {
+        setRate( rate , burst );
+        _tokens = _burst;
+    }
+
+    void TokenBucket::setRate( long long rate , long long burst ) {
+        _rate = std::max( 0LL , rate );
+        _burst = std::max( 0LL , burst );
+        _tokens = std::min( _tokens , (double)_burst );
+    }
+
+    long long TokenBucket::take( long long tokens , unsigned long long nowMicros ) {
+        if ( _rate == 0 ) {
+            _lastMicros = nowMicros;
+            return 0;
+        }
+
+        if ( nowMicros > _lastMicros ) {
+            _tokens = std::min( (double)_burst ,
+                                _tokens + ( nowMicros - _lastMicros ) * (double)_rate / 1000000 );
+        }
+        _lastMicros = std::max( _lastMicros , nowMicros );
+
+        _tokens -= tokens;
+        if ( _tokens >= 0 )
+            return 0;
+        return (long long)( -_tokens * 1000000 / _rate ) + 1;
+    }
+
+    void TokenBucket::consume( long long tokens ) {
+        long long waitMicros = take( tokens , curTimeMicros64() );
+        if ( waitMicros > 0 )
+            sleepmicros( waitMicros );
+    }
+
+} // namespace mongo
@@ -0,0 +1,54 @@
+// @file mongo/util/token_bucket.h
+
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#pragma once
+
+namespace mongo {
+
+    /**
+     * Limits the rate of some work to 'rate' tokens per second.  Tokens accrue up to 'burst',
+     * and a caller taking more tokens than there are waits for the difference, so work larger
+     * than the burst still goes through at the rate.  A rate of 0 is unlimited.
+     *
+     * Not thread safe.
+     */
+    class TokenBucket {
+    public:
+        TokenBucket( long long rate , long long burst );
+
+        /** Changes the rate and burst, keeping the tokens accrued so far. */
+        void setRate( long long rate , long long burst );
+
+        long long rate() const { return _rate; }
+
+        /**
+         * Takes 'tokens' at 'nowMicros'.
+         * @return microseconds to wait before doing the work they pay for
+         */
+        long long take( long long tokens , unsigned long long nowMicros );
+
+        /** Takes 'tokens', sleeping until the work they pay for may be done. */
+        void consume( long long tokens );
+
+    private:
+        long long _rate;
+        long long _burst;
+        double _tokens; // negative while callers are waiting
+        unsigned long long _lastMicros;
+    };
+
+} // namespace mongo
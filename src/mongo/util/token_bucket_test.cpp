@@ -0,0 +1,68 @@
+/*    Copyright 2013 10gen Inc.
+ *
+ *    Licensed under the Apache License, Version 2.0 (the "License");
+ *    you may not use this file except in compliance with the License.
+ *    You may obtain a copy of the License at
+ *
+ *    http://www.apache.org/licenses/LICENSE-2.0
+ *
+ *    Unless required by applicable law or agreed to in writing, software
+ *    distributed under the License is distributed on an "AS IS" BASIS,
+ *    WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ *    See the License for the specific language governing permissions and
+ *    limitations under the License.
+ */
+
+#include "mongo/unittest/unittest.h"
+#include "mongo/util/token_bucket.h"
+
+namespace mongo {
+namespace {
+
+    TEST(TokenBucket, UnlimitedNeverWaits) {
+        TokenBucket bucket(0, 0);
+        ASSERT_EQUALS(0, bucket.take(1000000, 1));
+        ASSERT_EQUALS(0, bucket.take(1000000, 1));
+    }
+
+    TEST(TokenBucket, BurstIsFree) {
+        TokenBucket bucket(1000, 500);
+        ASSERT_EQUALS(0, bucket.take(200, 1));
+        ASSERT_EQUALS(0, bucket.take(300, 1));
+        // the bucket is empty, 100 tokens take 100ms
+        ASSERT_EQUALS(100001, bucket.take(100, 1));
+    }
+
+    TEST(TokenBucket, RefillsAtRateUpToBurst) {
+        TokenBucket bucket(1000, 500);
+        ASSERT_EQUALS(0, bucket.take(500, 1));
+        // 250ms later there are 250 tokens
+        ASSERT_EQUALS(0, bucket.take(250, 250001));
+        ASSERT_GREATER_THAN(bucket.take(1, 250001), 0);
+
+        // a long idle time refills no more than the burst
+        TokenBucket idle(1000, 500);
+        ASSERT_EQUALS(0, idle.take(500, 1));
+        ASSERT_EQUALS(0, idle.take(500, 10000001));
+        ASSERT_GREATER_THAN(idle.take(1, 10000001), 0);
+    }
+
+    TEST(TokenBucket, LargeTakeWaitsAtRate) {
+        TokenBucket bucket(1000, 100);
+        // 2000 tokens with 100 in the bucket wait 1.9 seconds
+        ASSERT_EQUALS(1900001, bucket.take(2000, 1));
+        // and the next caller waits behind them
+        ASSERT_EQUALS(2000001, bucket.take(100, 1));
+    }
+
+    TEST(TokenBucket, SetRateKeepsDebt) {
+        TokenBucket bucket(1000, 100);
+        ASSERT_EQUALS(900001, bucket.take(1000, 1));
+        bucket.setRate(2000, 100);
+        ASSERT_EQUALS(2000, bucket.rate());
+        // 900 tokens owed at 2000 per second, plus 100 more
+        ASSERT_EQUALS(500001, bucket.take(100, 1));
+    }
+
+} // namespace
+} // namespace mongo